@@ -43,7 +43,7 @@ ActivationAndRecoverySensor::ActivationAndRecoverySensor(
 void ActivationAndRecoverySensor::print(double time, int loop)
 {
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(comm(), &myRank);
    
    stringstream name;
    name << "snapshot."<<setfill('0')<<setw(12)<<loop;
@@ -52,7 +52,7 @@ void ActivationAndRecoverySensor::print(double time, int loop)
       DirTestCreate(fullname.c_str());
    fullname += "/" + filename_;
 
-   PFILE* file = Popen(fullname.c_str(), "w", MPI_COMM_WORLD);
+   PFILE* file = Popen(fullname.c_str(), "w", comm());
    if (nFiles_ > 0)
      PioSet(file, "ngroup", nFiles_);
 
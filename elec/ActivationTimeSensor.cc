@@ -39,7 +39,7 @@ ActivationTimeSensor::ActivationTimeSensor(const SensorParms& sp,
 void ActivationTimeSensor::print(double time, int loop)
 {
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(comm(), &myRank);
 
    stringstream name;
    name << "snapshot."<<setfill('0')<<setw(12)<<loop;
@@ -50,9 +50,9 @@ void ActivationTimeSensor::print(double time, int loop)
 
    Long64 nGlobal;
    Long64 nLocal=nLocal_;
-   MPI_Allreduce(&nLocal, &nGlobal, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+   MPI_Allreduce(&nLocal, &nGlobal, 1, MPI_LONG_LONG, MPI_SUM, comm());
    
-   PFILE* file = Popen(fullname.c_str(), "w", MPI_COMM_WORLD);
+   PFILE* file = Popen(fullname.c_str(), "w", comm());
    if (nFiles_ > 0)
      PioSet(file, "ngroup", nFiles_);
    
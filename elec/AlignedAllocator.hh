@@ -5,6 +5,7 @@
 #include <limits>
 #include <cstdlib>
 #include <cstddef>
+#include "BulkMemory.hh"
 
 template <class T> class AlignedAllocator;
  
@@ -44,13 +45,13 @@ template <class T> class AlignedAllocator
    pointer allocate(size_type size,
                     AlignedAllocator<void>::const_pointer hint = 0)
    {
-      pointer ptr;
-      if (posix_memalign((void**)&ptr, 32, size*sizeof(T)) == 0)
+      pointer ptr = (pointer) BulkMemory::allocate(size*sizeof(T), 32);
+      if (ptr)
          return ptr;
       throw std::bad_alloc();
    }
    
-   void deallocate(pointer p, size_type n) {free(p);}
+   void deallocate(pointer p, size_type n) {BulkMemory::release(p);}
    size_type max_size() const throw()
    {
       return std::numeric_limits<size_type>::max() / sizeof(T);
@@ -3,6 +3,7 @@
 #include <cassert>
 #include <set>
 #include <vector>
+#include <sstream>
 #include "pio.h"
 #include "object_cc.hh"
 #include "Anatomy.hh"
@@ -12,35 +13,54 @@
 using std::string;
 using std::set;
 using std::vector;
+using std::stringstream;
+using std::istringstream;
 
 namespace
 {
    void readBucket(Anatomy& anatomy,
                    BucketOfBits* bucketP);
+   BucketOfBits* bcastBucket(BucketOfBits* bucketP, MPI_Comm peers);
 }
 
 BucketOfBits* readAnatomy(const string& filename, MPI_Comm comm,
-                          Anatomy& anatomy)
+                          Anatomy& anatomy, MPI_Comm peers)
 {
-   PFILE* file = Popen(filename.c_str(), "r", comm);
+   int peerRank = 0;
+   if (peers != MPI_COMM_NULL)
+      MPI_Comm_rank(peers, &peerRank);
 
-   OBJECT* hObj = file->headerObject;
+   int nxyz[3] = {0, 0, 0};
+   BucketOfBits* bucketP = 0;
+   if (peerRank == 0)
+   {
+      PFILE* file = Popen(filename.c_str(), "r", comm);
+
+      OBJECT* hObj = file->headerObject;
 
-   int nx, ny, nz;
-   objectGet(hObj, "nx", nx, "0");
-   objectGet(hObj, "ny", ny, "0");
-   objectGet(hObj, "nz", nz, "0");
-//   objectGet(hObj, "cellTypes", cellType_s);
+      objectGet(hObj, "nx", nxyz[0], "0");
+      objectGet(hObj, "ny", nxyz[1], "0");
+      objectGet(hObj, "nz", nxyz[2], "0");
+//      objectGet(hObj, "cellTypes", cellType_s);
 
-   Long64 nGlobal = nx*ny*nz;
+      bucketP = readPioFile(file);
+      Pclose(file);
+   }
+   if (peers != MPI_COMM_NULL)
+   {
+      MPI_Bcast(nxyz, 3, MPI_INT, 0, peers);
+      bucketP = bcastBucket(bucketP, peers);
+   }
+
+   int nx = nxyz[0];
+   int ny = nxyz[1];
+   int nz = nxyz[2];
+   Long64 nGlobal = Long64(nx)*ny*nz;
    assert(nGlobal > 0);
 //   assert(cellType_s.size() > 0);
 
    anatomy.setGridSize(nx, ny,nz);
 
-   BucketOfBits* bucketP = readPioFile(file);
-   Pclose(file);
-
    readBucket(anatomy, bucketP);
    return bucketP;
 }
@@ -68,3 +88,73 @@ namespace
       }
    }
 }
+
+namespace
+{
+   /** Returns the bucket of rank 0 of peers on rank 0 and a copy of it
+    *  everywhere else. */
+   BucketOfBits* bcastBucket(BucketOfBits* bucketP, MPI_Comm peers)
+   {
+      int myRank;
+      MPI_Comm_rank(peers, &myRank);
+
+      // Indexed by BucketOfBits::DataType
+      const char* typeCode[] = {"f", "u", "s", "u8", "f4", "f8"};
+
+      string header;
+      string records;
+      vector<int> recordLength;
+      if (myRank == 0)
+      {
+         stringstream buf;
+         for (unsigned ii=0; ii<bucketP->nFields(); ++ii)
+            buf << bucketP->fieldName(ii) << "\n"
+                << typeCode[bucketP->dataType(ii)] << "\n"
+                << bucketP->units(ii) << "\n";
+         header = buf.str();
+         recordLength.resize(bucketP->nRecords());
+         for (unsigned ii=0; ii<bucketP->nRecords(); ++ii)
+         {
+            const string& raw = bucketP->getRecord(ii).getRawData();
+            recordLength[ii] = raw.size();
+            records += raw;
+         }
+      }
+
+      int size[3];
+      size[0] = header.size();
+      size[1] = recordLength.size();
+      size[2] = records.size();
+      MPI_Bcast(size, 3, MPI_INT, 0, peers);
+      header.resize(size[0]);
+      recordLength.resize(size[1]);
+      records.resize(size[2]);
+      MPI_Bcast(&header[0], size[0], MPI_CHAR, 0, peers);
+      MPI_Bcast(recordLength.data(), size[1], MPI_INT, 0, peers);
+      MPI_Bcast(&records[0], size[2], MPI_CHAR, 0, peers);
+
+      if (myRank == 0)
+         return bucketP;
+
+      vector<string> fieldNames;
+      vector<string> fieldTypes;
+      vector<string> fieldUnits;
+      istringstream in(header);
+      string name, type, unit;
+      while (getline(in, name) && getline(in, type) && getline(in, unit))
+      {
+         fieldNames.push_back(name);
+         fieldTypes.push_back(type);
+         fieldUnits.push_back(unit);
+      }
+
+      BucketOfBits* copyP = new BucketOfBits(fieldNames, fieldTypes, fieldUnits);
+      string::size_type offset = 0;
+      for (unsigned ii=0; ii<recordLength.size(); ++ii)
+      {
+         copyP->addRecord(records.substr(offset, recordLength[ii]));
+         offset += recordLength[ii];
+      }
+      return copyP;
+   }
+}
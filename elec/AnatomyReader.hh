@@ -11,8 +11,13 @@ struct pfile_st;
 class Anatomy;
 class BucketOfBits;
 
-/** Caller must delete returned pointer */
+/** Caller must delete returned pointer.
+ *
+ *  If peers is not MPI_COMM_NULL only the tasks with rank 0 in peers
+ *  open the file.  They broadcast the grid size and their share of the
+ *  records to the other members of peers, i.e., to the tasks with the
+ *  same rank in other simulations that use the same file. */
 BucketOfBits* readAnatomy(const std::string& filename, MPI_Comm comm,
-                          Anatomy& anatomy);
+                          Anatomy& anatomy, MPI_Comm peers = MPI_COMM_NULL);
 
 #endif
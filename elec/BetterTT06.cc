@@ -18,6 +18,7 @@
 #include <cassert>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 
@@ -156,12 +157,38 @@ static const char* interpName[] = {
          }
       }
 
+      if (reactionPrefitting())
+      {
+         if (reusingInterpolants || funcCount == 0)
+         {
+            delete reaction;
+            return NULL;
+         }
+         // The worker owns the parameterized model from here on.  It
+         // can't call MPI, so it gets the rank from here.
+         int myRank = getRank(0);
+         startInterpolantFit(obj->name, _dt, [reaction, _dt, funcCount, myRank]()
+         {
+            reaction->createInterpolants(_dt, myRank);
+            InterpolantSet fit(reaction->_interpolant, reaction->_interpolant+funcCount);
+            delete reaction;
+            return fit;
+         });
+         return NULL;
+      }
+
       if (!reusingInterpolants)
       {
-      reaction->createInterpolants(_dt);
+      InterpolantSet fit;
+      bool newFit = finishInterpolantFit(obj->name, _dt, fit, [reaction, _dt, funcCount]()
+      {
+         reaction->createInterpolants(_dt, getRank(0));
+         return InterpolantSet(reaction->_interpolant, reaction->_interpolant+funcCount);
+      });
+      copy(fit.begin(), fit.end(), reaction->_interpolant);
 
-      //save the interpolants
-      if (funcCount > 0 && getRank(0) == 0)
+      //save the interpolants, once for all the pieces of the task loop
+      if (newFit && funcCount > 0 && getRank(0) == 0)
       {
          ofstream outfile((string(obj->name) +".fit.data").c_str());
          outfile.precision(16);
@@ -193,8 +220,31 @@ static const char* interpName[] = {
          outfile.close();
       }
       }
+      // gatePrecision = float stores the gates in single precision.  A
+      // sample of driftSampleCells cells is also integrated in double
+      // and every driftCheckRate steps the difference is printed, as a
+      // warning if the gates are off by more than driftTolerance.
+      string gatePrecision;
+      objectGet(obj, "gatePrecision", gatePrecision, "double");
+      if (gatePrecision != "double" && gatePrecision != "float")
+      {
+         if (getRank(0) == 0)
+            cerr << "ERROR: gatePrecision must be double or float" << endl;
+         assert(false); // reachable only due to bad input
+      }
 #ifdef USE_CUDA
+      if (gatePrecision == "float" && getRank(0) == 0)
+         cout << "WARNING: gatePrecision = float is not supported on the gpu" << endl;
       reaction->constructKernel();
+#else
+      if (gatePrecision == "float")
+      {
+         int driftSampleCells;
+         objectGet(obj, "driftSampleCells", driftSampleCells, "64");
+         objectGet(obj, "driftCheckRate", reaction->driftCheckRate_, "1000");
+         objectGet(obj, "driftTolerance", reaction->driftTolerance_, "1e-4");
+         reaction->useFloatGates(driftSampleCells);
+      }
 #endif
       return reaction;
    }
@@ -203,7 +253,7 @@ static const char* interpName[] = {
 namespace BetterTT06 
 {
 
-void ThisReaction::createInterpolants(const double _dt) {
+void ThisReaction::createInterpolants(const double _dt, const int myRank) {
 
    {
       int _numPoints = (1e-1 - 1e-7)/1e-6;
@@ -220,7 +270,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[0].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _fCass_RLA: " 
               << actualTolerance << " > " << relError
@@ -246,7 +296,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[1].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _Xr1_RLA: " 
               << actualTolerance << " > " << relError
@@ -268,7 +318,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[2].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _Xr1_RLB: " 
               << actualTolerance << " > " << relError
@@ -294,7 +344,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[3].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _Xr2_RLA: " 
               << actualTolerance << " > " << relError
@@ -316,7 +366,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[4].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _Xr2_RLB: " 
               << actualTolerance << " > " << relError
@@ -343,7 +393,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[5].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _Xs_RLA: " 
               << actualTolerance << " > " << relError
@@ -365,7 +415,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[6].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _Xs_RLB: " 
               << actualTolerance << " > " << relError
@@ -393,7 +443,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[7].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _d_RLA: " 
               << actualTolerance << " > " << relError
@@ -415,7 +465,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[8].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _d_RLB: " 
               << actualTolerance << " > " << relError
@@ -440,7 +490,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[9].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _f2_RLA: " 
               << actualTolerance << " > " << relError
@@ -462,7 +512,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[10].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _f2_RLB: " 
               << actualTolerance << " > " << relError
@@ -487,7 +537,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[11].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _f_RLA: " 
               << actualTolerance << " > " << relError
@@ -509,7 +559,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[12].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _f_RLB: " 
               << actualTolerance << " > " << relError
@@ -548,7 +598,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[13].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _h_RLA: " 
               << actualTolerance << " > " << relError
@@ -570,7 +620,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[14].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _h_RLB: " 
               << actualTolerance << " > " << relError
@@ -612,7 +662,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[15].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _j_RLA: " 
               << actualTolerance << " > " << relError
@@ -634,7 +684,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[16].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _j_RLB: " 
               << actualTolerance << " > " << relError
@@ -661,7 +711,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[17].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _m_RLA: " 
               << actualTolerance << " > " << relError
@@ -683,7 +733,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[18].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _m_RLB: " 
               << actualTolerance << " > " << relError
@@ -706,7 +756,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[19].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _r_RLA: " 
               << actualTolerance << " > " << relError
@@ -728,7 +778,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[20].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _r_RLB: " 
               << actualTolerance << " > " << relError
@@ -763,7 +813,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[21].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _s_RLA: " 
               << actualTolerance << " > " << relError
@@ -796,7 +846,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[22].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _s_RLB: " 
               << actualTolerance << " > " << relError
@@ -820,7 +870,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[23].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for exp_gamma_VFRT: " 
               << actualTolerance << " > " << relError
@@ -844,7 +894,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[24].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for exp_gamma_m1_VFRT: " 
               << actualTolerance << " > " << relError
@@ -878,7 +928,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[25].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for i_CalTerm3: " 
               << actualTolerance << " > " << relError
@@ -913,7 +963,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[26].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for i_CalTerm4: " 
               << actualTolerance << " > " << relError
@@ -941,7 +991,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[27].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for i_NaK_term: " 
               << actualTolerance << " > " << relError
@@ -962,7 +1012,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[28].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for i_p_K_term: " 
               << actualTolerance << " > " << relError
@@ -992,7 +1042,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 1e-3;
       double actualTolerance = _interpolant[29].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for inward_rectifier_potassium_current_i_Kitot: " 
               << actualTolerance << " > " << relError
@@ -1414,8 +1464,48 @@ ThisReaction::~ThisReaction() {
 #define real simdops::float64v
 #define load simdops::load
 
+#define FOR_EACH_GATE(X) X(Xr1) X(Xr2) X(Xs) X(d) X(f) X(f2) X(fCass) X(h) X(j) X(m) X(r) X(s)
+#define FOR_EACH_NONGATE(X) X(Ca_SR) X(Ca_i) X(Ca_ss) X(K_i) X(Na_i) X(R_prime)
+
+static inline real loadState(const double* x) { return load(x); }
+static inline void storeState(double* x, const real y) { store(x, y); }
+
+// Single precision gates are widened on load and rounded on store.
+// All of the arithmetic stays in double.
+static inline real loadState(const float* x)
+{
+   double wide[width];
+   for (int __kk=0; __kk<width; __kk++) { wide[__kk] = x[__kk]; }
+   return load(wide);
+}
+
+static inline void storeState(float* x, const real y)
+{
+   double wide[width];
+   store(wide, y);
+   for (int __kk=0; __kk<width; __kk++) { x[__kk] = wide[__kk]; }
+}
+
+static inline void gatherVm(const ro_array_ptr<int>& __indexArray,
+                            const ro_array_ptr<double>& __Vm,
+                            const unsigned nCells, const int __ii, double* __Vm_local)
+{
+   int cursor = 0;
+   for (int __kk=0; __kk<width; __kk++)
+   {
+      __Vm_local[__kk] = __Vm[__indexArray[__ii+cursor]];
+      if (__ii+cursor+1 < nCells) { cursor++; }
+   }
+}
+
 ThisReaction::ThisReaction(const int numPoints, const double __dt)
-: nCells_(numPoints)
+: nCells_(numPoints),
+  floatGates_(false),
+  driftCheckRate_(0),
+  driftTolerance_(0),
+  myRank_(0),
+  shadowSynced_(false),
+  nCalcs_(0)
 {
    state_.resize((nCells_+width-1)/width);
    __cachedDt = __dt;
@@ -1423,16 +1513,27 @@ ThisReaction::ThisReaction(const int numPoints, const double __dt)
 
 ThisReaction::~ThisReaction() {}
 
-void ThisReaction::calc(double _dt,
-                ro_mgarray_ptr<int> ___indexArray,
-                ro_mgarray_ptr<double> ___Vm,
-                ro_mgarray_ptr<double>,
-                wo_mgarray_ptr<double> ___dVm)
+void ThisReaction::useFloatGates(const int nSampleCells)
 {
-   ro_array_ptr<int>    __indexArray = ___indexArray.useOn(CPU);
-   ro_array_ptr<double> __Vm = ___Vm.useOn(CPU);
-   wo_array_ptr<double> __dVm = ___dVm.useOn(CPU);
+   const int nBlocks = (nCells_+width-1)/width;
+   floatGates_ = true;
+   std::vector<State, AlignedAllocator<State> >().swap(state_);
+   floatState_.resize(nBlocks);
+
+   // Spread the sample over the local cells.
+   const int nSample = min(nBlocks, (nSampleCells+width-1)/width);
+   shadowState_.resize(nSample);
+   shadowBlock_.resize(nSample);
+   for (int ii=0; ii<nSample; ii++)
+   {
+      shadowBlock_[ii] = (long long)ii*nBlocks/nSample;
+   }
+   myRank_ = getRank(0);
+}
 
+template <typename STATE>
+void ThisReaction::calcBlock(const double _dt, const double* __Vm_local, STATE& __state, double* __dVm_local)
+{
    //define the constants
    double Cm = 0.185000000000000;
    double F = 96485.3415000000;
@@ -1472,179 +1573,269 @@ void ThisReaction::calc(double _dt,
    double Na_o = 140;
    double K_mNa = 40;
    double _expensive_functions_040 = sqrt(K_o);
+   const real V = load(&__Vm_local[0]);
+
+   //set all state variables
+   real Ca_SR=loadState(__state.Ca_SR);
+   real Ca_i=loadState(__state.Ca_i);
+   real Ca_ss=loadState(__state.Ca_ss);
+   real K_i=loadState(__state.K_i);
+   real Na_i=loadState(__state.Na_i);
+   real R_prime=loadState(__state.R_prime);
+   real Xr1=loadState(__state.Xr1);
+   real Xr2=loadState(__state.Xr2);
+   real Xs=loadState(__state.Xs);
+   real d=loadState(__state.d);
+   real f=loadState(__state.f);
+   real f2=loadState(__state.f2);
+   real fCass=loadState(__state.fCass);
+   real h=loadState(__state.h);
+   real j=loadState(__state.j);
+   real m=loadState(__state.m);
+   real r=loadState(__state.r);
+   real s=loadState(__state.s);
+   //get the gate updates (diagonalized exponential integrator)
+   real fCass_inf = 0.4 + 0.6/(400.0*(Ca_ss*Ca_ss) + 1);
+   real _Xr1_RLA = _interpolant[1].eval(V);
+   real _Xr1_RLB = _interpolant[2].eval(V);
+   real _Xr2_RLA = _interpolant[3].eval(V);
+   real _Xr2_RLB = _interpolant[4].eval(V);
+   real _Xs_RLA = _interpolant[5].eval(V);
+   real _Xs_RLB = _interpolant[6].eval(V);
+   real _d_RLA = _interpolant[7].eval(V);
+   real _d_RLB = _interpolant[8].eval(V);
+   real _f_RLA = _interpolant[11].eval(V);
+   real _f_RLB = _interpolant[12].eval(V);
+   real _f2_RLA = _interpolant[9].eval(V);
+   real _f2_RLB = _interpolant[10].eval(V);
+   real _fCass_RLA = _interpolant[0].eval(Ca_ss);
+   real _fCass_RLB = -fCass_inf;
+   real _h_RLA = _interpolant[13].eval(V);
+   real _h_RLB = _interpolant[14].eval(V);
+   real _j_RLA = _interpolant[15].eval(V);
+   real _j_RLB = _interpolant[16].eval(V);
+   real _m_RLA = _interpolant[17].eval(V);
+   real _m_RLB = _interpolant[18].eval(V);
+   real _r_RLA = _interpolant[19].eval(V);
+   real _r_RLB = _interpolant[20].eval(V);
+   real _s_RLA = _interpolant[21].eval(V);
+   real _s_RLB = _interpolant[22].eval(V);
+   //get the other differential updates
+   real i_CalTerm3;
+   i_CalTerm3 = _interpolant[25].eval(V);
+   real i_CalTerm4 = _interpolant[26].eval(V);
+   real _expensive_functions_012 = log(Ca_o/Ca_i);
+   real E_Ca = 0.5*R*T*_expensive_functions_012/F;
+   real i_b_Ca = g_bca*(V - E_Ca);
+   real i_p_Ca = Ca_i*g_pCa/(Ca_i + K_pCa);
+   real exp_gamma_VFRT = _interpolant[23].eval(V);
+   real exp_gamma_m1_VFRT = _interpolant[24].eval(V);
+   real i_p_K_term = _interpolant[28].eval(V);
+   real _expensive_functions_026 = log(K_o/K_i);
+   real E_K = R*T*_expensive_functions_026/F;
+   real i_NaK_term = _interpolant[27].eval(V);
+   real i_NaK = Na_i*i_NaK_term/(Na_i + K_mNa);
+   real i_Naitot = 3*i_NaK;
+   real i_Kitot = -2*i_NaK;
+   real VEK = -E_K + V;
+   real Ca_i_bufc = (1.0/(Buf_c*K_buf_c/((Ca_i + K_buf_c)*(Ca_i + K_buf_c)) + 1));
+   real Ca_sr_bufsr = (1.0/(Buf_sr*K_buf_sr/((Ca_SR + K_buf_sr)*(Ca_SR + K_buf_sr)) + 1));
+   real Ca_ss_bufss = (1.0/(Buf_ss*K_buf_ss/((Ca_ss + K_buf_ss)*(Ca_ss + K_buf_ss)) + 1));
+   real i_leak = V_leak*(Ca_SR - Ca_i);
+   real i_up = Vmax_up/(1 + (K_up*K_up)/(Ca_i*Ca_i));
+   real i_xfer = V_xfer*(-Ca_i + Ca_ss);
+   real kcasr = max_sr - (max_sr - min_sr)/(1 + (EC*EC)/(Ca_SR*Ca_SR));
+   real k1 = k1_prime/kcasr;
+   real k2 = k2_prime*kcasr;
+   real O = (Ca_ss*Ca_ss)*R_prime*k1/((Ca_ss*Ca_ss)*k1 + k3);
+   real R_prime_diff = -Ca_ss*R_prime*k2 + k4*(-R_prime + 1);
+   real i_rel = O*V_rel*(Ca_SR - Ca_ss);
+   real Ca_SR_diff = Ca_sr_bufsr*(-i_leak - i_rel + i_up);
+   real i_CaL = d*f*f2*fCass*g_CaL*(-Ca_o*i_CalTerm3 + 0.25*Ca_ss*i_CalTerm4);
+   real i_NaCa = K_NaCa*((Na_i*Na_i*Na_i)*Ca_o*exp_gamma_VFRT - (Na_o*Na_o*Na_o)*Ca_i*alpha*exp_gamma_m1_VFRT)/(((Na_o*Na_o*Na_o) + (Km_Nai*Km_Nai*Km_Nai))*(Ca_o + Km_Ca)*(K_sat*exp_gamma_m1_VFRT + 1));
+   real sodium_calcium_exchanger_current_i_Naitot = 3*i_NaCa;
+   real inward_rectifier_potassium_current_i_Kitot = _interpolant[29].eval(VEK);
+   real i_p_K = VEK*g_pK*i_p_K_term;
+   real potassium_pump_current_i_Kitot = i_p_K;
+   real i_Kr = 0.430331482911935*VEK*_expensive_functions_040*Xr1*Xr2*g_Kr;
+   real rapid_time_dependent_potassium_current_i_Kitot = i_Kr;
+   real _expensive_functions_041 = log(Na_o/Na_i);
+   real E_Na = R*T*_expensive_functions_041/F;
+   real _expensive_functions_042 = log((K_o + Na_o*P_kna)/(K_i + Na_i*P_kna));
+   real E_Ks = R*T*_expensive_functions_042/F;
+   real i_Ks = (Xs*Xs)*g_Ks*(V - E_Ks);
+   real slow_time_dependent_potassium_current_i_Kitot = i_Ks;
+   real i_b_Na = g_bna*(-E_Na + V);
+   real sodium_background_current_i_Naitot = i_b_Na;
+   real i_to = VEK*g_to*r*s;
+   real transient_outward_current_i_Kitot = i_to;
+   real i_Kitot_001 = i_Kitot + inward_rectifier_potassium_current_i_Kitot + potassium_pump_current_i_Kitot + rapid_time_dependent_potassium_current_i_Kitot + slow_time_dependent_potassium_current_i_Kitot + transient_outward_current_i_Kitot;
+   real Ca_i_diff = Ca_i_bufc*(-1.0L/2.0L*Cm*(-2*i_NaCa + i_b_Ca + i_p_Ca)/(F*V_c) + i_xfer + V_sr*(i_leak - i_up)/V_c);
+   real Ca_ss_diff = Ca_ss_bufss*(-1.0L/2.0L*Cm*i_CaL/(F*V_ss) - V_c*i_xfer/V_ss + V_sr*i_rel/V_ss);
+   real i_Na = (m*m*m)*g_Na*h*j*(-E_Na + V);
+   real fast_sodium_current_i_Naitot = i_Na;
+   real K_i_diff = -Cm*factor_fix*i_Kitot_001/(F*V_c);
+   real i_Naitot_001 = fast_sodium_current_i_Naitot + i_Naitot + sodium_background_current_i_Naitot + sodium_calcium_exchanger_current_i_Naitot;
+   real Na_i_diff = -Cm*factor_fix*i_Naitot_001/(F*V_c);
+   //get Iion
+   real i_Caitot = i_b_Ca;
+   real calcium_pump_current_i_Caitot = i_p_Ca;
+   real L_type_Ca_current_i_Caitot = i_CaL;
+   real sodium_calcium_exchanger_current_i_Caitot = -2*i_NaCa;
+   real i_Caitot_001 = L_type_Ca_current_i_Caitot + calcium_pump_current_i_Caitot + i_Caitot + sodium_calcium_exchanger_current_i_Caitot;
+   real Iion = i_Caitot_001 + i_Kitot_001 + i_Naitot_001;
+   real Iion_001 = Iion;
+   //Do the markov update (1 step rosenbrock with gauss siedel)
+   //EDIT_STATE
+   Ca_SR += _dt*Ca_SR_diff;
+   Ca_i += _dt*Ca_i_diff;
+   Ca_ss += _dt*Ca_ss_diff;
+   K_i += _dt*K_i_diff;
+   Na_i += _dt*Na_i_diff;
+   R_prime += _dt*R_prime_diff;
+   Xr1 += _Xr1_RLA*(Xr1+_Xr1_RLB);
+   Xr2 += _Xr2_RLA*(Xr2+_Xr2_RLB);
+   Xs += _Xs_RLA*(Xs+_Xs_RLB);
+   d += _d_RLA*(d+_d_RLB);
+   f += _f_RLA*(f+_f_RLB);
+   f2 += _f2_RLA*(f2+_f2_RLB);
+   fCass += _fCass_RLA*(fCass+_fCass_RLB);
+   h += _h_RLA*(h+_h_RLB);
+   j += _j_RLA*(j+_j_RLB);
+   m += _m_RLA*(m+_m_RLB);
+   r += _r_RLA*(r+_r_RLB);
+   s += _s_RLA*(s+_s_RLB);
+   storeState(__state.Ca_SR, Ca_SR);
+   storeState(__state.Ca_i, Ca_i);
+   storeState(__state.Ca_ss, Ca_ss);
+   storeState(__state.K_i, K_i);
+   storeState(__state.Na_i, Na_i);
+   storeState(__state.R_prime, R_prime);
+   storeState(__state.Xr1, Xr1);
+   storeState(__state.Xr2, Xr2);
+   storeState(__state.Xs, Xs);
+   storeState(__state.d, d);
+   storeState(__state.f, f);
+   storeState(__state.f2, f2);
+   storeState(__state.fCass, fCass);
+   storeState(__state.h, h);
+   storeState(__state.j, j);
+   storeState(__state.m, m);
+   storeState(__state.r, r);
+   storeState(__state.s, s);
+
+   simdops::store(&__dVm_local[0],-Iion_001);
+}
+
+void ThisReaction::calc(double _dt,
+                ro_mgarray_ptr<int> ___indexArray,
+                ro_mgarray_ptr<double> ___Vm,
+                ro_mgarray_ptr<double>,
+                wo_mgarray_ptr<double> ___dVm)
+{
+   ro_array_ptr<int>    __indexArray = ___indexArray.useOn(CPU);
+   ro_array_ptr<double> __Vm = ___Vm.useOn(CPU);
+   wo_array_ptr<double> __dVm = ___dVm.useOn(CPU);
+
+   if (floatGates_)
+   {
+      advanceShadow(_dt, __indexArray, __Vm);
+   }
    for (unsigned __jj=0; __jj<(nCells_+width-1)/width; __jj++)
    {
       const int __ii = __jj*width;
-      //set Vm
       double __Vm_local[width];
+      gatherVm(__indexArray, __Vm, nCells_, __ii, __Vm_local);
+
+      double __dVm_local[width];
+      if (floatGates_)
+      {
+         calcBlock(_dt, __Vm_local, floatState_[__jj], __dVm_local);
+      }
+      else
+      {
+         calcBlock(_dt, __Vm_local, state_[__jj], __dVm_local);
+      }
+      for (int __kk=0; __kk<width && __ii+__kk<nCells_; __kk++)
+      {
+         __dVm[__indexArray[__ii+__kk]] = __dVm_local[__kk];
+      }
+   }
+}
+
+/** Steps the double precision shadow of the sampled blocks with the
+ *  same Vm as the real state.  Every driftCheckRate_ calls the shadow
+ *  is compared with the single precision state before both are stepped
+ *  and the largest differences are reported: absolute for the gates,
+ *  relative for the other state variables and absolute for dVm. */
+void ThisReaction::advanceShadow(const double _dt,
+                                 const ro_array_ptr<int>& __indexArray,
+                                 const ro_array_ptr<double>& __Vm)
+{
+   if (!shadowSynced_)
+   {
+      for (int ii=0; ii<shadowBlock_.size(); ii++)
       {
-         int cursor = 0;
+         const FloatGateState& source = floatState_[shadowBlock_[ii]];
          for (int __kk=0; __kk<width; __kk++)
          {
-            __Vm_local[__kk] = __Vm[__indexArray[__ii+cursor]];
-            if (__ii+__kk < nCells_) { cursor++; }
+#define COPY_STATE(name) shadowState_[ii].name[__kk] = source.name[__kk];
+            FOR_EACH_GATE(COPY_STATE) FOR_EACH_NONGATE(COPY_STATE)
+#undef COPY_STATE
          }
       }
-      const real V = load(&__Vm_local[0]);
-
-      //set all state variables
-      real Ca_SR=load(state_[__jj].Ca_SR);
-      real Ca_i=load(state_[__jj].Ca_i);
-      real Ca_ss=load(state_[__jj].Ca_ss);
-      real K_i=load(state_[__jj].K_i);
-      real Na_i=load(state_[__jj].Na_i);
-      real R_prime=load(state_[__jj].R_prime);
-      real Xr1=load(state_[__jj].Xr1);
-      real Xr2=load(state_[__jj].Xr2);
-      real Xs=load(state_[__jj].Xs);
-      real d=load(state_[__jj].d);
-      real f=load(state_[__jj].f);
-      real f2=load(state_[__jj].f2);
-      real fCass=load(state_[__jj].fCass);
-      real h=load(state_[__jj].h);
-      real j=load(state_[__jj].j);
-      real m=load(state_[__jj].m);
-      real r=load(state_[__jj].r);
-      real s=load(state_[__jj].s);
-      //get the gate updates (diagonalized exponential integrator)
-      real fCass_inf = 0.4 + 0.6/(400.0*(Ca_ss*Ca_ss) + 1);
-      real _Xr1_RLA = _interpolant[1].eval(V);
-      real _Xr1_RLB = _interpolant[2].eval(V);
-      real _Xr2_RLA = _interpolant[3].eval(V);
-      real _Xr2_RLB = _interpolant[4].eval(V);
-      real _Xs_RLA = _interpolant[5].eval(V);
-      real _Xs_RLB = _interpolant[6].eval(V);
-      real _d_RLA = _interpolant[7].eval(V);
-      real _d_RLB = _interpolant[8].eval(V);
-      real _f_RLA = _interpolant[11].eval(V);
-      real _f_RLB = _interpolant[12].eval(V);
-      real _f2_RLA = _interpolant[9].eval(V);
-      real _f2_RLB = _interpolant[10].eval(V);
-      real _fCass_RLA = _interpolant[0].eval(Ca_ss);
-      real _fCass_RLB = -fCass_inf;
-      real _h_RLA = _interpolant[13].eval(V);
-      real _h_RLB = _interpolant[14].eval(V);
-      real _j_RLA = _interpolant[15].eval(V);
-      real _j_RLB = _interpolant[16].eval(V);
-      real _m_RLA = _interpolant[17].eval(V);
-      real _m_RLB = _interpolant[18].eval(V);
-      real _r_RLA = _interpolant[19].eval(V);
-      real _r_RLB = _interpolant[20].eval(V);
-      real _s_RLA = _interpolant[21].eval(V);
-      real _s_RLB = _interpolant[22].eval(V);
-      //get the other differential updates
-      real i_CalTerm3;
-      i_CalTerm3 = _interpolant[25].eval(V);
-      real i_CalTerm4 = _interpolant[26].eval(V);
-      real _expensive_functions_012 = log(Ca_o/Ca_i);
-      real E_Ca = 0.5*R*T*_expensive_functions_012/F;
-      real i_b_Ca = g_bca*(V - E_Ca);
-      real i_p_Ca = Ca_i*g_pCa/(Ca_i + K_pCa);
-      real exp_gamma_VFRT = _interpolant[23].eval(V);
-      real exp_gamma_m1_VFRT = _interpolant[24].eval(V);
-      real i_p_K_term = _interpolant[28].eval(V);
-      real _expensive_functions_026 = log(K_o/K_i);
-      real E_K = R*T*_expensive_functions_026/F;
-      real i_NaK_term = _interpolant[27].eval(V);
-      real i_NaK = Na_i*i_NaK_term/(Na_i + K_mNa);
-      real i_Naitot = 3*i_NaK;
-      real i_Kitot = -2*i_NaK;
-      real VEK = -E_K + V;
-      real Ca_i_bufc = (1.0/(Buf_c*K_buf_c/((Ca_i + K_buf_c)*(Ca_i + K_buf_c)) + 1));
-      real Ca_sr_bufsr = (1.0/(Buf_sr*K_buf_sr/((Ca_SR + K_buf_sr)*(Ca_SR + K_buf_sr)) + 1));
-      real Ca_ss_bufss = (1.0/(Buf_ss*K_buf_ss/((Ca_ss + K_buf_ss)*(Ca_ss + K_buf_ss)) + 1));
-      real i_leak = V_leak*(Ca_SR - Ca_i);
-      real i_up = Vmax_up/(1 + (K_up*K_up)/(Ca_i*Ca_i));
-      real i_xfer = V_xfer*(-Ca_i + Ca_ss);
-      real kcasr = max_sr - (max_sr - min_sr)/(1 + (EC*EC)/(Ca_SR*Ca_SR));
-      real k1 = k1_prime/kcasr;
-      real k2 = k2_prime*kcasr;
-      real O = (Ca_ss*Ca_ss)*R_prime*k1/((Ca_ss*Ca_ss)*k1 + k3);
-      real R_prime_diff = -Ca_ss*R_prime*k2 + k4*(-R_prime + 1);
-      real i_rel = O*V_rel*(Ca_SR - Ca_ss);
-      real Ca_SR_diff = Ca_sr_bufsr*(-i_leak - i_rel + i_up);
-      real i_CaL = d*f*f2*fCass*g_CaL*(-Ca_o*i_CalTerm3 + 0.25*Ca_ss*i_CalTerm4);
-      real i_NaCa = K_NaCa*((Na_i*Na_i*Na_i)*Ca_o*exp_gamma_VFRT - (Na_o*Na_o*Na_o)*Ca_i*alpha*exp_gamma_m1_VFRT)/(((Na_o*Na_o*Na_o) + (Km_Nai*Km_Nai*Km_Nai))*(Ca_o + Km_Ca)*(K_sat*exp_gamma_m1_VFRT + 1));
-      real sodium_calcium_exchanger_current_i_Naitot = 3*i_NaCa;
-      real inward_rectifier_potassium_current_i_Kitot = _interpolant[29].eval(VEK);
-      real i_p_K = VEK*g_pK*i_p_K_term;
-      real potassium_pump_current_i_Kitot = i_p_K;
-      real i_Kr = 0.430331482911935*VEK*_expensive_functions_040*Xr1*Xr2*g_Kr;
-      real rapid_time_dependent_potassium_current_i_Kitot = i_Kr;
-      real _expensive_functions_041 = log(Na_o/Na_i);
-      real E_Na = R*T*_expensive_functions_041/F;
-      real _expensive_functions_042 = log((K_o + Na_o*P_kna)/(K_i + Na_i*P_kna));
-      real E_Ks = R*T*_expensive_functions_042/F;
-      real i_Ks = (Xs*Xs)*g_Ks*(V - E_Ks);
-      real slow_time_dependent_potassium_current_i_Kitot = i_Ks;
-      real i_b_Na = g_bna*(-E_Na + V);
-      real sodium_background_current_i_Naitot = i_b_Na;
-      real i_to = VEK*g_to*r*s;
-      real transient_outward_current_i_Kitot = i_to;
-      real i_Kitot_001 = i_Kitot + inward_rectifier_potassium_current_i_Kitot + potassium_pump_current_i_Kitot + rapid_time_dependent_potassium_current_i_Kitot + slow_time_dependent_potassium_current_i_Kitot + transient_outward_current_i_Kitot;
-      real Ca_i_diff = Ca_i_bufc*(-1.0L/2.0L*Cm*(-2*i_NaCa + i_b_Ca + i_p_Ca)/(F*V_c) + i_xfer + V_sr*(i_leak - i_up)/V_c);
-      real Ca_ss_diff = Ca_ss_bufss*(-1.0L/2.0L*Cm*i_CaL/(F*V_ss) - V_c*i_xfer/V_ss + V_sr*i_rel/V_ss);
-      real i_Na = (m*m*m)*g_Na*h*j*(-E_Na + V);
-      real fast_sodium_current_i_Naitot = i_Na;
-      real K_i_diff = -Cm*factor_fix*i_Kitot_001/(F*V_c);
-      real i_Naitot_001 = fast_sodium_current_i_Naitot + i_Naitot + sodium_background_current_i_Naitot + sodium_calcium_exchanger_current_i_Naitot;
-      real Na_i_diff = -Cm*factor_fix*i_Naitot_001/(F*V_c);
-      //get Iion
-      real i_Caitot = i_b_Ca;
-      real calcium_pump_current_i_Caitot = i_p_Ca;
-      real L_type_Ca_current_i_Caitot = i_CaL;
-      real sodium_calcium_exchanger_current_i_Caitot = -2*i_NaCa;
-      real i_Caitot_001 = L_type_Ca_current_i_Caitot + calcium_pump_current_i_Caitot + i_Caitot + sodium_calcium_exchanger_current_i_Caitot;
-      real Iion = i_Caitot_001 + i_Kitot_001 + i_Naitot_001;
-      real Iion_001 = Iion;
-      //Do the markov update (1 step rosenbrock with gauss siedel)
-      //EDIT_STATE
-      Ca_SR += _dt*Ca_SR_diff;
-      Ca_i += _dt*Ca_i_diff;
-      Ca_ss += _dt*Ca_ss_diff;
-      K_i += _dt*K_i_diff;
-      Na_i += _dt*Na_i_diff;
-      R_prime += _dt*R_prime_diff;
-      Xr1 += _Xr1_RLA*(Xr1+_Xr1_RLB);
-      Xr2 += _Xr2_RLA*(Xr2+_Xr2_RLB);
-      Xs += _Xs_RLA*(Xs+_Xs_RLB);
-      d += _d_RLA*(d+_d_RLB);
-      f += _f_RLA*(f+_f_RLB);
-      f2 += _f2_RLA*(f2+_f2_RLB);
-      fCass += _fCass_RLA*(fCass+_fCass_RLB);
-      h += _h_RLA*(h+_h_RLB);
-      j += _j_RLA*(j+_j_RLB);
-      m += _m_RLA*(m+_m_RLB);
-      r += _r_RLA*(r+_r_RLB);
-      s += _s_RLA*(s+_s_RLB);
-      store(state_[__jj].Ca_SR, Ca_SR);
-      store(state_[__jj].Ca_i, Ca_i);
-      store(state_[__jj].Ca_ss, Ca_ss);
-      store(state_[__jj].K_i, K_i);
-      store(state_[__jj].Na_i, Na_i);
-      store(state_[__jj].R_prime, R_prime);
-      store(state_[__jj].Xr1, Xr1);
-      store(state_[__jj].Xr2, Xr2);
-      store(state_[__jj].Xs, Xs);
-      store(state_[__jj].d, d);
-      store(state_[__jj].f, f);
-      store(state_[__jj].f2, f2);
-      store(state_[__jj].fCass, fCass);
-      store(state_[__jj].h, h);
-      store(state_[__jj].j, j);
-      store(state_[__jj].m, m);
-      store(state_[__jj].r, r);
-      store(state_[__jj].s, s);
+      shadowSynced_ = true;
+      nCalcs_ = 0;
+   }
 
-      double __dVm_local[width];
-      simdops::store(&__dVm_local[0],-Iion_001);
+   ++nCalcs_;
+   const bool check = (driftCheckRate_ > 0 && nCalcs_ % driftCheckRate_ == 0);
+   double gateDrift = 0;
+   double nonGateDrift = 0;
+   double dVmDrift = 0;
+   for (int ii=0; ii<shadowBlock_.size(); ii++)
+   {
+      const int __ii = shadowBlock_[ii]*width;
+      double __Vm_local[width];
+      gatherVm(__indexArray, __Vm, nCells_, __ii, __Vm_local);
+
+      double shadowDVm[width];
+      double floatDVm[width];
+      if (check)
       {
-         int cursor = 0;
+         FloatGateState trial = floatState_[shadowBlock_[ii]];
+         const State& shadow = shadowState_[ii];
          for (int __kk=0; __kk<width && __ii+__kk<nCells_; __kk++)
          {
-            __dVm[__indexArray[__ii+__kk]] = __dVm_local[__kk];
+#define GATE_DRIFT(name) gateDrift = max(gateDrift, fabs(trial.name[__kk]-shadow.name[__kk]));
+#define NONGATE_DRIFT(name) nonGateDrift = max(nonGateDrift, fabs(trial.name[__kk]-shadow.name[__kk])/max(fabs(shadow.name[__kk]),1e-300));
+            FOR_EACH_GATE(GATE_DRIFT) FOR_EACH_NONGATE(NONGATE_DRIFT)
+#undef GATE_DRIFT
+#undef NONGATE_DRIFT
          }
+         calcBlock(_dt, __Vm_local, trial, floatDVm);
       }
+      calcBlock(_dt, __Vm_local, shadowState_[ii], shadowDVm);
+      if (check)
+      {
+         for (int __kk=0; __kk<width && __ii+__kk<nCells_; __kk++)
+         {
+            dVmDrift = max(dVmDrift, fabs(floatDVm[__kk]-shadowDVm[__kk]));
+         }
+      }
+   }
+   if (!check)
+   {
+      return;
+   }
+   const bool drifted = (gateDrift > driftTolerance_);
+   if (drifted || myRank_ == 0)
+   {
+      cout << (drifted ? "WARNING: " : "")
+           << "BetterTT06 single precision gate drift on task " << myRank_
+           << " after " << nCalcs_ << " steps: gates " << gateDrift
+           << ", other state (relative) " << nonGateDrift
+           << ", dVm " << dVmDrift << endl;
    }
 }
 #endif //USE_CUDA
@@ -1662,10 +1853,20 @@ void ThisReaction::initializeMembraneVoltage(ro_mgarray_ptr<int> __indexArray_m,
    ro_array_ptr<int> __indexArray = __indexArray_m.useOn(CPU);
 #ifdef USE_CUDA
 #define READ_STATE(state,index) (stateData[_##state##_off*nCells_+index])
+#define WRITE_STATE(state,index,value) (READ_STATE(state,index) = (value))
    wo_array_ptr<double> stateData = stateTransport_.useOn(CPU);
 #else //USE_CUDA
-#define READ_STATE(state,index) (state_[index/width].state[index % width])
-   state_.resize((nCells_+width-1)/width);
+#define READ_STATE(state,index) (floatGates_ ? double(floatState_[index/width].state[index % width]) : state_[index/width].state[index % width])
+#define WRITE_STATE(state,index,value) (floatGates_ ? (void)(floatState_[index/width].state[index % width] = (value)) : (void)(state_[index/width].state[index % width] = (value)))
+   if (floatGates_)
+   {
+      floatState_.resize((nCells_+width-1)/width);
+      shadowSynced_ = false;
+   }
+   else
+   {
+      state_.resize((nCells_+width-1)/width);
+   }
 #endif //USE_CUDA
 
 
@@ -1709,24 +1910,24 @@ void ThisReaction::initializeMembraneVoltage(ro_mgarray_ptr<int> __indexArray_m,
    double s = s_init;
    for (int iCell=0; iCell<nCells_; iCell++)
    {
-      READ_STATE(Ca_SR,iCell) = Ca_SR;
-      READ_STATE(Ca_i,iCell) = Ca_i;
-      READ_STATE(Ca_ss,iCell) = Ca_ss;
-      READ_STATE(K_i,iCell) = K_i;
-      READ_STATE(Na_i,iCell) = Na_i;
-      READ_STATE(R_prime,iCell) = R_prime;
-      READ_STATE(Xr1,iCell) = Xr1;
-      READ_STATE(Xr2,iCell) = Xr2;
-      READ_STATE(Xs,iCell) = Xs;
-      READ_STATE(d,iCell) = d;
-      READ_STATE(f,iCell) = f;
-      READ_STATE(f2,iCell) = f2;
-      READ_STATE(fCass,iCell) = fCass;
-      READ_STATE(h,iCell) = h;
-      READ_STATE(j,iCell) = j;
-      READ_STATE(m,iCell) = m;
-      READ_STATE(r,iCell) = r;
-      READ_STATE(s,iCell) = s;
+      WRITE_STATE(Ca_SR,iCell,Ca_SR);
+      WRITE_STATE(Ca_i,iCell,Ca_i);
+      WRITE_STATE(Ca_ss,iCell,Ca_ss);
+      WRITE_STATE(K_i,iCell,K_i);
+      WRITE_STATE(Na_i,iCell,Na_i);
+      WRITE_STATE(R_prime,iCell,R_prime);
+      WRITE_STATE(Xr1,iCell,Xr1);
+      WRITE_STATE(Xr2,iCell,Xr2);
+      WRITE_STATE(Xs,iCell,Xs);
+      WRITE_STATE(d,iCell,d);
+      WRITE_STATE(f,iCell,f);
+      WRITE_STATE(f2,iCell,f2);
+      WRITE_STATE(fCass,iCell,fCass);
+      WRITE_STATE(h,iCell,h);
+      WRITE_STATE(j,iCell,j);
+      WRITE_STATE(m,iCell,m);
+      WRITE_STATE(r,iCell,r);
+      WRITE_STATE(s,iCell,s);
       __Vm[__indexArray[iCell]] = V_init;
    }
 }
@@ -1854,29 +2055,67 @@ void ThisReaction::setValue(int iCell, int varHandle, double value)
 {
 #ifdef USE_CUDA
    auto stateData = stateTransport_.readwrite(CPU);
+#else //USE_CUDA
+   shadowSynced_ = false;
 #endif //USE_CUDA
 
 
 
    if (0) {}
-   else if (varHandle == Ca_SR_handle) { READ_STATE(Ca_SR,iCell) = value; }
-   else if (varHandle == Ca_i_handle) { READ_STATE(Ca_i,iCell) = value; }
-   else if (varHandle == Ca_ss_handle) { READ_STATE(Ca_ss,iCell) = value; }
-   else if (varHandle == K_i_handle) { READ_STATE(K_i,iCell) = value; }
-   else if (varHandle == Na_i_handle) { READ_STATE(Na_i,iCell) = value; }
-   else if (varHandle == R_prime_handle) { READ_STATE(R_prime,iCell) = value; }
-   else if (varHandle == Xr1_handle) { READ_STATE(Xr1,iCell) = value; }
-   else if (varHandle == Xr2_handle) { READ_STATE(Xr2,iCell) = value; }
-   else if (varHandle == Xs_handle) { READ_STATE(Xs,iCell) = value; }
-   else if (varHandle == d_handle) { READ_STATE(d,iCell) = value; }
-   else if (varHandle == f_handle) { READ_STATE(f,iCell) = value; }
-   else if (varHandle == f2_handle) { READ_STATE(f2,iCell) = value; }
-   else if (varHandle == fCass_handle) { READ_STATE(fCass,iCell) = value; }
-   else if (varHandle == h_handle) { READ_STATE(h,iCell) = value; }
-   else if (varHandle == j_handle) { READ_STATE(j,iCell) = value; }
-   else if (varHandle == m_handle) { READ_STATE(m,iCell) = value; }
-   else if (varHandle == r_handle) { READ_STATE(r,iCell) = value; }
-   else if (varHandle == s_handle) { READ_STATE(s,iCell) = value; }
+   else if (varHandle == Ca_SR_handle) { WRITE_STATE(Ca_SR,iCell,value); }
+   else if (varHandle == Ca_i_handle) { WRITE_STATE(Ca_i,iCell,value); }
+   else if (varHandle == Ca_ss_handle) { WRITE_STATE(Ca_ss,iCell,value); }
+   else if (varHandle == K_i_handle) { WRITE_STATE(K_i,iCell,value); }
+   else if (varHandle == Na_i_handle) { WRITE_STATE(Na_i,iCell,value); }
+   else if (varHandle == R_prime_handle) { WRITE_STATE(R_prime,iCell,value); }
+   else if (varHandle == Xr1_handle) { WRITE_STATE(Xr1,iCell,value); }
+   else if (varHandle == Xr2_handle) { WRITE_STATE(Xr2,iCell,value); }
+   else if (varHandle == Xs_handle) { WRITE_STATE(Xs,iCell,value); }
+   else if (varHandle == d_handle) { WRITE_STATE(d,iCell,value); }
+   else if (varHandle == f_handle) { WRITE_STATE(f,iCell,value); }
+   else if (varHandle == f2_handle) { WRITE_STATE(f2,iCell,value); }
+   else if (varHandle == fCass_handle) { WRITE_STATE(fCass,iCell,value); }
+   else if (varHandle == h_handle) { WRITE_STATE(h,iCell,value); }
+   else if (varHandle == j_handle) { WRITE_STATE(j,iCell,value); }
+   else if (varHandle == m_handle) { WRITE_STATE(m,iCell,value); }
+   else if (varHandle == r_handle) { WRITE_STATE(r,iCell,value); }
+   else if (varHandle == s_handle) { WRITE_STATE(s,iCell,value); }
+}
+
+/** One column at a time: the handle is resolved once and the cells
+ *  are set in parallel. */
+void ThisReaction::setValues(int varHandle, const vector<double>& value)
+{
+#ifdef USE_CUDA
+   auto stateData = stateTransport_.readwrite(CPU);
+#else //USE_CUDA
+   shadowSynced_ = false;
+#endif //USE_CUDA
+   int nCells = value.size();
+#define SET_COLUMN(state) \
+   _Pragma("omp parallel for") \
+   for (int ii=0; ii<nCells; ++ii) WRITE_STATE(state,ii,value[ii])
+
+   if (0) {}
+   else if (varHandle == Ca_SR_handle) { SET_COLUMN(Ca_SR); }
+   else if (varHandle == Ca_i_handle) { SET_COLUMN(Ca_i); }
+   else if (varHandle == Ca_ss_handle) { SET_COLUMN(Ca_ss); }
+   else if (varHandle == K_i_handle) { SET_COLUMN(K_i); }
+   else if (varHandle == Na_i_handle) { SET_COLUMN(Na_i); }
+   else if (varHandle == R_prime_handle) { SET_COLUMN(R_prime); }
+   else if (varHandle == Xr1_handle) { SET_COLUMN(Xr1); }
+   else if (varHandle == Xr2_handle) { SET_COLUMN(Xr2); }
+   else if (varHandle == Xs_handle) { SET_COLUMN(Xs); }
+   else if (varHandle == d_handle) { SET_COLUMN(d); }
+   else if (varHandle == f_handle) { SET_COLUMN(f); }
+   else if (varHandle == f2_handle) { SET_COLUMN(f2); }
+   else if (varHandle == fCass_handle) { SET_COLUMN(fCass); }
+   else if (varHandle == h_handle) { SET_COLUMN(h); }
+   else if (varHandle == j_handle) { SET_COLUMN(j); }
+   else if (varHandle == m_handle) { SET_COLUMN(m); }
+   else if (varHandle == r_handle) { SET_COLUMN(r); }
+   else if (varHandle == s_handle) { SET_COLUMN(s); }
+#undef SET_COLUMN
 }
 
 
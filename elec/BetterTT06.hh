@@ -45,6 +45,31 @@ namespace BetterTT06
       double r[SIMDOPS_FLOAT64V_WIDTH];
       double s[SIMDOPS_FLOAT64V_WIDTH];
    };
+
+   /** State with the gates (bounded in [0,1]) stored in single
+    *  precision.  Used when gatePrecision = float. */
+   struct FloatGateState
+   {
+
+      double Ca_SR[SIMDOPS_FLOAT64V_WIDTH];
+      double Ca_i[SIMDOPS_FLOAT64V_WIDTH];
+      double Ca_ss[SIMDOPS_FLOAT64V_WIDTH];
+      double K_i[SIMDOPS_FLOAT64V_WIDTH];
+      double Na_i[SIMDOPS_FLOAT64V_WIDTH];
+      double R_prime[SIMDOPS_FLOAT64V_WIDTH];
+      float Xr1[SIMDOPS_FLOAT64V_WIDTH];
+      float Xr2[SIMDOPS_FLOAT64V_WIDTH];
+      float Xs[SIMDOPS_FLOAT64V_WIDTH];
+      float d[SIMDOPS_FLOAT64V_WIDTH];
+      float f[SIMDOPS_FLOAT64V_WIDTH];
+      float f2[SIMDOPS_FLOAT64V_WIDTH];
+      float fCass[SIMDOPS_FLOAT64V_WIDTH];
+      float h[SIMDOPS_FLOAT64V_WIDTH];
+      float j[SIMDOPS_FLOAT64V_WIDTH];
+      float m[SIMDOPS_FLOAT64V_WIDTH];
+      float r[SIMDOPS_FLOAT64V_WIDTH];
+      float s[SIMDOPS_FLOAT64V_WIDTH];
+   };
 #endif //USE_CUDA
 
    class ThisReaction : public Reaction
@@ -53,13 +78,14 @@ namespace BetterTT06
       ThisReaction(const int numPoints, const double __dt);
       std::string methodName() const;
       
-      void createInterpolants(const double _dt);
+      void createInterpolants(const double _dt, const int myRank);
       //void updateNonGate(double dt, const VectorDouble32&Vm, VectorDouble32&dVR);
       //void updateGate   (double dt, const VectorDouble32&Vm) ;
       virtual void getCheckpointInfo(std::vector<std::string>& fieldNames,
                                      std::vector<std::string>& fieldUnits) const;
       virtual int getVarHandle(const std::string& varName) const;
       virtual void setValue(int iCell, int varHandle, double value);
+      virtual void setValues(int varHandle, const std::vector<double>& value);
       virtual double getValue(int iCell, int varHandle) const;
       virtual double getValue(int iCell, int varHandle, double V) const;
       virtual const std::string getUnit(const std::string& varName) const;
@@ -101,6 +127,25 @@ namespace BetterTT06
       int blockSize_;
 #else //USE_CUDA
       std::vector<State, AlignedAllocator<State> > state_;
+
+      // gatePrecision = float keeps the state in floatState_ instead of
+      // state_ and integrates a sample of it in double alongside.
+      void useFloatGates(const int nSampleCells);
+      template <typename STATE>
+      void calcBlock(const double dt, const double* Vm, STATE& state, double* dVm);
+      void advanceShadow(const double dt,
+                         const ro_array_ptr<int>& indexArray,
+                         const ro_array_ptr<double>& Vm);
+
+      bool floatGates_;
+      int driftCheckRate_;
+      double driftTolerance_;
+      int myRank_;
+      std::vector<FloatGateState, AlignedAllocator<FloatGateState> > floatState_;
+      std::vector<State, AlignedAllocator<State> > shadowState_;
+      std::vector<int> shadowBlock_;
+      bool shadowSynced_;
+      int nCalcs_;
 #endif
 
       //BGQ_HACKFIX, compiler bug with zero length arrays
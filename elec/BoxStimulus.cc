@@ -38,8 +38,8 @@ BoxStimulus::BoxStimulus(const BoxStimulusParms& p, const Anatomy& anatomy, Puls
    int myrank;
    int nLocal = stimList.size();						// Local # of box stimulus gids within tissue; the _ at end means this variable only apply to current class, not others (just a naming convention)
    int nGlobal;									// Global # of box stimulus gids within tissue
-   MPI_Comm_rank(MPI_COMM_WORLD, &myrank);					// Get the current rank (process) #
-   MPI_Reduce(&nLocal, &nGlobal, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);	// Add local rank sum to global sum accross all ranks:  [1:  # local gids w/in tissue] [2:  # global gids w/in tissue] [3:  # elements to send from this process] [4:  MPI datatype of each element] [5:  MPI operation to perform] [6:  rank of receiving process w/in communicator] [7:  The MPI communicator]
+   MPI_Comm_rank(p.baseParms.comm, &myrank);					// Get the current rank (process) #
+   MPI_Reduce(&nLocal, &nGlobal, 1, MPI_INT, MPI_SUM, 0, p.baseParms.comm);	// Add local rank sum to global sum accross all ranks:  [1:  # local gids w/in tissue] [2:  # global gids w/in tissue] [3:  # elements to send from this process] [4:  MPI datatype of each element] [5:  MPI operation to perform] [6:  rank of receiving process w/in communicator] [7:  The MPI communicator]
    if (myrank == 0)								// If at root rank (rank 0), print out global # of cells w/in tissue for this box stimulus
    {
    	cout << "# of tissue compute cells within box stimulus \"" << name << "\" = " << nGlobal << " (# cells should be (lx-1)x(ly-1)x(lz-1) b/c of fencepost condition, where lx, ly, and lz are length of box in discrete points in x, y, and z, respectively)" << endl;
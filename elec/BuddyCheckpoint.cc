@@ -0,0 +1,471 @@
+#include "BuddyCheckpoint.hh"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <dirent.h>
+#include <unistd.h>
+#include "Simulate.hh"
+#include "Anatomy.hh"
+#include "ReactionManager.hh"
+#include "Long64.hh"
+#include "ioUtils.h"
+
+using namespace std;
+
+namespace
+{
+   template <class T>
+   void append(vector<char>& buf, const T& value)
+   {
+      const char* p = reinterpret_cast<const char*>(&value);
+      buf.insert(buf.end(), p, p+sizeof(T));
+   }
+
+   void appendString(vector<char>& buf, const string& value)
+   {
+      append(buf, unsigned(value.size()));
+      buf.insert(buf.end(), value.begin(), value.end());
+   }
+
+   class Unpacker
+   {
+    public:
+      Unpacker(const vector<char>& buf) : p_(&buf[0]), end_(&buf[0]+buf.size()) {}
+      bool ok() const {return p_ <= end_;}
+      template <class T> T get()
+      {
+         T value = T();
+         if (p_ + sizeof(T) <= end_)
+            memcpy(&value, p_, sizeof(T));
+         p_ += sizeof(T);
+         return value;
+      }
+      string getString()
+      {
+         unsigned n = get<unsigned>();
+         if (p_ + n > end_)
+         {
+            p_ = end_ + 1;
+            return string();
+         }
+         string value(p_, n);
+         p_ += n;
+         return value;
+      }
+    private:
+      const char* p_;
+      const char* end_;
+   };
+
+   void pack(const Simulate& sim, vector<char>& buf)
+   {
+      const Anatomy& anatomy = sim.anatomy_;
+      int nTasks, myRank;
+      MPI_Comm_size(sim.comm_, &nTasks);
+      MPI_Comm_rank(sim.comm_, &myRank);
+
+      vector<string> fieldNames;
+      vector<string> fieldUnits;
+      sim.reaction_->getCheckpointInfo(fieldNames, fieldUnits);
+      vector<int> handle = sim.reaction_->getVarHandle(fieldNames);
+
+      unsigned nLocal = anatomy.nLocal();
+      buf.clear();
+      buf.reserve(256 + nLocal*8*(2+fieldNames.size()));
+      append(buf, int(sim.loop_));
+      append(buf, sim.time_);
+      append(buf, nTasks);
+      append(buf, myRank);
+      append(buf, nLocal);
+      appendString(buf, sim.reaction_->stateDescription());
+      append(buf, unsigned(fieldNames.size()));
+      for (unsigned ii=0; ii<fieldNames.size(); ++ii)
+         appendString(buf, fieldNames[ii]);
+
+      vector<double> value(handle.size(), 0.0);
+      ro_array_ptr<double> vmarray = sim.vdata_.VmTransport_.useOn(CPU);
+      for (unsigned ii=0; ii<nLocal; ++ii)
+      {
+         append(buf, anatomy.gid(ii));
+         append(buf, vmarray[ii]);
+         sim.reaction_->getValue(ii, handle, value);
+         for (unsigned jj=0; jj<value.size(); ++jj)
+            append(buf, value[jj]);
+      }
+   }
+
+   /** Returns an empty string on success and the reason otherwise. */
+   string unpack(const vector<char>& buf, Simulate& sim)
+   {
+      const Anatomy& anatomy = sim.anatomy_;
+      int nTasks, myRank;
+      MPI_Comm_size(sim.comm_, &nTasks);
+      MPI_Comm_rank(sim.comm_, &myRank);
+
+      Unpacker data(buf);
+      int loop = data.get<int>();
+      double time = data.get<double>();
+      int nTasksFile = data.get<int>();
+      int owner = data.get<int>();
+      unsigned nLocal = data.get<unsigned>();
+      string method = data.getString();
+      unsigned nFields = data.get<unsigned>();
+      vector<string> fieldNames(nFields);
+      for (unsigned ii=0; ii<nFields && data.ok(); ++ii)
+         fieldNames[ii] = data.getString();
+      if (!data.ok())
+         return "truncated header";
+      if (nTasksFile != nTasks || owner != myRank)
+         return "written by a run with a different number of tasks";
+      if (nLocal != anatomy.nLocal())
+         return "different number of local cells";
+      if (method != sim.reaction_->stateDescription())
+         return "different reaction model";
+
+      vector<int> handle(nFields);
+      for (unsigned ii=0; ii<nFields; ++ii)
+         handle[ii] = sim.reaction_->getVarHandle(fieldNames[ii]);
+
+      wo_array_ptr<double> vmarray = sim.vdata_.VmTransport_.useOn(CPU);
+      for (unsigned ii=0; ii<nLocal; ++ii)
+      {
+         Long64 gid = data.get<Long64>();
+         double Vm = data.get<double>();
+         if (gid != anatomy.gid(ii))
+            return "cells are in a different order";
+         vmarray[ii] = Vm;
+         for (unsigned jj=0; jj<nFields; ++jj)
+         {
+            double value = data.get<double>();
+            if (handle[jj] >= 0)
+               sim.reaction_->setValue(ii, handle[jj], value);
+         }
+      }
+      if (!data.ok())
+         return "truncated data";
+
+      sim.loop_ = loop;
+      sim.time_ = time;
+      return "";
+   }
+
+   /** Writes to a temporary file and renames it once the data is
+    *  complete.  Returns false if any step fails. */
+   bool writeFile(const string& name, const vector<char>& buf)
+   {
+      string tmpName = name + ".tmp";
+      FILE* file = fopen(tmpName.c_str(), "w");
+      if (file == 0)
+      {
+         cerr << "BuddyCheckpoint: can't open " << tmpName << endl;
+         return false;
+      }
+      size_t nWritten = fwrite(&buf[0], 1, buf.size(), file);
+      bool ok = (nWritten == buf.size());
+      ok = (fclose(file) == 0) && ok;
+      if (ok && rename(tmpName.c_str(), name.c_str()) == 0)
+         return true;
+      cerr << "BuddyCheckpoint: can't write " << name << endl;
+      unlink(tmpName.c_str());
+      return false;
+   }
+
+   bool readFile(const string& name, vector<char>& buf)
+   {
+      FILE* file = fopen(name.c_str(), "r");
+      if (file == 0)
+         return false;
+      fseek(file, 0, SEEK_END);
+      long size = ftell(file);
+      fseek(file, 0, SEEK_SET);
+      buf.resize(size);
+      size_t nRead = fread(&buf[0], 1, size, file);
+      fclose(file);
+      return nRead == size_t(size);
+   }
+
+   /** Exchanges variable sized buffers.  Every task sends sendBuf to
+    *  each of dest and receives one buffer from each of source. */
+   void exchange(const vector<char>& sendBuf, const vector<int>& dest,
+                 vector<vector<char> >& recvBuf, const vector<int>& source,
+                 MPI_Comm comm)
+   {
+      const int sizeTag = 31;
+      const int dataTag = 32;
+      unsigned sendSize = sendBuf.size();
+      vector<unsigned> recvSize(source.size());
+      vector<MPI_Request> request(source.size() + dest.size());
+      for (unsigned ii=0; ii<source.size(); ++ii)
+         MPI_Irecv(&recvSize[ii], 1, MPI_UNSIGNED, source[ii], sizeTag, comm, &request[ii]);
+      for (unsigned ii=0; ii<dest.size(); ++ii)
+         MPI_Isend(&sendSize, 1, MPI_UNSIGNED, dest[ii], sizeTag, comm, &request[source.size()+ii]);
+      MPI_Waitall(request.size(), &request[0], MPI_STATUSES_IGNORE);
+
+      recvBuf.resize(source.size());
+      for (unsigned ii=0; ii<source.size(); ++ii)
+      {
+         recvBuf[ii].resize(recvSize[ii]);
+         MPI_Irecv(&recvBuf[ii][0], recvSize[ii], MPI_CHAR, source[ii], dataTag, comm, &request[ii]);
+      }
+      for (unsigned ii=0; ii<dest.size(); ++ii)
+         MPI_Isend(const_cast<char*>(&sendBuf[0]), sendSize, MPI_CHAR, dest[ii], dataTag,
+                   comm, &request[source.size()+ii]);
+      MPI_Waitall(request.size(), &request[0], MPI_STATUSES_IGNORE);
+   }
+}
+
+
+/** The partner of the k-th task on a node is the k-th task (modulo the
+ *  task count) on the next node, so the copies of a node are spread
+ *  over one other node. */
+BuddyCheckpoint::BuddyCheckpoint(const string& dirName, const Simulate& sim,
+                                 bool keepFiles)
+: comm_(sim.comm_),
+  dirName_(dirName)
+{
+   MPI_Comm_rank(comm_, &myRank_);
+   MPI_Comm_size(comm_, &nTasks_);
+   MPI_Comm_split_type(comm_, MPI_COMM_TYPE_SHARED, myRank_, MPI_INFO_NULL, &nodeComm_);
+   int nodeRank;
+   MPI_Comm_rank(nodeComm_, &nodeRank);
+
+   prefix_ = dirName_ + "/cardioid." + sim.name_ + ".";
+
+   // Name each node by the lowest rank on it.
+   int nodeLeader = myRank_;
+   MPI_Bcast(&nodeLeader, 1, MPI_INT, 0, nodeComm_);
+   vector<int> leader(nTasks_);
+   MPI_Allgather(&nodeLeader, 1, MPI_INT, &leader[0], 1, MPI_INT, comm_);
+
+   map<int, vector<int> > node;
+   for (int ii=0; ii<nTasks_; ++ii)
+      node[leader[ii]].push_back(ii);
+   vector<vector<int> > member;
+   for (map<int, vector<int> >::const_iterator iter=node.begin(); iter!=node.end(); ++iter)
+      member.push_back(iter->second);
+   int nNodes = member.size();
+
+   vector<int> partner(nTasks_);
+   for (int kk=0; kk<nNodes; ++kk)
+   {
+      const vector<int>& next = member[(kk+1)%nNodes];
+      for (unsigned ll=0; ll<member[kk].size(); ++ll)
+         partner[member[kk][ll]] = next[ll % next.size()];
+   }
+   if (nNodes == 1)
+      for (int ii=0; ii<nTasks_; ++ii)
+         partner[ii] = (ii+1) % nTasks_;
+   partner_ = partner[myRank_];
+   for (int ii=0; ii<nTasks_; ++ii)
+      if (partner[ii] == myRank_ && ii != myRank_)
+         wards_.push_back(ii);
+
+   if (myRank_ == 0 && nNodes == 1)
+      cout << "BuddyCheckpoint: all tasks are on one node.  The memory\n"
+           << "   checkpoints will not survive the loss of the node." << endl;
+
+   if (nodeRank == 0)
+      DirTestCreate(dirName_.c_str());
+   MPI_Barrier(comm_);
+   if (!keepFiles)
+      removeOlderThan(INT_MAX);
+   MPI_Barrier(comm_);
+}
+
+BuddyCheckpoint::~BuddyCheckpoint()
+{
+   MPI_Comm_free(&nodeComm_);
+}
+
+void BuddyCheckpoint::write(const Simulate& sim)
+{
+   vector<char> buf;
+   pack(sim, buf);
+
+   vector<int> dest;
+   if (partner_ != myRank_)
+      dest.push_back(partner_);
+   vector<vector<char> > wardBuf;
+   exchange(buf, dest, wardBuf, wards_, comm_);
+
+   vector<string> written(1, fileName(sim.loop_, myRank_, myRank_));
+   int ok = writeFile(written[0], buf);
+   for (unsigned ii=0; ii<wards_.size(); ++ii)
+   {
+      written.push_back(fileName(sim.loop_, wards_[ii], myRank_));
+      ok = writeFile(written.back(), wardBuf[ii]) && ok;
+   }
+
+   // Once every task holds the new generation the old one can go.
+   // If any write failed the new generation is incomplete, so drop it
+   // and keep the old one instead.
+   int allOk;
+   MPI_Allreduce(&ok, &allOk, 1, MPI_INT, MPI_LAND, comm_);
+   if (allOk)
+   {
+      removeOlderThan(sim.loop_);
+      return;
+   }
+   for (unsigned ii=0; ii<written.size(); ++ii)
+      unlink(written[ii].c_str());
+   if (myRank_ == 0)
+      cout << "BuddyCheckpoint: checkpoint at loop " << sim.loop_
+           << " failed.  Keeping the previous one." << endl;
+}
+
+bool BuddyCheckpoint::restore(Simulate& sim)
+{
+   // Every task reports the (loop, owner) of the files it reads.
+   vector<Entry> entry = listFiles();
+   vector<int> local;
+   for (unsigned ii=0; ii<entry.size(); ++ii)
+   {
+      if (entry[ii].partial)
+         continue;
+      local.push_back(entry[ii].loop);
+      local.push_back(entry[ii].owner);
+   }
+   int nLocal = local.size();
+   vector<int> recvCnt(nTasks_);
+   MPI_Allgather(&nLocal, 1, MPI_INT, &recvCnt[0], 1, MPI_INT, comm_);
+   vector<int> offset(nTasks_+1, 0);
+   for (int ii=0; ii<nTasks_; ++ii)
+      offset[ii+1] = offset[ii] + recvCnt[ii];
+   vector<int> all(offset[nTasks_]+1);
+   MPI_Allgatherv(local.empty() ? 0 : &local[0], nLocal, MPI_INT,
+                  &all[0], &recvCnt[0], &offset[0], MPI_INT, comm_);
+
+   // reader[loop][owner] is the lowest task that can read the copy.
+   map<int, vector<int> > reader;
+   for (int rr=0; rr<nTasks_; ++rr)
+      for (int ii=offset[rr]; ii<offset[rr+1]; ii+=2)
+      {
+         int loop = all[ii];
+         int owner = all[ii+1];
+         if (owner < 0 || owner >= nTasks_)
+            continue;
+         vector<int>& tt = reader[loop];
+         tt.resize(nTasks_, -1);
+         if (tt[owner] < 0)
+            tt[owner] = rr;
+      }
+   int loop = -1;
+   for (map<int, vector<int> >::const_reverse_iterator iter=reader.rbegin();
+        iter!=reader.rend() && loop<0; ++iter)
+      if (count(iter->second.begin(), iter->second.end(), -1) == 0)
+         loop = iter->first;
+   if (loop < 0)
+   {
+      if (myRank_ == 0)
+         cout << "BuddyCheckpoint: no complete memory checkpoint in "
+              << dirName_ << endl;
+      return false;
+   }
+   const vector<int>& source = reader[loop];
+
+   // Readers send each copy they were picked for back to its owner.
+   vector<vector<char> > sendBuf;
+   vector<int> dest;
+   for (unsigned ii=0; ii<entry.size(); ++ii)
+   {
+      int owner = entry[ii].owner;
+      if (entry[ii].partial || entry[ii].loop != loop || owner >= nTasks_ || source[owner] != myRank_
+          || find(dest.begin(), dest.end(), owner) != dest.end())
+         continue;
+      sendBuf.push_back(vector<char>());
+      if (!readFile(entry[ii].name, sendBuf.back()))
+         sendBuf.back().clear();
+      dest.push_back(owner);
+   }
+   vector<vector<char> > recvBuf;
+   vector<MPI_Request> request(2*dest.size());
+   vector<unsigned> sendSize(dest.size());
+   for (unsigned ii=0; ii<dest.size(); ++ii)
+   {
+      sendSize[ii] = sendBuf[ii].size();
+      MPI_Isend(&sendSize[ii], 1, MPI_UNSIGNED, dest[ii], 33, comm_, &request[2*ii]);
+      MPI_Isend(sendBuf[ii].empty() ? 0 : &sendBuf[ii][0], sendSize[ii], MPI_CHAR,
+                dest[ii], 34, comm_, &request[2*ii+1]);
+   }
+   unsigned recvSize;
+   MPI_Recv(&recvSize, 1, MPI_UNSIGNED, source[myRank_], 33, comm_, MPI_STATUS_IGNORE);
+   vector<char> buf(recvSize+1);
+   MPI_Recv(&buf[0], recvSize, MPI_CHAR, source[myRank_], 34, comm_, MPI_STATUS_IGNORE);
+   buf.resize(recvSize);
+   if (!request.empty())
+      MPI_Waitall(request.size(), &request[0], MPI_STATUSES_IGNORE);
+
+   string error = buf.empty() ? string("unreadable file") : unpack(buf, sim);
+   if (!error.empty())
+      cout << "BuddyCheckpoint: task " << myRank_ << " can't use the copy of loop "
+           << loop << " held by task " << source[myRank_] << ": " << error << endl;
+   int ok = error.empty();
+   int allOk;
+   MPI_Allreduce(&ok, &allOk, 1, MPI_INT, MPI_MIN, comm_);
+   if (allOk && myRank_ == 0)
+      cout << "BuddyCheckpoint: restored loop " << loop << " from " << dirName_ << endl;
+   return allOk;
+}
+
+/** The tasks of a node see the same directory.  They share the work by
+ *  taking every nodeSize-th file of the sorted listing. */
+vector<BuddyCheckpoint::Entry> BuddyCheckpoint::listFiles() const
+{
+   int nodeRank, nodeSize;
+   MPI_Comm_rank(nodeComm_, &nodeRank);
+   MPI_Comm_size(nodeComm_, &nodeSize);
+
+   string base = prefix_.substr(dirName_.size()+1);
+   vector<string> name;
+   DIR* dir = opendir(dirName_.c_str());
+   if (dir == 0)
+      return vector<Entry>();
+   while (struct dirent* ent = readdir(dir))
+   {
+      string fname = ent->d_name;
+      if (fname.compare(0, base.size(), base) == 0)
+         name.push_back(fname);
+   }
+   closedir(dir);
+   sort(name.begin(), name.end());
+
+   vector<Entry> entry;
+   for (unsigned ii=nodeRank; ii<name.size(); ii+=nodeSize)
+   {
+      Entry ee;
+      int nChar = 0;
+      const char* suffix = name[ii].c_str() + base.size();
+      if (sscanf(suffix, "%d.%d.%d%n", &ee.loop, &ee.owner, &ee.holder, &nChar) != 3)
+         continue;
+      ee.partial = (strcmp(suffix+nChar, ".tmp") == 0);
+      if (suffix[nChar] != '\0' && !ee.partial)
+         continue;
+      ee.name = dirName_ + "/" + name[ii];
+      entry.push_back(ee);
+   }
+   return entry;
+}
+
+void BuddyCheckpoint::removeOlderThan(int loop) const
+{
+   vector<Entry> entry = listFiles();
+   // Nobody may unlink before all the tasks of the node have listed.
+   MPI_Barrier(nodeComm_);
+   for (unsigned ii=0; ii<entry.size(); ++ii)
+      if (entry[ii].loop < loop)
+         unlink(entry[ii].name.c_str());
+}
+
+string BuddyCheckpoint::fileName(int loop, int owner, int holder) const
+{
+   stringstream name;
+   name << prefix_ << setfill('0') << setw(12) << loop << "." << owner << "." << holder;
+   return name.str();
+}
@@ -0,0 +1,71 @@
+#ifndef BUDDY_CHECKPOINT_HH
+#define BUDDY_CHECKPOINT_HH
+
+#include <string>
+#include <vector>
+#include <mpi.h>
+
+class Simulate;
+
+/** Diskless checkpoints for fast recovery from the loss of a node.
+ *
+ *  Each task stores its Vm and cell model state in a node local
+ *  memory file system (/dev/shm by default) and sends the same data
+ *  to a partner task on a different node, which stores it the same
+ *  way.  Writing a checkpoint costs one pairwise exchange and two
+ *  memory copies, so it can be done much more often than a pio
+ *  checkpoint.
+ *
+ *  To recover, the job is relaunched with the same number of tasks
+ *  and memoryRestart = 1.  The tasks gather the surviving copies,
+ *  pick the latest loop for which every task has at least one copy
+ *  and send each copy back to its owner.  This works as long as no
+ *  task loses its node together with its partner.
+ *
+ *  The files are named <prefix><loop>.<owner>.<holder>.  After every
+ *  task has written a new checkpoint successfully the older ones are
+ *  removed, so at any time there is one complete generation on the
+ *  nodes.
+ */
+class BuddyCheckpoint
+{
+ public:
+   BuddyCheckpoint(const std::string& dirName, const Simulate& sim,
+                   bool keepFiles);
+   ~BuddyCheckpoint();
+
+   /** Collective on the simulation communicator.  The previous
+    *  checkpoint is removed only if every task wrote all of its
+    *  files; otherwise the new one is discarded. */
+   void write(const Simulate& sim);
+
+   /** Loads the latest complete checkpoint and sets loop_ and time_.
+    *  Returns false on every task if no complete checkpoint exists.
+    *  Collective. */
+   bool restore(Simulate& sim);
+
+ private:
+   struct Entry
+   {
+      int loop;
+      int owner;
+      int holder;
+      bool partial; // left over from an interrupted write
+      std::string name;
+   };
+
+   std::vector<Entry> listFiles() const;
+   void removeOlderThan(int loop) const;
+   std::string fileName(int loop, int owner, int holder) const;
+
+   MPI_Comm comm_;
+   MPI_Comm nodeComm_;
+   int myRank_;
+   int nTasks_;
+   int partner_;            // receives a copy of my data
+   std::vector<int> wards_; // tasks that send me a copy of their data
+   std::string dirName_;
+   std::string prefix_;
+};
+
+#endif
@@ -0,0 +1,272 @@
+#include "BulkMemory.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "ddcMalloc.h"
+
+using namespace std;
+
+namespace
+{
+   const size_t hugePageBytes = 2*1024*1024;
+   const int maxNumaNodes = 64;
+   const int maxSamplesPerBlock = 4096;
+
+   struct Block
+   {
+      size_t bytes;
+      size_t mappedBytes; // 0 unless the block came from mmap
+      int tag;
+   };
+
+   BulkMemory::Pages g_pages = BulkMemory::normalPages;
+   bool g_firstTouch = true;
+   int g_explicitFailures = 0;
+
+   mutex g_mutex;
+   map<void*, Block> g_blocks;
+
+   size_t roundUp(size_t bytes, size_t unit)
+   {
+      return (bytes + unit - 1)/unit*unit;
+   }
+
+   void* hugeMap(size_t bytes)
+   {
+#ifdef MAP_HUGETLB
+      void* ptr = mmap(NULL, bytes, PROT_READ|PROT_WRITE,
+                       MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+      if (ptr != MAP_FAILED)
+         return ptr;
+#endif
+      return NULL;
+   }
+
+   /** Writes one byte in each page, split over all OpenMP threads with
+    *  a static schedule.  See BulkMemory.hh for what this does and does
+    *  not guarantee about placement. */
+   void touch(void* ptr, size_t bytes, size_t pageBytes)
+   {
+      char* base = (char*) ptr;
+      long nPages = (bytes + pageBytes - 1)/pageBytes;
+      #pragma omp parallel for schedule(static)
+      for (long ii=0; ii<nPages; ++ii)
+         base[ii*pageBytes] = 0;
+   }
+
+   /** Node of every sampled page of the block, through move_pages with
+    *  no target nodes.  Pages that are not resident yet are skipped. */
+   void sampleNodes(void* ptr, const Block& block, size_t pageBytes,
+                    vector<double>& bytesOnNode)
+   {
+      long nPages = (block.bytes + pageBytes - 1)/pageBytes;
+      long stride = max(1L, nPages/maxSamplesPerBlock);
+      vector<void*> pages;
+      for (long ii=0; ii<nPages; ii+=stride)
+         pages.push_back((char*)ptr + ii*pageBytes);
+      vector<int> status(pages.size(), -1);
+#ifdef SYS_move_pages
+      if (syscall(SYS_move_pages, 0, pages.size(), &pages[0], NULL, &status[0], 0) != 0)
+         return;
+#else
+      return;
+#endif
+      double weight = double(block.bytes)/pages.size();
+      for (unsigned ii=0; ii<status.size(); ++ii)
+         if (status[ii] >= 0 && status[ii] < maxNumaNodes)
+            bytesOnNode[status[ii]] += weight;
+   }
+
+   double anonHugeBytes()
+   {
+      ifstream in("/proc/self/smaps_rollup");
+      string key;
+      double kB;
+      while (in >> key)
+      {
+         if (key == "AnonHugePages:" && in >> kB)
+            return kB*1024;
+         in.ignore(1024, '\n');
+      }
+      return 0;
+   }
+}
+
+namespace BulkMemory
+{
+
+void setPolicy(Pages pages, bool firstTouch)
+{
+   g_pages = pages;
+   g_firstTouch = firstTouch;
+}
+
+bool parsePages(const string& name, Pages& pages)
+{
+   if (name == "none")
+      pages = normalPages;
+   else if (name == "transparent")
+      pages = transparentHugePages;
+   else if (name == "explicit")
+      pages = explicitHugePages;
+   else
+      return false;
+   return true;
+}
+
+void* allocate(size_t bytes, size_t alignment)
+{
+   void* ptr = NULL;
+   if (bytes < bulkBytes)
+   {
+      if (posix_memalign(&ptr, alignment, bytes) != 0)
+         return NULL;
+      return ptr;
+   }
+
+   Block block;
+   block.bytes = bytes;
+   block.mappedBytes = 0;
+   block.tag = ddcMemGetTag();
+
+   size_t pageBytes = sysconf(_SC_PAGESIZE);
+   if (g_pages == explicitHugePages)
+   {
+      size_t mapped = roundUp(bytes, hugePageBytes);
+      ptr = hugeMap(mapped);
+      if (ptr)
+      {
+         block.mappedBytes = mapped;
+         pageBytes = hugePageBytes;
+      }
+      else
+      {
+         lock_guard<mutex> lock(g_mutex);
+         ++g_explicitFailures;
+      }
+   }
+   if (!ptr)
+   {
+      if (g_pages == normalPages)
+      {
+         if (posix_memalign(&ptr, alignment, bytes) != 0)
+            return NULL;
+      }
+      else
+      {
+         if (posix_memalign(&ptr, max(alignment, hugePageBytes), bytes) != 0)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+         madvise(ptr, roundUp(bytes, hugePageBytes), MADV_HUGEPAGE);
+#endif
+         pageBytes = hugePageBytes;
+      }
+   }
+
+   if (g_firstTouch)
+      touch(ptr, bytes, pageBytes);
+
+   lock_guard<mutex> lock(g_mutex);
+   g_blocks[ptr] = block;
+   return ptr;
+}
+
+void release(void* ptr)
+{
+   if (!ptr)
+      return;
+   size_t mappedBytes = 0;
+   {
+      lock_guard<mutex> lock(g_mutex);
+      map<void*, Block>::iterator here = g_blocks.find(ptr);
+      if (here != g_blocks.end())
+      {
+         mappedBytes = here->second.mappedBytes;
+         g_blocks.erase(here);
+      }
+   }
+   if (mappedBytes > 0)
+      munmap(ptr, mappedBytes);
+   else
+      free(ptr);
+}
+
+/** The node of a page is only known once it has been touched, so
+ *  this is meant to be called after the first time step or at least
+ *  after initialization. */
+void reportPlacement(MPI_Comm comm)
+{
+   const int nCols = maxNumaNodes + 1; // last column counts hugepages
+   vector<double> local(DDCMEM_NTAGS*nCols + 2, 0.0);
+   size_t smallPage = sysconf(_SC_PAGESIZE);
+   {
+      lock_guard<mutex> lock(g_mutex);
+      for (map<void*, Block>::const_iterator here=g_blocks.begin();
+           here!=g_blocks.end(); ++here)
+      {
+         const Block& block = here->second;
+         vector<double> onNode(maxNumaNodes, 0.0);
+         sampleNodes(here->first, block, smallPage, onNode);
+         double* row = &local[block.tag*nCols];
+         for (int ii=0; ii<maxNumaNodes; ++ii)
+            row[ii] += onNode[ii];
+         if (block.mappedBytes > 0)
+            row[maxNumaNodes] += block.bytes;
+      }
+      local[DDCMEM_NTAGS*nCols] = g_explicitFailures;
+   }
+   local[DDCMEM_NTAGS*nCols+1] = anonHugeBytes();
+
+   int myRank;
+   MPI_Comm_rank(comm, &myRank);
+   vector<double> sum(local.size());
+   MPI_Reduce(&local[0], &sum[0], local.size(), MPI_DOUBLE, MPI_SUM, 0, comm);
+   if (myRank != 0)
+      return;
+
+   int nNodes = 0;
+   for (int tag=0; tag<DDCMEM_NTAGS; ++tag)
+      for (int ii=0; ii<maxNumaNodes; ++ii)
+         if (sum[tag*nCols+ii] > 0)
+            nNodes = max(nNodes, ii+1);
+
+   const double b2mb = 1024.0*1024.0;
+   const char* pageName[] = {"none", "transparent", "explicit"};
+   printf("Bulk memory placement (MB summed over tasks, hugePages = %s, firstTouch = %d):\n",
+          pageName[g_pages], int(g_firstTouch));
+   printf("   tag       ");
+   for (int ii=0; ii<nNodes; ++ii)
+      printf("   node %-3d", ii);
+   printf("   hugetlb\n");
+   for (int tag=0; tag<DDCMEM_NTAGS; ++tag)
+   {
+      const double* row = &sum[tag*nCols];
+      double total = row[maxNumaNodes];
+      for (int ii=0; ii<nNodes; ++ii)
+         total += row[ii];
+      if (total == 0)
+         continue;
+      printf("   %-10s", ddcMemTagName(tag));
+      for (int ii=0; ii<nNodes; ++ii)
+         printf(" %10.2f", row[ii]/b2mb);
+      printf(" %9.2f\n", row[maxNumaNodes]/b2mb);
+   }
+   printf("   transparent hugepages in use: %.2f MB\n", sum[DDCMEM_NTAGS*nCols+1]/b2mb);
+   if (sum[DDCMEM_NTAGS*nCols] > 0)
+      printf("   %d explicit hugepage allocations fell back to transparent hugepages\n",
+             int(sum[DDCMEM_NTAGS*nCols]));
+   fflush(stdout);
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef BULK_MEMORY_HH
+#define BULK_MEMORY_HH
+
+#include <cstddef>
+#include <string>
+#include <mpi.h>
+
+/** Allocation of the large host arrays: Vm and dVm (lazy_array), the
+ *  diffusion weights (Array3d) and the reaction state (vectors with
+ *  AlignedAllocator) all come through here.
+ *
+ *  Blocks of at least bulkBytes can be
+ *   - backed by transparent hugepages (2 MB aligned and madvised) or by
+ *     explicit hugepages from the hugetlbfs pool.  If the pool is
+ *     empty the block falls back to transparent hugepages.
+ *   - touched in parallel before they are handed out.  The pages are
+ *     split evenly over all OpenMP threads with a static schedule, so
+ *     they are spread over the NUMA domains instead of all landing on
+ *     the domain of the master thread that allocates and initializes
+ *     the array.  A page only ends up next to the thread that works
+ *     on it when the work is split the same way, as in a
+ *     "#pragma omp parallel for schedule(static)" over the whole
+ *     array.  The reaction and diffusion thread teams of the
+ *     simulation loops use their own partitions (mkOffsets), which do
+ *     not match this split in general.
+ *
+ *  Smaller blocks are plain aligned allocations.  The policy only
+ *  affects blocks allocated after it is set. */
+namespace BulkMemory
+{
+   enum Pages {normalPages, transparentHugePages, explicitHugePages};
+
+   const std::size_t bulkBytes = 2*1024*1024;
+
+   void setPolicy(Pages pages, bool firstTouch);
+   /** Parses none, transparent or explicit.  Returns false otherwise. */
+   bool parsePages(const std::string& name, Pages& pages);
+
+   void* allocate(std::size_t bytes, std::size_t alignment);
+   void release(void* ptr);
+
+   /** Prints (on rank 0 of comm) how many MB of the bulk blocks of each
+    *  ddcMem tag are on each NUMA node, summed over the tasks, and how
+    *  much of the process memory is on hugepages. */
+   void reportPlacement(MPI_Comm comm);
+}
+
+#endif
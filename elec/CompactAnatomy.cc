@@ -0,0 +1,282 @@
+#include "CompactAnatomy.hh"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include "Anatomy.hh"
+#include "AnatomyCell.hh"
+#include "mpiUtils.h"
+
+using namespace std;
+
+namespace
+{
+   const char magic[8] = {'C', 'A', 'R', 'D', 'A', 'N', 'A', '1'};
+   const unsigned endianKey = 0x01020304;
+   const MPI_Offset headerSize = 64;
+
+   struct Offsets
+   {
+      Offsets(const CompactAnatomy::Header& h)
+      {
+         runStart = headerSize;
+         runLength = runStart + h.nRuns*sizeof(Long64);
+         cellType = runLength + h.nRuns*sizeof(unsigned);
+         fibre = cellType + h.nCells;
+      }
+      MPI_Offset runStart;
+      MPI_Offset runLength;
+      MPI_Offset cellType;
+      MPI_Offset fibre;
+   };
+
+   // The MPI-IO counts are ints.  Sections are moved as blocks of
+   // ioBlockBytes plus a remainder of bytes.  Both calls are made on
+   // every task, so the collectives match whatever the local sizes.
+   const int ioBlockBytes = 1<<20;
+
+   MPI_Datatype ioBlockType()
+   {
+      static MPI_Datatype type = MPI_DATATYPE_NULL;
+      if (type == MPI_DATATYPE_NULL)
+      {
+         MPI_Type_contiguous(ioBlockBytes, MPI_BYTE, &type);
+         MPI_Type_commit(&type);
+      }
+      return type;
+   }
+
+   void readAt(MPI_File file, MPI_Offset offset, void* buf, Long64 nBytes)
+   {
+      Long64 nBlocks = nBytes/ioBlockBytes;
+      Long64 nHead = nBlocks*ioBlockBytes;
+      MPI_File_read_at_all(file, offset, buf, int(nBlocks), ioBlockType(),
+                           MPI_STATUS_IGNORE);
+      MPI_File_read_at_all(file, offset+nHead, (char*)buf+nHead, int(nBytes-nHead),
+                           MPI_BYTE, MPI_STATUS_IGNORE);
+   }
+
+   void writeAt(MPI_File file, MPI_Offset offset, const void* buf, Long64 nBytes)
+   {
+      Long64 nBlocks = nBytes/ioBlockBytes;
+      Long64 nHead = nBlocks*ioBlockBytes;
+      char* data = (char*) const_cast<void*>(buf);
+      MPI_File_write_at_all(file, offset, data, int(nBlocks), ioBlockType(),
+                            MPI_STATUS_IGNORE);
+      MPI_File_write_at_all(file, offset+nHead, data+nHead, int(nBytes-nHead),
+                            MPI_BYTE, MPI_STATUS_IGNORE);
+   }
+
+   void badFile(const string& filename, const string& reason)
+   {
+      if (getRank(0) == 0)
+         cout << "Fatal Error: " << filename << " is not a usable compact anatomy file ("
+              << reason << ")." << endl;
+      abortAll(1);
+   }
+
+   void readFile(const string& filename, MPI_Comm comm, Anatomy& anatomy,
+                 CompactAnatomy::FibreData& fibre)
+   {
+      int myRank, nTasks;
+      MPI_Comm_rank(comm, &myRank);
+      MPI_Comm_size(comm, &nTasks);
+
+      MPI_File file;
+      if (MPI_File_open(comm, const_cast<char*>(filename.c_str()), MPI_MODE_RDONLY,
+                        MPI_INFO_NULL, &file) != MPI_SUCCESS)
+         badFile(filename, "can't open");
+
+      CompactAnatomy::Header header;
+      readAt(file, 0, &header, sizeof(header));
+      if (memcmp(header.magic, magic, sizeof(magic)) != 0)
+         badFile(filename, "bad magic number");
+      if (header.endianKey != endianKey)
+         badFile(filename, "written on a machine with the other byte order");
+      Offsets offset(header);
+
+      anatomy.setGridSize(header.nx, header.ny, header.nz);
+      fibre.fibreType = header.fibreType;
+
+      Long64 runBegin = header.nRuns*myRank/nTasks;
+      Long64 runEnd = header.nRuns*(myRank+1)/nTasks;
+      Long64 nRuns = runEnd - runBegin;
+      vector<Long64> runStart(nRuns+1);
+      vector<unsigned> runLength(nRuns+1);
+      readAt(file, offset.runStart + runBegin*sizeof(Long64), &runStart[0], nRuns*sizeof(Long64));
+      readAt(file, offset.runLength + runBegin*sizeof(unsigned), &runLength[0], nRuns*sizeof(unsigned));
+
+      Long64 nLocal = 0;
+      for (Long64 ii=0; ii<nRuns; ++ii)
+         nLocal += runLength[ii];
+      Long64 cellBegin = 0;
+      MPI_Exscan(&nLocal, &cellBegin, 1, MPI_UINT64_T, MPI_SUM, comm);
+      if (myRank == 0)
+         cellBegin = 0;
+
+      vector<unsigned char> cellType(nLocal+1);
+      readAt(file, offset.cellType + cellBegin, &cellType[0], nLocal);
+
+      vector<unsigned short> angle;
+      vector<float> tensor;
+      switch (header.fibreType)
+      {
+        case CompactAnatomy::noFibre:
+         break;
+        case CompactAnatomy::angles:
+         angle.resize(2*nLocal+1);
+         readAt(file, offset.fibre + 2*cellBegin*sizeof(unsigned short),
+                &angle[0], 2*nLocal*sizeof(unsigned short));
+         break;
+        case CompactAnatomy::tensor:
+         tensor.resize(6*nLocal+1);
+         readAt(file, offset.fibre + 6*cellBegin*sizeof(float),
+                &tensor[0], 6*nLocal*sizeof(float));
+         break;
+        default:
+         badFile(filename, "unknown fibre type");
+      }
+      MPI_File_close(&file);
+
+      vector<AnatomyCell>& cells = anatomy.cellArray();
+      cells.reserve(cells.size() + nLocal);
+      if (!angle.empty())
+      {
+         fibre.theta.reserve(nLocal);
+         fibre.phi.reserve(nLocal);
+      }
+      Long64 iCell = 0;
+      for (Long64 ii=0; ii<nRuns; ++ii)
+         for (unsigned jj=0; jj<runLength[ii]; ++jj, ++iCell)
+         {
+            AnatomyCell tmp;
+            tmp.gid_ = runStart[ii] + jj;
+            tmp.cellType_ = cellType[iCell];
+            if (!tensor.empty())
+            {
+               const float* ss = &tensor[6*iCell];
+               tmp.sigma_.a11 = ss[0];
+               tmp.sigma_.a12 = ss[1];
+               tmp.sigma_.a13 = ss[2];
+               tmp.sigma_.a22 = ss[3];
+               tmp.sigma_.a23 = ss[4];
+               tmp.sigma_.a33 = ss[5];
+            }
+            if (!angle.empty())
+            {
+               fibre.theta.push_back(angle[2*iCell]*CompactAnatomy::angleScale);
+               fibre.phi.push_back(angle[2*iCell+1]*CompactAnatomy::angleScale);
+            }
+            cells.push_back(tmp);
+         }
+   }
+
+   template <class T>
+   void bcastVector(vector<T>& data, MPI_Comm peers)
+   {
+      unsigned long size = data.size();
+      MPI_Bcast(&size, 1, MPI_UNSIGNED_LONG, 0, peers);
+      data.resize(size);
+      if (size > 0)
+         MPI_Bcast(&data[0], size*sizeof(T), MPI_BYTE, 0, peers);
+   }
+}
+
+namespace CompactAnatomy
+{
+   void read(const string& filename, MPI_Comm comm, Anatomy& anatomy,
+             FibreData& fibre, MPI_Comm peers)
+   {
+      int peerRank = 0;
+      if (peers != MPI_COMM_NULL)
+         MPI_Comm_rank(peers, &peerRank);
+
+      if (peerRank == 0)
+         readFile(filename, comm, anatomy, fibre);
+
+      if (peers != MPI_COMM_NULL)
+      {
+         int data[4] = {int(anatomy.nx()), int(anatomy.ny()), int(anatomy.nz()), fibre.fibreType};
+         MPI_Bcast(data, 4, MPI_INT, 0, peers);
+         anatomy.setGridSize(data[0], data[1], data[2]);
+         fibre.fibreType = data[3];
+         bcastVector(anatomy.cellArray(), peers);
+         bcastVector(fibre.theta, peers);
+         bcastVector(fibre.phi, peers);
+      }
+   }
+
+   void write(const string& filename, int nx, int ny, int nz, int fibreType,
+              const vector<Long64>& gid,
+              const vector<unsigned char>& cellType,
+              const vector<unsigned short>& angle,
+              const vector<float>& tensor,
+              MPI_Comm comm)
+   {
+      int myRank;
+      MPI_Comm_rank(comm, &myRank);
+
+      vector<Long64> runStart;
+      vector<unsigned> runLength;
+      for (unsigned ii=0; ii<gid.size(); ++ii)
+      {
+         if (ii == 0 || gid[ii] != gid[ii-1]+1 || gid[ii] % nx == 0)
+         {
+            runStart.push_back(gid[ii]);
+            runLength.push_back(0);
+         }
+         ++runLength.back();
+      }
+
+      Long64 local[2] = {runStart.size(), gid.size()};
+      Long64 begin[2] = {0, 0};
+      Long64 total[2];
+      MPI_Exscan(local, begin, 2, MPI_UINT64_T, MPI_SUM, comm);
+      if (myRank == 0)
+         begin[0] = begin[1] = 0;
+      MPI_Allreduce(local, total, 2, MPI_UINT64_T, MPI_SUM, comm);
+
+      Header header;
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, magic, sizeof(magic));
+      header.endianKey = endianKey;
+      header.nx = nx;
+      header.ny = ny;
+      header.nz = nz;
+      header.fibreType = fibreType;
+      header.nRuns = total[0];
+      header.nCells = total[1];
+      Offsets offset(header);
+
+      MPI_File file;
+      if (myRank == 0)
+         MPI_File_delete(const_cast<char*>(filename.c_str()), MPI_INFO_NULL);
+      MPI_Barrier(comm);
+      if (MPI_File_open(comm, const_cast<char*>(filename.c_str()),
+                        MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+      {
+         if (myRank == 0)
+            cout << "Fatal Error: can't open " << filename
+                 << " to write the compact anatomy." << endl;
+         abortAll(1);
+      }
+
+      assert(sizeof(header) <= headerSize);
+      char headerBuf[headerSize];
+      memset(headerBuf, 0, headerSize);
+      memcpy(headerBuf, &header, sizeof(header));
+      writeAt(file, 0, headerBuf, myRank == 0 ? headerSize : 0);
+      writeAt(file, offset.runStart + begin[0]*sizeof(Long64),
+              runStart.data(), local[0]*sizeof(Long64));
+      writeAt(file, offset.runLength + begin[0]*sizeof(unsigned),
+              runLength.data(), local[0]*sizeof(unsigned));
+      writeAt(file, offset.cellType + begin[1], cellType.data(), local[1]);
+      if (fibreType == CompactAnatomy::angles)
+         writeAt(file, offset.fibre + 2*begin[1]*sizeof(unsigned short),
+                 angle.data(), 2*local[1]*sizeof(unsigned short));
+      if (fibreType == CompactAnatomy::tensor)
+         writeAt(file, offset.fibre + 6*begin[1]*sizeof(float),
+                 tensor.data(), 6*local[1]*sizeof(float));
+      MPI_File_close(&file);
+   }
+}
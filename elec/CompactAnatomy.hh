@@ -0,0 +1,87 @@
+#ifndef COMPACT_ANATOMY_HH
+#define COMPACT_ANATOMY_HH
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <mpi.h>
+#include "Long64.hh"
+
+class Anatomy;
+
+/** Compact binary anatomy files.
+ *
+ *  A pio anatomy file spends a 64-bit gid, a cellType and either six
+ *  sigma doubles or two angles on every cell, usually as ascii.  Since
+ *  the cells of a heart fill long runs of the grid, the compact format
+ *  stores
+ *
+ *   - the gids as runs of consecutive gids along x (a run never
+ *     crosses the end of a grid row),
+ *   - the cellType as one byte per cell,
+ *   - the fibre angles theta and phi as 16-bit integers, angle =
+ *     q*2pi/65536, or the conductivity tensor as six floats in
+ *     internal units.
+ *
+ *  Layout: a 64 byte header (CompactAnatomyHeader), the start gid of
+ *  every run (Long64), the length of every run (uint32), the cellType
+ *  of every cell, then the fibre data of every cell.  The cells are in
+ *  gid order.  All integers are in the byte order of the writer and
+ *  the header holds a key to detect a mismatch.
+ *
+ *  convertAnatomy makes compact files from pio anatomy files.
+ */
+namespace CompactAnatomy
+{
+   enum FibreType {noFibre = 0, angles = 1, tensor = 2};
+
+   const double angleScale = 6.283185307179586476925286766559/65536;
+
+   struct Header
+   {
+      char magic[8];
+      unsigned endianKey;
+      int nx, ny, nz;
+      int fibreType;
+      Long64 nCells;
+      Long64 nRuns;
+   };
+
+   inline unsigned short quantizeAngle(double angle)
+   {
+      double q = angle/angleScale;
+      q -= 65536*floor(q/65536);
+      return (unsigned short)((unsigned long)(q+0.5) & 0xffff);
+   }
+
+   /** Fibre angles decoded from a compact file, indexed like the cells.
+    *  They are empty unless fibreType is angles. */
+   struct FibreData
+   {
+      int fibreType;
+      std::vector<double> theta;
+      std::vector<double> phi;
+   };
+
+   /** Reads filename in parallel and appends the cells of this task to
+    *  anatomy.  Every task reads a contiguous range of runs.  Tensors
+    *  go straight to AnatomyCell::sigma_, angles to fibre.
+    *
+    *  If peers is not MPI_COMM_NULL only the tasks with rank 0 in peers
+    *  read the file and they broadcast the result (as in readAnatomy). */
+   void read(const std::string& filename, MPI_Comm comm, Anatomy& anatomy,
+             FibreData& fibre, MPI_Comm peers = MPI_COMM_NULL);
+
+   /** Collective.  Each task passes its cells sorted by gid, and all
+    *  the gids of task r must be smaller than those of task r+1.
+    *  angle holds theta, phi pairs and tensor holds sigma11, sigma12,
+    *  sigma13, sigma22, sigma23, sigma33 for every cell. */
+   void write(const std::string& filename, int nx, int ny, int nz, int fibreType,
+              const std::vector<Long64>& gid,
+              const std::vector<unsigned char>& cellType,
+              const std::vector<unsigned short>& angle,
+              const std::vector<float>& tensor,
+              MPI_Comm comm);
+}
+
+#endif
@@ -9,7 +9,6 @@ DVThreshSensor::DVThreshSensor(const SensorParms& sp,
    vdata_(vdata),
    comm_(comm)
 {
-   MPI_Comm comm_ = MPI_COMM_WORLD;
    MPI_Comm_rank(comm_, &myRank_);
    nlocal_=anatomy.nLocal();
    threshold_ = sp.value;
@@ -3,6 +3,8 @@
 
 #include "lazy_array.hh"
 
+namespace FGRUtils { struct Stencil; }
+
 /**
  *  We have managed to do something exceptionally stupid in this class.
  *  The behavior of the calc function depends on the context from which
@@ -25,6 +27,16 @@ class Diffusion
    virtual void updateRemoteVoltage(ro_mgarray_ptr<double> VmRemote) = 0;
    virtual void calc(rw_mgarray_ptr<double> dVm) = 0;
    virtual void calc_overlap(rw_mgarray_ptr<double> dVm) {};
+   /** Versions of updateLocalVoltage and calc that only touch the
+    *  local cells in [begin, end).  They are used by the task graph
+    *  loop, so calcRange sets dVm just like calc does for the omp loop.
+    *  Classes that implement them return true from hasRangeCalc. */
+   virtual bool hasRangeCalc() const {return false;}
+   virtual void updateLocalVoltageRange(ro_mgarray_ptr<double> VmLocal, int begin, int end) {};
+   virtual void calcRange(rw_mgarray_ptr<double> dVm, int begin, int end) {};
+   /** Classes whose calc is a plain 19 point stencil can describe it
+    *  for loops that fuse it with the other phases of a step. */
+   virtual bool getStencil(FGRUtils::Stencil& stencil) const {return false;}
    virtual unsigned* blockIndex(){return 0;}
    virtual double* VmBlock(){return 0;}
    virtual double* dVmBlock(){return 0;}
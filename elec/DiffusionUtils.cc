@@ -3,6 +3,7 @@
 #include "LocalGrid.hh"
 #include "Tuple.hh"
 #include <mpi.h>
+#include "mpiUtils.h"
 #include <algorithm>
 #include <iostream>
 
@@ -20,7 +21,7 @@ LocalGrid DiffusionUtils::findBoundingBox(const Anatomy& anatomy, bool verbose)
 {
    // needed for verbose output
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   myRank = getRank(0);
    
    //assert(anatomy.nLocal() > 0);
    if (anatomy.nLocal() > 0)
@@ -69,7 +70,7 @@ LocalGrid DiffusionUtils::findBoundingBox_simd(const Anatomy& anatomy, bool verb
 {
    // needed for verbose output
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   myRank = getRank(0);
 
    //assert(anatomy.nLocal() > 0);
    if (anatomy.nLocal() > 0)
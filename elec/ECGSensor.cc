@@ -3,19 +3,25 @@
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <algorithm>
 
 #include "pio.h"
 #include "ioUtils.h"
 #include "Simulate.hh"
 #include "PerformanceTimers.hh"
 #include "PioHeaderData.hh"
+#include "ECGTreecode.hh"
+#include "ReproducibleSum.hh"
+#ifdef USE_CUDA
 #include <cuda.h>
 #include <cuda_runtime_api.h>
 
 #define CUDA_VERIFY(x) do { cudaError_t error = x; if (error != cudaSuccess) { cout << error << endl; assert(error == cudaSuccess && #x ); } } while(0)
+#endif
 
 using namespace std;
 using PerformanceTimers::sensorEvalTimer;
+using PerformanceTimers::reproducibleSumTimer;
 
 ECGSensor::ECGSensor(const SensorParms& sp,
                      const ECGSensorParms& p,
@@ -27,16 +33,41 @@ ECGSensor::ECGSensor(const SensorParms& sp,
   ecgNames(p.ecgNames),
   filename_(p.filename),
   nEval_(0),
-  dVmDiffusionTransport_(sim.vdata_.dVmDiffusionTransport_)
+  dVmDiffusionTransport_(sim.vdata_.dVmDiffusionTransport_),
+  treecode_(0)
 {
-    kECG=p.kconst;
+    const Anatomy& anatomy = sim.anatomy_;
+    kECG=p.kconst*anatomy.dx()*anatomy.dy()*anatomy.dz();
     const int dim=3;
     nEcgPoints=p.ecgPoints.size()/dim;
     std::vector<double> ecgPoints(p.ecgPoints);
     ecgPointTransport_.resize(ecgPoints.size());
     auto ecgPointAccess = ecgPointTransport_.writeonly(CPU);
     copy(ecgPoints.begin(), ecgPoints.end(), ecgPointAccess.begin());
-    calcInvR(sim);
+    maxTerms_ = anatomy.nGlobal();
+    invrMax_ = 0;
+    // The treecode groups the cells of each task, so its sums depend
+    // on the decomposition.
+    if (p.theta > 0 && ReproducibleSum::enabled())
+    {
+       int myRank;
+       MPI_Comm_rank(comm(), &myRank);
+       if (myRank == 0)
+          cout << "ECG sensor " << filename_ << ": reproducibleSums is set, "
+               << "using exact sums instead of the treecode" << endl;
+    }
+    if (p.theta > 0 && !ReproducibleSum::enabled())
+       buildTreecode(sim, p);
+    else
+       calcInvR(sim);
+    if (ReproducibleSum::enabled())
+    {
+       auto invr = invrTransport_.readonly(CPU);
+       double localMax = 0;
+       for (unsigned ii=0; ii<invr.size(); ++ii)
+          localMax = max(localMax, invr[ii]);
+       invrMax_ = ReproducibleSum::globalBound(localMax, comm());
+    }
    
     std::vector<double> ecgs(nEcgPoints, 0);
     ecgsTransport_.resize(ecgs.size());
@@ -44,9 +75,43 @@ ECGSensor::ECGSensor(const SensorParms& sp,
     copy(ecgs.begin(), ecgs.end(), ecgAccess.begin());
 }
 
+ECGSensor::~ECGSensor()
+{
+   delete treecode_;
+}
+
+void ECGSensor::buildTreecode(const Simulate& sim, const ECGSensorParms& p)
+{
+   const Anatomy& anatomy = sim.anatomy_;
+   unsigned nLocal = anatomy.nLocal();
+   vector<Vector> cells(nLocal);
+   for (unsigned ii=0; ii<nLocal; ++ii)
+   {
+      Tuple tt = anatomy.globalTuple(ii);
+      cells[ii] = Vector(tt.x()*anatomy.dx(), tt.y()*anatomy.dy(), tt.z()*anatomy.dz());
+   }
+   vector<Vector> electrodes(nEcgPoints);
+   for (int jj=0; jj<nEcgPoints; ++jj)
+      electrodes[jj] = Vector(p.ecgPoints[3*jj], p.ecgPoints[3*jj+1], p.ecgPoints[3*jj+2]);
+
+   treecode_ = new ECGTreecode(cells, electrodes, p.theta, p.leafSize);
+
+   double terms[3] = {double(treecode_->nFarPairs()),
+                      double(treecode_->nNearPairs()),
+                      double(nLocal)*nEcgPoints};
+   double sum[3];
+   MPI_Reduce(terms, sum, 3, MPI_DOUBLE, MPI_SUM, 0, comm());
+   int myRank;
+   MPI_Comm_rank(comm(), &myRank);
+   if (myRank == 0)
+      cout << "ECG sensor " << filename_ << ": treecode with theta = " << p.theta
+           << ", " << sum[0] << " far field and " << sum[1]
+           << " exact terms per evaluation (dense: " << sum[2] << ")" << endl;
+}
+
 void ECGSensor::calcInvR(const Simulate& sim)
 {
-    Anatomy anatomy=sim.anatomy_;
+    const Anatomy& anatomy=sim.anatomy_;
     unsigned nlocal=anatomy.nLocal();
     int nx=anatomy.nx();
     int ny=anatomy.ny();
@@ -56,8 +121,6 @@ void ECGSensor::calcInvR(const Simulate& sim)
     double dy=anatomy.dy();
     double dz=anatomy.dz();
 
-    kECG=kECG*dx*dy*dz;
-
     lazy_array<Long64>  gidsTransport_;
     gidsTransport_.resize(nlocal);
     auto gridAccess = gidsTransport_.writeonly(CPU);
@@ -65,8 +128,8 @@ void ECGSensor::calcInvR(const Simulate& sim)
         gridAccess[ii]=anatomy.gid(ii);
     }
     
-    std::vector<double> invr(nlocal*nSensorPoints_,0.0);
     invrTransport_.resize(nlocal*nSensorPoints_);
+#ifdef USE_CUDA
     auto invrAccess=invrTransport_.writeonly(GPU);
     CUDA_VERIFY(cudaMemset(invrAccess.raw(), 0, sizeof(double)*invrAccess.size()));
     
@@ -76,10 +139,26 @@ void ECGSensor::calcInvR(const Simulate& sim)
                  nEcgPoints,
                  nx, ny, nz,
                  dx, dy, dz);
+#else
+    auto invrAccess=invrTransport_.writeonly(CPU);
+    auto ecgPoints=ecgPointTransport_.readonly(CPU);
+    for(unsigned ii=0; ii<nlocal; ++ii){
+        Long64 gid=anatomy.gid(ii);
+        double xcoor=(gid%nx)*dx;
+        double ycoor=((gid/nx)%ny)*dy;
+        double zcoor=(gid/nx/ny)*dz;
+        for(int jj=0; jj<nEcgPoints; ++jj){
+            double dxx=xcoor-ecgPoints[jj*3];
+            double dyy=ycoor-ecgPoints[jj*3+1];
+            double dzz=zcoor-ecgPoints[jj*3+2];
+            invrAccess[ii*nEcgPoints+jj]=1.0/sqrt(dxx*dxx+dyy*dyy+dzz*dzz);
+        }
+    }
+#endif
         
  if(0){ // DEBUG to print out r with PIO
   int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(comm(), &myRank);
 
    std::string filename_r="rData";
    int loop=0;
@@ -92,7 +171,7 @@ void ECGSensor::calcInvR(const Simulate& sim)
    fullname += "/" + filename_r;
 
    int nFiles_r=4;
-   PFILE* file = Popen(fullname.c_str(), "w", MPI_COMM_WORLD);
+   PFILE* file = Popen(fullname.c_str(), "w", comm());
    if (nFiles_r > 0)
      PioSet(file, "ngroup", nFiles_r);
 
@@ -155,7 +234,7 @@ void ECGSensor::calcInvR(const Simulate& sim)
 void ECGSensor::print(double time, int loop)
 {
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(comm(), &myRank);
    
    stringstream name;
    name << "snapshot."<<setfill('0')<<setw(12)<<loop;
@@ -164,7 +243,7 @@ void ECGSensor::print(double time, int loop)
       DirTestCreate(fullname.c_str());
    fullname += "/" + filename_;
 
-   PFILE* file = Popen(fullname.c_str(), "w", MPI_COMM_WORLD);
+   PFILE* file = Popen(fullname.c_str(), "w", comm());
    if (nFiles_ > 0)
      PioSet(file, "ngroup", nFiles_);
 
@@ -244,9 +323,63 @@ void calcEcg(rw_mgarray_ptr<double> _ecgs,
    }
 }
 
+/** The sums of calcEcg and of the MPI_Reduce in eval, folded so that
+ *  rank 0 gets bitwise the same ECG for any decomposition.  Serial
+ *  like calcEcg: sensors run inside the omp critical of loopIO. */
+void ECGSensor::reproducibleEcg(double* ecgs)
+{
+   startTimer(reproducibleSumTimer);
+   const int nFolds = ReproducibleSum::nFolds;
+   auto invr = invrTransport_.readonly(CPU);
+   auto dVmDiffusion = dVmDiffusionTransport_.readonly(CPU);
+   int nData = dVmDiffusion.size();
+   double dVmMax = 0;
+   for (int ii=0; ii<nData; ++ii)
+      dVmMax = max(dVmMax, fabs(dVmDiffusion[ii]));
+   // |invr*dVm| can't round above invrMax*dVmMax
+   ReproducibleSum folding(invrMax_*ReproducibleSum::globalBound(dVmMax, comm()), maxTerms_);
+
+   vector<double> folds(nFolds*nEcgPoints, 0.0);
+   for (int ii=0; ii<nData; ++ii)
+      for (int jj=0; jj<nEcgPoints; ++jj)
+         folding.deposit(invr[ii*nEcgPoints+jj]*dVmDiffusion[ii], &folds[nFolds*jj]);
+
+   vector<double> sum(folds.size());
+   MPI_Reduce(&folds[0], &sum[0], folds.size(), MPI_DOUBLE, MPI_SUM, 0, comm());
+   for (int jj=0; jj<nEcgPoints; ++jj)
+      ecgs[jj] = ReproducibleSum::value(&sum[nFolds*jj]);
+   stopTimer(reproducibleSumTimer);
+}
+
 void ECGSensor::eval(double time, int loop)
 {
    startTimer(sensorEvalTimer);
+   if (ReproducibleSum::enabled())
+   {
+      double ecgsRecvBuf[nEcgPoints];
+      reproducibleEcg(ecgsRecvBuf);
+      int myRank;
+      MPI_Comm_rank(comm(), &myRank);
+      if (myRank == 0)
+      {
+         saveLoops.push_back(loop);
+         for (int ii=0; ii<nEcgPoints; ++ii)
+            saveEcgs.push_back(ecgsRecvBuf[ii]*kECG);
+      }
+      stopTimer(sensorEvalTimer);
+      return;
+   }
+   if (treecode_)
+   {
+      auto ecgs = ecgsTransport_.writeonly(CPU);
+      for (int ii=0; ii<ecgs.size(); ++ii)
+         ecgs[ii] = 0;
+      auto dVmDiffusion = dVmDiffusionTransport_.readonly(CPU);
+      treecode_->eval(dVmDiffusion.raw(), ecgs.raw());
+   }
+   else
+   {
+#ifdef USE_CUDA
    {   // zero out
    	auto ecgs = ecgsTransport_.writeonly(GPU);
         CUDA_VERIFY(cudaMemset(ecgs.raw(), 0, sizeof(double)*ecgs.size()));
@@ -258,7 +391,7 @@ void ECGSensor::eval(double time, int loop)
         auto dVmDiffusion=dVmDiffusionTransport_.readonly(CPU);
 
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(comm(), &myRank);
 
    if(myRank==0){
        std::cout << "Loop "<< loop <<"\n\n\n";
@@ -295,16 +428,28 @@ void ECGSensor::eval(double time, int loop)
                dVmDiffusionTransport_, 
                nEcgPoints);
  }
+#else
+   {
+      auto ecgs = ecgsTransport_.writeonly(CPU);
+      for (int ii=0; ii<ecgs.size(); ++ii)
+         ecgs[ii] = 0;
+   }
+   calcEcg(ecgsTransport_,
+           invrTransport_,
+           dVmDiffusionTransport_,
+           nEcgPoints);
+#endif
+   }
    
    auto ecgs = ecgsTransport_.readonly(CPU);
    const double* ecgsSendBuf=ecgs.raw();
    double ecgsRecvBuf[nEcgPoints];
-   // MPI_Allreduce(ecgsSendBuf, ecgsRecvBuf, nEcgPoints, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);  
+   // MPI_Allreduce(ecgsSendBuf, ecgsRecvBuf, nEcgPoints, MPI_DOUBLE, MPI_SUM, comm());  
    // Only the Rank 0 stores the total ecg values
-   MPI_Reduce(ecgsSendBuf, ecgsRecvBuf, nEcgPoints, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);  
+   MPI_Reduce(ecgsSendBuf, ecgsRecvBuf, nEcgPoints, MPI_DOUBLE, MPI_SUM, 0, comm());  
  
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(comm(), &myRank);
 
    if(myRank==0){   
         saveLoops.push_back(loop);
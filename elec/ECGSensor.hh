@@ -6,6 +6,7 @@
 #include "VectorDouble32.hh"
 #include "lazy_array.hh"
 
+class ECGTreecode;
 
 void calcInvrCUDA(wo_mgarray_ptr<double> invr,
                   ro_mgarray_ptr<Long64> gids,
@@ -29,6 +30,8 @@ struct ECGSensorParms
    int nSensorPoints;
    int stencilSize;
    double kconst;
+   double theta;
+   int leafSize;
    std::string filename;
    std::vector<double> ecgPoints;
    std::vector<std::string> ecgNames;
@@ -42,7 +45,7 @@ class ECGSensor : public Sensor
    ECGSensor(const SensorParms& sp,
              const ECGSensorParms& p,
              const Simulate& sim);
-   ~ECGSensor() {};
+   ~ECGSensor();
 
  private:
 
@@ -50,6 +53,8 @@ class ECGSensor : public Sensor
    void eval(double time, int loop);
    
    void calcInvR(const Simulate& sim);
+   void buildTreecode(const Simulate& sim, const ECGSensorParms& p);
+   void reproducibleEcg(double* ecgs);
 
    std::string filename_;
    
@@ -72,6 +77,9 @@ class ECGSensor : public Sensor
    lazy_array<double> ecgPointTransport_;
    lazy_array<double> ecgsTransport_;
    lazy_array<double> invrTransport_;
+   ECGTreecode* treecode_; // replaces invr when theta > 0
+   double invrMax_;        // for reproducible sums
+   double maxTerms_;
 
 };
 
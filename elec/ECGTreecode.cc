@@ -0,0 +1,232 @@
+#include "ECGTreecode.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+
+ECGTreecode::ECGTreecode(const vector<Vector>& cells,
+                         const vector<Vector>& electrodes,
+                         double theta, int leafSize)
+: electrode_(electrodes)
+{
+   assert(theta > 0 && theta < 1);
+   assert(leafSize > 0);
+   build(cells, leafSize);
+   buildLists(cells, electrodes, theta);
+   moments_.resize(nMoments*node_.size());
+   sortedSource_.resize(order_.size());
+}
+
+/** Each node gets the tight bounding box of its cells and is split at
+ *  the middle of that box.  A node whose box has no extent (repeated
+ *  positions) stays a leaf whatever its size. */
+void ECGTreecode::build(const vector<Vector>& cells, int leafSize)
+{
+   int nCells = cells.size();
+   order_.resize(nCells);
+   for (int ii=0; ii<nCells; ++ii)
+      order_[ii] = ii;
+   if (nCells == 0)
+      return;
+
+   Node root;
+   root.begin = 0;
+   root.end = nCells;
+   node_.push_back(root);
+   for (unsigned in=0; in<node_.size(); ++in)
+   {
+      int begin = node_[in].begin;
+      int end = node_[in].end;
+      Vector lo = cells[order_[begin]];
+      Vector hi = lo;
+      for (int ii=begin+1; ii<end; ++ii)
+         for (int kk=0; kk<3; ++kk)
+         {
+            lo[kk] = min(lo[kk], cells[order_[ii]][kk]);
+            hi[kk] = max(hi[kk], cells[order_[ii]][kk]);
+         }
+      Vector mid = (lo+hi)/2.0;
+      double radius2 = 0;
+      for (int ii=begin; ii<end; ++ii)
+         radius2 = max(radius2, diffSq(cells[order_[ii]], mid));
+      node_[in].center = mid;
+      node_[in].radius = sqrt(radius2);
+      node_[in].firstChild = -1;
+      node_[in].nChildren = 0;
+
+      if (end-begin <= leafSize || radius2 == 0)
+      {
+         leaves_.push_back(in);
+         continue;
+      }
+
+      // Octant k has x above the middle if bit 2 is set, y if bit 1
+      // and z if bit 0.
+      int bound[9];
+      bound[0] = begin;
+      bound[8] = end;
+      for (int axis=0, step=4; axis<3; ++axis, step/=2)
+         for (int kk=0; kk<8; kk+=2*step)
+         {
+            int* first = &order_[0] + bound[kk];
+            int* last = &order_[0] + bound[kk+2*step];
+            int* split = partition(first, last, [&](int ii) {return cells[ii][axis] <= mid[axis];});
+            bound[kk+step] = split - &order_[0];
+         }
+
+      node_[in].firstChild = node_.size();
+      for (int kk=0; kk<8; ++kk)
+      {
+         if (bound[kk+1] == bound[kk])
+            continue;
+         Node child;
+         child.begin = bound[kk];
+         child.end = bound[kk+1];
+         node_.push_back(child);
+         ++node_[in].nChildren;
+      }
+   }
+
+   offset_.resize(nCells);
+   for (unsigned ii=0; ii<leaves_.size(); ++ii)
+   {
+      const Node& leaf = node_[leaves_[ii]];
+      for (int jj=leaf.begin; jj<leaf.end; ++jj)
+         offset_[jj] = cells[order_[jj]] - leaf.center;
+   }
+}
+
+void ECGTreecode::buildLists(const vector<Vector>& cells,
+                             const vector<Vector>& electrodes, double theta)
+{
+   int nElectrodes = electrodes.size();
+   farStart_.assign(1, 0);
+   nearStart_.assign(1, 0);
+   vector<int> stack;
+   for (int jj=0; jj<nElectrodes; ++jj)
+   {
+      if (!node_.empty())
+         stack.push_back(0);
+      while (!stack.empty())
+      {
+         int in = stack.back();
+         stack.pop_back();
+         const Node& node = node_[in];
+         double dist = length(electrodes[jj] - node.center);
+         if (node.radius < theta*dist)
+         {
+            farNode_.push_back(in);
+            continue;
+         }
+         if (node.firstChild < 0)
+         {
+            for (int ii=node.begin; ii<node.end; ++ii)
+            {
+               nearCell_.push_back(ii);
+               nearInvr_.push_back(1.0/length(electrodes[jj] - cells[order_[ii]]));
+            }
+            continue;
+         }
+         for (int kk=0; kk<node.nChildren; ++kk)
+            stack.push_back(node.firstChild+kk);
+      }
+      farStart_.push_back(farNode_.size());
+      nearStart_.push_back(nearCell_.size());
+   }
+}
+
+void ECGTreecode::computeMoments(const double* source)
+{
+   int nCells = order_.size();
+   #pragma omp parallel for
+   for (int ii=0; ii<nCells; ++ii)
+      sortedSource_[ii] = source[order_[ii]];
+
+   int nLeaves = leaves_.size();
+   #pragma omp parallel for
+   for (int il=0; il<nLeaves; ++il)
+   {
+      const Node& leaf = node_[leaves_[il]];
+      double* mm = &moments_[nMoments*leaves_[il]];
+      for (int kk=0; kk<nMoments; ++kk)
+         mm[kk] = 0;
+      for (int ii=leaf.begin; ii<leaf.end; ++ii)
+      {
+         double q = sortedSource_[ii];
+         const Vector& d = offset_[ii];
+         mm[0] += q;
+         mm[1] += q*d[0];
+         mm[2] += q*d[1];
+         mm[3] += q*d[2];
+         mm[4] += q*d[0]*d[0];
+         mm[5] += q*d[1]*d[1];
+         mm[6] += q*d[2]*d[2];
+         mm[7] += q*d[0]*d[1];
+         mm[8] += q*d[0]*d[2];
+         mm[9] += q*d[1]*d[2];
+      }
+   }
+
+   // Children come after their parents.
+   for (int in=node_.size()-1; in>=0; --in)
+   {
+      const Node& node = node_[in];
+      if (node.firstChild < 0)
+         continue;
+      double* mm = &moments_[nMoments*in];
+      for (int kk=0; kk<nMoments; ++kk)
+         mm[kk] = 0;
+      for (int ic=node.firstChild; ic<node.firstChild+node.nChildren; ++ic)
+      {
+         const double* cm = &moments_[nMoments*ic];
+         Vector s = node_[ic].center - node.center;
+         mm[0] += cm[0];
+         mm[1] += cm[1] + cm[0]*s[0];
+         mm[2] += cm[2] + cm[0]*s[1];
+         mm[3] += cm[3] + cm[0]*s[2];
+         mm[4] += cm[4] + 2*cm[1]*s[0] + cm[0]*s[0]*s[0];
+         mm[5] += cm[5] + 2*cm[2]*s[1] + cm[0]*s[1]*s[1];
+         mm[6] += cm[6] + 2*cm[3]*s[2] + cm[0]*s[2]*s[2];
+         mm[7] += cm[7] + cm[1]*s[1] + cm[2]*s[0] + cm[0]*s[0]*s[1];
+         mm[8] += cm[8] + cm[1]*s[2] + cm[3]*s[0] + cm[0]*s[0]*s[2];
+         mm[9] += cm[9] + cm[2]*s[2] + cm[3]*s[1] + cm[0]*s[1]*s[2];
+      }
+   }
+}
+
+/** With R the vector from the center of a node to the electrode
+ *
+ *    sum_i q_i/|R - d_i| ~ M0/R + R.M1/R^3 + (3 R.S.R - tr(S) R^2)/(2 R^5)
+ *
+ *  where M0, M1 and S are the moments of the node.  */
+void ECGTreecode::eval(const double* source, double* ecg)
+{
+   computeMoments(source);
+
+   int nElectrodes = electrode_.size();
+   #pragma omp parallel for schedule(dynamic, 4)
+   for (int jj=0; jj<nElectrodes; ++jj)
+   {
+      double sum = 0;
+      for (unsigned long kk=farStart_[jj]; kk<farStart_[jj+1]; ++kk)
+      {
+         int in = farNode_[kk];
+         const double* mm = &moments_[nMoments*in];
+         Vector R = electrode_[jj] - node_[in].center;
+         double r2 = dot(R, R);
+         double ir = 1.0/sqrt(r2);
+         double ir3 = ir/r2;
+         double ir5 = ir3/r2;
+         double dipole = mm[1]*R[0] + mm[2]*R[1] + mm[3]*R[2];
+         double RSR = mm[4]*R[0]*R[0] + mm[5]*R[1]*R[1] + mm[6]*R[2]*R[2]
+            + 2*(mm[7]*R[0]*R[1] + mm[8]*R[0]*R[2] + mm[9]*R[1]*R[2]);
+         double trace = mm[4] + mm[5] + mm[6];
+         sum += mm[0]*ir + dipole*ir3 + 0.5*(3*RSR - trace*r2)*ir5;
+      }
+      for (unsigned long kk=nearStart_[jj]; kk<nearStart_[jj+1]; ++kk)
+         sum += nearInvr_[kk]*sortedSource_[nearCell_[kk]];
+      ecg[jj] += sum;
+   }
+}
@@ -0,0 +1,73 @@
+#ifndef ECG_TREECODE_HH
+#define ECG_TREECODE_HH
+
+#include <vector>
+#include "Vector.hh"
+
+/** Treecode evaluation of the pseudo-ECG sums
+ *
+ *     ecg[j] += sum_i source[i] / |cell_i - electrode_j|
+ *
+ *  for many electrodes without the cells x electrodes table of
+ *  inverse distances.
+ *
+ *  The cells are sorted into an octree with at most leafSize cells per
+ *  leaf.  Every step the monopole, dipole and second moments of the
+ *  source are computed for each node (leaves from their cells, the
+ *  other nodes by shifting the moments of their children).  A node
+ *  whose radius is less than theta times its distance to an electrode
+ *  contributes through its quadrupole expansion; the relative error of
+ *  such a term is of order theta^3.  Otherwise its children are
+ *  opened.  The leaves that are never far enough use the exact kernel.
+ *  The geometry doesn't change so the lists of far nodes and near
+ *  cells (with their inverse distances) of each electrode are built
+ *  once.
+ */
+class ECGTreecode
+{
+ public:
+   ECGTreecode(const std::vector<Vector>& cells,
+               const std::vector<Vector>& electrodes,
+               double theta, int leafSize);
+
+   void eval(const double* source, double* ecg);
+
+   unsigned nNodes() const {return node_.size();}
+   unsigned long nFarPairs() const {return farNode_.size();}
+   unsigned long nNearPairs() const {return nearCell_.size();}
+
+ private:
+   struct Node
+   {
+      Vector center;
+      double radius;
+      int begin, end;      // range of order_
+      int firstChild;      // children are contiguous, -1 for a leaf
+      int nChildren;
+   };
+
+   // monopole, dipole and second moments (xx yy zz xy xz yz) about
+   // the center of a node.
+   enum {nMoments = 10};
+
+   void build(const std::vector<Vector>& cells, int leafSize);
+   void buildLists(const std::vector<Vector>& cells,
+                   const std::vector<Vector>& electrodes, double theta);
+   void computeMoments(const double* source);
+
+   std::vector<Node> node_;      // breadth first, so parents come first
+   std::vector<int> order_;      // cells in tree order
+   std::vector<Vector> offset_;  // cell position relative to its leaf center
+   std::vector<int> leaves_;
+   std::vector<double> moments_; // nMoments per node
+   std::vector<double> sortedSource_;
+
+   std::vector<Vector> electrode_;
+   std::vector<unsigned long> farStart_;   // CSR by electrode
+   std::vector<int> farNode_;
+   std::vector<unsigned long> nearStart_;  // CSR by electrode
+   std::vector<int> nearCell_;             // index in tree order
+   std::vector<double> nearInvr_;
+};
+
+#endif
@@ -32,7 +32,8 @@ FGRDiffusion::FGRDiffusion(const FGRDiffusionParms& parms,
    unsigned nz = localGrid_.nz();
 
    // This is a test
-   for (unsigned ii=0; ii<anatomy.size(); ++ii)
+   #pragma omp parallel for
+   for (int ii=0; ii<anatomy.size(); ++ii)
    {
       Tuple globalTuple = anatomy.globalTuple(ii);
       Tuple ll = localGrid_.localTuple(globalTuple);
@@ -205,7 +206,8 @@ void FGRDiffusion::calc(rw_mgarray_ptr<double> /*dVm_managed*/)
 void FGRDiffusion::buildTupleArray(const Anatomy& anatomy)
 {
    localTuple_.resize(anatomy.nLocal(), Tuple(0,0,0));
-   for (unsigned ii=0; ii<anatomy.nLocal(); ++ii)
+   #pragma omp parallel for
+   for (int ii=0; ii<anatomy.nLocal(); ++ii)
    {
       Tuple globalTuple = anatomy.globalTuple(ii);
       localTuple_[ii] = localGrid_.localTuple(globalTuple);
@@ -221,7 +223,8 @@ void FGRDiffusion::buildTupleArray(const Anatomy& anatomy)
 void FGRDiffusion::buildBlockIndex(const Anatomy& anatomy)
 {
    blockIndex_.resize(anatomy.size());
-   for (unsigned ii=0; ii<anatomy.size(); ++ii)
+   #pragma omp parallel for
+   for (int ii=0; ii<anatomy.size(); ++ii)
    {
       Tuple globalTuple = anatomy.globalTuple(ii);
       Tuple ll = localGrid_.localTuple(globalTuple);
@@ -342,18 +345,22 @@ void FGRDiffusion::precomputeCoefficients(const Anatomy& anatomy)
    Array3d<int> tissueBlk(nx, ny, nz, 0);
 
    const vector<AnatomyCell>& cell = anatomy.cellArray();
-   for (unsigned ii=0; ii<anatomy.size(); ++ii)
+   #pragma omp parallel for
+   for (int ii=0; ii<anatomy.size(); ++ii)
    {
       unsigned ib = blockIndex_[ii];
       sigmaBlk(ib) = anatomy.conductivity(ii);
       tissueBlk(ib) = isTissue(anatomy.cellType(ii));
    }
 
-   for (unsigned ii=0; ii<weight_.size(); ++ii)
+   #pragma omp parallel for
+   for (int ii=0; ii<weight_.size(); ++ii)
       for (unsigned jj=0; jj<19; ++jj)
          weight_(ii).A[jj] = 0.0;
 
-   for (unsigned iCell=0; iCell<anatomy.nLocal(); ++iCell)
+   // Every cell has its own block so the cells are independent.
+   #pragma omp parallel for
+   for (int iCell=0; iCell<anatomy.nLocal(); ++iCell)
    {
       unsigned ib = blockIndex_[iCell];
       int tissue[19] = {0};
@@ -4,6 +4,7 @@
 #include "Anatomy.hh"
 #include "Vector.hh"
 #include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include "PerformanceTimers.hh"
 
@@ -16,7 +17,11 @@ FGRDiffusionOMP::FGRDiffusionOMP(const FGRDiffusionParms& parms,
 : Diffusion(parms.diffusionScale_),
   nLocal_(anatomy.nLocal()),
   nRemote_(anatomy.nRemote()),
-  localGrid_(DiffusionUtils::findBoundingBox(anatomy, parms.printBBox_))
+  localGrid_(DiffusionUtils::findBoundingBox(anatomy, parms.printBBox_)),
+  skipQuiescent_(parms.skipQuiescent_),
+  skipValid_(false),
+  skipTolerance_(parms.skipTolerance_),
+  skipBlockSize_(max(1, parms.skipBlockSize_))
 {
 
    unsigned nx = localGrid_.nx();
@@ -69,12 +74,37 @@ FGRDiffusionOMP::FGRDiffusionOMP(const FGRDiffusionParms& parms,
    faceNbrOffset_[5] = offset_[ZZP];
 
    precomputeCoefficients(anatomy);
+   if (skipQuiescent_)
+      buildSkipBlocks(anatomy);
 }
 
 
 void FGRDiffusionOMP::updateLocalVoltage(ro_mgarray_ptr<double> VmLocal_managed)
 {
    ro_array_ptr<double> VmLocal = VmLocal_managed.useOn(CPU);
+   if (skipQuiescent_)
+   {
+      #pragma omp parallel
+      {
+         startTimer(FGR_ArrayLocal2MatrixTimer);
+         #pragma omp for
+         for (int jj=0; jj<busyBlock_.size(); ++jj)
+         {
+            int iBlock = busyBlock_[jj];
+            double delta = blockDelta_[iBlock];
+            for (int kk=blockLocalStart_[iBlock]; kk<blockLocalStart_[iBlock+1]; ++kk)
+            {
+               int ii = blockLocalCell_[kk];
+               double& phi = VmBlock_(blockIndex_[ii]);
+               delta = max(delta, abs(VmLocal[ii] - phi));
+               phi = VmLocal[ii];
+            }
+            blockDelta_[iBlock] = delta;
+         }
+         stopTimer(FGR_ArrayLocal2MatrixTimer);
+      }
+      return;
+   }
 #pragma omp parallel
    {
       startTimer(FGR_ArrayLocal2MatrixTimer);
@@ -88,9 +118,46 @@ void FGRDiffusionOMP::updateLocalVoltage(ro_mgarray_ptr<double> VmLocal_managed)
    }
 }
 
+/** Serial version of updateLocalVoltage for a subset of the local
+ *  cells.  Called from the tasks of the task graph loop.  The range
+ *  functions don't track activity and always do the full sweep. */
+void FGRDiffusionOMP::updateLocalVoltageRange(ro_mgarray_ptr<double> VmLocal_managed,
+                                              int begin, int end)
+{
+   ro_array_ptr<double> VmLocal = VmLocal_managed.useOn(CPU);
+   for (int ii=begin; ii<end; ++ii)
+   {
+      int index = blockIndex_[ii];
+      VmBlock_(index) = VmLocal[ii];
+   }
+}
+
 void FGRDiffusionOMP::updateRemoteVoltage(ro_mgarray_ptr<double> VmRemote_managed)
 {
    ro_array_ptr<double> VmRemote = VmRemote_managed.useOn(CPU);
+   if (skipQuiescent_)
+   {
+      #pragma omp parallel
+      {
+         startTimer(FGR_ArrayRemote2MatrixTimer);
+         unsigned* bb = &blockIndex_[nLocal_];
+         #pragma omp for
+         for (int iBlock=0; iBlock<blockDelta_.size(); ++iBlock)
+         {
+            double delta = blockDelta_[iBlock];
+            for (int kk=blockRemoteStart_[iBlock]; kk<blockRemoteStart_[iBlock+1]; ++kk)
+            {
+               int ii = blockRemoteCell_[kk];
+               double& phi = VmBlock_(bb[ii]);
+               delta = max(delta, abs(VmRemote[ii] - phi));
+               phi = VmRemote[ii];
+            }
+            blockDelta_[iBlock] = delta;
+         }
+         stopTimer(FGR_ArrayRemote2MatrixTimer);
+      }
+      return;
+   }
 #pragma omp parallel
    {
       startTimer(FGR_ArrayRemote2MatrixTimer);
@@ -106,10 +173,72 @@ void FGRDiffusionOMP::updateRemoteVoltage(ro_mgarray_ptr<double> VmRemote_manage
 }
 
 
+/** With skipQuiescent set the stencil is evaluated block by block.
+ *  The stencil is linear, so the result for any cell of a block can
+ *  have moved by at most
+ *
+ *     blockWeight * max |dVm| over the block and its 26 neighbors
+ *
+ *  since the previous step, where blockWeight is the largest sum of
+ *  |weights| (times diffusionScale) in the block.  These bounds are
+ *  summed in blockBudget_ and as long as the budget stays at or below
+ *  skipTolerance the block reuses its last results.  A front that
+ *  reaches the boundary of a block shows up in the delta of the
+ *  neighbor block and wakes it up on the same step.
+ *
+ *  With the default skipTolerance of zero a block is only skipped
+ *  when none of the voltages it reads have changed at all, so the
+ *  results are bit for bit those of the full sweep.  Otherwise the
+ *  error in dVm of every cell is at most skipTolerance. */
 void FGRDiffusionOMP::calc(rw_mgarray_ptr<double> dVm_managed)
 {
    rw_array_ptr<double> dVm = dVm_managed.useOn(CPU);
    int nCells = dVm.size();
+   if (skipQuiescent_)
+   {
+      #pragma omp parallel
+      {
+         startTimer(FGR_StencilTimer);
+         #pragma omp for
+         for (int jj=0; jj<busyBlock_.size(); ++jj)
+         {
+            int iBlock = busyBlock_[jj];
+            int begin = blockLocalStart_[iBlock];
+            int end = blockLocalStart_[iBlock+1];
+            if (skipValid_)
+            {
+               blockBudget_[iBlock] += blockWeight_[iBlock]*neighborhoodDelta(iBlock);
+               if (blockBudget_[iBlock] <= skipTolerance_)
+               {
+                  for (int kk=begin; kk<end; ++kk)
+                     dVm[blockLocalCell_[kk]] = dVmLast_[blockLocalCell_[kk]];
+                  continue;
+               }
+            }
+            blockBudget_[iBlock] = 0;
+            for (int kk=begin; kk<end; ++kk)
+            {
+               int iCell = blockLocalCell_[kk];
+               int ib = blockIndex_[iCell];
+
+               double* phi = & (VmBlock_(ib));
+               const WeightType *A = weight_(ib).A;
+               double tmp = A0_(ib) * (*(phi+offset_[0]));
+               for (unsigned ii=1; ii<19; ++ii)
+                  tmp += A[ii] * ( *(phi+offset_[ii]));
+
+               dVmLast_[iCell] = dVm[iCell] = tmp*diffusionScale_;
+            }
+         }
+         // implicit barrier: every block has read its neighbors
+         #pragma omp for
+         for (int iBlock=0; iBlock<blockDelta_.size(); ++iBlock)
+            blockDelta_[iBlock] = 0;
+         stopTimer(FGR_StencilTimer);
+      }
+      skipValid_ = true;
+      return;
+   }
 #pragma omp parallel
    {// parallel section to contain timer start/stop
       startTimer(FGR_StencilTimer);
@@ -130,7 +259,115 @@ void FGRDiffusionOMP::calc(rw_mgarray_ptr<double> dVm_managed)
    } // parallel section
 }
 
+/** Serial version of calc for a subset of the local cells. */
+void FGRDiffusionOMP::calcRange(rw_mgarray_ptr<double> dVm_managed, int begin, int end)
+{
+   rw_array_ptr<double> dVm = dVm_managed.useOn(CPU);
+   for (int iCell=begin; iCell<end; ++iCell)
+   {
+      int ib = blockIndex_[iCell];
+
+      double* phi = & (VmBlock_(ib));
+      const WeightType *A = weight_(ib).A;
+      double tmp = A0_(ib) * (*(phi+offset_[0]));
+      for (unsigned ii=1; ii<19; ++ii)
+         tmp += A[ii] * ( *(phi+offset_[ii]));
 
+      dVm[iCell] = tmp*diffusionScale_;
+   }
+}
+
+
+
+bool FGRDiffusionOMP::getStencil(Stencil& stencil) const
+{
+   stencil.nx = localGrid_.nx();
+   stencil.ny = localGrid_.ny();
+   stencil.nz = localGrid_.nz();
+   for (unsigned ii=0; ii<19; ++ii)
+      stencil.offset[ii] = offset_[ii];
+   stencil.blockIndex = &blockIndex_[0];
+   stencil.A0 = A0_.cBlock();
+   stencil.weight = weight_.cBlock();
+   stencil.diffusionScale = diffusionScale_;
+   return true;
+}
+
+/** Sorts the local and remote cells into blocks and finds the
+ *  largest absolute weight sum of each block. */
+void FGRDiffusionOMP::buildSkipBlocks(const Anatomy& anatomy)
+{
+   nbx_ = (localGrid_.nx() + skipBlockSize_ - 1) / skipBlockSize_;
+   nby_ = (localGrid_.ny() + skipBlockSize_ - 1) / skipBlockSize_;
+   nbz_ = (localGrid_.nz() + skipBlockSize_ - 1) / skipBlockSize_;
+   int nBlocks = nbx_*nby_*nbz_;
+
+   vector<int> blockOf(anatomy.size());
+   for (unsigned ii=0; ii<anatomy.size(); ++ii)
+   {
+      Tuple ll = localGrid_.localTuple(anatomy.globalTuple(ii));
+      blockOf[ii] = (ll.x()/skipBlockSize_)
+         + nbx_*((ll.y()/skipBlockSize_) + nby_*(ll.z()/skipBlockSize_));
+   }
+
+   blockLocalStart_.assign(nBlocks+1, 0);
+   blockRemoteStart_.assign(nBlocks+1, 0);
+   for (int ii=0; ii<nLocal_; ++ii)
+      ++blockLocalStart_[blockOf[ii]+1];
+   for (int ii=0; ii<nRemote_; ++ii)
+      ++blockRemoteStart_[blockOf[nLocal_+ii]+1];
+   for (int iBlock=0; iBlock<nBlocks; ++iBlock)
+   {
+      blockLocalStart_[iBlock+1] += blockLocalStart_[iBlock];
+      blockRemoteStart_[iBlock+1] += blockRemoteStart_[iBlock];
+   }
+
+   // cells stay in index order within a block
+   blockLocalCell_.resize(nLocal_);
+   blockRemoteCell_.resize(nRemote_);
+   vector<int> next(blockLocalStart_.begin(), blockLocalStart_.end()-1);
+   for (int ii=0; ii<nLocal_; ++ii)
+      blockLocalCell_[next[blockOf[ii]]++] = ii;
+   next.assign(blockRemoteStart_.begin(), blockRemoteStart_.end()-1);
+   for (int ii=0; ii<nRemote_; ++ii)
+      blockRemoteCell_[next[blockOf[nLocal_+ii]]++] = ii;
+
+   blockWeight_.assign(nBlocks, 0.0);
+   for (int ii=0; ii<nLocal_; ++ii)
+   {
+      int ib = blockIndex_[ii];
+      double sum = abs(A0_(ib));
+      for (unsigned jj=1; jj<19; ++jj)
+         sum += abs(weight_(ib).A[jj]);
+      sum *= abs(diffusionScale_);
+      blockWeight_[blockOf[ii]] = max(blockWeight_[blockOf[ii]], sum);
+   }
+
+   busyBlock_.clear();
+   for (int iBlock=0; iBlock<nBlocks; ++iBlock)
+      if (blockLocalStart_[iBlock+1] > blockLocalStart_[iBlock])
+         busyBlock_.push_back(iBlock);
+
+   blockDelta_.assign(nBlocks, 0.0);
+   blockBudget_.assign(nBlocks, 0.0);
+   dVmLast_.assign(nLocal_, 0.0);
+}
+
+/** Largest voltage change in block iBlock and the blocks around it.
+ *  Blocks are at least one voxel wide so this covers the footprint of
+ *  the stencil of every cell in the block. */
+double FGRDiffusionOMP::neighborhoodDelta(int iBlock) const
+{
+   int bx = iBlock % nbx_;
+   int by = (iBlock / nbx_) % nby_;
+   int bz = iBlock / (nbx_*nby_);
+   double delta = 0;
+   for (int kk=max(0, bz-1); kk<=min(nbz_-1, bz+1); ++kk)
+      for (int jj=max(0, by-1); jj<=min(nby_-1, by+1); ++jj)
+         for (int ii=max(0, bx-1); ii<=min(nbx_-1, bx+1); ++ii)
+            delta = max(delta, blockDelta_[ii + nbx_*(jj + nby_*kk)]);
+   return delta;
+}
 
 /** We're building the localTuple array only for local cells.  We can't
  * do stencil operations on remote particles so we shouldn't need
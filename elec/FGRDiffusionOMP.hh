@@ -21,6 +21,12 @@ class FGRDiffusionOMP : public Diffusion
    void updateRemoteVoltage(ro_mgarray_ptr<double> VmRemote);
    void calc(rw_mgarray_ptr<double> dVm);
 
+   bool hasRangeCalc() const {return true;}
+   void updateLocalVoltageRange(ro_mgarray_ptr<double> VmLocal, int begin, int end);
+   void calcRange(rw_mgarray_ptr<double> dVm, int begin, int end);
+
+   bool getStencil(FGRUtils::Stencil& stencil) const;
+
  private:
    void buildTupleArray(const Anatomy& anatomy);
    void buildBlockIndex(const Anatomy& anatomy);
@@ -30,6 +36,8 @@ class FGRDiffusionOMP : public Diffusion
    Vector f1(int ib, int iFace, const Vector& h,
              const Array3d<SymmetricTensor>& sigmaBlk);
    void printAllWeights(const Array3d<int>& tissue);
+   void buildSkipBlocks(const Anatomy& anatomy);
+   double neighborhoodDelta(int iBlock) const;
 
    int                             nLocal_;
    int                             nRemote_;
@@ -41,6 +49,28 @@ class FGRDiffusionOMP : public Diffusion
    Array3d<double>                 A0_;
    Array3d<FGRUtils::DiffWeight>   weight_;
    Array3d<double>                 VmBlock_;
+
+   // Quiescent block skipping.  The local grid is cut into blocks of
+   // skipBlockSize^3 voxels.  The cells of each block are listed in
+   // blockLocalCell_/blockRemoteCell_ (offsets in blockLocalStart_ and
+   // blockRemoteStart_).  blockDelta_ accumulates the max |dVm| seen by
+   // the update functions since the last calc, blockBudget_ bounds how
+   // far the reused stencil results of a block can be from the exact
+   // ones.
+   bool                            skipQuiescent_;
+   bool                            skipValid_;
+   double                          skipTolerance_;
+   int                             skipBlockSize_;
+   int                             nbx_, nby_, nbz_;
+   std::vector<int>                busyBlock_; // blocks with local cells
+   std::vector<int>                blockLocalStart_;
+   std::vector<int>                blockLocalCell_;
+   std::vector<int>                blockRemoteStart_;
+   std::vector<int>                blockRemoteCell_;
+   std::vector<double>             blockDelta_;
+   std::vector<double>             blockWeight_;
+   std::vector<double>             blockBudget_;
+   std::vector<double>             dVmLast_;
 };
 
 #endif
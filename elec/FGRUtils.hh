@@ -25,12 +25,30 @@ namespace FGRUtils
    {
       bool   printBBox_;
       double diffusionScale_;
+      bool   skipQuiescent_;
+      double skipTolerance_;
+      int    skipBlockSize_;
    };
    
    struct DiffWeight
    {
       WeightType A[19];
    };
+
+   /** The stencil of FGRDiffusionOMP for loops that apply it
+    *  themselves.  The grid arrays are nx*ny*nz Array3d blocks (z is
+    *  the fast index).  dVm of local cell ii is diffusionScale times
+    *  A0[ib]*Vm[ib] + sum of weight[ib].A[jj]*Vm[ib+offset[jj]] for
+    *  jj=1..18, where ib = blockIndex[ii]. */
+   struct Stencil
+   {
+      int nx, ny, nz;
+      int offset[19];
+      const unsigned* blockIndex;
+      const double* A0;
+      const DiffWeight* weight;
+      double diffusionScale;
+   };
    
 
    void setGradientWeights(double* grad, int* tissue,
@@ -169,7 +169,7 @@ void GDLoadBalancer::initialDistByWorkFn(vector<AnatomyCell>& cells, int nx, int
    }
 
    //ewd DEBUG
-   MPI_Barrier(MPI_COMM_WORLD);
+   MPI_Barrier(comm_);
    
    // we now have process coordinates for all local grid points, change dest_
    // index in cells array
@@ -487,7 +487,7 @@ double GDLoadBalancer::distributePlaneByWorkFn(vector<AnatomyCell>& cells, int z
       if (myRank_ != *zpeit)
       {
          MPI_Status status;
-         MPI_Recv(&buf[0],size,MPI_INT,*zpeit,myRank_,MPI_COMM_WORLD,&status);
+         MPI_Recv(&buf[0],size,MPI_INT,*zpeit,myRank_,comm_,&status);
          for (int ii=0; ii<size; ii++)
             kpxycnt[ii] += buf[ii];
       }
@@ -496,7 +496,7 @@ double GDLoadBalancer::distributePlaneByWorkFn(vector<AnatomyCell>& cells, int z
          for (set<int>::iterator destpeit = kpProcs.begin(); destpeit != kpProcs.end(); ++destpeit)
          {
             if (*destpeit != *zpeit)
-               MPI_Send(&kpxyloc[0],size,MPI_INT,*destpeit,*destpeit,MPI_COMM_WORLD);
+               MPI_Send(&kpxyloc[0],size,MPI_INT,*destpeit,*destpeit,comm_);
          }
          for (int ii=0; ii<size; ii++)
             kpxycnt[ii] += kpxyloc[ii];
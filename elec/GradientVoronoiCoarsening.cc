@@ -106,6 +106,16 @@ GradientVoronoiCoarsening::GradientVoronoiCoarsening(
 {
    eval_count_=0;
    
+   if( ReproducibleSum::enabled() && use_communication_avoiding_algorithm_ )
+   {
+      int myRank;
+      MPI_Comm_rank(comm_, &myRank);
+      if( myRank==0 )
+         cout<<"WARNING: "<<filename_<<": the communication avoiding gradient "
+             <<"writes partial sums of each task, so reproducibleSums can't make "
+             <<"them independent of the decomposition"<<endl;
+   }
+   
    const int nLocal = anatomy_.nLocal();
    
    dx_.resize(nLocal);
@@ -214,6 +224,27 @@ void GradientVoronoiCoarsening::setupLSmatrix()
    valMat12_.clear();
    valMat22_.clear();
 
+   vector<LocalSums*> valcolors;
+   valcolors.push_back(&valMat00_);
+   valcolors.push_back(&valMat01_);
+   valcolors.push_back(&valMat02_);
+   valcolors.push_back(&valMat11_);
+   valcolors.push_back(&valMat12_);
+   valcolors.push_back(&valMat22_);
+   
+   if( ReproducibleSum::enabled() )
+   {
+      double bound=0.;
+      for(std::vector<ColoredCell>::const_iterator ccell =colored_cells_.begin();
+                                                   ccell!=colored_cells_.end();
+                                                 ++ccell)
+         if( ccell->normLargerThanTol() )
+         {
+            const double d=maxDisplacement(ccell->index());
+            bound=max(bound,d*d*ccell->inorm2());
+         }
+      foldSums(bound,valcolors);
+   }
 
    for(std::vector<ColoredCell>::const_iterator ccell =colored_cells_.begin();
                                                 ccell!=colored_cells_.end();
@@ -257,17 +288,23 @@ void GradientVoronoiCoarsening::setupLSmatrix()
    }
    
    // consolidate matrices over MPI tasks
-   vector<LocalSums*> valcolors;
-   valcolors.push_back(&valMat00_);
-   valcolors.push_back(&valMat01_);
-   valcolors.push_back(&valMat02_);
-   valcolors.push_back(&valMat11_);
-   valcolors.push_back(&valMat12_);
-   valcolors.push_back(&valMat22_);
-   
    coarsening_.exchangeAndSum(valcolors);
 }
 
+// With reproducibleSums the sums are folded (see LocalSums::setFolding).
+// bound is at least the largest value this task adds to them.
+void GradientVoronoiCoarsening::foldSums(double bound, const vector<LocalSums*>& sums)
+{
+   startTimer(reproducibleSumTimer);
+   bound=ReproducibleSum::globalBound(bound, comm_);
+   // a value per cell, plus the center term of the communication
+   // avoiding right hand side
+   const ReproducibleSum folding(bound, anatomy_.nGlobal()+1.);
+   for(unsigned i=0;i<sums.size();i++)
+      sums[i]->setFolding(folding);
+   stopTimer(reproducibleSumTimer);
+}
+
 // setup r.h.s. of least square system dX^T W^2 dX grad V = dX^T W^2 dF
 void GradientVoronoiCoarsening::setupLSsystem(ro_array_ptr<double> val)
 {
@@ -283,6 +320,20 @@ void GradientVoronoiCoarsening::setupLSsystem(ro_array_ptr<double> val)
          valRHS0_.clear();
          valRHS1_.clear();
          valRHS2_.clear();
+         vector<LocalSums*> valcolors;
+         valcolors.push_back(&valRHS0_);
+         valcolors.push_back(&valRHS1_);
+         valcolors.push_back(&valRHS2_);
+         if( ReproducibleSum::enabled() )
+         {
+            double bound=0.;
+            for(std::vector<ColoredCell>::const_iterator ccell =colored_cells_.begin();
+                                                         ccell!=colored_cells_.end();
+                                                       ++ccell)
+               if( ccell->normLargerThanTol() )
+                  bound=max(bound,maxDisplacement(ccell->index())*ccell->inorm2());
+            foldSums(bound,valcolors);
+         }
          for(std::vector<ColoredCell>::const_iterator ccell =colored_cells_.begin();
                                                       ccell!=colored_cells_.end();
                                                     ++ccell)
@@ -311,11 +362,6 @@ void GradientVoronoiCoarsening::setupLSsystem(ro_array_ptr<double> val)
             }
          }
       
-         vector<LocalSums*> valcolors;
-         valcolors.push_back(&valRHS0_);
-         valcolors.push_back(&valRHS1_);
-         valcolors.push_back(&valRHS2_);
-   
          coarsening_.exchangeAndSum(valcolors);
       
          const std::set<int>& compute_colors(coarsening_.getOwnedColors());
@@ -340,6 +386,39 @@ void GradientVoronoiCoarsening::setupLSsystem(ro_array_ptr<double> val)
    valRHS0_.clear();
    valRHS1_.clear();
    valRHS2_.clear();
+   vector<LocalSums*> valcolors;
+   valcolors.push_back(&valRHS0_);
+   valcolors.push_back(&valRHS1_);
+   valcolors.push_back(&valRHS2_);
+
+   if( ReproducibleSum::enabled() )
+   {
+      double bound=0.;
+      for(std::vector<ColoredCell>::const_iterator ccell =colored_cells_.begin();
+                                                   ccell!=colored_cells_.end();
+                                                 ++ccell)
+         if( ccell->normLargerThanTol() )
+         {
+            const int ic=ccell->index();
+            const int color=ccell->color();
+            const double v=( use_communication_avoiding_algorithm_ ? val[ic]
+                                                                   : val[ic]-valcolors_.value(color) );
+            bound=max(bound,maxDisplacement(ic)*fabs(ccell->inorm2()*v));
+         }
+      if( use_communication_avoiding_algorithm_ )
+      {
+         const std::set<int>& compute_colors(coarsening_.getOwnedColors());
+         for(set<int>::const_iterator it = compute_colors.begin();
+                                      it!= compute_colors.end();
+                                    ++it)
+         {
+            const double* b=bf0[*it];
+            const double v=fabs(valcolors_.value(*it));
+            bound=max(bound,v*max(max(fabs(b[0]),fabs(b[1])),fabs(b[2])));
+         }
+      }
+      foldSums(bound,valcolors);
+   }
 
    if( use_communication_avoiding_algorithm_ )
    {
@@ -402,11 +481,6 @@ void GradientVoronoiCoarsening::setupLSsystem(ro_array_ptr<double> val)
       }
 
       // consolidate vector over MPI tasks
-      vector<LocalSums*> valcolors;
-      valcolors.push_back(&valRHS0_);
-      valcolors.push_back(&valRHS1_);
-      valcolors.push_back(&valRHS2_);
-   
       coarsening_.exchangeAndSum(valcolors);   
    }
    stopTimer(sensorSetupLSTimer);
@@ -496,7 +570,7 @@ void GradientVoronoiCoarsening::prologComputeLeastSquareGradients()
       }
    } 
    
-   MPI_Barrier(MPI_COMM_WORLD);
+   MPI_Barrier(comm_);
    int npts=((int)compute_colors.size()-(int)included_eval_colors_.size());
    if( npts>0 )cout<<"GradientVoronoiCoarsening --- WARNING: exclude "
                    <<npts<<" points from coarsened data on task "<<myRank
@@ -5,6 +5,8 @@
 #include "Sensor.hh"
 
 #include <string.h>
+#include <cmath>
+#include <algorithm>
 
 class Anatomy;
 class PotentialData;
@@ -114,6 +116,11 @@ class GradientVoronoiCoarsening : public Sensor
    void setupLSsystem(ro_array_ptr<double> val);
    void computeColorCenterValues(ro_array_ptr<double> val);
    void setupLSmatrix();
+   void foldSums(double bound, const std::vector<LocalSums*>& sums);
+   double maxDisplacement(const int ic)const
+   {
+      return std::max(std::max(fabs(dx_[ic]),fabs(dy_[ic])),fabs(dz_[ic]));
+   }
    void prologComputeLeastSquareGradients();
    int solve3x3(const double s[6], const double r[3], double x[3], const int color);
    
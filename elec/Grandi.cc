@@ -18,6 +18,7 @@
 #include <cassert>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 
@@ -129,12 +130,38 @@ static const char* interpName[] = {
          }
       }
 
+      if (reactionPrefitting())
+      {
+         if (reusingInterpolants || funcCount == 0)
+         {
+            delete reaction;
+            return NULL;
+         }
+         // The worker owns the parameterized model from here on.  It
+         // can't call MPI, so it gets the rank from here.
+         int myRank = getRank(0);
+         startInterpolantFit(obj->name, _dt, [reaction, _dt, funcCount, myRank]()
+         {
+            reaction->createInterpolants(_dt, myRank);
+            InterpolantSet fit(reaction->_interpolant, reaction->_interpolant+funcCount);
+            delete reaction;
+            return fit;
+         });
+         return NULL;
+      }
+
       if (!reusingInterpolants)
       {
-      reaction->createInterpolants(_dt);
+      InterpolantSet fit;
+      bool newFit = finishInterpolantFit(obj->name, _dt, fit, [reaction, _dt, funcCount]()
+      {
+         reaction->createInterpolants(_dt, getRank(0));
+         return InterpolantSet(reaction->_interpolant, reaction->_interpolant+funcCount);
+      });
+      copy(fit.begin(), fit.end(), reaction->_interpolant);
 
-      //save the interpolants
-      if (funcCount > 0 && getRank(0) == 0)
+      //save the interpolants, once for all the pieces of the task loop
+      if (newFit && funcCount > 0 && getRank(0) == 0)
       {
          ofstream outfile((string(obj->name) +".fit.data").c_str());
          outfile.precision(16);
@@ -176,7 +203,7 @@ static const char* interpName[] = {
 namespace Grandi 
 {
 
-void ThisReaction::createInterpolants(const double _dt) {
+void ThisReaction::createInterpolants(const double _dt, const int myRank) {
 
    {
       int _numPoints = (100 - -100)/1e-2;
@@ -196,7 +223,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[0].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _d_RLA: " 
               << actualTolerance << " > " << relError
@@ -218,7 +245,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[1].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _d_RLB: " 
               << actualTolerance << " > " << relError
@@ -242,7 +269,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[2].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_045: " 
               << actualTolerance << " > " << relError
@@ -266,7 +293,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[3].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_046: " 
               << actualTolerance << " > " << relError
@@ -290,7 +317,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[4].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_047: " 
               << actualTolerance << " > " << relError
@@ -314,7 +341,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[5].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_048: " 
               << actualTolerance << " > " << relError
@@ -338,7 +365,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[6].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_049: " 
               << actualTolerance << " > " << relError
@@ -362,7 +389,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[7].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_050: " 
               << actualTolerance << " > " << relError
@@ -386,7 +413,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[8].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_051: " 
               << actualTolerance << " > " << relError
@@ -410,7 +437,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[9].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_052: " 
               << actualTolerance << " > " << relError
@@ -434,7 +461,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[10].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_053: " 
               << actualTolerance << " > " << relError
@@ -458,7 +485,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[11].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_054: " 
               << actualTolerance << " > " << relError
@@ -483,7 +510,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[12].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_060: " 
               << actualTolerance << " > " << relError
@@ -508,7 +535,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[13].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_061: " 
               << actualTolerance << " > " << relError
@@ -533,7 +560,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[14].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_062: " 
               << actualTolerance << " > " << relError
@@ -558,7 +585,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[15].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_063: " 
               << actualTolerance << " > " << relError
@@ -583,7 +610,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[16].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_065: " 
               << actualTolerance << " > " << relError
@@ -608,7 +635,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[17].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _expensive_functions_067: " 
               << actualTolerance << " > " << relError
@@ -631,7 +658,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[18].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _f_RLA: " 
               << actualTolerance << " > " << relError
@@ -654,7 +681,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[19].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _f_RLB: " 
               << actualTolerance << " > " << relError
@@ -676,7 +703,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[20].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _hL_RLB: " 
               << actualTolerance << " > " << relError
@@ -717,7 +744,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[21].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _h_RLA: " 
               << actualTolerance << " > " << relError
@@ -739,7 +766,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[22].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _h_RLB: " 
               << actualTolerance << " > " << relError
@@ -783,7 +810,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[23].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _j_RLA: " 
               << actualTolerance << " > " << relError
@@ -805,7 +832,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[24].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _j_RLB: " 
               << actualTolerance << " > " << relError
@@ -830,7 +857,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[25].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _mL_RLA: " 
               << actualTolerance << " > " << relError
@@ -854,7 +881,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[26].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _mL_RLB: " 
               << actualTolerance << " > " << relError
@@ -878,7 +905,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[27].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _m_RLA: " 
               << actualTolerance << " > " << relError
@@ -900,7 +927,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[28].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _m_RLB: " 
               << actualTolerance << " > " << relError
@@ -925,7 +952,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[29].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _xkr_RLA: " 
               << actualTolerance << " > " << relError
@@ -947,7 +974,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[30].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _xkr_RLB: " 
               << actualTolerance << " > " << relError
@@ -970,7 +997,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[31].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _xks_RLA: " 
               << actualTolerance << " > " << relError
@@ -992,7 +1019,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[32].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _xks_RLB: " 
               << actualTolerance << " > " << relError
@@ -1015,7 +1042,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[33].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _xkur_RLA: " 
               << actualTolerance << " > " << relError
@@ -1037,7 +1064,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[34].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _xkur_RLB: " 
               << actualTolerance << " > " << relError
@@ -1060,7 +1087,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[35].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _xtf_RLA: " 
               << actualTolerance << " > " << relError
@@ -1082,7 +1109,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[36].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _xtf_RLB: " 
               << actualTolerance << " > " << relError
@@ -1105,7 +1132,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[37].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _ykur_RLA: " 
               << actualTolerance << " > " << relError
@@ -1127,7 +1154,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[38].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _ykur_RLB: " 
               << actualTolerance << " > " << relError
@@ -1150,7 +1177,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[39].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _ytf_RLA: " 
               << actualTolerance << " > " << relError
@@ -1172,7 +1199,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[40].create(_inputs,_outputs, relError,1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for _ytf_RLB: " 
               << actualTolerance << " > " << relError
@@ -1201,7 +1228,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[41].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for fnak: " 
               << actualTolerance << " > " << relError
@@ -1222,7 +1249,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[42].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for kp_kp: " 
               << actualTolerance << " > " << relError
@@ -1243,7 +1270,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[43].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for rkr: " 
               << actualTolerance << " > " << relError
@@ -1272,7 +1299,7 @@ void ThisReaction::createInterpolants(const double _dt) {
       }
       double relError = 0.0001;
       double actualTolerance = _interpolant[44].create(_inputs,_outputs, relError,0.1);
-      if (actualTolerance > relError  && getRank(0) == 0)
+      if (actualTolerance > relError  && myRank == 0)
       {
          cerr << "Warning: Could not meet tolerance for IK1: " 
               << actualTolerance << " > " << relError
@@ -2743,6 +2770,61 @@ void ThisReaction::setValue(int iCell, int varHandle, double value)
    else if (varHandle == ytf_handle) { READ_STATE(ytf,iCell) = value; }
 }
 
+/** One column at a time: the handle is resolved once and the cells
+ *  are set in parallel. */
+void ThisReaction::setValues(int varHandle, const vector<double>& value)
+{
+#ifdef USE_CUDA
+   auto stateData = stateTransport_.readwrite(CPU);
+#endif //USE_CUDA
+   int nCells = value.size();
+#define SET_COLUMN(state) \
+   _Pragma("omp parallel for") \
+   for (int ii=0; ii<nCells; ++ii) READ_STATE(state,ii) = value[ii]
+
+   if (0) {}
+   else if (varHandle == CaM_handle) { SET_COLUMN(CaM); }
+   else if (varHandle == Cai_handle) { SET_COLUMN(Cai); }
+   else if (varHandle == Caj_handle) { SET_COLUMN(Caj); }
+   else if (varHandle == Casl_handle) { SET_COLUMN(Casl); }
+   else if (varHandle == Casr_handle) { SET_COLUMN(Casr); }
+   else if (varHandle == Ki_handle) { SET_COLUMN(Ki); }
+   else if (varHandle == Myc_handle) { SET_COLUMN(Myc); }
+   else if (varHandle == Mym_handle) { SET_COLUMN(Mym); }
+   else if (varHandle == NaBj_handle) { SET_COLUMN(NaBj); }
+   else if (varHandle == NaBsl_handle) { SET_COLUMN(NaBsl); }
+   else if (varHandle == Nai_handle) { SET_COLUMN(Nai); }
+   else if (varHandle == Naj_handle) { SET_COLUMN(Naj); }
+   else if (varHandle == Nasl_handle) { SET_COLUMN(Nasl); }
+   else if (varHandle == RyRi_handle) { SET_COLUMN(RyRi); }
+   else if (varHandle == RyRo_handle) { SET_COLUMN(RyRo); }
+   else if (varHandle == RyRr_handle) { SET_COLUMN(RyRr); }
+   else if (varHandle == SLHj_handle) { SET_COLUMN(SLHj); }
+   else if (varHandle == SLHsl_handle) { SET_COLUMN(SLHsl); }
+   else if (varHandle == SLLj_handle) { SET_COLUMN(SLLj); }
+   else if (varHandle == SLLsl_handle) { SET_COLUMN(SLLsl); }
+   else if (varHandle == SRB_handle) { SET_COLUMN(SRB); }
+   else if (varHandle == TnCHc_handle) { SET_COLUMN(TnCHc); }
+   else if (varHandle == TnCHm_handle) { SET_COLUMN(TnCHm); }
+   else if (varHandle == TnCL_handle) { SET_COLUMN(TnCL); }
+   else if (varHandle == d_handle) { SET_COLUMN(d); }
+   else if (varHandle == f_handle) { SET_COLUMN(f); }
+   else if (varHandle == fcaBj_handle) { SET_COLUMN(fcaBj); }
+   else if (varHandle == fcaBsl_handle) { SET_COLUMN(fcaBsl); }
+   else if (varHandle == h_handle) { SET_COLUMN(h); }
+   else if (varHandle == hL_handle) { SET_COLUMN(hL); }
+   else if (varHandle == j_handle) { SET_COLUMN(j); }
+   else if (varHandle == m_handle) { SET_COLUMN(m); }
+   else if (varHandle == mL_handle) { SET_COLUMN(mL); }
+   else if (varHandle == xkr_handle) { SET_COLUMN(xkr); }
+   else if (varHandle == xks_handle) { SET_COLUMN(xks); }
+   else if (varHandle == xkur_handle) { SET_COLUMN(xkur); }
+   else if (varHandle == xtf_handle) { SET_COLUMN(xtf); }
+   else if (varHandle == ykur_handle) { SET_COLUMN(ykur); }
+   else if (varHandle == ytf_handle) { SET_COLUMN(ytf); }
+#undef SET_COLUMN
+}
+
 
 double ThisReaction::getValue(int iCell, int varHandle) const
 {
@@ -74,13 +74,14 @@ namespace Grandi
       ThisReaction(const int numPoints, const double __dt);
       std::string methodName() const;
       
-      void createInterpolants(const double _dt);
+      void createInterpolants(const double _dt, const int myRank);
       //void updateNonGate(double dt, const VectorDouble32&Vm, VectorDouble32&dVR);
       //void updateGate   (double dt, const VectorDouble32&Vm) ;
       virtual void getCheckpointInfo(std::vector<std::string>& fieldNames,
                                      std::vector<std::string>& fieldUnits) const;
       virtual int getVarHandle(const std::string& varName) const;
       virtual void setValue(int iCell, int varHandle, double value);
+      virtual void setValues(int varHandle, const std::vector<double>& value);
       virtual double getValue(int iCell, int varHandle) const;
       virtual double getValue(int iCell, int varHandle, double V) const;
       virtual const std::string getUnit(const std::string& varName) const;
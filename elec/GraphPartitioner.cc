@@ -0,0 +1,1009 @@
+#include "GraphPartitioner.hh"
+
+#include <cmath>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <queue>
+#include <map>
+#include <set>
+#include <random>
+#include "Anatomy.hh"
+#include "mpiUtils.h"
+
+using namespace std;
+
+namespace
+{
+   typedef long long Weight;
+
+   /** Weighted undirected graph in compressed row format. */
+   struct Graph
+   {
+      vector<int> xadj;
+      vector<int> adjncy;
+      vector<Weight> adjwgt;
+      vector<Weight> vwgt;
+      int nVertices() const {return vwgt.size();}
+   };
+
+   typedef priority_queue<pair<Weight, int> > GainQueue;
+
+   const int nStencil = 18;
+   const int nFaces = 6;
+   const int stencil[nStencil][3] =
+   {
+      { 1, 0, 0}, {-1, 0, 0}, { 0, 1, 0}, { 0,-1, 0}, { 0, 0, 1}, { 0, 0,-1},
+      { 1, 1, 0}, {-1, 1, 0}, { 1,-1, 0}, {-1,-1, 0},
+      { 1, 0, 1}, {-1, 0, 1}, { 1, 0,-1}, {-1, 0,-1},
+      { 0, 1, 1}, { 0,-1, 1}, { 0, 1,-1}, { 0,-1,-1}
+   };
+
+   /** Sparse personalized all-to-all.  send[ii] goes to task ii.  On
+    *  return recv holds the data from all tasks in rank order and
+    *  recvCnt[ii] the number of items from task ii. */
+   template <class T>
+   void exchange(const vector<vector<T> >& send, vector<T>& recv,
+                 vector<int>& recvCnt, MPI_Comm comm)
+   {
+      int nTasks;
+      MPI_Comm_size(comm, &nTasks);
+      vector<int> sendCnt(nTasks), sendOff(nTasks+1, 0), recvOff(nTasks+1, 0);
+      for (int ii=0; ii<nTasks; ++ii)
+      {
+         sendCnt[ii] = send[ii].size()*sizeof(T);
+         sendOff[ii+1] = sendOff[ii] + sendCnt[ii];
+      }
+      vector<T> sendBuf;
+      sendBuf.reserve(sendOff[nTasks]/sizeof(T));
+      for (int ii=0; ii<nTasks; ++ii)
+         sendBuf.insert(sendBuf.end(), send[ii].begin(), send[ii].end());
+      recvCnt.resize(nTasks);
+      MPI_Alltoall(&sendCnt[0], 1, MPI_INT, &recvCnt[0], 1, MPI_INT, comm);
+      for (int ii=0; ii<nTasks; ++ii)
+         recvOff[ii+1] = recvOff[ii] + recvCnt[ii];
+      recv.resize(recvOff[nTasks]/sizeof(T) + 1);
+      sendBuf.resize(sendBuf.size() + 1);
+      MPI_Alltoallv(&sendBuf[0], &sendCnt[0], &sendOff[0], MPI_BYTE,
+                    &recv[0], &recvCnt[0], &recvOff[0], MPI_BYTE, comm);
+      recv.resize(recvOff[nTasks]/sizeof(T));
+      for (int ii=0; ii<nTasks; ++ii)
+         recvCnt[ii] /= sizeof(T);
+   }
+
+   /** Gathers the vectors of all tasks in rank order. */
+   template <class T>
+   void gatherAll(const vector<T>& local, vector<T>& all, MPI_Comm comm)
+   {
+      int nTasks;
+      MPI_Comm_size(comm, &nTasks);
+      int nBytes = local.size()*sizeof(T);
+      vector<int> cnt(nTasks), off(nTasks+1, 0);
+      MPI_Allgather(&nBytes, 1, MPI_INT, &cnt[0], 1, MPI_INT, comm);
+      for (int ii=0; ii<nTasks; ++ii)
+         off[ii+1] = off[ii] + cnt[ii];
+      all.resize(off[nTasks]/sizeof(T) + 1);
+      MPI_Allgatherv(const_cast<T*>(local.data()), nBytes, MPI_BYTE,
+                     &all[0], &cnt[0], &off[0], MPI_BYTE, comm);
+      all.resize(off[nTasks]/sizeof(T));
+   }
+
+   /** Heavy edge matching.  Fills cmap with the coarse vertex of every
+    *  vertex and returns the number of coarse vertices. */
+   int matchVertices(const Graph& g, Weight maxVwgt, mt19937& rng, vector<int>& cmap)
+   {
+      int nv = g.nVertices();
+      vector<int> order(nv);
+      iota(order.begin(), order.end(), 0);
+      shuffle(order.begin(), order.end(), rng);
+      vector<int> mate(nv, -1);
+      for (int ii=0; ii<nv; ++ii)
+      {
+         int uu = order[ii];
+         if (mate[uu] >= 0)
+            continue;
+         int best = uu;
+         Weight bestWgt = 0;
+         for (int jj=g.xadj[uu]; jj<g.xadj[uu+1]; ++jj)
+         {
+            int vv = g.adjncy[jj];
+            if (mate[vv] < 0 && g.adjwgt[jj] > bestWgt &&
+                g.vwgt[uu] + g.vwgt[vv] <= maxVwgt)
+            {
+               best = vv;
+               bestWgt = g.adjwgt[jj];
+            }
+         }
+         mate[uu] = best;
+         mate[best] = uu;
+      }
+
+      cmap.resize(nv);
+      int nc = 0;
+      for (int uu=0; uu<nv; ++uu)
+         if (uu <= mate[uu])
+         {
+            cmap[uu] = nc;
+            cmap[mate[uu]] = nc;
+            ++nc;
+         }
+      return nc;
+   }
+
+   void contract(const Graph& g, const vector<int>& cmap, int nc, Graph& coarse)
+   {
+      int nv = g.nVertices();
+      coarse.vwgt.assign(nc, 0);
+      vector<int> first(nc+1, 0);
+      for (int uu=0; uu<nv; ++uu)
+      {
+         coarse.vwgt[cmap[uu]] += g.vwgt[uu];
+         ++first[cmap[uu]+1];
+      }
+      for (int ii=0; ii<nc; ++ii)
+         first[ii+1] += first[ii];
+      vector<int> members(nv);
+      vector<int> pos(first.begin(), first.end()-1);
+      for (int uu=0; uu<nv; ++uu)
+         members[pos[cmap[uu]]++] = uu;
+
+      coarse.xadj.assign(1, 0);
+      coarse.adjncy.clear();
+      coarse.adjwgt.clear();
+      vector<int> slot(nc, -1);
+      for (int cu=0; cu<nc; ++cu)
+      {
+         int start = coarse.adjncy.size();
+         for (int ii=first[cu]; ii<first[cu+1]; ++ii)
+         {
+            int uu = members[ii];
+            for (int jj=g.xadj[uu]; jj<g.xadj[uu+1]; ++jj)
+            {
+               int cv = cmap[g.adjncy[jj]];
+               if (cv == cu)
+                  continue;
+               if (slot[cv] >= start)
+                  coarse.adjwgt[slot[cv]] += g.adjwgt[jj];
+               else
+               {
+                  slot[cv] = coarse.adjncy.size();
+                  coarse.adjncy.push_back(cv);
+                  coarse.adjwgt.push_back(g.adjwgt[jj]);
+               }
+            }
+         }
+         coarse.xadj.push_back(coarse.adjncy.size());
+      }
+   }
+
+   /** Greedy graph growing.  Part 0 grows from a random vertex, always
+    *  taking the vertex that adds the least to the cut, until it holds
+    *  target0. */
+   void growBisection(const Graph& g, Weight target0, mt19937& rng, vector<char>& part)
+   {
+      int nv = g.nVertices();
+      part.assign(nv, 1);
+      vector<Weight> gain(nv, 0);
+      for (int uu=0; uu<nv; ++uu)
+         for (int jj=g.xadj[uu]; jj<g.xadj[uu+1]; ++jj)
+            gain[uu] -= g.adjwgt[jj];
+
+      GainQueue queue;
+      Weight weight0 = 0;
+      int nLeft = nv;
+      while (weight0 < target0 && nLeft > 0)
+      {
+         if (queue.empty())
+         {
+            // start (or restart in another component) at a random vertex
+            int uu = rng() % nv;
+            while (part[uu] == 0)
+               uu = (uu+1) % nv;
+            queue.push(make_pair(gain[uu], uu));
+         }
+         int uu = queue.top().second;
+         Weight gg = queue.top().first;
+         queue.pop();
+         if (part[uu] == 0 || gg != gain[uu])
+            continue;
+         part[uu] = 0;
+         weight0 += g.vwgt[uu];
+         --nLeft;
+         for (int jj=g.xadj[uu]; jj<g.xadj[uu+1]; ++jj)
+         {
+            int vv = g.adjncy[jj];
+            if (part[vv] == 0)
+               continue;
+            gain[vv] += 2*g.adjwgt[jj];
+            queue.push(make_pair(gain[vv], vv));
+         }
+      }
+   }
+
+   Weight excessWeight(const Weight weight[2], const Weight maxWeight[2])
+   {
+      return max(Weight(0), weight[0]-maxWeight[0]) +
+             max(Weight(0), weight[1]-maxWeight[1]);
+   }
+
+   /** Boundary Fiduccia-Mattheyses refinement of a bisection.  Each pass
+    *  moves boundary vertices in order of gain while the receiving part
+    *  stays below maxWeight, then rolls back to the best state seen
+    *  (least excess weight, then least cut).  Returns the cut. */
+   Weight refineBisection(const Graph& g, const Weight maxWeight[2], int nPasses,
+                          vector<char>& part, Weight& excess)
+   {
+      int nv = g.nVertices();
+      vector<Weight> ext(nv, 0), internal(nv, 0);
+      Weight weight[2] = {0, 0};
+      Weight cut = 0;
+      for (int uu=0; uu<nv; ++uu)
+      {
+         weight[int(part[uu])] += g.vwgt[uu];
+         for (int jj=g.xadj[uu]; jj<g.xadj[uu+1]; ++jj)
+            if (part[g.adjncy[jj]] == part[uu])
+               internal[uu] += g.adjwgt[jj];
+            else
+               ext[uu] += g.adjwgt[jj];
+         cut += ext[uu];
+      }
+      cut /= 2;
+
+      vector<char> locked(nv);
+      GainQueue queue[2];
+      vector<int> moves;
+      for (int pass=0; pass<nPasses; ++pass)
+      {
+         locked.assign(nv, 0);
+         for (int ii=0; ii<2; ++ii)
+            queue[ii] = GainQueue();
+         for (int uu=0; uu<nv; ++uu)
+            if (ext[uu] > 0)
+               queue[int(part[uu])].push(make_pair(ext[uu]-internal[uu], uu));
+
+         moves.clear();
+         Weight bestCut = cut;
+         Weight bestExcess = excessWeight(weight, maxWeight);
+         unsigned bestMove = 0;
+         unsigned patience = max(25, nv/50);
+
+         while (moves.size() < unsigned(nv) && moves.size() - bestMove < patience)
+         {
+            for (int ii=0; ii<2; ++ii)
+               while (!queue[ii].empty())
+               {
+                  int uu = queue[ii].top().second;
+                  if (locked[uu] || part[uu] != ii ||
+                      queue[ii].top().first != ext[uu]-internal[uu])
+                     queue[ii].pop();
+                  else
+                     break;
+               }
+
+            int from;
+            if (weight[0] > maxWeight[0])
+               from = 0;
+            else if (weight[1] > maxWeight[1])
+               from = 1;
+            else if (queue[0].empty())
+               from = 1;
+            else if (queue[1].empty())
+               from = 0;
+            else
+               from = (queue[0].top().first >= queue[1].top().first) ? 0 : 1;
+            if (queue[from].empty())
+               break;
+
+            int uu = queue[from].top().second;
+            queue[from].pop();
+            locked[uu] = 1;
+            int to = 1 - from;
+            if (weight[from] <= maxWeight[from] &&
+                weight[to] + g.vwgt[uu] > maxWeight[to])
+               continue;
+
+            cut -= ext[uu] - internal[uu];
+            swap(ext[uu], internal[uu]);
+            part[uu] = to;
+            weight[from] -= g.vwgt[uu];
+            weight[to] += g.vwgt[uu];
+            for (int jj=g.xadj[uu]; jj<g.xadj[uu+1]; ++jj)
+            {
+               int vv = g.adjncy[jj];
+               Weight ww = g.adjwgt[jj];
+               if (part[vv] == to)
+               {
+                  ext[vv] -= ww;
+                  internal[vv] += ww;
+               }
+               else
+               {
+                  ext[vv] += ww;
+                  internal[vv] -= ww;
+               }
+               if (!locked[vv] && ext[vv] > 0)
+                  queue[int(part[vv])].push(make_pair(ext[vv]-internal[vv], vv));
+            }
+            moves.push_back(uu);
+
+            Weight excess = excessWeight(weight, maxWeight);
+            if (excess < bestExcess || (excess == bestExcess && cut < bestCut))
+            {
+               bestExcess = excess;
+               bestCut = cut;
+               bestMove = moves.size();
+            }
+         }
+
+         // undo the moves after the best state
+         for (int ii=moves.size()-1; ii>=int(bestMove); --ii)
+         {
+            int uu = moves[ii];
+            int from = part[uu];
+            int to = 1 - from;
+            cut -= ext[uu] - internal[uu];
+            swap(ext[uu], internal[uu]);
+            part[uu] = to;
+            weight[from] -= g.vwgt[uu];
+            weight[to] += g.vwgt[uu];
+            for (int jj=g.xadj[uu]; jj<g.xadj[uu+1]; ++jj)
+            {
+               int vv = g.adjncy[jj];
+               if (part[vv] == to)
+               {
+                  ext[vv] -= g.adjwgt[jj];
+                  internal[vv] += g.adjwgt[jj];
+               }
+               else
+               {
+                  ext[vv] += g.adjwgt[jj];
+                  internal[vv] -= g.adjwgt[jj];
+               }
+            }
+         }
+         assert(cut == bestCut);
+         if (bestMove == 0)
+            break;
+      }
+      excess = excessWeight(weight, maxWeight);
+      return cut;
+   }
+
+   /** Multilevel bisection of g into parts of weight fraction0 and
+    *  1-fraction0 of the total.  Returns the cut and the excess weight
+    *  over the tolerance. */
+   Weight bisectGraph(const Graph& g, double fraction0, double tolerance, int nTrials,
+                      unsigned seed, vector<char>& part, Weight& excess)
+   {
+      const int coarsenTo = 100;
+      mt19937 rng(seed);
+
+      Weight total = accumulate(g.vwgt.begin(), g.vwgt.end(), Weight(0));
+      Weight target[2];
+      target[0] = llround(total*fraction0);
+      target[1] = total - target[0];
+      Weight maxWeight[2];
+      for (int ii=0; ii<2; ++ii)
+         maxWeight[ii] = target[ii] + Weight(tolerance*target[ii]);
+
+      vector<Graph> level(1, g);
+      vector<vector<int> > cmap;
+      Weight maxVwgt = max(Weight(1), Weight(1.5*total/coarsenTo));
+      while (level.back().nVertices() > coarsenTo)
+      {
+         vector<int> map;
+         int nc = matchVertices(level.back(), maxVwgt, rng, map);
+         if (nc > 0.95*level.back().nVertices())
+            break;
+         Graph coarse;
+         contract(level.back(), map, nc, coarse);
+         cmap.push_back(map);
+         level.push_back(coarse);
+      }
+
+      Weight bestCut = 0;
+      Weight bestExcess = -1;
+      vector<char> trial;
+      for (int ii=0; ii<nTrials; ++ii)
+      {
+         Weight trialExcess;
+         growBisection(level.back(), target[0], rng, trial);
+         Weight cut = refineBisection(level.back(), maxWeight, 4, trial, trialExcess);
+         if (bestExcess < 0 || trialExcess < bestExcess ||
+             (trialExcess == bestExcess && cut < bestCut))
+         {
+            bestCut = cut;
+            bestExcess = trialExcess;
+            part = trial;
+         }
+      }
+
+      Weight cut = bestCut;
+      excess = bestExcess;
+      for (int ll=cmap.size()-1; ll>=0; --ll)
+      {
+         vector<char> fine(level[ll].nVertices());
+         for (unsigned uu=0; uu<fine.size(); ++uu)
+            fine[uu] = part[cmap[ll][uu]];
+         part.swap(fine);
+         cut = refineBisection(level[ll], maxWeight, 8, part, excess);
+      }
+      return cut;
+   }
+}
+
+
+GraphPartitioner::GraphPartitioner(Anatomy& anatomy, const GraphPartitionerParms& parms,
+                                   MPI_Comm comm)
+: verbose_(parms.verbose),
+  maxVertices_(max(parms.maxVertices, 1000)),
+  nTrials_(max(parms.nTrials, 1)),
+  refineSweeps_(parms.refineSweeps),
+  imbalance_(parms.imbalance),
+  nbrWeight_(parms.nbrWeight),
+  comm_(comm),
+  nx_(anatomy.nx()), ny_(anatomy.ny()), nz_(anatomy.nz()),
+  gidToTuple_(anatomy.nx(), anatomy.ny(), anatomy.nz()),
+  cells_(anatomy.cellArray())
+{
+   MPI_Comm_size(comm_, &nTasks_);
+   MPI_Comm_rank(comm_, &myRank_);
+
+   int nLevels = 0;
+   while ((1<<nLevels) < nTasks_)
+      ++nLevels;
+   double tolerance = imbalance_/max(nLevels, 1);
+
+   MPI_Comm subComm;
+   MPI_Comm_dup(comm_, &subComm);
+   while (true)
+   {
+      int nSub;
+      MPI_Comm_size(subComm, &nSub);
+      if (nSub == 1)
+         break;
+      bisect(subComm, tolerance);
+      int subRank;
+      MPI_Comm_rank(subComm, &subRank);
+      MPI_Comm half;
+      MPI_Comm_split(subComm, subRank < nSub/2 ? 0 : 1, subRank, &half);
+      MPI_Comm_free(&subComm);
+      subComm = half;
+   }
+   MPI_Comm_free(&subComm);
+
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+      cells_[ii].dest_ = myRank_;
+   sort(cells_.begin(), cells_.end(), AnatomyCellGidSort());
+
+   if (verbose_)
+      printStatistics("bisection");
+   for (int ii=0; ii<refineSweeps_; ++ii)
+      refine(ii);
+   if (verbose_ && refineSweeps_ > 0)
+      printStatistics("refinement");
+}
+
+/** Splits the cells of the tasks in comm into two parts with loads in
+ *  the ratio of the sizes of the two halves of comm and sends each part
+ *  to its half. */
+void GraphPartitioner::bisect(MPI_Comm comm, double tolerance)
+{
+   int nTasks, myRank;
+   MPI_Comm_size(comm, &nTasks);
+   MPI_Comm_rank(comm, &myRank);
+
+   Long64 nLocal = cells_.size();
+   Long64 nCells;
+   MPI_Allreduce(&nLocal, &nCells, 1, MPI_UINT64_T, MPI_SUM, comm);
+   if (nCells == 0)
+      return;
+
+   // bounding box of the subdomain
+   int bounds[6] = {nx_, ny_, nz_, 0, 0, 0};
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+   {
+      Tuple tt = gidToTuple_(cells_[ii].gid_);
+      bounds[0] = min(bounds[0], tt.x());
+      bounds[1] = min(bounds[1], tt.y());
+      bounds[2] = min(bounds[2], tt.z());
+      bounds[3] = min(bounds[3], -tt.x());
+      bounds[4] = min(bounds[4], -tt.y());
+      bounds[5] = min(bounds[5], -tt.z());
+   }
+   MPI_Allreduce(MPI_IN_PLACE, bounds, 6, MPI_INT, MPI_MIN, comm);
+   int lo[3] = {bounds[0], bounds[1], bounds[2]};
+   int hi[3] = {-bounds[3], -bounds[4], -bounds[5]};
+
+   // Aggregate the voxels into cubic blocks such that the block graph
+   // has at most maxVertices_ vertices.  The blocks are distributed in
+   // ranges of block number.
+   int blockSize = max(1, int(cbrt(double(nCells)/maxVertices_)));
+   int nBlock[3];
+   Long64 nBlocks;
+   vector<Long64> block, blockId;
+   while (true)
+   {
+      for (int ii=0; ii<3; ++ii)
+         nBlock[ii] = (hi[ii] - lo[ii])/blockSize + 1;
+      nBlocks = Long64(nBlock[0])*nBlock[1]*nBlock[2];
+      for (unsigned ii=0; ii<cells_.size(); ++ii)
+      {
+         Tuple tt = gidToTuple_(cells_[ii].gid_);
+         Long64 bb = (tt.x()-lo[0])/blockSize + nBlock[0]*
+            (Long64((tt.y()-lo[1])/blockSize) + nBlock[1]*Long64((tt.z()-lo[2])/blockSize));
+         cells_[ii].dest_ = bb*nTasks/nBlocks;
+      }
+      exchangeCells(comm);
+      sort(cells_.begin(), cells_.end(), AnatomyCellGidSort());
+
+      block.resize(cells_.size());
+      for (unsigned ii=0; ii<cells_.size(); ++ii)
+      {
+         Tuple tt = gidToTuple_(cells_[ii].gid_);
+         block[ii] = (tt.x()-lo[0])/blockSize + nBlock[0]*
+            (Long64((tt.y()-lo[1])/blockSize) + nBlock[1]*Long64((tt.z()-lo[2])/blockSize));
+      }
+      blockId = block;
+      sort(blockId.begin(), blockId.end());
+      blockId.erase(unique(blockId.begin(), blockId.end()), blockId.end());
+      Long64 nVertices = blockId.size();
+      MPI_Allreduce(MPI_IN_PLACE, &nVertices, 1, MPI_UINT64_T, MPI_SUM, comm);
+      if (nVertices <= Long64(maxVertices_))
+         break;
+      blockSize = max(blockSize+1, int(ceil(blockSize*sqrt(double(nVertices)/maxVertices_))));
+   }
+   localGid_.resize(cells_.size());
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+      localGid_[ii] = cells_[ii].gid_;
+
+   // Vertex weights are the number of cells in a block.  Edge weights
+   // are the number of faces between two blocks.  A face that crosses
+   // to a block of another task is counted by the task that owns the
+   // block on the far side.
+   vector<Long64> vertex(2*blockId.size());
+   for (unsigned ii=0; ii<blockId.size(); ++ii)
+   {
+      vertex[2*ii] = blockId[ii];
+      vertex[2*ii+1] = 0;
+   }
+   vector<Long64> edge;
+   vector<vector<Long64> > query(nTasks);
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+   {
+      unsigned iv = lower_bound(blockId.begin(), blockId.end(), block[ii]) - blockId.begin();
+      ++vertex[2*iv+1];
+      Tuple tt = gidToTuple_(cells_[ii].gid_);
+      int xyz[3] = {tt.x(), tt.y(), tt.z()};
+      for (int dd=0; dd<3; ++dd)
+      {
+         if (xyz[dd] == hi[dd] || (xyz[dd]-lo[dd]+1) % blockSize != 0)
+            continue;
+         Long64 step[3] = {1, Long64(nx_), Long64(nx_)*ny_};
+         Long64 stride[3] = {1, Long64(nBlock[0]), Long64(nBlock[0])*nBlock[1]};
+         Long64 nbrGid = cells_[ii].gid_ + step[dd];
+         Long64 nbrBlock = block[ii] + stride[dd];
+         int nbrOwner = nbrBlock*nTasks/nBlocks;
+         if (nbrOwner == myRank)
+         {
+            if (binary_search(localGid_.begin(), localGid_.end(), nbrGid))
+            {
+               edge.push_back(block[ii]);
+               edge.push_back(nbrBlock);
+            }
+         }
+         else
+         {
+            query[nbrOwner].push_back(nbrGid);
+            query[nbrOwner].push_back(block[ii]);
+         }
+      }
+   }
+   {
+      vector<Long64> recv;
+      vector<int> recvCnt;
+      exchange(query, recv, recvCnt, comm);
+      for (unsigned ii=0; ii<recv.size(); ii+=2)
+         if (binary_search(localGid_.begin(), localGid_.end(), recv[ii]))
+         {
+            Tuple tt = gidToTuple_(recv[ii]);
+            Long64 bb = (tt.x()-lo[0])/blockSize + nBlock[0]*
+               (Long64((tt.y()-lo[1])/blockSize) + nBlock[1]*Long64((tt.z()-lo[2])/blockSize));
+            edge.push_back(recv[ii+1]);
+            edge.push_back(bb);
+         }
+   }
+
+   // merge parallel edges into (u, v, weight) triples
+   vector<pair<Long64, Long64> > pairs;
+   for (unsigned ii=0; ii<edge.size(); ii+=2)
+      pairs.push_back(make_pair(edge[ii], edge[ii+1]));
+   sort(pairs.begin(), pairs.end());
+   edge.clear();
+   for (unsigned ii=0; ii<pairs.size(); ++ii)
+   {
+      if (ii == 0 || pairs[ii] != pairs[ii-1])
+      {
+         edge.push_back(pairs[ii].first);
+         edge.push_back(pairs[ii].second);
+         edge.push_back(0);
+      }
+      ++edge.back();
+   }
+
+   // Every task gets the whole block graph.  The owners hold ranges of
+   // block numbers so the gathered vertices are sorted.
+   vector<Long64> allVertex, allEdge;
+   gatherAll(vertex, allVertex, comm);
+   gatherAll(edge, allEdge, comm);
+   vector<Long64> allBlockId(allVertex.size()/2);
+   Graph graph;
+   graph.vwgt.resize(allBlockId.size());
+   for (unsigned ii=0; ii<allBlockId.size(); ++ii)
+   {
+      allBlockId[ii] = allVertex[2*ii];
+      graph.vwgt[ii] = allVertex[2*ii+1];
+   }
+   vector<int> uu(allEdge.size()/3), vv(allEdge.size()/3);
+   graph.xadj.assign(allBlockId.size()+1, 0);
+   for (unsigned ii=0; ii<uu.size(); ++ii)
+   {
+      uu[ii] = lower_bound(allBlockId.begin(), allBlockId.end(), allEdge[3*ii]) - allBlockId.begin();
+      vv[ii] = lower_bound(allBlockId.begin(), allBlockId.end(), allEdge[3*ii+1]) - allBlockId.begin();
+      ++graph.xadj[uu[ii]+1];
+      ++graph.xadj[vv[ii]+1];
+   }
+   for (unsigned ii=0; ii<allBlockId.size(); ++ii)
+      graph.xadj[ii+1] += graph.xadj[ii];
+   graph.adjncy.resize(graph.xadj.back());
+   graph.adjwgt.resize(graph.xadj.back());
+   {
+      vector<int> pos(graph.xadj.begin(), graph.xadj.end()-1);
+      for (unsigned ii=0; ii<uu.size(); ++ii)
+      {
+         graph.adjncy[pos[uu[ii]]] = vv[ii];
+         graph.adjwgt[pos[uu[ii]]++] = allEdge[3*ii+2];
+         graph.adjncy[pos[vv[ii]]] = uu[ii];
+         graph.adjwgt[pos[vv[ii]]++] = allEdge[3*ii+2];
+      }
+   }
+
+   // Every task bisects with its own seed and the best result wins.
+   int nLeft = nTasks/2;
+   vector<char> part;
+   Weight excess;
+   Weight cut = bisectGraph(graph, double(nLeft)/nTasks, tolerance, nTrials_,
+                            12345u + 7919u*myRank, part, excess);
+   struct {double value; int rank;} score, best;
+   score.value = double(excess)*(double(nCells)+1.0) + cut;
+   score.rank = myRank;
+   MPI_Allreduce(&score, &best, 1, MPI_DOUBLE_INT, MPI_MINLOC, comm);
+   part.resize(graph.nVertices() + 1);
+   MPI_Bcast(&part[0], graph.nVertices(), MPI_CHAR, best.rank, comm);
+
+   if (verbose_ && myRank == 0 && nTasks == nTasks_)
+      cout << "GraphPartitioner: top bisection of " << nCells << " cells with "
+           << graph.nVertices() << " blocks of size " << blockSize
+           << ", cut = " << cut << " faces" << endl;
+
+   // part 0 goes to the lower half of comm, part 1 to the upper half
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+   {
+      int iv = lower_bound(allBlockId.begin(), allBlockId.end(), block[ii]) - allBlockId.begin();
+      if (part[iv] == 0)
+         cells_[ii].dest_ = Long64(myRank)*nLeft/nTasks;
+      else
+         cells_[ii].dest_ = nLeft + Long64(myRank)*(nTasks-nLeft)/nTasks;
+   }
+   exchangeCells(comm);
+}
+
+/** Sends every cell to task dest_ of comm. */
+void GraphPartitioner::exchangeCells(MPI_Comm comm)
+{
+   int nTasks;
+   MPI_Comm_size(comm, &nTasks);
+   sort(cells_.begin(), cells_.end(), AnatomyCellDestSort());
+   unsigned nLocal = cells_.size();
+   vector<unsigned> dest(nLocal+1);
+   vector<int> sendCnt(nTasks, 0), recvCnt(nTasks);
+   for (unsigned ii=0; ii<nLocal; ++ii)
+   {
+      dest[ii] = cells_[ii].dest_;
+      ++sendCnt[dest[ii]];
+   }
+   MPI_Alltoall(&sendCnt[0], 1, MPI_INT, &recvCnt[0], 1, MPI_INT, comm);
+   unsigned nRecv = accumulate(recvCnt.begin(), recvCnt.end(), 0u);
+   unsigned capacity = max(nLocal, nRecv) + 1;
+   cells_.resize(capacity);
+   assignArray((unsigned char*) &cells_[0], &nLocal, capacity,
+               sizeof(AnatomyCell), &dest[0], 0, comm);
+   cells_.resize(nLocal);
+}
+
+/** Finds the owners of the cells within the stencil of my cells that I
+ *  don't own.  Such a cell is a boundary cell of its owner, so only
+ *  boundary cells are registered in a directory distributed by gid. */
+void GraphPartitioner::findGhostOwners()
+{
+   localGid_.resize(cells_.size());
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+      localGid_[ii] = cells_[ii].gid_;
+
+   vector<vector<Long64> > reg(nTasks_), query(nTasks_);
+   ghostGid_.clear();
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+   {
+      Tuple tt = gidToTuple_(cells_[ii].gid_);
+      bool boundary = false;
+      for (int jj=0; jj<nStencil; ++jj)
+      {
+         int x = tt.x() + stencil[jj][0];
+         int y = tt.y() + stencil[jj][1];
+         int z = tt.z() + stencil[jj][2];
+         if (x < 0 || y < 0 || z < 0 || x >= nx_ || y >= ny_ || z >= nz_)
+            continue;
+         Long64 gid = x + nx_*(y + Long64(ny_)*z);
+         if (!binary_search(localGid_.begin(), localGid_.end(), gid))
+         {
+            boundary = true;
+            ghostGid_.push_back(gid);
+         }
+      }
+      if (boundary)
+         reg[cells_[ii].gid_ % nTasks_].push_back(cells_[ii].gid_);
+   }
+   sort(ghostGid_.begin(), ghostGid_.end());
+   ghostGid_.erase(unique(ghostGid_.begin(), ghostGid_.end()), ghostGid_.end());
+   for (unsigned ii=0; ii<ghostGid_.size(); ++ii)
+      query[ghostGid_[ii] % nTasks_].push_back(ghostGid_[ii]);
+
+   // directory of (gid, owner) for the gids that hash to this task
+   vector<pair<Long64, int> > directory;
+   {
+      vector<Long64> recv;
+      vector<int> recvCnt;
+      exchange(reg, recv, recvCnt, comm_);
+      unsigned kk = 0;
+      for (int ii=0; ii<nTasks_; ++ii)
+         for (int jj=0; jj<recvCnt[ii]; ++jj)
+            directory.push_back(make_pair(recv[kk++], ii));
+      sort(directory.begin(), directory.end());
+   }
+
+   vector<Long64> recv;
+   vector<int> recvCnt;
+   exchange(query, recv, recvCnt, comm_);
+   vector<vector<int> > answer(nTasks_);
+   unsigned kk = 0;
+   for (int ii=0; ii<nTasks_; ++ii)
+      for (int jj=0; jj<recvCnt[ii]; ++jj)
+      {
+         vector<pair<Long64, int> >::const_iterator here =
+            lower_bound(directory.begin(), directory.end(), make_pair(recv[kk++], -1));
+         if (here != directory.end() && here->first == recv[kk-1])
+            answer[ii].push_back(here->second);
+         else
+            answer[ii].push_back(-1);
+      }
+   vector<int> owners;
+   exchange(answer, owners, recvCnt, comm_);
+
+   // the answers come back in the order of the queries, grouped by
+   // directory task
+   ghostOwner_.resize(ghostGid_.size());
+   vector<int> next(nTasks_+1, 0);
+   for (int ii=0; ii<nTasks_; ++ii)
+      next[ii+1] = next[ii] + recvCnt[ii];
+   for (unsigned ii=0; ii<ghostGid_.size(); ++ii)
+      ghostOwner_[ii] = owners[next[ghostGid_[ii] % nTasks_]++];
+}
+
+/** Owner of gid as far as this task knows, -1 if it isn't tissue.
+ *  Local cells are owned by their dest_. */
+int GraphPartitioner::owner(Long64 gid) const
+{
+   vector<Long64>::const_iterator here =
+      lower_bound(localGid_.begin(), localGid_.end(), gid);
+   if (here != localGid_.end() && *here == gid)
+      return cells_[here - localGid_.begin()].dest_;
+   here = lower_bound(ghostGid_.begin(), ghostGid_.end(), gid);
+   if (here != ghostGid_.end() && *here == gid)
+      return ghostOwner_[here - ghostGid_.begin()];
+   return -1;
+}
+
+/** One sweep of k-way refinement.  On even sweeps cells only move to
+ *  higher ranks, on odd sweeps to lower ranks. */
+void GraphPartitioner::refine(int sweep)
+{
+   findGhostOwners();
+
+   // neighbor pairs and the number of stencil pairs behind them
+   map<int, int> contact;
+   for (unsigned ii=0; ii<ghostGid_.size(); ++ii)
+      if (ghostOwner_[ii] >= 0)
+         contact[ghostOwner_[ii]] = 0;
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+   {
+      Tuple tt = gidToTuple_(cells_[ii].gid_);
+      for (int jj=0; jj<nStencil; ++jj)
+      {
+         int x = tt.x() + stencil[jj][0];
+         int y = tt.y() + stencil[jj][1];
+         int z = tt.z() + stencil[jj][2];
+         if (x < 0 || y < 0 || z < 0 || x >= nx_ || y >= ny_ || z >= nz_)
+            continue;
+         int oo = owner(x + nx_*(y + Long64(ny_)*z));
+         if (oo >= 0 && oo != myRank_)
+            ++contact[oo];
+      }
+   }
+
+   vector<int> load(nTasks_), nNbr(nTasks_);
+   int myLoad = cells_.size();
+   int myNbr = contact.size();
+   MPI_Allgather(&myLoad, 1, MPI_INT, &load[0], 1, MPI_INT, comm_);
+   MPI_Allgather(&myNbr, 1, MPI_INT, &nNbr[0], 1, MPI_INT, comm_);
+   double aveLoad = accumulate(load.begin(), load.end(), 0.0)/nTasks_;
+   double aveNbr = max(1.0, accumulate(nNbr.begin(), nNbr.end(), 0.0)/nTasks_);
+   int maxLoad = int(aveLoad*(1+imbalance_));
+   int minLoad = int(aveLoad*(1-imbalance_)) + 1;
+
+   // my neighbors tell me who their neighbors are
+   vector<vector<int> > nbrOfNbr;
+   {
+      vector<int> myNbrs;
+      for (map<int, int>::const_iterator iter=contact.begin(); iter!=contact.end(); ++iter)
+         myNbrs.push_back(iter->first);
+      vector<vector<int> > send(nTasks_);
+      for (unsigned ii=0; ii<myNbrs.size(); ++ii)
+         send[myNbrs[ii]] = myNbrs;
+      vector<int> recv, recvCnt;
+      exchange(send, recv, recvCnt, comm_);
+      nbrOfNbr.resize(nTasks_);
+      unsigned kk = 0;
+      for (int ii=0; ii<nTasks_; ++ii)
+      {
+         nbrOfNbr[ii].assign(recv.begin()+kk, recv.begin()+kk+recvCnt[ii]);
+         kk += recvCnt[ii];
+      }
+   }
+   set<pair<int, int> > newPairs;
+   vector<int> moved(nTasks_, 0);
+   int nOut = 0;
+
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+   {
+      if (myLoad - nOut <= minLoad)
+         break;
+      Tuple tt = gidToTuple_(cells_[ii].gid_);
+      int nbrOwner[nStencil];
+      bool boundary = false;
+      for (int jj=0; jj<nStencil; ++jj)
+      {
+         int x = tt.x() + stencil[jj][0];
+         int y = tt.y() + stencil[jj][1];
+         int z = tt.z() + stencil[jj][2];
+         nbrOwner[jj] = -1;
+         if (x < 0 || y < 0 || z < 0 || x >= nx_ || y >= ny_ || z >= nz_)
+            continue;
+         nbrOwner[jj] = owner(x + nx_*(y + Long64(ny_)*z));
+         if (nbrOwner[jj] >= 0 && nbrOwner[jj] != myRank_)
+            boundary = true;
+      }
+      if (!boundary)
+         continue;
+
+      // stencil pairs of this cell with each task
+      map<int, int> pairs;
+      for (int jj=0; jj<nStencil; ++jj)
+         if (nbrOwner[jj] >= 0)
+            ++pairs[nbrOwner[jj]];
+      int facesMine = 0;
+      for (int jj=0; jj<nFaces; ++jj)
+         facesMine += (nbrOwner[jj] == myRank_);
+
+      int bestTarget = -1;
+      double bestDelta = 0;
+      for (map<int, int>::const_iterator target=pairs.begin(); target!=pairs.end(); ++target)
+      {
+         int bb = target->first;
+         if (bb == myRank_ || (sweep % 2 == 0) != (bb > myRank_))
+            continue;
+         int quota = (maxLoad - load[bb])/max(1, nNbr[bb]);
+         if (moved[bb] >= quota)
+            continue;
+         int facesTarget = 0;
+         for (int jj=0; jj<nFaces; ++jj)
+            facesTarget += (nbrOwner[jj] == bb);
+         if (facesTarget == 0)
+            continue;
+
+         double delta = facesMine - facesTarget;
+         for (map<int, int>::const_iterator xx=pairs.begin(); xx!=pairs.end(); ++xx)
+         {
+            int other = xx->first;
+            if (other == myRank_)
+               continue;
+            double wMe = nNbr[myRank_]/aveNbr;
+            double wOther = nNbr[other]/aveNbr;
+            double wTarget = nNbr[bb]/aveNbr;
+            // this cell may be my last contact with other
+            if (contact[other] == xx->second &&
+                (other != bb || pairs.count(myRank_) == 0))
+               delta -= nbrWeight_*(wMe + wOther);
+            // and bb may gain other as a neighbor
+            if (other != bb &&
+                !binary_search(nbrOfNbr[bb].begin(), nbrOfNbr[bb].end(), other) &&
+                newPairs.count(make_pair(bb, other)) == 0)
+               delta += nbrWeight_*(wTarget + wOther);
+         }
+         if (delta < bestDelta ||
+             (delta == 0 && bestTarget < 0 && load[myRank_] - nOut > load[bb] + moved[bb] + 1))
+         {
+            bestDelta = delta;
+            bestTarget = bb;
+         }
+      }
+      if (bestTarget < 0)
+         continue;
+
+      for (map<int, int>::const_iterator xx=pairs.begin(); xx!=pairs.end(); ++xx)
+      {
+         if (xx->first == myRank_)
+            contact[bestTarget] += xx->second;
+         else
+            contact[xx->first] -= xx->second;
+         if (xx->first != bestTarget)
+            newPairs.insert(make_pair(bestTarget, xx->first));
+      }
+      cells_[ii].dest_ = bestTarget;
+      ++moved[bestTarget];
+      ++nOut;
+   }
+
+   exchangeCells(comm_);
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+      cells_[ii].dest_ = myRank_;
+   sort(cells_.begin(), cells_.end(), AnatomyCellGidSort());
+}
+
+void GraphPartitioner::printStatistics(const char* label)
+{
+   findGhostOwners();
+   Long64 cutFaces = 0;
+   set<int> nbrs;
+   for (unsigned ii=0; ii<cells_.size(); ++ii)
+   {
+      Tuple tt = gidToTuple_(cells_[ii].gid_);
+      for (int jj=0; jj<nStencil; ++jj)
+      {
+         int x = tt.x() + stencil[jj][0];
+         int y = tt.y() + stencil[jj][1];
+         int z = tt.z() + stencil[jj][2];
+         if (x < 0 || y < 0 || z < 0 || x >= nx_ || y >= ny_ || z >= nz_)
+            continue;
+         int oo = owner(x + nx_*(y + Long64(ny_)*z));
+         if (oo < 0 || oo == myRank_)
+            continue;
+         nbrs.insert(oo);
+         if (jj < nFaces)
+            ++cutFaces;
+      }
+   }
+   int local[2] = {int(cells_.size()), int(nbrs.size())};
+   int maxVal[2], minVal[2];
+   Long64 sum[3] = {Long64(local[0]), cutFaces, Long64(local[1])};
+   MPI_Allreduce(local, maxVal, 2, MPI_INT, MPI_MAX, comm_);
+   MPI_Allreduce(local, minVal, 2, MPI_INT, MPI_MIN, comm_);
+   MPI_Allreduce(MPI_IN_PLACE, sum, 3, MPI_UINT64_T, MPI_SUM, comm_);
+   if (myRank_ == 0)
+      cout << "GraphPartitioner " << label << ":"
+           << " min/ave/max load = " << minVal[0] << " " << double(sum[0])/nTasks_
+           << " " << maxVal[0]
+           << ", cut faces = " << sum[1]/2
+           << ", min/ave/max neighbors = " << minVal[1] << " " << double(sum[2])/nTasks_
+           << " " << maxVal[1] << endl;
+}
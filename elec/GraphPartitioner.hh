@@ -0,0 +1,86 @@
+#ifndef GRAPH_PARTITIONER_HH
+#define GRAPH_PARTITIONER_HH
+
+#include <vector>
+#include <mpi.h>
+#include "AnatomyCell.hh"
+#include "IndexToTuple.hh"
+#include "Long64.hh"
+
+class Anatomy;
+
+struct GraphPartitionerParms
+{
+   bool verbose;
+   int maxVertices;   // size limit of the replicated graph of a bisection
+   int nTrials;       // initial bisections of the coarsest graph
+   int refineSweeps;  // sweeps of the final k-way refinement
+   double imbalance;  // allowed (max load)/(average load) - 1
+   double nbrWeight;  // cost of a neighbor task in units of cut faces
+};
+
+/** Multilevel graph partitioner on the voxel adjacency graph.
+ *
+ *  The geometric balancers balance cell counts but don't look at the
+ *  halo.  This one minimizes the number of cut faces (the halo that
+ *  HaloExchange sends every step) subject to a load balance tolerance
+ *  and penalizes the number of neighbor tasks.
+ *
+ *  The tasks are split by parallel recursive bisection.  At each level
+ *  the tasks of a subdomain aggregate its voxels into blocks, small
+ *  enough that the block graph has at most maxVertices vertices, and
+ *  build that graph together.  Every task then bisects the replicated
+ *  block graph with its own random seed (heavy edge matching, greedy
+ *  graph growing, boundary FM refinement on the way back up) and the
+ *  best bisection wins.  The two halves go to two halves of the tasks
+ *  and the recursion continues on split communicators until each
+ *  subdomain has one task.  Since the subdomains shrink, the blocks
+ *  become single voxels at the deep levels.
+ *
+ *  A few sweeps of parallel k-way refinement on the voxels then move
+ *  boundary cells between neighbor tasks where that lowers
+ *
+ *     cut faces + nbrWeight * (weighted number of neighbor pairs)
+ *
+ *  without exceeding the load tolerance.  A neighbor pair (A,B) is
+ *  weighted by nNbr(A)/<nNbr> + nNbr(B)/<nNbr> so that tasks with many
+ *  neighbors shed them first.  Two tasks are neighbors if their cells
+ *  are within the 18 point stencil.  Moves alternate between going to
+ *  higher and lower ranks so that neighbors never swap the same cells.
+ *
+ *  On return each task holds the cells it owns and dest_ is its rank.
+ */
+class GraphPartitioner
+{
+ public:
+   GraphPartitioner(Anatomy& anatomy, const GraphPartitionerParms& parms,
+                    MPI_Comm comm);
+
+ private:
+   void bisect(MPI_Comm comm, double tolerance);
+   void refine(int sweep);
+   void findGhostOwners();
+   int owner(Long64 gid) const;
+   void exchangeCells(MPI_Comm comm);
+   void printStatistics(const char* label);
+
+   bool verbose_;
+   int maxVertices_;
+   int nTrials_;
+   int refineSweeps_;
+   double imbalance_;
+   double nbrWeight_;
+
+   MPI_Comm comm_;
+   int myRank_;
+   int nTasks_;
+   int nx_, ny_, nz_;
+   IndexToTuple gidToTuple_;
+
+   std::vector<AnatomyCell>& cells_;
+   std::vector<Long64> localGid_;  // sorted gids of cells_
+   std::vector<Long64> ghostGid_;  // sorted gids near my cells owned elsewhere
+   std::vector<int> ghostOwner_;
+};
+
+#endif
@@ -212,8 +212,8 @@ GridRouter::GridRouter(vector<Long64>& gid, int nx, int ny, int nz, MPI_Comm com
    }
 
    int rc = selfTest();
-   MPI_Barrier(MPI_COMM_WORLD);
-   if (rc != 0) MPI_Abort(MPI_COMM_WORLD, -1);
+   MPI_Barrier(comm_);
+   if (rc != 0) MPI_Abort(comm_, -1);
 
 }
 
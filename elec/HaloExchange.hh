@@ -8,6 +8,7 @@
 #include "PerformanceTimers.hh"
 #include "DeviceFor.hh"
 #include "cudaNVTX.h"
+#include "ddcMalloc.h"
 
 #ifdef SPI
 #include "spi_impl.h"
@@ -67,6 +68,7 @@ class HaloExchangeBase
    virtual void fillSendBuffer(ro_mgarray_ptr<T> _externalData)
    {
       startTimer(PerformanceTimers::haloMove2BufTimer);
+      DdcMemTagScope memTag(DDCMEM_HALO);
 
       ro_array_ptr<int> sendMap = sendMap_.readonly(CPU);
       wo_array_ptr<T> sendBuf = sendBuf_.writeonly(CPU);
@@ -198,6 +200,7 @@ class HaloExchange : public HaloExchangeBase<T>
    {
 #pragma omp critical 
       {
+         DdcMemTagScope memTag(DDCMEM_HALO);
          const char* sendBuf = (const char*)sendBuf_.readonly(CPU).raw();
          char* recvBuf = (char*)recvBuf_.writeonly(CPU).raw();
 
@@ -272,6 +275,7 @@ class HaloExchangeDevice : public HaloExchange<T>
    void fillSendBuffer(ro_mgarray_ptr<T> _data)
    {
       startTimer(PerformanceTimers::haloMove2BufTimer);
+      DdcMemTagScope memTag(DDCMEM_HALO);
 
       ro_array_ptr<int> sendMap = sendMap_.readonly(DEFAULT_COMPUTE_SPACE);
       wo_array_ptr<T> sendBuf = sendBuf_.writeonly(DEFAULT_COMPUTE_SPACE);
@@ -7,6 +7,8 @@
 #include <algorithm>
 #include <cassert>
 #include <sstream>
+#include <map>
+#include <unordered_map>
 #include "ioUtils.h"
 #include "GridAssignmentObject.h"
 #include "mpiUtils.h"
@@ -16,6 +18,109 @@
 #include "writeCells.hh"
 using namespace std;
 
+namespace
+{
+   /** Sends send[task] to every task in send and receives what the
+    *  other tasks send to this one, without knowing in advance who they
+    *  are.  Uses synchronous sends and a nonblocking barrier, so the
+    *  cost depends on the number of partners, not on the number of
+    *  tasks. */
+   void sparseExchange(const map<int, vector<char> >& send,
+                       map<int, vector<char> >& recv, int tag, MPI_Comm comm)
+   {
+      vector<MPI_Request> request(send.size());
+      unsigned nSend = 0;
+      for (map<int, vector<char> >::const_iterator iter=send.begin(); iter!=send.end(); ++iter)
+         MPI_Issend(const_cast<char*>(iter->second.data()), iter->second.size(), MPI_BYTE,
+                    iter->first, tag, comm, &request[nSend++]);
+
+      recv.clear();
+      MPI_Request barrier;
+      bool sendsDone = false;
+      while (true)
+      {
+         int flag;
+         MPI_Status status;
+         MPI_Iprobe(MPI_ANY_SOURCE, tag, comm, &flag, &status);
+         if (flag)
+         {
+            int count;
+            MPI_Get_count(&status, MPI_BYTE, &count);
+            vector<char>& buf = recv[status.MPI_SOURCE];
+            buf.resize(count);
+            MPI_Recv(buf.data(), count, MPI_BYTE, status.MPI_SOURCE, tag, comm,
+                     MPI_STATUS_IGNORE);
+         }
+         if (sendsDone)
+         {
+            int done;
+            MPI_Test(&barrier, &done, MPI_STATUS_IGNORE);
+            if (done)
+               break;
+         }
+         else
+         {
+            int done;
+            MPI_Testall(nSend, request.data(), &done, MPI_STATUSES_IGNORE);
+            if (done)
+            {
+               MPI_Ibarrier(comm, &barrier);
+               sendsDone = true;
+            }
+         }
+      }
+   }
+
+   /** Uniform grid of buckets over a set of centers.  With a bucket
+    *  size of at least the interaction range all candidates for a point
+    *  are in the 27 surrounding buckets. */
+   class CenterIndex
+   {
+    public:
+      CenterIndex(const vector<Vector>& centers, const vector<int>& ids, double bucketSize)
+      : h_(bucketSize)
+      {
+         for (unsigned ii=0; ii<ids.size(); ++ii)
+            bucket_[key(centers[ids[ii]], 0, 0, 0)].push_back(ids[ii]);
+      }
+
+      void near(const Vector& r, vector<int>& ids) const
+      {
+         ids.clear();
+         for (int ix=-1; ix<=1; ++ix)
+            for (int iy=-1; iy<=1; ++iy)
+               for (int iz=-1; iz<=1; ++iz)
+               {
+                  unordered_map<long long, vector<int> >::const_iterator here =
+                     bucket_.find(key(r, ix, iy, iz));
+                  if (here != bucket_.end())
+                     ids.insert(ids.end(), here->second.begin(), here->second.end());
+               }
+      }
+
+    private:
+      long long key(const Vector& r, int dx, int dy, int dz) const
+      {
+         const long long offset = 1<<20;
+         long long ix = (long long)floor(r.x()/h_) + dx + offset;
+         long long iy = (long long)floor(r.y()/h_) + dy + offset;
+         long long iz = (long long)floor(r.z()/h_) + dz + offset;
+         return ix + (iy<<21) + (iz<<42);
+      }
+
+      double h_;
+      unordered_map<long long, vector<int> > bucket_;
+   };
+
+   struct CenterRecord
+   {
+      int id;
+      double r[3];
+      double radius;
+      double alpha;
+   };
+}
+
 
 // ToDo
 // 1.  The (test) results are not reproducible across different numbers
@@ -41,7 +146,7 @@ using namespace std;
 
 
 
-Koradi::Koradi(Anatomy& anatomy, const KoradiParms& parms)
+Koradi::Koradi(Anatomy& anatomy, const KoradiParms& parms, MPI_Comm comm)
 :verbose_(parms.verbose),
  nCentersPerTask_(parms.nCentersPerTask),
  maxVoronoiSteps_(parms.maxVoronoiSteps),
@@ -50,20 +155,23 @@ Koradi::Koradi(Anatomy& anatomy, const KoradiParms& parms)
  tolerance_      (parms.tolerance),
  nbrDeltaR_      (parms.nbrDeltaR),
  alphaStep_      (parms.alphaStep),
+ comm_           (comm),
  indexToVector_  (anatomy.nx(), anatomy.ny(), anatomy.nz()),
  indexTo3Vector_ (anatomy.nx(), anatomy.ny(), anatomy.nz()),
  cells_          (anatomy.cellArray())
 {
-   MPI_Comm_size(MPI_COMM_WORLD, &nTasks_);
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank_);
+   MPI_Comm_size(comm_, &nTasks_);
+   MPI_Comm_rank(comm_, &myRank_);
 
    localOffset_ = myRank_*nCentersPerTask_;
+   nExchanges_ = 0;
 
    centers_.resize(nTasks_*nCentersPerTask_);
    radii_.resize(nTasks_*nCentersPerTask_);
    alpha_.resize(nTasks_*nCentersPerTask_, 1.0);
    load_.resize(nTasks_*nCentersPerTask_, 0.0);
    nbrDomains_.resize(nCentersPerTask_);
+   haveNbrDomains_ = false;
 
    if (centers_.size() == 1 ) maxVoronoiSteps_ = 1;
 
@@ -83,13 +191,16 @@ Koradi::Koradi(Anatomy& anatomy, const KoradiParms& parms)
             DirTestCreate(fullname.c_str());
          fullname += "/domains";
          writeCells(cells_, anatomy.nx(), anatomy.ny(), anatomy.nz(),
-                    fullname.c_str());
+                    fullname.c_str(), comm_);
       }
       
       if (verbose_)
          printStatistics();
 
-      double maxLoad = *max_element(load_.begin(), load_.end());
+      // the only global communication of a step
+      double maxLoad = *max_element(load_.begin()+localOffset_,
+                                    load_.begin()+localOffset_+nCentersPerTask_);
+      MPI_Allreduce(MPI_IN_PLACE, &maxLoad, 1, MPI_DOUBLE, MPI_MAX, comm_);
       double imbalance = abs(maxLoad - targetLoad_)/targetLoad_;
       if (imbalance < tolerance_)
          break;
@@ -102,14 +213,15 @@ Koradi::Koradi(Anatomy& anatomy, const KoradiParms& parms)
    DirTestCreate(fullname.c_str());
    fullname += "/domains";
    writeCells(cells_, anatomy.nx(), anatomy.ny(), anatomy.nz(),
-              fullname.c_str());
+              fullname.c_str(), comm_);
    */
 }
 
 void Koradi::balanceStep()
 {
-   findNbrDomains();
    biasAlpha();
+   exchangeCenters();
+   findNbrDomains();
    assignCells();
    moveCenters();
    computeRadii();
@@ -122,6 +234,8 @@ void Koradi::voronoiBalance()
       assignCells();
       moveCenters();
       computeRadii();
+      exchangeCenters();
+      findNbrDomains();
       if (verbose_) {
          computeLoad(load_);
          printStatistics();
@@ -139,8 +253,9 @@ void Koradi::distributeCellsEvenly()
 {
    Long64 nLocal = cells_.size();
    Long64 nGlobal = 0;
-   MPI_Allreduce(&nLocal, &nGlobal, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+   MPI_Allreduce(&nLocal, &nGlobal, 1, MPI_LONG_LONG, MPI_SUM, comm_);
    if (myRank_ == 0) cout << "nGlobal = "<<nGlobal<<" nAve = " <<nGlobal/nTasks_/nCentersPerTask_<<endl;
+   targetLoad_ = double(nGlobal)/(nTasks_*nCentersPerTask_);
    
    size_t nWant = nGlobal / nTasks_;
    unsigned nExtra = nGlobal % nTasks_;
@@ -152,7 +267,7 @@ void Koradi::distributeCellsEvenly()
                    nLocal,
                    nWant,
                    sizeof(AnatomyCell),
-                   MPI_COMM_WORLD);
+                   comm_);
    cells_.resize(nWant);
 }
 
@@ -173,7 +288,7 @@ void Koradi::pickInitialCenters()
       centers_[ii+localOffset_] = indexToVector_(gid);
    }
 
-   allGather(centers_, nCentersPerTask_, MPI_COMM_WORLD);
+   allGather(centers_, nCentersPerTask_, comm_);
    if (myRank_ ==0)
    {
       cout <<"Finished initial centers" <<endl;
@@ -191,17 +306,20 @@ void Koradi::assignCells()
 void Koradi::calculateCellDestinations()
 {
    // Without nbr domain info, bootstrap using a grid approach.
-   if (nbrDomains_[0].size() == 0)
+   if (!haveNbrDomains_)
    {
       GRID_ASSIGNMENT_OBJECT* gao = gao_init(centers_.size(),
                                              (const void*) &(centers_[0]),
                                              sizeof(Vector));
    
+      vector<THREE_VECTOR> r(cells_.size());
+      vector<int> dest(cells_.size());
       for (unsigned ii=0; ii<cells_.size(); ++ii)
-      {
-         THREE_VECTOR r = indexTo3Vector_(cells_[ii].gid_);
-         cells_[ii].dest_ = gao_nearestCenter(gao, r);
-      }
+         r[ii] = indexTo3Vector_(cells_[ii].gid_);
+      if (r.size() > 0)
+         gao_nearestCenters(gao, r.size(), (const void*) &r[0], sizeof(THREE_VECTOR), &dest[0]);
+      for (unsigned ii=0; ii<cells_.size(); ++ii)
+         cells_[ii].dest_ = dest[ii];
       gao_destroy(gao);
    }
    else // we know which domains might be close
@@ -233,22 +351,30 @@ void Koradi::calculateCellDestinations()
 void Koradi::exchangeCells()
 {
    AnatomyCellDestSort sortByDest;
-   sort(cells_.begin(), cells_.end(), sortByDest);
-   vector<unsigned> dest(cells_.size());
+
+   // Once the neighbors are known cells only move between neighbors,
+   // so a sparse exchange avoids assignArray's global reduction.
+   map<int, vector<char> > send, recv;
+   unsigned nKeep = 0;
    for (unsigned ii=0; ii<cells_.size(); ++ii)
-      dest[ii] = cells_[ii].dest_/nCentersPerTask_;
-   
-   unsigned nLocal = cells_.size();
-   unsigned capacity = max(vector<AnatomyCell>::size_type(10000), 4*cells_.size());
-   cells_.resize(capacity);
-   assignArray((unsigned char*) &(cells_[0]),
-               &nLocal,
-               capacity,
-               sizeof(AnatomyCell),
-               &(dest[0]),
-               0,
-               MPI_COMM_WORLD);
-   cells_.resize(nLocal);
+   {
+      int task = cells_[ii].dest_/nCentersPerTask_;
+      if (task == myRank_)
+      {
+         cells_[nKeep++] = cells_[ii];
+         continue;
+      }
+      const char* cell = (const char*) &cells_[ii];
+      vector<char>& buf = send[task];
+      buf.insert(buf.end(), cell, cell+sizeof(AnatomyCell));
+   }
+   cells_.resize(nKeep);
+   sparseExchange(send, recv, exchangeTag(), comm_);
+   for (map<int, vector<char> >::const_iterator iter=recv.begin(); iter!=recv.end(); ++iter)
+   {
+      const AnatomyCell* cell = (const AnatomyCell*) iter->second.data();
+      cells_.insert(cells_.end(), cell, cell + iter->second.size()/sizeof(AnatomyCell));
+   }
    sort(cells_.begin(), cells_.end(), sortByDest);
 }
 
@@ -269,7 +395,6 @@ void Koradi::moveCenters()
 
    for (unsigned ii=0; ii<nCentersPerTask_; ++ii)
       centers_[ii+localOffset_] /= double(nCells[ii+localOffset_]);
-   allGather(centers_, nCentersPerTask_, MPI_COMM_WORLD);
 }
 
 // We impose minimum radius to ensure that if a domain happens to
@@ -277,7 +402,8 @@ void Koradi::moveCenters()
 // volume.
 void Koradi::computeRadii()
 {
-   radii_.assign(radii_.size(), 0.);
+   for (unsigned ii=0; ii<nCentersPerTask_; ++ii)
+      radii_[ii+localOffset_] = 0.;
    
    #pragma omp parallel for
    for (int ii=0; ii<cells_.size(); ++ii)
@@ -289,20 +415,26 @@ void Koradi::computeRadii()
       radii_[cellOwner] = max(radii_[cellOwner], r2);
    }
 
-   for (unsigned ii=0; ii<radii_.size(); ++ii)
-      radii_[ii] = sqrt(radii_[ii]);
-
-   allGather(radii_, nCentersPerTask_, MPI_COMM_WORLD);
+   for (unsigned ii=0; ii<nCentersPerTask_; ++ii)
+      radii_[ii+localOffset_] = sqrt(radii_[ii+localOffset_]);
 }
 
 void Koradi::printStatistics()
 {
    computeRadii();
 
-   double maxLoad = *max_element(load_.begin(), load_.end());
-   double minLoad = *min_element(load_.begin(), load_.end());
-   double maxRadius = *max_element(radii_.begin(), radii_.end());
-   double minRadius = *min_element(radii_.begin(), radii_.end());
+   vector<double>::const_iterator loadBegin = load_.begin() + localOffset_;
+   vector<double>::const_iterator radiiBegin = radii_.begin() + localOffset_;
+   double value[4];
+   value[0] = -*min_element(loadBegin, loadBegin+nCentersPerTask_);
+   value[1] = *max_element(loadBegin, loadBegin+nCentersPerTask_);
+   value[2] = -*min_element(radiiBegin, radiiBegin+nCentersPerTask_);
+   value[3] = *max_element(radiiBegin, radiiBegin+nCentersPerTask_);
+   MPI_Allreduce(MPI_IN_PLACE, value, 4, MPI_DOUBLE, MPI_MAX, comm_);
+   double minLoad = -value[0];
+   double maxLoad = value[1];
+   double minRadius = -value[2];
+   double maxRadius = value[3];
 
    if (myRank_ == 0)
    {
@@ -315,13 +447,7 @@ void Koradi::printStatistics()
 void Koradi::biasAlpha()
 {
    computeLoad(load_);
-
-   double globalAveLoad=0;
-   for (unsigned ii=0; ii<load_.size(); ++ii)
-      globalAveLoad += load_[ii];
-   globalAveLoad /= load_.size();
-   
-   targetLoad_ = globalAveLoad;
+   double globalAveLoad = targetLoad_;
 
    for (unsigned ii=0; ii<nCentersPerTask_; ++ii)
    {
@@ -335,22 +461,126 @@ void Koradi::biasAlpha()
          alpha_[localOffset_+ii] /= 1+alphaStep_;
       }
    }
+}
+
+/** Bootstrap: every task learns every center once. */
+void Koradi::gatherAllCenters()
+{
+   allGather(centers_, nCentersPerTask_, comm_);
+   allGather(radii_, nCentersPerTask_, comm_);
+   allGather(alpha_, nCentersPerTask_, comm_);
+   knownCenters_.clear();
+   for (int ii=0; ii<int(centers_.size()); ++ii)
+      if (ii < localOffset_ || ii >= localOffset_+nCentersPerTask_)
+         knownCenters_.push_back(ii);
+}
+
+/** Sends the center, radius and alpha of the local centers to the
+ *  tasks that own their neighbor domains, along with what this task
+ *  knows about those neighbors, so that a domain that moves within
+ *  range of a neighbor's neighbor is found in the next
+ *  findNbrDomains.  knownCenters_ is rebuilt from what arrives. */
+void Koradi::exchangeCenters()
+{
+   if (!haveNbrDomains_)
+   {
+      gatherAllCenters();
+      return;
+   }
 
-   allGather(alpha_, nCentersPerTask_, MPI_COMM_WORLD);
+   vector<CenterRecord> record;
+   vector<int> nbrCenters;
+   for (unsigned ii=0; ii<nCentersPerTask_; ++ii)
+      nbrCenters.insert(nbrCenters.end(), nbrDomains_[ii].begin(), nbrDomains_[ii].end());
+   sort(nbrCenters.begin(), nbrCenters.end());
+   nbrCenters.erase(unique(nbrCenters.begin(), nbrCenters.end()), nbrCenters.end());
+   for (int ii=0; ii<nCentersPerTask_; ++ii)
+      nbrCenters.push_back(ii+localOffset_);
+   for (unsigned ii=0; ii<nbrCenters.size(); ++ii)
+   {
+      int id = nbrCenters[ii];
+      CenterRecord rec;
+      rec.id = id;
+      for (int jj=0; jj<3; ++jj)
+         rec.r[jj] = centers_[id][jj];
+      rec.radius = radii_[id];
+      rec.alpha = alpha_[id];
+      record.push_back(rec);
+   }
+
+   map<int, vector<char> > send, recv;
+   const char* begin = (const char*) record.data();
+   const char* end = begin + record.size()*sizeof(CenterRecord);
+   for (unsigned ii=0; ii<nbrCenters.size(); ++ii)
+   {
+      int task = nbrCenters[ii]/nCentersPerTask_;
+      if (task != myRank_ && send.count(task) == 0)
+         send[task].assign(begin, end);
+   }
+   sparseExchange(send, recv, exchangeTag(), comm_);
+
+   // What a task says about its own centers beats what its neighbors
+   // say about them.
+   knownCenters_.clear();
+   for (int pass=0; pass<2; ++pass)
+      for (map<int, vector<char> >::const_iterator iter=recv.begin(); iter!=recv.end(); ++iter)
+      {
+         const CenterRecord* rec = (const CenterRecord*) iter->second.data();
+         unsigned nRec = iter->second.size()/sizeof(CenterRecord);
+         for (unsigned ii=0; ii<nRec; ++ii)
+         {
+            int id = rec[ii].id;
+            int owner = id/nCentersPerTask_;
+            if (owner == myRank_ || (pass == 0) == (owner == iter->first))
+               continue;
+            centers_[id] = Vector(rec[ii].r[0], rec[ii].r[1], rec[ii].r[2]);
+            radii_[id] = rec[ii].radius;
+            alpha_[id] = rec[ii].alpha;
+            knownCenters_.push_back(id);
+         }
+      }
+   sort(knownCenters_.begin(), knownCenters_.end());
+   knownCenters_.erase(unique(knownCenters_.begin(), knownCenters_.end()), knownCenters_.end());
 }
 
+/** A task leaves sparseExchange when the barrier completes, so it can
+ *  post the sends of its next exchange while a neighbor still probes
+ *  for the last one.  Each exchange gets its own tag so that the
+ *  neighbor doesn't take them for the current round.  Every task makes
+ *  the same exchanges in the same order, and the tags stay well below
+ *  the smallest MPI_TAG_UB (32767). */
+int Koradi::exchangeTag()
+{
+   return 7300 + nExchanges_++ % 16384;
+}
+
+/** Neighbor domains of the local centers among the known centers,
+ *  found through a bucket grid so the cost doesn't grow with the
+ *  number of tasks. */
 void Koradi::findNbrDomains()
 {
    for (unsigned ii=0; ii<nCentersPerTask_; ++ii)
       nbrDomains_[ii].clear();
 
+   vector<int> candidates(knownCenters_);
+   double maxRadius = 0;
+   for (unsigned ii=0; ii<nCentersPerTask_; ++ii)
+      candidates.push_back(ii+localOffset_);
+   for (unsigned ii=0; ii<candidates.size(); ++ii)
+      maxRadius = max(maxRadius, radii_[candidates[ii]]);
+   CenterIndex index(centers_, candidates, 2*maxRadius + nbrDeltaR_ + 1e-6);
+
+   vector<int> near;
    for (unsigned iCenter=0; iCenter<nCentersPerTask_; ++iCenter)
    {
       unsigned ii = iCenter+localOffset_;
       const Vector& ci = centers_[ii];
       double rii = radii_[ii];
-      for (unsigned jj=0; jj<centers_.size(); ++jj)
+      index.near(ci, near);
+      sort(near.begin(), near.end());
+      for (unsigned kk=0; kk<near.size(); ++kk)
       {
+         unsigned jj = near[kk];
          if (jj == ii)
             continue;
          Vector cij = ci - centers_[jj];
@@ -360,6 +590,7 @@ void Koradi::findNbrDomains()
              nbrDomains_[iCenter].push_back(jj);
       }
    }
+   haveNbrDomains_ = true;
 }
 
 
@@ -389,6 +620,7 @@ void Koradi::bruteForceDistanceCheck()
    }
 }
 
+// Only the load of the local centers.  Nobody else needs it.
 void Koradi::computeLoad(vector<double>& load)
 {
    load.assign(nTasks_*nCentersPerTask_, 0.);
@@ -397,5 +629,4 @@ void Koradi::computeLoad(vector<double>& load)
    {
       load[cells_[ii].dest_] += 1;
    }
-   allGather(load, nCentersPerTask_, MPI_COMM_WORLD);
 }
@@ -2,6 +2,7 @@
 #define KORADI_HH
 
 #include <vector>
+#include <mpi.h>
 #include "AnatomyCell.hh"
 #include "Vector.hh"
 #include "IndexToVector.hh"
@@ -26,7 +27,7 @@ class Koradi
 {
  public:
    
-   Koradi(Anatomy&, const KoradiParms& parms);
+   Koradi(Anatomy&, const KoradiParms& parms, MPI_Comm comm);
    
    
  private:
@@ -46,8 +47,11 @@ class Koradi
    void calculateCellDestinations();
    void exchangeCells();
    void bruteForceDistanceCheck();
+   void gatherAllCenters();
+   void exchangeCenters();
    void findNbrDomains();
    void computeLoad(std::vector<double>& load);
+   int exchangeTag();
 
 
    bool verbose_;
@@ -60,14 +64,17 @@ class Koradi
    double tolerance_;
    double nbrDeltaR_;
 
+   MPI_Comm comm_;
    int myRank_;
    int nTasks_;
    int localOffset_;
+   int nExchanges_;  // sparse exchanges so far, see exchangeTag
 
    IndexToVector indexToVector_;
    IndexToThreeVector indexTo3Vector_;
 
-   // shared globally
+   // Indexed by center, but only the local centers and knownCenters_
+   // are up to date.
    std::vector<Vector> centers_;
    std::vector<double> radii_;
    std::vector<double> alpha_;
@@ -77,6 +84,8 @@ class Koradi
    // local only
    std::vector<AnatomyCell>& cells_;
    std::vector<std::vector<int> > nbrDomains_;
+   std::vector<int> knownCenters_;  // remote centers heard from in the last exchange
+   bool haveNbrDomains_;
    
 };
 
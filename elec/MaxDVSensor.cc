@@ -17,7 +17,6 @@ MaxDVSensor::MaxDVSensor(const SensorParms& sp,
    comm_(comm),
    os_(os)
 {
-   MPI_Comm comm_ = MPI_COMM_WORLD;
    MPI_Comm_rank(comm_, &myRank_);
 
    nlocal_=anatomy.nLocal();
@@ -37,7 +36,6 @@ MaxDVSensor::MaxDVSensor(const SensorParms& sp,
    vdata_(vdata),
    comm_(comm)
 {
-   MPI_Comm comm_ = MPI_COMM_WORLD;
    MPI_Comm_rank(comm_, &myRank_);
 
    nlocal_=anatomy.nLocal();
@@ -19,7 +19,7 @@ MinMaxSensor::MinMaxSensor(const SensorParms& sp, const MinMaxSensorParms& p,
   vdata_(vdata),
   nLocal_(anatomy.nLocal())
 {
-  MPI_Comm comm = MPI_COMM_WORLD;
+  MPI_Comm comm = this->comm();
   MPI_Comm_rank(comm, &myRank_);
 
   string filename = p.dirname + "/" + p.filename;
@@ -32,7 +32,7 @@ MinMaxSensor::MinMaxSensor(const SensorParms& sp, const MinMaxSensorParms& p,
      fout_->setf(ios::scientific,ios::floatfield);
      (*fout_) << "#    time   min V_m    max V_m    max-min" << endl;
   }
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(comm);
 }
 
 MinMaxSensor::~MinMaxSensor()
@@ -57,8 +57,8 @@ void MinMaxSensor::print(double time, int /*loop*/)
    
    // MPI_Allreduce over all tasks to get global min/max
    double vmin, vmax;
-   MPI_Allreduce(&vmin_loc, &vmin, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
-   MPI_Allreduce(&vmax_loc, &vmax, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+   MPI_Allreduce(&vmin_loc, &vmin, 1, MPI_DOUBLE, MPI_MIN, comm());
+   MPI_Allreduce(&vmax_loc, &vmax, 1, MPI_DOUBLE, MPI_MAX, comm());
    
    if (myRank_ == 0)
    {
@@ -30,6 +30,17 @@ class NullDiffusion : public Diffusion
       }
    };
 
+   bool hasRangeCalc() const {return true;}
+   void updateLocalVoltageRange(ro_mgarray_ptr<double> VmLocal, int begin, int end) {};
+   void calcRange(rw_mgarray_ptr<double> _dVm, int begin, int end)
+   {
+      rw_array_ptr<double> dVm = _dVm.useOn(CPU);
+      for (int ii=begin; ii<end; ++ii)
+      {
+         dVm[ii] = 0;
+      }
+   };
+
    unsigned* blockIndex() {return &blockIndex_[0];}
    double* VmBlock() {return &Vm_;}
    double* dVmBlock() {return &dVm_;}
@@ -18,6 +18,7 @@
 #include <cassert>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 
@@ -75,12 +76,38 @@ static const char* interpName[] = {
          }
       }
 
+      if (reactionPrefitting())
+      {
+         if (reusingInterpolants || funcCount == 0)
+         {
+            delete reaction;
+            return NULL;
+         }
+         // The worker owns the parameterized model from here on.  It
+         // can't call MPI, so it gets the rank from here.
+         int myRank = getRank(0);
+         startInterpolantFit(obj->name, _dt, [reaction, _dt, funcCount, myRank]()
+         {
+            reaction->createInterpolants(_dt, myRank);
+            InterpolantSet fit(reaction->_interpolant, reaction->_interpolant+funcCount);
+            delete reaction;
+            return fit;
+         });
+         return NULL;
+      }
+
       if (!reusingInterpolants)
       {
-      reaction->createInterpolants(_dt);
+      InterpolantSet fit;
+      bool newFit = finishInterpolantFit(obj->name, _dt, fit, [reaction, _dt, funcCount]()
+      {
+         reaction->createInterpolants(_dt, getRank(0));
+         return InterpolantSet(reaction->_interpolant, reaction->_interpolant+funcCount);
+      });
+      copy(fit.begin(), fit.end(), reaction->_interpolant);
 
-      //save the interpolants
-      if (funcCount > 0 && getRank(0) == 0)
+      //save the interpolants, once for all the pieces of the task loop
+      if (newFit && funcCount > 0 && getRank(0) == 0)
       {
          ofstream outfile((string(obj->name) +".fit.data").c_str());
          outfile.precision(16);
@@ -119,7 +146,7 @@ static const char* interpName[] = {
 namespace Passive 
 {
 
-void ThisReaction::createInterpolants(const double _dt) {
+void ThisReaction::createInterpolants(const double _dt, const int myRank) {
 
 }
 
@@ -331,7 +358,7 @@ void ThisReaction::calc(double _dt,
          for (int __kk=0; __kk<width; __kk++)
          {
             __Vm_local[__kk] = __Vm[__indexArray[__ii+cursor]];
-            if (__ii+__kk < nCells_) { cursor++; }
+            if (__ii+cursor+1 < nCells_) { cursor++; }
          }
       }
       const real V = load(&__Vm_local[0]);
@@ -354,6 +381,17 @@ void ThisReaction::calc(double _dt,
    }
 }
 #endif //USE_CUDA
+
+/** Same arithmetic as calc so that both give identical results. */
+void ThisReaction::pointCalc(double, int nCells, const double* Vm,
+                             const double*, double*, double* dVm) const
+{
+   for (int ii=0; ii<nCells; ii++)
+   {
+      double Iion = G*(-E_R + Vm[ii]);
+      dVm[ii] = -Iion;
+   }
+}
    
 string ThisReaction::methodName() const
 {
@@ -35,7 +35,7 @@ namespace Passive
       ThisReaction(const int numPoints, const double __dt);
       std::string methodName() const;
       
-      void createInterpolants(const double _dt);
+      void createInterpolants(const double _dt, const int myRank);
       //void updateNonGate(double dt, const VectorDouble32&Vm, VectorDouble32&dVR);
       //void updateGate   (double dt, const VectorDouble32&Vm) ;
       virtual void getCheckpointInfo(std::vector<std::string>& fieldNames,
@@ -45,6 +45,10 @@ namespace Passive
       virtual double getValue(int iCell, int varHandle) const;
       virtual double getValue(int iCell, int varHandle, double V) const;
       virtual const std::string getUnit(const std::string& varName) const;
+      virtual int nPointStates() const {return 0;}
+      virtual void pointCalc(double dt, int nCells, const double* Vm,
+                             const double* iStim, double* state,
+                             double* dVm) const;
 
     private:
       unsigned nCells_;
@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include "pio.h"
 #include "mpiUtils.h"
+#include "external.h"
 #include "ioUtils.h"
 #include "tagServer.h"
 #include "unionOfStrings.hh"
@@ -69,6 +70,7 @@ namespace PerformanceTimers
    TimerHandle gateRLTimer;
    TimerHandle diffusionLoopTimer;
    TimerHandle integratorTimer;
+   TimerHandle timeBlockTimer;
    TimerHandle reactionLoopTimer;
    TimerHandle reactionWaitTimer;
    TimerHandle diffusionWaitTimer;
@@ -101,6 +103,7 @@ namespace PerformanceTimers
    TimerHandle timingBarrierTimer;
    TimerHandle FGR_2D_StencilTimerTimer;
    TimerHandle stencilOverlapTimer;
+   TimerHandle reproducibleSumTimer;
    
    vector<TimerStruct> timers_;
    typedef map<string, TimerHandle> HandleMap;
@@ -139,6 +142,7 @@ void  profileInit()
    GateNonGateTimer = profileGetHandle("GateNonGateBarrier");
    diffusionLoopTimer= profileGetHandle("DiffusionLoop");
    integratorTimer = profileGetHandle("Integrator");
+   timeBlockTimer = profileGetHandle("TimeBlock");
    haloTimer = profileGetHandle("HaloExchange");
    reactionLoopTimer = profileGetHandle("ReactionLoop");
    reactionWaitTimer = profileGetHandle("ReactionWait");
@@ -170,6 +174,7 @@ void  profileInit()
    timingBarrierTimer = profileGetHandle("TimingBarrier");
    FGR_2D_StencilTimer = profileGetHandle("FGR_2D_Stencil");
    stencilOverlapTimer = profileGetHandle("stencilOverlap");
+   reproducibleSumTimer = profileGetHandle("ReproducibleSums");
    machineSpecficInit(); 
 }
 void profileStart(const TimerHandle& handle)
@@ -388,7 +393,7 @@ void profileDumpTimes(ostream& out)
 
 void profileDumpAll(const string& dirname)
 {
-   MPI_Comm comm = MPI_COMM_WORLD;
+   MPI_Comm comm = COMM_LOCAL;
    int myRank;
    MPI_Comm_rank(comm, &myRank);
    if (myRank == 0)
@@ -409,7 +414,7 @@ void profileDumpAll(const string& dirname)
 
 void profileDumpStats(ostream& out)
 {
-   MPI_Comm comm = MPI_COMM_WORLD;
+   MPI_Comm comm = COMM_LOCAL;
    int myRank;
    MPI_Comm_rank(comm, &myRank);
    unsigned nTasks = getSize(0); 
@@ -31,6 +31,7 @@ namespace PerformanceTimers
    extern TimerHandle gateRLTimer;
    extern TimerHandle diffusionLoopTimer;
    extern TimerHandle integratorTimer;
+   extern TimerHandle timeBlockTimer;
    extern TimerHandle reactionLoopTimer;
    extern TimerHandle reactionWaitTimer;
    extern TimerHandle diffusionWaitTimer;
@@ -62,6 +63,7 @@ namespace PerformanceTimers
    extern TimerHandle printDataTimer;
    extern TimerHandle timingBarrierTimer;
    extern TimerHandle stencilOverlapTimer;
+   extern TimerHandle reproducibleSumTimer;
 };
 
 /** Use the startTimer and stopTimer macros for timers that are inside
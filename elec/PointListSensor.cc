@@ -20,7 +20,7 @@ PointListSensor::PointListSensor(const SensorParms& sp, const PointListSensorPar
   vdata_(vdata)
 {
   int myRank;
-  MPI_Comm comm = MPI_COMM_WORLD;
+  MPI_Comm comm = this->comm();
   MPI_Comm_rank(comm, &myRank);
 
   const int plistsize = p.pointList.size();
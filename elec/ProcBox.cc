@@ -4,6 +4,7 @@
 //ewd DEBUG
 #include "GridPoint.hh"
 #include <mpi.h>
+#include "mpiUtils.h"
 //ewd DEBUG
 using namespace std;
 
@@ -337,7 +338,7 @@ int ProcBox::trialMove(int dim, int val, ProcBox& nbrbox)
          GridPoint gpt(peid_,npex_,npey_,npez_);
          GridPoint nbrpt(nbr,npex_,npey_,npez_);
          int myRank_;
-         MPI_Comm_rank(MPI_COMM_WORLD, &myRank_);
+         myRank_ = getRank(0);
          if (myRank_ == 39)
             cout << "TRIAL_START:  dim = " << dim << ", val = " << val 
                  << ", pe " << peid_ << " (" << gpt.x << "," << gpt.y << "," << gpt.z << "), box = " <<
@@ -372,7 +373,7 @@ int ProcBox::trialMove(int dim, int val, ProcBox& nbrbox)
             GridPoint gpt(peid_,npex_,npey_,npez_);
             GridPoint nbrpt(nbr,npex_,npey_,npez_);
             int myRank_;
-            MPI_Comm_rank(MPI_COMM_WORLD, &myRank_);
+            myRank_ = getRank(0);
             if (myRank_ == 39)
                cout << "TRIAL_ACCEPTED:  dim = " << dim << ", val = " << val 
                     << ", pe " << peid_ << " (" << gpt.x << "," << gpt.y << "," << gpt.z << "), box = " <<
@@ -402,7 +403,7 @@ int ProcBox::trialMove(int dim, int val, ProcBox& nbrbox)
             int myRank_;
             myvol = volume();
             nbrvol = nbrbox.volume();
-            MPI_Comm_rank(MPI_COMM_WORLD, &myRank_);
+            myRank_ = getRank(0);
             if (myRank_ == 39)
                cout << "TRIAL_REJECTED1:  dim = " << dim << ", val = " << val 
                     << ", pe " << peid_ << " (" << gpt.x << "," << gpt.y << "," << gpt.z << "), box = " <<
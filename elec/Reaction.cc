@@ -90,6 +90,12 @@ void Reaction::setValue(int iCell, int varHandle, double value)
    assert(false);
 }
 
+void Reaction::setValues(int varHandle, const vector<double>& value)
+{
+   for (unsigned ii=0; ii<value.size(); ++ii)
+      setValue(ii, varHandle, value[ii]);
+}
+
 
 double Reaction::getValue(int iCell, int handle, double V) const
 {
@@ -31,12 +31,29 @@ class Reaction
    virtual int getVarHandle(const std::string& varName) const;
    std::vector<int> getVarHandle(const std::vector<std::string>& varName) const;
    virtual void setValue(int iCell, int varHandle, double value);
+   /** Sets varHandle of every cell, value[ii] for cell ii.  Models
+    *  with many state variables should override this so that the
+    *  handle is looked up once per column rather than once per cell. */
+   virtual void setValues(int varHandle, const std::vector<double>& value);
    virtual double getValue(int iCell, int varHandle) const;
    virtual double getValue(int iCell, int varHandle, double V) const;
    virtual void getValue(int iCell,
                          const std::vector<int>& handle,
                          std::vector<double>& value) const;
    virtual const std::string getUnit(const std::string& varName) const;
+
+   /** Optional pointwise form of calc for loops that keep their own
+    *  copy of the cell state (the temporally blocked loop).  A model
+    *  that supports it returns the number of doubles of state per cell
+    *  from nPointStates, -1 otherwise.  pointCalc advances nCells
+    *  independent cells by dt.  It is called concurrently and must
+    *  only touch its arguments. */
+   virtual int nPointStates() const {return -1;}
+   virtual void getPointState(int iCell, double* state) const {};
+   virtual void setPointState(int iCell, const double* state) {};
+   virtual void pointCalc(double dt, int nCells, const double* Vm,
+                          const double* iStim, double* state,
+                          double* dVm) const {};
 };
 
 //! Call this instead of initializeMembraneVoltage directly.
@@ -1,12 +1,14 @@
 
 #include <set>
 #include <algorithm>
+#include <cmath>
 #include "ReactionManager.hh"
 #include "Reaction.hh"
 #include "object_cc.hh"
 #include "units.h"
 #include "reactionFactory.hh"
 #include "slow_fix.hh"
+#include "ddcMalloc.h"
 
 
 using namespace std;
@@ -17,8 +19,15 @@ void ReactionManager::calc(double dt,
                            ro_mgarray_ptr<double> iStim,
                            wo_mgarray_ptr<double> dVm)
 {
+   // state arrays are allocated lazily, often on the first call
+   DdcMemTagScope memTag(DDCMEM_REACTION);
    for (int ii=0; ii<reactions_.size(); ++ii)
    {
+      if (substepper_[ii] != NULL)
+      {
+         calcSubstepped(ii, dt, Vm, iStim, dVm);
+         continue;
+      }
       reactions_[ii]->calc(dt,
                            ro_mgarray_ptr<int>(EindexFromIindex_).slice(extents_[ii],extents_[ii+1]),
                            Vm,
@@ -27,6 +36,104 @@ void ReactionManager::calc(double dt,
    }
 }
 
+void ReactionManager::calc(int piece,
+                           double dt,
+                           ro_mgarray_ptr<double> Vm,
+                           ro_mgarray_ptr<double> iStim,
+                           wo_mgarray_ptr<double> dVm)
+{
+   if (substepper_[piece] != NULL)
+      calcSubstepped(piece, dt, Vm, iStim, dVm);
+   else
+      reactions_[piece]->calc(dt, pieceCells(piece), Vm, iStim, dVm);
+}
+
+/** The piece is first advanced with dt as usual.  The cells whose Vm
+ *  moved faster than the threshold in the previous step are then
+ *  redone from their saved state with nSubsteps steps of the fine
+ *  model, which sees the same Vm evolve under its own current only
+ *  (the usual splitting of reaction and diffusion).  Their dVm is the
+ *  average over the substeps. */
+void ReactionManager::calcSubstepped(int piece,
+                                     double dt,
+                                     ro_mgarray_ptr<double> Vm,
+                                     ro_mgarray_ptr<double> iStim,
+                                     wo_mgarray_ptr<double> dVm)
+{
+   Substepper& sub(*substepper_[piece]);
+   Reaction* coarse = reactions_[piece];
+   const int nCells = extents_[piece+1]-extents_[piece];
+   const int nHandles = sub.handles.size();
+   ro_mgarray_ptr<int> cells = pieceCells(piece);
+   ro_array_ptr<int> index = cells.useOn(CPU);
+   ro_array_ptr<double> VmArray = Vm.useOn(CPU);
+
+   // Fast Vm, whether from the reaction or from diffusion and stimulus,
+   // marks the upstroke and the cells it is about to reach.
+   sub.active.clear();
+   if (sub.primed)
+   {
+      for (int ii=0; ii<nCells; ++ii)
+      {
+         double rate = max(fabs(VmArray[index[ii]]-sub.lastVm[ii])/dt, fabs(sub.lastDVm[ii]));
+         if (rate > sub.threshold)
+            sub.active.push_back(ii);
+      }
+   }
+   sub.savedState.resize(sub.active.size()*nHandles);
+   for (int ii=0; ii<sub.active.size(); ++ii)
+      for (int jj=0; jj<nHandles; ++jj)
+         sub.savedState[ii*nHandles+jj] = coarse->getValue(sub.active[ii], sub.handles[jj]);
+
+   coarse->calc(dt, cells, Vm, iStim, dVm);
+
+   double* dVmArray = dVm.useOn(CPU).raw();
+   const double fineDt = dt/sub.nSubsteps;
+   for (int begin=0; begin<sub.active.size(); begin+=sub.chunkSize)
+   {
+      const int end = min<int>(begin+sub.chunkSize, sub.active.size());
+      {
+         wo_array_ptr<double> fineVm = sub.fineVm.writeonly(CPU);
+         for (int slot=0; slot<sub.chunkSize; ++slot)
+         {
+            // Slots past the end repeat the last cell and are ignored.
+            int ii = min(begin+slot, end-1);
+            for (int jj=0; jj<nHandles; ++jj)
+               sub.fine->setValue(slot, sub.handles[jj], sub.savedState[ii*nHandles+jj]);
+            fineVm[slot] = VmArray[index[sub.active[ii]]];
+         }
+      }
+      for (int isub=0; isub<sub.nSubsteps; ++isub)
+      {
+         sub.fine->calc(fineDt, sub.fineIndex, sub.fineVm, sub.fineIStim, sub.fineDVm);
+         rw_array_ptr<double> fineVm = sub.fineVm.readwrite(CPU);
+         ro_array_ptr<double> fineDVm = sub.fineDVm.readonly(CPU);
+         for (int slot=0; slot<end-begin; ++slot)
+            fineVm[slot] += fineDt*fineDVm[slot];
+      }
+      ro_array_ptr<double> fineVm = sub.fineVm.readonly(CPU);
+      for (int slot=0; slot<end-begin; ++slot)
+      {
+         const int ii = sub.active[begin+slot];
+         for (int jj=0; jj<nHandles; ++jj)
+            coarse->setValue(ii, sub.handles[jj], sub.fine->getValue(slot, sub.handles[jj]));
+         dVmArray[index[ii]] = (fineVm[slot]-VmArray[index[ii]])/dt;
+      }
+   }
+
+   for (int ii=0; ii<nCells; ++ii)
+   {
+      sub.lastVm[ii] = VmArray[index[ii]];
+      sub.lastDVm[ii] = dVmArray[index[ii]];
+   }
+   sub.primed = true;
+}
+
+ro_mgarray_ptr<int> ReactionManager::pieceCells(int piece) const
+{
+   return ro_mgarray_ptr<int>(EindexFromIindex_).slice(extents_[piece],extents_[piece+1]);
+}
+
 void ReactionManager::updateNonGate(double dt,
                                     ro_mgarray_ptr<double> Vm,
                                     wo_mgarray_ptr<double> dVm)
@@ -58,20 +165,44 @@ void ReactionManager::initializeMembraneState(wo_mgarray_ptr<double> Vm)
 {
    for (int ii=0; ii<reactions_.size(); ++ii)
    {
-      ::initializeMembraneState(reactions_[ii], objectNameFromRidx_[ii],
+      ::initializeMembraneState(reactions_[ii], objectNameFromRidx_[ridxFromPiece_[ii]],
                                 ro_mgarray_ptr<int>(EindexFromIindex_).slice(extents_[ii],extents_[ii+1]),
                                 Vm);
    }
 }
 
 
+ReactionManager::~ReactionManager()
+{
+   for (int ii=0; ii<substepper_.size(); ++ii)
+   {
+      if (substepper_[ii] != NULL)
+         delete substepper_[ii]->fine;
+      delete substepper_[ii];
+   }
+}
+
 void ReactionManager::addReaction(const std::string& rxnObjectName)
 {
    objectNameFromRidx_.push_back(rxnObjectName);
 }
 
 
-void ReactionManager::create(const double dt, ro_array_ptr<int> cellTypes, const ThreadTeam &group)
+void ReactionManager::prefit(const double dt)
+{
+   for (int ridx=0; ridx<objectNameFromRidx_.size(); ++ridx)
+   {
+      OBJECT* obj = objectFind(objectNameFromRidx_[ridx], "REACTION");
+      int nSubsteps;
+      objectGet(obj, "substeps", nSubsteps, "1");
+      reactionPrefit(objectNameFromRidx_[ridx], dt);
+      if (nSubsteps > 1)
+         reactionPrefit(objectNameFromRidx_[ridx], dt/nSubsteps);
+   }
+}
+
+void ReactionManager::create(const double dt, ro_array_ptr<int> cellTypes, const ThreadTeam &group,
+                             int pieceSize)
 {
    //construct an array of all the objects
    int numReactions=objectNameFromRidx_.size();
@@ -266,12 +397,31 @@ void ReactionManager::create(const double dt, ro_array_ptr<int> cellTypes, const
       }
    }
    
+   //split the extents into pieces.  Every reaction keeps at least one
+   //piece, even if it has no cells.
+   {
+      vector<int> pieceExtents(1, 0);
+      for (int ireaction=0; ireaction<numReactions; ++ireaction)
+      {
+         int localSize = countFromRidx[ireaction];
+         int nPieces = 1;
+         if (pieceSize > 0 && localSize > pieceSize)
+            nPieces = (localSize+pieceSize-1)/pieceSize;
+         for (int ipiece=0; ipiece<nPieces; ++ipiece)
+         {
+            pieceExtents.push_back(extents_[ireaction] + (localSize*(ipiece+1))/nPieces);
+            ridxFromPiece_.push_back(ireaction);
+         }
+      }
+      extents_ = pieceExtents;
+   }
+
    //create the reaction objects
-   reactions_.resize(numReactions);
-   for (int ireaction=0; ireaction<numReactions; ++ireaction)
+   reactions_.resize(ridxFromPiece_.size());
+   for (int ipiece=0; ipiece<reactions_.size(); ++ipiece)
    {
-      int localSize = countFromRidx[ireaction];
-      reactions_[ireaction] = reactionFactory(objectNameFromRidx_[ireaction], dt, localSize, group);
+      int localSize = extents_[ipiece+1]-extents_[ipiece];
+      reactions_[ipiece] = reactionFactory(objectNameFromRidx_[ridxFromPiece_[ipiece]], dt, localSize, group);
    }
 
    //Ok, now we've created the reaction objects.  Now we need to
@@ -285,11 +435,11 @@ void ReactionManager::create(const double dt, ro_array_ptr<int> cellTypes, const
    {
       //find a reaction object for this type.
       Reaction* thisReaction=NULL;
-      for (int ireaction=0; ireaction<numReactions; ++ireaction)
+      for (int ipiece=0; ipiece<reactions_.size(); ++ipiece)
       {
-         if (typeFromRidx_[ireaction] == itype)
+         if (typeFromRidx_[ridxFromPiece_[ipiece]] == itype)
          {
-            thisReaction = reactions_[ireaction];
+            thisReaction = reactions_[ipiece];
             break;
          }
       }
@@ -368,6 +518,47 @@ void ReactionManager::create(const double dt, ro_array_ptr<int> cellTypes, const
          subHandleInfoFromTypeAndHandle_[itype][thisHandle].second = units_convert(1,unitFromHandle_[thisHandle].c_str(),thisSubUnit.c_str());
       }
    }
+
+   //set up adaptive substepping.  The fine model of a piece integrates
+   //substepChunk cells at a time.
+   const int substepChunk = 256;
+   substepper_.assign(reactions_.size(), NULL);
+   for (int ipiece=0; ipiece<reactions_.size(); ++ipiece)
+   {
+      int ridx = ridxFromPiece_[ipiece];
+      int nSubsteps;
+      objectGet(objects[ridx], "substeps", nSubsteps, "1");
+      int localSize = extents_[ipiece+1]-extents_[ipiece];
+      if (nSubsteps <= 1 || localSize == 0)
+         continue;
+
+      Substepper* sub = new Substepper;
+      sub->nSubsteps = nSubsteps;
+      objectGet(objects[ridx], "substepThreshold", sub->threshold, "5", "voltage/t");
+      sub->chunkSize = min(substepChunk, localSize);
+      sub->fine = reactionFactory(objectNameFromRidx_[ridx], dt/nSubsteps, sub->chunkSize, group);
+      sub->handles = subHandlesFromType[typeFromRidx_[ridx]];
+      sub->primed = false;
+      sub->lastVm.resize(localSize);
+      sub->lastDVm.resize(localSize);
+      sub->fineIndex.resize(sub->chunkSize);
+      sub->fineVm.resize(sub->chunkSize);
+      sub->fineIStim.resize(sub->chunkSize);
+      sub->fineDVm.resize(sub->chunkSize);
+      {
+         wo_array_ptr<int> fineIndex = sub->fineIndex.writeonly(CPU);
+         wo_array_ptr<double> fineIStim = sub->fineIStim.writeonly(CPU);
+         for (int ii=0; ii<sub->chunkSize; ++ii)
+         {
+            fineIndex[ii] = ii;
+            fineIStim[ii] = 0;
+         }
+      }
+      // Some models allocate their state here.  It is overwritten for
+      // every chunk.
+      sub->fine->initializeMembraneVoltage(sub->fineIndex, sub->fineVm);
+      substepper_[ipiece] = sub;
+   }
 }
 
 std::string ReactionManager::stateDescription() const {
@@ -419,22 +610,41 @@ vector<int> ReactionManager::getVarHandle(const vector<string>& varName) const
 }
 void ReactionManager::setValue(int iCell, int varHandle, double value)
 {
-   int ridx = getRidxFromCell(iCell);
+   int piece = getPieceFromCell(iCell);
    int subHandle;
    double myUnitFromTheirUnit;
-   if (subUsesHandle(ridx, varHandle, subHandle, myUnitFromTheirUnit)) {
-      int subCell = IindexFromEindex_[iCell]-extents_[ridx];
-      reactions_[ridx]->setValue(subCell, subHandle, value/myUnitFromTheirUnit);
+   if (subUsesHandle(ridxFromPiece_[piece], varHandle, subHandle, myUnitFromTheirUnit)) {
+      int subCell = IindexFromEindex_[iCell]-extents_[piece];
+      reactions_[piece]->setValue(subCell, subHandle, value/myUnitFromTheirUnit);
+   }
+}
+void ReactionManager::setValues(int varHandle, const vector<double>& value)
+{
+   ro_array_ptr<int> EindexFromIindex = EindexFromIindex_.readonly(CPU);
+   vector<double> subValue;
+   for (int piece=0; piece<reactions_.size(); ++piece)
+   {
+      int subHandle;
+      double myUnitFromTheirUnit;
+      if (!subUsesHandle(ridxFromPiece_[piece], varHandle, subHandle, myUnitFromTheirUnit))
+         continue;
+      int begin = extents_[piece];
+      int nCells = extents_[piece+1]-begin;
+      subValue.resize(nCells);
+      #pragma omp parallel for
+      for (int ii=0; ii<nCells; ++ii)
+         subValue[ii] = value[EindexFromIindex[begin+ii]]/myUnitFromTheirUnit;
+      reactions_[piece]->setValues(subHandle, subValue);
    }
 }
 double ReactionManager::getValue(int iCell, int varHandle) const
 {
-   int ridx = getRidxFromCell(iCell);
+   int piece = getPieceFromCell(iCell);
    int subHandle;
    double myUnitFromTheirUnit;
-   if (subUsesHandle(ridx, varHandle, subHandle, myUnitFromTheirUnit)) {
-      int subCell = IindexFromEindex_[iCell]-extents_[ridx];
-      return myUnitFromTheirUnit*reactions_[ridx]->getValue(subCell, subHandle);
+   if (subUsesHandle(ridxFromPiece_[piece], varHandle, subHandle, myUnitFromTheirUnit)) {
+      int subCell = IindexFromEindex_[iCell]-extents_[piece];
+      return myUnitFromTheirUnit*reactions_[piece]->getValue(subCell, subHandle);
    } else {
       return numeric_limits<double>::quiet_NaN();
    }
@@ -458,10 +668,31 @@ vector<int> ReactionManager::allCellTypes() const
    return retVal;
 }
    
-int ReactionManager::getRidxFromCell(const int Eindex) const {
+int ReactionManager::nPointStates() const
+{
+   if (reactions_.size() != 1 || substepper_[0] != NULL)
+      return -1;
+   return reactions_[0]->nPointStates();
+}
+void ReactionManager::getPointState(int iCell, double* state) const
+{
+   reactions_[0]->getPointState(IindexFromEindex_[iCell], state);
+}
+void ReactionManager::setPointState(int iCell, const double* state)
+{
+   reactions_[0]->setPointState(IindexFromEindex_[iCell], state);
+}
+void ReactionManager::pointCalc(double dt, int nCells, const double* Vm,
+                                const double* iStim, double* state,
+                                double* dVm) const
+{
+   reactions_[0]->pointCalc(dt, nCells, Vm, iStim, state, dVm);
+}
+
+int ReactionManager::getPieceFromCell(const int Eindex) const {
    int Iindex = IindexFromEindex_[Eindex];
    assert(Iindex != -1);
-   //binary search to find the proper Ridx.
+   //binary search to find the proper piece.
    int begin=0;
    int end=extents_.size();
    while (begin+1 < end)
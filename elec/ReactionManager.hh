@@ -13,10 +13,18 @@ class Reaction;
 class ReactionManager
 {
  public:
+   ~ReactionManager();
    void calc(double dt,
              ro_mgarray_ptr<double> Vm,
              ro_mgarray_ptr<double> iStim,
              wo_mgarray_ptr<double> dVm);
+   /** calc for a single piece.  Different pieces may be computed
+    *  concurrently. */
+   void calc(int piece,
+             double dt,
+             ro_mgarray_ptr<double> Vm,
+             ro_mgarray_ptr<double> iStim,
+             wo_mgarray_ptr<double> dVm);
    void updateNonGate(double dt, ro_mgarray_ptr<double> Vm, wo_mgarray_ptr<double> dVR);
    void updateGate   (double dt, ro_mgarray_ptr<double> Vm);
    std::string stateDescription() const;
@@ -27,7 +35,24 @@ class ReactionManager
    void initializeMembraneState(wo_mgarray_ptr<double> Vm);
 
    void addReaction(const std::string& reactionName);
-   void create(const double dt, ro_array_ptr<int> cellTypes, const ThreadTeam &group);
+   /** Starts the interpolant fits of the reaction objects (and of
+    *  their substep models) on worker threads.  create picks them up.
+    *  Call this early so the fits overlap the anatomy and the
+    *  decomposition. */
+   void prefit(const double dt);
+   /** When pieceSize is positive the cells of each reaction object are
+    *  split into pieces of at most pieceSize cells, each with its own
+    *  instance of the reaction model.
+    *
+    *  A REACTION object with substeps > 1 gets adaptive substepping:
+    *  cells whose Vm changes faster than substepThreshold are advanced
+    *  with substeps steps of dt/substeps by a second instance of the
+    *  model.  Only calc substeps; updateNonGate and updateGate do not. */
+   void create(const double dt, ro_array_ptr<int> cellTypes, const ThreadTeam &group,
+               int pieceSize = 0);
+   int nPieces() const {return reactions_.size();}
+   /** Indices of the cells in a piece. */
+   ro_mgarray_ptr<int> pieceCells(int piece) const;
 
    /** Functions needed for checkpoint/restart */
    void getCheckpointInfo(std::vector<std::string>& fieldNames,
@@ -35,24 +60,67 @@ class ReactionManager
    int getVarHandle(const std::string& varName) const;
    std::vector<int> getVarHandle(const std::vector<std::string>& varName) const;
    void setValue(int iCell, int varHandle, double value);
+   /** Sets varHandle of all local cells, value[ii] for cell ii. */
+   void setValues(int varHandle, const std::vector<double>& value);
    double getValue(int iCell, int varHandle) const;
    void getValue(int iCell,
                  ro_array_ptr<int> handle,
                  wo_array_ptr<double> value) const;
    const std::string getUnit(const std::string& varName) const;
    std::vector<int> allCellTypes() const;
+
+   /** Pointwise form of calc (see Reaction::pointCalc).  Only there
+    *  when all cells are handled by a single reaction object without
+    *  substepping, otherwise nPointStates returns -1.  iCell is a
+    *  local cell index. */
+   int nPointStates() const;
+   void getPointState(int iCell, double* state) const;
+   void setPointState(int iCell, const double* state);
+   void pointCalc(double dt, int nCells, const double* Vm,
+                  const double* iStim, double* state, double* dVm) const;
    
  private:
    std::vector<std::string> objectNameFromRidx_;
+   // reactions_ and extents_ are indexed by piece.
    std::vector<Reaction*> reactions_;
    std::vector<int> extents_;
+   std::vector<int> ridxFromPiece_;
    lazy_array<int> EindexFromIindex_;
    std::vector<int> IindexFromEindex_;
    
    std::vector<std::string> unitFromHandle_;
    std::map<std::string, int> handleFromVarname_;
 
-   int getRidxFromCell(const int iCell) const;
+   /** Cells of a piece that are stepped with a smaller time step.
+    *  They are gathered into chunks of chunkSize cells that the fine
+    *  model integrates one after the other. */
+   struct Substepper
+   {
+      int nSubsteps;
+      double threshold;
+      Reaction* fine;
+      int chunkSize;
+      std::vector<int> handles;
+      bool primed;
+      std::vector<double> lastVm;
+      std::vector<double> lastDVm;
+      std::vector<int> active;
+      std::vector<double> savedState;
+      lazy_array<int> fineIndex;
+      lazy_array<double> fineVm;
+      lazy_array<double> fineIStim;
+      lazy_array<double> fineDVm;
+   };
+
+   void calcSubstepped(int piece, double dt,
+                       ro_mgarray_ptr<double> Vm,
+                       ro_mgarray_ptr<double> iStim,
+                       wo_mgarray_ptr<double> dVm);
+
+   // indexed by piece, NULL when the piece is not substepped.
+   std::vector<Substepper*> substepper_;
+
+   int getPieceFromCell(const int iCell) const;
    bool subUsesHandle(const int ridx, const int handle, int& subHandle, double& myUnitFromTheirUnit) const;
    
    std::vector<std::map<int, std::pair<int, double> > > subHandleInfoFromTypeAndHandle_;
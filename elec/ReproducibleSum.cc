@@ -0,0 +1,54 @@
+#include "ReproducibleSum.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+   bool g_enabled = false;
+}
+
+void ReproducibleSum::setEnabled(bool enabled)
+{
+   g_enabled = enabled;
+}
+
+bool ReproducibleSum::enabled()
+{
+   return g_enabled;
+}
+
+double ReproducibleSum::globalBound(double localBound, MPI_Comm comm)
+{
+   double bound;
+   MPI_Allreduce(&localBound, &bound, 1, MPI_DOUBLE, MPI_MAX, comm);
+   return bound;
+}
+
+ReproducibleSum::ReproducibleSum()
+{
+   for (int kk=0; kk<nFolds; ++kk)
+      sigma_[kk] = 0;
+}
+
+/** With 2^e >= bound and 2^(b-1) >= maxTerms, fold kk rounds what
+ *  is left of a term to a multiple of 2^(s-52) where s = e_kk + b.
+ *  Adding 1.5*2^s keeps the sum in the binade of 2^s, so the rounding
+ *  only depends on the term, and maxTerms of these pieces add up to
+ *  less than 2^s.  The rest of the term is below 2^(s-53), which is
+ *  the e of the next fold. */
+ReproducibleSum::ReproducibleSum(double bound, double maxTerms)
+{
+   int e, b;
+   frexp(std::max(bound, DBL_MIN), &e);
+   frexp(std::max(maxTerms, 1.0), &b);
+   ++b;
+   for (int kk=0; kk<nFolds; ++kk)
+   {
+      int s = e + b;
+      // Folds that would be subnormal carry nothing of interest.
+      sigma_[kk] = (s > DBL_MIN_EXP + 53) ? ldexp(1.5, s) : 0;
+      e = s - 53;
+   }
+}
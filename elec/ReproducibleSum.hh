@@ -0,0 +1,62 @@
+#ifndef REPRODUCIBLE_SUM_HH
+#define REPRODUCIBLE_SUM_HH
+
+#include <mpi.h>
+
+/** Sums of doubles that don't depend on the order of the terms, so
+ *  that the same cells give bitwise the same sum on any number of
+ *  tasks and threads.
+ *
+ *  Every term is split into nFolds pieces that are multiples of fixed
+ *  powers of two (the pre-rounding of Demmel and Nguyen's
+ *  reproducible summation).  The pieces of one fold add up without
+ *  rounding, so fold sums can be combined in any order: across
+ *  threads, in messages, or with MPI_SUM.  The powers of two follow
+ *  from an upper bound on |term| and on the number of terms, and all
+ *  the sums that are combined must use the same bounds.  The error is
+ *  below 2^-159 * bound * (4 maxTerms)^4, about 1e-13 of the bound for
+ *  1e8 terms.
+ *
+ *  The sums only take this path when the reproducibleSums keyword of
+ *  the SIMULATE object is set.  The extra work shows up in the
+ *  ReproducibleSums timer. */
+class ReproducibleSum
+{
+ public:
+   enum {nFolds = 3};
+
+   static void setEnabled(bool enabled);
+   static bool enabled();
+   /** Largest localBound over the tasks of comm. */
+   static double globalBound(double localBound, MPI_Comm comm);
+
+   ReproducibleSum();
+   /** bound >= |x| for every x that is deposited and maxTerms >= the
+    *  number of terms of any one sum. */
+   ReproducibleSum(double bound, double maxTerms);
+
+   /** Adds x to folds[0] ... folds[nFolds-1]. */
+   void deposit(double x, double* folds) const
+   {
+      for (int kk=0; kk<nFolds; ++kk)
+      {
+         double q = (sigma_[kk] + x) - sigma_[kk];
+         folds[kk] += q;
+         x -= q;
+      }
+   }
+
+   /** The sum of the terms in folds.  Smallest fold first. */
+   static double value(const double* folds)
+   {
+      double sum = 0;
+      for (int kk=nFolds-1; kk>=0; --kk)
+         sum += folds[kk];
+      return sum;
+   }
+
+ private:
+   double sigma_[nFolds];
+};
+
+#endif
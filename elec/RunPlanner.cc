@@ -0,0 +1,455 @@
+#include "RunPlanner.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <omp.h>
+#include <mpi.h>
+
+#include "Simulate.hh"
+#include "Diffusion.hh"
+#include "diffusionFactory.hh"
+#include "ReactionManager.hh"
+#include "HaloExchange.hh"
+#include "CommTable.hh"
+#include "simulationLoop.hh"
+#include "object_cc.hh"
+#include "mpiUtils.h"
+
+using namespace std;
+
+/*!
+  @page obj_PLAN PLAN object
+
+  Start cardioid as "cardioid --plan [input files]" to plan a large
+  run instead of running it.  The anatomy, decomposition, reaction and
+  diffusion of the input deck are set up as usual on the tasks of the
+  job, which should be one node with the tasks per node and threads
+  per task of the intended run.  The planner then times nSteps steps
+  of the reaction model (with one thread and as the omp loop calls it),
+  the diffusion stencil (with one thread and with all threads), the
+  integrator and the halo exchange.
+
+  From these rates it predicts the wall time per simulated second for
+  every combination of node count, loop type and checkpoint rate
+  listed below.  The model assumes even load, halo volume that grows
+  as the 2/3 power of the cells per task starting from the volume in
+  the CommTable of this job, one message per neighbor with the given
+  latency and bandwidth, and checkpoints written at ioBandwidth.  For
+  the pdr loop the best number of diffusion cores is chosen.  The
+  blocked loop and the sensors are not modeled.
+
+  Rank 0 prints all candidates.  The fastest candidates whose
+  efficiency (node seconds of the cheapest candidate divided by their
+  own node seconds) is at least minEfficiency are written to
+  plan.01.data, plan.02.data, ...  Each file holds the SIMULATE
+  (and DIFFUSION) keywords that differ from the deck and is meant to
+  be given after the deck: "cardioid object.data plan.01.data".
+
+  The object called plan is used.  Without one all keywords take
+  their defaults.
+
+  @beginkeywords
+    @kw{bandwidth, Network bandwidth per task in GB/s., 10}
+    @kw{checkpointRates, Checkpoint rates (in time steps) to try. -1
+      means no checkpoints., The checkpointRate of the deck}
+    @kw{ioBandwidth, File system bandwidth for the whole job in GB/s., 2}
+    @kw{latency, Network latency per message in microseconds., 2}
+    @kw{loopTypes, Loop types to try (omp\, pdr\, task)., omp pdr task}
+    @kw{minEfficiency, Candidates below this efficiency are not
+      written., 0.5}
+    @kw{nodes, Node counts to try., 1 2 4 8 16 32 64 128 256}
+    @kw{nSteps, Time steps timed for each kernel., 20}
+    @kw{nWrite, Number of candidates written as fragments., 3}
+  @endkeywords
+*/
+
+namespace
+{
+   /** Measured rates.  Per cell costs are in seconds per cell and
+    *  step, the largest over the tasks. */
+   struct Rates
+   {
+      double nCellsGlobal;
+      double imbalance;        // max over average local cells
+      double nLocalAvg;
+      double reactionOmp;      // reaction as the omp loop calls it
+      double reactionCore;     // reaction on one thread
+      double diffusionCore;    // diffusion on one thread
+      double diffusionSpeedup; // diffusion on nThreads vs one thread
+      double integrate;        // integrator on nThreads
+      double haloTime;         // measured exchange per step
+      double haloBytes;        // bytes sent per step, largest task
+      double haloMsgs;         // messages sent per step, largest task
+      double checkpointBytes;  // bytes per cell in a checkpoint
+      int nThreads;
+      int nTasks;
+      int tasksPerNode;
+   };
+
+   struct PlanParms
+   {
+      vector<int> nodes;
+      vector<string> loopTypes;
+      vector<int> checkpointRates;
+      double latency;     // s
+      double bandwidth;   // bytes/s
+      double ioBandwidth; // bytes/s
+      double minEfficiency;
+      int nSteps;
+      int nWrite;
+   };
+
+   struct Candidate
+   {
+      int nodes;
+      string loopType;
+      int nDiffusionCores;
+      int checkpointRate;
+      double step;     // s per step without I/O
+      double halo;     // s per step
+      double io;       // s per step
+      double wall;     // s per simulated second
+      double efficiency;
+   };
+
+   bool fasterThan(const Candidate& a, const Candidate& b)
+   {
+      return a.wall < b.wall;
+   }
+
+   double maxOverTasks(double value, MPI_Comm comm)
+   {
+      MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_DOUBLE, MPI_MAX, comm);
+      return value;
+   }
+
+   /** Seconds per cell and step, the largest over the tasks. */
+   double perCell(double seconds, int nSteps, int nLocal, MPI_Comm comm)
+   {
+      double cost = 0;
+      if (nLocal > 0)
+         cost = seconds/nSteps/nLocal;
+      return maxOverTasks(cost, comm);
+   }
+
+   Rates measure(Simulate& sim, int nSteps)
+   {
+      MPI_Comm comm = sim.comm_;
+      Rates rr;
+      rr.nThreads = omp_get_max_threads();
+      MPI_Comm_size(comm, &rr.nTasks);
+      {
+         int myRank;
+         MPI_Comm_rank(comm, &myRank);
+         MPI_Comm nodeComm;
+         MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, myRank, MPI_INFO_NULL, &nodeComm);
+         MPI_Comm_size(nodeComm, &rr.tasksPerNode);
+         MPI_Comm_free(&nodeComm);
+         rr.tasksPerNode = int(maxOverTasks(rr.tasksPerNode, comm));
+      }
+
+      int nLocal = sim.anatomy_.nLocal();
+      double counts[2] = {double(nLocal), double(nLocal)};
+      MPI_Allreduce(MPI_IN_PLACE, counts, 1, MPI_DOUBLE, MPI_SUM, comm);
+      MPI_Allreduce(MPI_IN_PLACE, counts+1, 1, MPI_DOUBLE, MPI_MAX, comm);
+      rr.nCellsGlobal = counts[0];
+      rr.nLocalAvg = counts[0]/rr.nTasks;
+      rr.imbalance = counts[1]/max(1.0, rr.nLocalAvg);
+
+      vector<string> fieldNames, fieldUnits;
+      sim.reaction_->getCheckpointInfo(fieldNames, fieldUnits);
+      rr.checkpointBytes = 8.0*(2 + fieldNames.size());
+
+      simulationProlog(sim);
+      PotentialData& vdata = sim.vdata_;
+      lazy_array<double> iStimTransport;
+      iStimTransport.resize(nLocal);
+      {
+         wo_array_ptr<double> iStim = iStimTransport.useOn(CPU);
+         for (int ii=0; ii<nLocal; ++ii)
+            iStim[ii] = 0;
+      }
+
+      // The pdr loop builds diffusion for its thread teams.  Time the
+      // omp form of the same stencil instead.
+      Diffusion* diffusion = sim.diffusion_;
+      if (sim.loopType_ == Simulate::pdr)
+      {
+         string variant = sim.diffusionVariant_;
+         diffusion = diffusionFactory(sim.diffusionName_, sim.anatomy_,
+                                      sim.diffusionThreads_, sim.reactionThreads_,
+                                      Simulate::omp, variant);
+      }
+      HaloExchangeDevice<double> voltageExchange(sim.sendMap_, sim.commTable_);
+      rr.haloBytes = maxOverTasks(sim.commTable_->sendSize()*sizeof(double), comm);
+      rr.haloMsgs = maxOverTasks(sim.commTable_->_sendTask.size(), comm);
+
+      double tReactionOmp = 0, tReactionCore = 0, tDiffusionCore = 0;
+      double tDiffusion = 0, tIntegrate = 0, tHalo = 0;
+      for (int step=-1; step<nSteps; ++step)
+      {
+         // step -1 warms up and is not counted
+         double scale = (step < 0) ? 0 : 1;
+         double t0 = MPI_Wtime();
+         sim.reaction_->calc(sim.dt_, vdata.VmTransport_, iStimTransport, vdata.dVmReactionTransport_);
+         tReactionOmp += scale*(MPI_Wtime()-t0);
+
+         omp_set_num_threads(1);
+         t0 = MPI_Wtime();
+         sim.reaction_->calc(sim.dt_, vdata.VmTransport_, iStimTransport, vdata.dVmReactionTransport_);
+         tReactionCore += scale*(MPI_Wtime()-t0);
+         diffusion->updateLocalVoltage(vdata.VmTransport_);
+         t0 = MPI_Wtime();
+         diffusion->calc(vdata.dVmDiffusionTransport_);
+         tDiffusionCore += scale*(MPI_Wtime()-t0);
+         omp_set_num_threads(rr.nThreads);
+
+         MPI_Barrier(comm);
+         t0 = MPI_Wtime();
+         voltageExchange.fillSendBuffer(vdata.VmTransport_);
+         voltageExchange.startComm();
+         voltageExchange.wait();
+         tHalo += scale*(MPI_Wtime()-t0);
+
+         t0 = MPI_Wtime();
+         diffusion->updateLocalVoltage(vdata.VmTransport_);
+         diffusion->updateRemoteVoltage(voltageExchange.getRecvBuf());
+         diffusion->calc(vdata.dVmDiffusionTransport_);
+         tDiffusion += scale*(MPI_Wtime()-t0);
+
+         t0 = MPI_Wtime();
+         {
+            rw_array_ptr<double> Vm = vdata.VmTransport_.readwrite(CPU);
+            ro_array_ptr<double> dVmR = vdata.dVmReactionTransport_.readonly(CPU);
+            ro_array_ptr<double> dVmD = vdata.dVmDiffusionTransport_.readonly(CPU);
+            double dt = sim.dt_;
+            #pragma omp parallel for
+            for (int ii=0; ii<nLocal; ++ii)
+               Vm[ii] += dt*(dVmR[ii]+dVmD[ii]);
+         }
+         tIntegrate += scale*(MPI_Wtime()-t0);
+      }
+      if (diffusion != sim.diffusion_)
+         delete diffusion;
+
+      rr.reactionOmp = perCell(tReactionOmp, nSteps, nLocal, comm);
+      rr.reactionCore = perCell(tReactionCore, nSteps, nLocal, comm);
+      rr.diffusionCore = perCell(tDiffusionCore, nSteps, nLocal, comm);
+      rr.integrate = perCell(tIntegrate, nSteps, nLocal, comm);
+      double diffusionAll = perCell(tDiffusion, nSteps, nLocal, comm);
+      rr.diffusionSpeedup = 1;
+      if (diffusionAll > 0)
+         rr.diffusionSpeedup = min(double(rr.nThreads), rr.diffusionCore/diffusionAll);
+      rr.haloTime = maxOverTasks(tHalo/nSteps, comm);
+      return rr;
+   }
+
+   /** Diffusion time for n cells on k threads.  The speedup is
+    *  interpolated linearly between one thread and the measured
+    *  speedup on all threads. */
+   double diffusionTime(const Rates& rr, double n, int k)
+   {
+      double speedup = 1;
+      if (rr.nThreads > 1)
+         speedup = 1 + (rr.diffusionSpeedup-1)*(k-1)/(rr.nThreads-1);
+      return rr.diffusionCore*n/speedup;
+   }
+
+   double haloTime(const Rates& rr, const PlanParms& pp, double n, int nTasks)
+   {
+      if (nTasks == 1)
+         return 0;
+      double bytes, msgs;
+      if (rr.haloBytes > 0 && rr.nLocalAvg > 0)
+      {
+         bytes = rr.haloBytes*pow(n/rr.nLocalAvg, 2.0/3.0);
+         msgs = rr.haloMsgs;
+      }
+      else
+      {
+         // one face of a cube of n cells in each direction
+         bytes = sizeof(double)*6*pow(n, 2.0/3.0);
+         msgs = 6;
+      }
+      return msgs*pp.latency + bytes/pp.bandwidth;
+   }
+
+   /** Returns false if the loop type can't run in this configuration. */
+   bool predict(const Rates& rr, const PlanParms& pp, double dt, Candidate& cc)
+   {
+      int nTasks = cc.nodes*rr.tasksPerNode;
+      int c = rr.nThreads;
+      double n = rr.nCellsGlobal/nTasks*rr.imbalance;
+      double halo = haloTime(rr, pp, n, nTasks);
+      double integrate = rr.integrate*n;
+      cc.halo = halo;
+      cc.nDiffusionCores = 0;
+      if (cc.loopType == "omp")
+      {
+         // the exchange runs while the reaction is computed
+         cc.step = max(rr.reactionOmp*n, halo) + diffusionTime(rr, n, c) + integrate;
+      }
+      else if (cc.loopType == "pdr")
+      {
+         if (c < 2)
+            return false;
+         cc.step = -1;
+         for (int nd=1; nd<c; ++nd)
+         {
+            double step = max(rr.reactionCore*n/(c-nd), halo + diffusionTime(rr, n, nd)) + integrate;
+            if (cc.step < 0 || step < cc.step)
+            {
+               cc.step = step;
+               cc.nDiffusionCores = nd;
+            }
+         }
+      }
+      else if (cc.loopType == "task")
+      {
+         // interior blocks don't wait for the halo
+         cc.step = max(rr.reactionCore*n/c + diffusionTime(rr, n, c), halo) + integrate;
+      }
+      else
+         return false;
+
+      cc.io = 0;
+      if (cc.checkpointRate > 0)
+         cc.io = rr.nCellsGlobal*rr.checkpointBytes/pp.ioBandwidth/cc.checkpointRate;
+      // dt is in ms
+      cc.wall = (cc.step + cc.io)*1000.0/dt;
+      return true;
+   }
+
+   void writeFragment(const Candidate& cc, int rank, const Rates& rr,
+                      const Simulate& sim)
+   {
+      stringstream name;
+      name << "plan." << (rank < 9 ? "0" : "") << rank+1 << ".data";
+      FILE* file = fopen(name.str().c_str(), "w");
+      if (!file)
+      {
+         cout << "Can't write " << name.str() << endl;
+         return;
+      }
+      int nTasks = cc.nodes*rr.tasksPerNode;
+      fprintf(file, "// Run plan candidate %d: %d nodes, %d tasks of %d threads.\n",
+              rank+1, cc.nodes, nTasks, rr.nThreads);
+      fprintf(file, "// Predicted %.4g s wall per simulated second (step %.4g ms,\n"
+              "// halo %.4g ms, checkpoints %.4g ms per step), efficiency %.2f.\n",
+              cc.wall, 1e3*cc.step, 1e3*cc.halo, 1e3*cc.io, cc.efficiency);
+      fprintf(file, "// Give this file after the deck, e.g.\n"
+              "//    OMP_NUM_THREADS=%d mpirun -np %d cardioid object.data %s\n",
+              rr.nThreads, nTasks, name.str().c_str());
+      fprintf(file, "%s SIMULATE\n{\n", sim.name_.c_str());
+      fprintf(file, "   loopType = %s;\n", cc.loopType.c_str());
+      if (cc.loopType == "pdr")
+         fprintf(file, "   nDiffusionCores = %d;\n", cc.nDiffusionCores);
+      fprintf(file, "   checkpointRate = %d;\n", cc.checkpointRate);
+      fprintf(file, "}\n");
+      // The omp stencil doesn't work in the pdr loop.
+      if (cc.loopType == "pdr")
+      {
+         string variant;
+         objectGet(objectFind(sim.diffusionName_, "DIFFUSION"), "variant", variant, "omp");
+         if (variant == "omp")
+            fprintf(file, "%s DIFFUSION { variant = threads; }\n", sim.diffusionName_.c_str());
+      }
+      fclose(file);
+   }
+}
+
+void runPlanner(Simulate& sim, const string& name)
+{
+   if (object_find2(name.c_str(), "PLAN", IGNORE_IF_NOT_FOUND) == NULL)
+   {
+      string empty = name + " PLAN { nWrite = 3; }";
+      object_compilestring(const_cast<char*>(empty.c_str()));
+   }
+   OBJECT* obj = objectFind(name, "PLAN");
+   PlanParms pp;
+   objectGet(obj, "nodes", pp.nodes);
+   if (pp.nodes.empty())
+      for (int nn=1; nn<=256; nn*=2)
+         pp.nodes.push_back(nn);
+   objectGet(obj, "loopTypes", pp.loopTypes);
+   if (pp.loopTypes.empty())
+   {
+      pp.loopTypes.push_back("omp");
+      pp.loopTypes.push_back("pdr");
+      pp.loopTypes.push_back("task");
+   }
+   objectGet(obj, "checkpointRates", pp.checkpointRates);
+   if (pp.checkpointRates.empty())
+      pp.checkpointRates.push_back(sim.checkpointRate_);
+   objectGet(obj, "latency", pp.latency, "2");
+   objectGet(obj, "bandwidth", pp.bandwidth, "10");
+   objectGet(obj, "ioBandwidth", pp.ioBandwidth, "2");
+   objectGet(obj, "minEfficiency", pp.minEfficiency, "0.5");
+   objectGet(obj, "nSteps", pp.nSteps, "20");
+   objectGet(obj, "nWrite", pp.nWrite, "3");
+   pp.latency *= 1e-6;
+   pp.bandwidth *= 1e9;
+   pp.ioBandwidth *= 1e9;
+   if (pp.nSteps < 1)
+      pp.nSteps = 1;
+
+   timestampBarrier("Starting run planner measurements", sim.comm_);
+   Rates rr = measure(sim, pp.nSteps);
+   timestampBarrier("Finished run planner measurements", sim.comm_);
+
+   vector<Candidate> candidates;
+   for (unsigned in=0; in<pp.nodes.size(); ++in)
+      for (unsigned il=0; il<pp.loopTypes.size(); ++il)
+         for (unsigned ic=0; ic<pp.checkpointRates.size(); ++ic)
+         {
+            Candidate cc;
+            cc.nodes = pp.nodes[in];
+            cc.loopType = pp.loopTypes[il];
+            cc.checkpointRate = pp.checkpointRates[ic];
+            if (cc.nodes > 0 && predict(rr, pp, sim.dt_, cc))
+               candidates.push_back(cc);
+         }
+   double cheapest = -1;
+   for (unsigned ii=0; ii<candidates.size(); ++ii)
+   {
+      double cost = candidates[ii].wall*candidates[ii].nodes;
+      if (cheapest < 0 || cost < cheapest)
+         cheapest = cost;
+   }
+   for (unsigned ii=0; ii<candidates.size(); ++ii)
+      candidates[ii].efficiency = cheapest/(candidates[ii].wall*candidates[ii].nodes);
+   sort(candidates.begin(), candidates.end(), fasterThan);
+
+   if (getRank(0) != 0)
+      return;
+
+   printf("\nRun planner measurements on %d tasks (%d per node) of %d threads:\n",
+          rr.nTasks, rr.tasksPerNode, rr.nThreads);
+   printf("   cells                  %14.0f (imbalance %.3f)\n", rr.nCellsGlobal, rr.imbalance);
+   printf("   reaction (omp loop)    %14.4g s per cell and step\n", rr.reactionOmp);
+   printf("   reaction (1 thread)    %14.4g s per cell and step\n", rr.reactionCore);
+   printf("   diffusion (1 thread)   %14.4g s per cell and step, speedup %.2f on %d threads\n",
+          rr.diffusionCore, rr.diffusionSpeedup, rr.nThreads);
+   printf("   integrator             %14.4g s per cell and step\n", rr.integrate);
+   printf("   halo exchange          %14.4g s per step, %.0f bytes in %.0f messages\n",
+          rr.haloTime, rr.haloBytes, rr.haloMsgs);
+   printf("\n   nodes  loop  nDiff  ckptRate   step(ms)   halo(ms)     io(ms)  wall/sim s  efficiency\n");
+   int nWritten = 0;
+   for (unsigned ii=0; ii<candidates.size(); ++ii)
+   {
+      const Candidate& cc = candidates[ii];
+      bool write = (nWritten < pp.nWrite && cc.efficiency >= pp.minEfficiency);
+      printf("   %5d  %4s  %5d  %8d %10.4g %10.4g %10.4g %11.4g %10.2f%s\n",
+             cc.nodes, cc.loopType.c_str(), cc.nDiffusionCores, cc.checkpointRate,
+             1e3*cc.step, 1e3*cc.halo, 1e3*cc.io, cc.wall, cc.efficiency,
+             write ? "  *" : "");
+      if (write)
+         writeFragment(cc, nWritten++, rr, sim);
+   }
+   printf("\n%d candidates (marked *) written to plan.NN.data\n", nWritten);
+   fflush(stdout);
+}
@@ -0,0 +1,17 @@
+#ifndef RUN_PLANNER_HH
+#define RUN_PLANNER_HH
+
+#include <string>
+
+class Simulate;
+
+/** Dry run that predicts the wall time per simulated second of the
+ *  simulation in sim for other node counts, loop types, thread splits
+ *  and checkpoint rates, and writes the best candidates as object.data
+ *  fragments.  The reaction, diffusion and halo exchange of sim are
+ *  timed on the tasks of this job (meant to be one node) and the rest
+ *  comes from a simple model.  See the PLAN object.  Collective on
+ *  sim.comm_. */
+void runPlanner(Simulate& sim, const std::string& name);
+
+#endif
@@ -2,6 +2,7 @@
 #define SENSOR_HH
 #include <vector>
 #include <iostream>
+#include <mpi.h>
 
 struct SensorParms
 {
@@ -10,6 +11,7 @@ struct SensorParms
    double startTime;
    double endTime;
    double value;
+   MPI_Comm comm;
 };
 
 
@@ -21,7 +23,8 @@ class Sensor
      printRate_(p.printRate),
      startTime_(p.startTime),
      endTime_(p.endTime),
-     value_(p.value)
+     value_(p.value),
+     comm_(p.comm)
    {}
    virtual ~Sensor() {};
 
@@ -41,6 +44,7 @@ class Sensor
 
    int printRate()const{return printRate_;}
    int evalRate()const{return evalRate_;}
+   MPI_Comm comm()const{return comm_;}
    
    // to be implemented if sensor needs to know 
    // about reaction data
@@ -68,6 +72,7 @@ class Sensor
    double startTime_;
    double endTime_;
    double value_;
+   MPI_Comm comm_;
     
    virtual void print(double time, int loop) = 0;
    virtual void eval(double time, int loop) = 0;
@@ -55,7 +55,7 @@ void Simulate::checkRanges(ro_mgarray_ptr<double> _Vm,
 void Simulate::outOfRange(unsigned index, const double Vm, const double dVmr, const double dVmd)
 {
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank); 
+   MPI_Comm_rank(comm_, &myRank);
 
 #if 0 //FIXME!!!!!!
    /** This is awful.  Some diffusion classes don't store the results in
@@ -80,6 +80,7 @@ bool Simulate::checkIO(int loop) const
    if ( loop<0 )loop=loop_;
    
    if (loop > 0 && checkpointRate_ > 0 && loop % checkpointRate_ == 0)return true;
+   if (loop > 0 && memoryCheckpointRate_ > 0 && loop % memoryCheckpointRate_ == 0)return true;
    
    for (unsigned ii=0; ii<sensor_.size(); ++ii)
    {
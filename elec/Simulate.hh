@@ -6,6 +6,7 @@
 #include <set>
 #include <vector>
 #include <cmath>
+#include <mpi.h>
 
 #include "Long64.hh"
 #include "Anatomy.hh"
@@ -20,11 +21,13 @@ class Stimulus;
 class Sensor;
 class Drug;
 class CommTable;
+class BuddyCheckpoint;
 //using std::isnan;
 
 // storage class for persistent data such as potentials that may 
 // need to be analyzed or printed out by sensors
 struct CheckRange { bool on; double vMin,vMax;};
+struct ThreadTuning { bool on; int warmup, window;};
 class PotentialData
 {
  public:
@@ -69,7 +72,7 @@ class Simulate
 {
  public:
 
-   enum LoopType {omp, pdr};
+   enum LoopType {omp, pdr, task, blocked};
    
    void checkRanges(int begin, int end,
                     ro_mgarray_ptr<double> Vm,
@@ -84,6 +87,7 @@ class Simulate
    void bufferReactionData(const int begin, const int end);
    void bufferReactionData();
    
+   MPI_Comm comm_; // every task that takes part in this simulation
    CheckRange checkRange_;
    LoopType loopType_;
    volatile int loop_; // volatile (read + modified in threaded section)
@@ -95,10 +99,18 @@ class Simulate
    int printIndex_;
    FILE *printFile_; 
    int checkpointRate_;
+   int memReportRate_;
    bool asciiCheckpoints_;
+   int memoryCheckpointRate_;
+   bool memoryRestart_;
+   BuddyCheckpoint* buddyCheckpoint_; // null unless memory checkpoints are on
 
    ThreadTeam diffusionThreads_;
    ThreadTeam reactionThreads_;
+   ThreadTuning threadTuning_;
+   int taskBlocksPerThread_;
+   int timeBlockSteps_;
+   int timeBlockSize_;
    
    double dt_;
    double time_;
@@ -115,6 +127,8 @@ class Simulate
 
    Anatomy anatomy_;
    Diffusion* diffusion_;
+   std::string diffusionName_;    // needed to rebuild diffusion_
+   std::string diffusionVariant_; // when the thread teams change
    ReactionManager* reaction_;
    std::vector<Stimulus*> stimulus_;
    std::vector<Sensor*> sensor_;
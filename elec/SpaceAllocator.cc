@@ -13,6 +13,8 @@
 
 
 #include "SpaceAllocator.hh"
+#include "ddcMalloc.h"
+#include "BulkMemory.hh"
 
 
 template <>
@@ -29,7 +31,10 @@ bool spaceMalloc<void>(const ExecutionSpace space,void** dst, const std::size_t
    }
    return true;
 #else
-   return posix_memalign(dst,512,size) != 0;
+   *dst = BulkMemory::allocate(size, 512);
+   if (*dst)
+      ddcMemTrack(*dst, size, __FILE__);
+   return *dst == NULL;
 #endif
 }
 
@@ -72,7 +77,8 @@ void spaceFree<void>(const ExecutionSpace space,void* dst)
       CUDA_VERIFY(cudaFree(dst));
    }
 #else
-   free(dst);
+   ddcMemUntrack(dst);
+   BulkMemory::release(dst);
 #endif
 }
                    
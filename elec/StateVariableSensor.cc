@@ -28,7 +28,7 @@ namespace
    set<Long64> mkCellSet(const Anatomy& anatomy,
                          const vector<Long64>& cells,
                          string cellListFilename,
-                         double radius);
+                         double radius, MPI_Comm comm);
    FieldMap mkFieldMap(const ReactionManager* reaction);
 }
 
@@ -77,7 +77,7 @@ StateVariableSensor::StateVariableSensor(
    }
       
    set<Long64> requestedCells = mkCellSet(
-      sim.anatomy_, p.cells, p.cellListFilename, p.radius);
+      sim.anatomy_, p.cells, p.cellListFilename, p.radius, sim.comm_);
 
    for (unsigned ii=0; ii<sim.anatomy_.nLocal(); ++ii)
    {
@@ -88,7 +88,7 @@ StateVariableSensor::StateVariableSensor(
 
    int localRecords = localCells_.size();
    int nRecords;
-   MPI_Allreduce(&localRecords, &nRecords, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+   MPI_Allreduce(&localRecords, &nRecords, 1, MPI_INT, MPI_SUM, comm());
    
    lRec_ = gidRecLen + handles_.size()*varRecLen +1;
    if (binaryOutput_)
@@ -129,7 +129,7 @@ StateVariableSensor::~StateVariableSensor()
  */
 void StateVariableSensor::print(double time, int loop)
 {
-   MPI_Comm comm = MPI_COMM_WORLD;
+   MPI_Comm comm = this->comm();
    int myRank;
    MPI_Comm_rank(comm, &myRank);
 
@@ -231,12 +231,12 @@ namespace
    set<Long64> mkCellSet(const Anatomy& anatomy,
                          const vector<Long64>& cells,
                          string cellListFilename,
-                         double radius)
+                         double radius, MPI_Comm comm)
    {
       // Union of user specification
       vector<Long64> requestedCells;
       if (!cellListFilename.empty())
-         readCellList(cellListFilename, requestedCells);
+         readCellList(cellListFilename, requestedCells, comm);
       requestedCells.insert(requestedCells.end(), cells.begin(), cells.end());
    
       // Form bounding box
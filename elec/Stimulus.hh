@@ -2,11 +2,13 @@
 #define STIMULUS_HH
 
 #include "lazy_array.hh"
+#include <mpi.h>
 
 struct StimulusBaseParms
 {
    double t0;
    double tf;
+   MPI_Comm comm;
 };
 
 
@@ -10,6 +10,7 @@
 #include "PerformanceTimers.hh"
 #include "ThreadServer.hh"
 #include "mpiUtils.h"
+#include "external.h"
 #include <cstdlib>
 #include <cstring>
 #include <map>
@@ -90,7 +91,7 @@ TT06Dev_Reaction::TT06Dev_Reaction(const double dt, const int numPoints, TT06Dev
       TT06Func::initCnst();
       initExp(); 
       int pid;
-      MPI_Comm_rank(MPI_COMM_WORLD,&pid);	  
+      pid = getRank(0);	  
       string fCassFormName[] = { "TT06", "RICE"}; 
       if (pid ==0) printf("fCassForm = %s\n",fCassFormName[fCassForm].c_str()); 
    }   
@@ -615,10 +616,10 @@ HandleMap& TT06Dev_Reaction::getHandleMap() const
           if (filetest(parms.fitFile.c_str(), S_IFREG) == 0) fileFitExists=1; 
           if (fileFitExists) object_compilefile(parms.fitFile.c_str()); 
         }
-        MPI_Bcast(&fileFitExists, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Bcast(&fileFitExists, 1, MPI_INT, 0, COMM_LOCAL);
         if (fileFitExists) 
         {
-           object_Bcast(0, MPI_COMM_WORLD);
+           object_Bcast(0, COMM_LOCAL);
            parms.fit = scanFit();
         }
       }
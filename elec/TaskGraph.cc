@@ -0,0 +1,157 @@
+#include "TaskGraph.hh"
+
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <omp.h>
+
+using namespace std;
+
+TaskGraph::TaskGraph()
+: nQueues_(0)
+{
+}
+
+int TaskGraph::addTask(const Work& work, int home, bool masterOnly)
+{
+   Task task;
+   task.work = work;
+   task.home = home;
+   task.masterOnly = masterOnly;
+   task.nPredecessors = 0;
+   tasks_.push_back(task);
+   nQueues_ = 0; // storage for execute is now the wrong size
+   return tasks_.size()-1;
+}
+
+void TaskGraph::addDependency(int before, int after)
+{
+   assert(before >= 0 && before < tasks_.size());
+   assert(after >= 0 && after < tasks_.size());
+   tasks_[before].successor.push_back(after);
+   ++tasks_[after].nPredecessors;
+}
+
+void TaskGraph::FreeQueues::operator()(Queue* queue) const
+{
+   for (int ii=0; ii<n; ++ii)
+      queue[ii].~Queue();
+   free(queue);
+}
+
+void TaskGraph::execute()
+{
+   int nTasks = tasks_.size();
+   if (nTasks == 0)
+      return;
+
+   int nThreads = omp_get_max_threads();
+   if (nQueues_ != nThreads)
+   {
+      pending_.reset(new atomic<int>[nTasks]);
+      queue_.reset();
+      void* storage;
+      if (posix_memalign(&storage, alignof(Queue), nThreads*sizeof(Queue)) != 0)
+         throw bad_alloc();
+      Queue* queue = static_cast<Queue*>(storage);
+      for (int ii=0; ii<nThreads; ++ii)
+         new (queue+ii) Queue;
+      queue_.get_deleter().n = nThreads;
+      queue_.reset(queue);
+      for (int ii=0; ii<nThreads; ++ii)
+         queue_[ii].item.resize(nTasks);
+      masterQueue_.item.resize(nTasks);
+      nQueues_ = nThreads;
+   }
+
+   for (int ii=0; ii<nQueues_; ++ii)
+   {
+      queue_[ii].lock.clear();
+      queue_[ii].head = queue_[ii].tail = 0;
+   }
+   masterQueue_.lock.clear();
+   masterQueue_.head = masterQueue_.tail = 0;
+   remaining_.store(nTasks);
+   for (int ii=0; ii<nTasks; ++ii)
+   {
+      pending_[ii].store(tasks_[ii].nPredecessors, memory_order_relaxed);
+      if (tasks_[ii].nPredecessors > 0)
+         continue;
+      if (tasks_[ii].masterOnly)
+         masterQueue_.push(ii);
+      else
+         queue_[tasks_[ii].home % nQueues_].push(ii);
+   }
+
+   #pragma omp parallel
+   worker(omp_get_thread_num(), omp_get_num_threads());
+}
+
+void TaskGraph::worker(int tid, int nThreads)
+{
+   while (remaining_.load(memory_order_acquire) > 0)
+   {
+      int task = -1;
+      if (tid == 0)
+         task = masterQueue_.popBack();
+      if (task < 0 && tid < nQueues_)
+         task = queue_[tid].popBack();
+      for (int ii=1; task < 0 && ii<nQueues_; ++ii)
+         task = queue_[(tid+ii) % nQueues_].popFront();
+      if (task < 0)
+      {
+         this_thread::yield();
+         continue;
+      }
+
+      tasks_[task].work();
+      const vector<int>& successor = tasks_[task].successor;
+      for (unsigned ii=0; ii<successor.size(); ++ii)
+         release(successor[ii], tid);
+      remaining_.fetch_sub(1, memory_order_acq_rel);
+   }
+}
+
+/** The acq_rel decrement makes the writes of every predecessor visible
+ *  to the thread that queues the task, and the queue lock passes them
+ *  on to whoever runs it. */
+void TaskGraph::release(int task, int tid)
+{
+   if (pending_[task].fetch_sub(1, memory_order_acq_rel) != 1)
+      return;
+   if (tasks_[task].masterOnly)
+      masterQueue_.push(task);
+   else
+      queue_[tid % nQueues_].push(task);
+}
+
+void TaskGraph::Queue::push(int task)
+{
+   while (lock.test_and_set(memory_order_acquire))
+      ;
+   item[tail++] = task;
+   lock.clear(memory_order_release);
+}
+
+int TaskGraph::Queue::popBack()
+{
+   int task = -1;
+   while (lock.test_and_set(memory_order_acquire))
+      ;
+   if (tail > head)
+      task = item[--tail];
+   lock.clear(memory_order_release);
+   return task;
+}
+
+int TaskGraph::Queue::popFront()
+{
+   int task = -1;
+   while (lock.test_and_set(memory_order_acquire))
+      ;
+   if (tail > head)
+      task = item[head++];
+   lock.clear(memory_order_release);
+   return task;
+}
@@ -0,0 +1,88 @@
+#ifndef TASK_GRAPH_HH
+#define TASK_GRAPH_HH
+
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/** A dependency graph of tasks executed by a small work stealing
+ *  runtime.
+ *
+ *  The graph is built once with addTask and addDependency and can then
+ *  be executed any number of times.  execute opens an OpenMP parallel
+ *  region and returns when every task has run exactly once.  A task
+ *  becomes ready when all of its predecessors have finished.
+ *
+ *  Each thread owns a queue.  Ready tasks are pushed to the queue of
+ *  the thread that released them (or, at the start, to the queue of
+ *  their home thread).  Owners take work from the back of their queue,
+ *  which favors the data they just touched, and idle threads steal
+ *  from the front of the other queues.
+ *
+ *  Tasks added with masterOnly set only ever run on the master thread.
+ *  Use this for anything that calls MPI.
+ */
+class TaskGraph
+{
+ public:
+   typedef std::function<void()> Work;
+
+   TaskGraph();
+
+   /** Returns the id of the new task.  home is the thread that should
+    *  preferably run the task when it has no predecessors. */
+   int addTask(const Work& work, int home = 0, bool masterOnly = false);
+   /** Task after may not start until task before has finished. */
+   void addDependency(int before, int after);
+
+   int nTasks() const {return tasks_.size();}
+
+   /** Runs all tasks.  Call from outside of any parallel region. */
+   void execute();
+
+ private:
+   struct Task
+   {
+      Work work;
+      int home;
+      bool masterOnly;
+      std::vector<int> successor;
+      int nPredecessors;
+   };
+
+   /** A queue of task ids.  Every task is pushed at most once per
+    *  execute so a linear buffer of nTasks entries is large enough. */
+   struct alignas(64) Queue
+   {
+      std::atomic_flag lock;
+      int head;
+      int tail;
+      std::vector<int> item;
+      void push(int task);
+      int popBack();
+      int popFront();
+   };
+
+   /** new[] does not honor the alignment of Queue before C++17, so
+    *  the queues live in posix_memalign storage and this destroys
+    *  and frees them. */
+   struct FreeQueues
+   {
+      FreeQueues() : n(0) {}
+      int n;
+      void operator()(Queue* queue) const;
+   };
+
+   void worker(int tid, int nThreads);
+   void release(int task, int tid);
+
+   std::vector<Task> tasks_;
+   std::unique_ptr<std::atomic<int>[]> pending_;
+   std::unique_ptr<Queue[], FreeQueues> queue_;
+   int nQueues_;
+   Queue masterQueue_;
+   std::atomic<int> remaining_;
+};
+
+#endif
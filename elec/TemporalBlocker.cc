@@ -0,0 +1,245 @@
+#include "TemporalBlocker.hh"
+
+#include <cassert>
+#include <algorithm>
+#include <omp.h>
+
+#include "ReactionManager.hh"
+#include "PerformanceTimers.hh"
+
+using namespace std;
+using namespace FGRUtils;
+using namespace PerformanceTimers;
+
+TemporalBlocker::TemporalBlocker(const Stencil& stencil, int nLocal,
+                                 int tileSize, int maxSteps)
+: stencil_(stencil),
+  nLocal_(nLocal),
+  maxSteps_(max(1, maxSteps))
+{
+   tileSize = max(1, tileSize);
+   const int n[3] = {stencil.nx, stencil.ny, stencil.nz};
+
+   // The offsets are only meaningful in the grid they were made for.
+   // Recover the displacement of each stencil point so that it can be
+   // applied to the tile buffers.
+   for (int jj=0; jj<19; ++jj)
+   {
+      bool found = false;
+      for (int dx=-1; dx<=1; ++dx)
+         for (int dy=-1; dy<=1; ++dy)
+            for (int dz=-1; dz<=1; ++dz)
+               if (dz + n[2]*(dy + n[1]*dx) == stencil.offset[jj])
+               {
+                  displacement_[jj][0] = dx;
+                  displacement_[jj][1] = dy;
+                  displacement_[jj][2] = dz;
+                  found = true;
+               }
+      assert(found);
+   }
+
+   vector<int> coord(3*nLocal);
+   for (int ii=0; ii<nLocal; ++ii)
+   {
+      unsigned ib = stencil.blockIndex[ii];
+      coord[3*ii+0] = ib / (n[1]*n[2]);
+      coord[3*ii+1] = (ib / n[2]) % n[1];
+      coord[3*ii+2] = ib % n[2];
+   }
+
+   int nt[3];
+   for (int dd=0; dd<3; ++dd)
+      nt[dd] = (n[dd] + tileSize - 1) / tileSize;
+
+   // Only tiles that own cells are kept.
+   vector<int> slot(nt[0]*nt[1]*nt[2], -1);
+   for (int ii=0; ii<nLocal; ++ii)
+   {
+      int it = coord[3*ii+0]/tileSize
+         + nt[0]*(coord[3*ii+1]/tileSize + nt[1]*(coord[3*ii+2]/tileSize));
+      if (slot[it] < 0)
+      {
+         slot[it] = tile_.size();
+         Tile tile;
+         int t[3] = {it % nt[0], (it / nt[0]) % nt[1], it / (nt[0]*nt[1])};
+         for (int dd=0; dd<3; ++dd)
+         {
+            tile.origin[dd] = max(0, t[dd]*tileSize - maxSteps_);
+            int end = min(n[dd], (t[dd]+1)*tileSize + maxSteps_);
+            tile.extent[dd] = end - tile.origin[dd];
+         }
+         tile_.push_back(tile);
+      }
+   }
+
+   // Every cell within maxSteps of the core of a tile goes to its
+   // buffer.  The cells are sorted by their distance from the core so
+   // that the cells updated in a step are always a prefix, and by
+   // buffer position within each distance.
+   typedef pair<pair<int, int>, int> Member; // ((distance, pos), cell)
+   vector<vector<Member> > member(tile_.size());
+   for (int ii=0; ii<nLocal; ++ii)
+   {
+      int lo[3], hi[3];
+      for (int dd=0; dd<3; ++dd)
+      {
+         lo[dd] = max(0, coord[3*ii+dd] - maxSteps_) / tileSize;
+         hi[dd] = min(n[dd]-1, coord[3*ii+dd] + maxSteps_) / tileSize;
+      }
+      for (int tz=lo[2]; tz<=hi[2]; ++tz)
+         for (int ty=lo[1]; ty<=hi[1]; ++ty)
+            for (int tx=lo[0]; tx<=hi[0]; ++tx)
+            {
+               int it = slot[tx + nt[0]*(ty + nt[1]*tz)];
+               if (it < 0)
+                  continue;
+               int t[3] = {tx, ty, tz};
+               int dist = 0;
+               for (int dd=0; dd<3; ++dd)
+               {
+                  dist = max(dist, t[dd]*tileSize - coord[3*ii+dd]);
+                  dist = max(dist, coord[3*ii+dd] - ((t[dd]+1)*tileSize - 1));
+               }
+               if (dist > maxSteps_)
+                  continue;
+               const Tile& tile = tile_[it];
+               int local[3];
+               for (int dd=0; dd<3; ++dd)
+                  local[dd] = coord[3*ii+dd] - tile.origin[dd];
+               int pos = local[2] + tile.extent[2]*(local[1] + tile.extent[1]*local[0]);
+               member[it].push_back(Member(make_pair(dist, pos), ii));
+            }
+   }
+
+   unsigned maxVolume = 0;
+   unsigned maxCells = 0;
+   for (unsigned it=0; it<tile_.size(); ++it)
+   {
+      Tile& tile = tile_[it];
+      sort(member[it].begin(), member[it].end());
+      tile.nWithin.assign(maxSteps_+1, 0);
+      for (unsigned kk=0; kk<member[it].size(); ++kk)
+      {
+         tile.cell.push_back(member[it][kk].second);
+         tile.pos.push_back(member[it][kk].first.second);
+         ++tile.nWithin[member[it][kk].first.first];
+      }
+      for (int dd=1; dd<=maxSteps_; ++dd)
+         tile.nWithin[dd] += tile.nWithin[dd-1];
+      maxVolume = max(maxVolume, unsigned(tile.extent[0]*tile.extent[1]*tile.extent[2]));
+      maxCells = max(maxCells, unsigned(tile.cell.size()));
+   }
+
+   scratch_.resize(omp_get_max_threads());
+   for (unsigned ii=0; ii<scratch_.size(); ++ii)
+   {
+      scratch_[ii].V[0].resize(maxVolume);
+      scratch_[ii].V[1].resize(maxVolume);
+      scratch_[ii].Vm.resize(maxCells);
+      scratch_[ii].iStim.resize(maxCells);
+      scratch_[ii].dVmR.resize(maxCells);
+      scratch_[ii].dVmD.resize(maxCells);
+   }
+}
+
+void TemporalBlocker::advance(ReactionManager& reaction, double dt, int nSteps,
+                              double* Vm, const vector<const double*>& iStim,
+                              double* dVmR, double* dVmD)
+{
+   assert(nSteps > 0 && nSteps <= maxSteps_);
+   assert(iStim.size() >= nSteps);
+   int nStates = reaction.nPointStates();
+   assert(nStates >= 0);
+
+   // The tiles read the halo from these copies while they write the
+   // cells they own.
+   VmIn_.resize(nLocal_);
+   stateIn_.resize(nStates*nLocal_);
+   #pragma omp parallel for
+   for (int ii=0; ii<nLocal_; ++ii)
+   {
+      VmIn_[ii] = Vm[ii];
+      if (nStates > 0)
+         reaction.getPointState(ii, &stateIn_[nStates*ii]);
+   }
+   for (unsigned ii=0; ii<scratch_.size(); ++ii)
+      scratch_[ii].state.resize(nStates*scratch_[ii].Vm.size());
+
+   int nTiles = tile_.size();
+   #pragma omp parallel
+   {
+      startTimer(timeBlockTimer);
+      Scratch& scratch = scratch_[omp_get_thread_num()];
+      #pragma omp for schedule(dynamic, 1)
+      for (int it=0; it<nTiles; ++it)
+         advanceTile(tile_[it], scratch, reaction, dt, nSteps, Vm, iStim, dVmR, dVmD);
+      stopTimer(timeBlockTimer);
+   }
+}
+
+void TemporalBlocker::advanceTile(const Tile& tile, Scratch& scratch,
+                                  ReactionManager& reaction, double dt, int nSteps,
+                                  double* Vm, const vector<const double*>& iStim,
+                                  double* dVmR, double* dVmD)
+{
+   const int* cell = &tile.cell[0];
+   const int* pos = &tile.pos[0];
+   int nStates = reaction.nPointStates();
+   int offset[19];
+   for (int jj=0; jj<19; ++jj)
+      offset[jj] = displacement_[jj][2]
+         + tile.extent[2]*(displacement_[jj][1] + tile.extent[1]*displacement_[jj][0]);
+
+   // Voxels without a cell stay zero, as in the diffusion classes.
+   int volume = tile.extent[0]*tile.extent[1]*tile.extent[2];
+   fill(scratch.V[0].begin(), scratch.V[0].begin()+volume, 0.0);
+   fill(scratch.V[1].begin(), scratch.V[1].begin()+volume, 0.0);
+
+   int nLoad = tile.nWithin[nSteps];
+   for (int cc=0; cc<nLoad; ++cc)
+   {
+      scratch.V[0][pos[cc]] = VmIn_[cell[cc]];
+      for (int ss=0; ss<nStates; ++ss)
+         scratch.state[nStates*cc+ss] = stateIn_[nStates*cell[cc]+ss];
+   }
+
+   const double scale = stencil_.diffusionScale;
+   int cur = 0;
+   for (int kk=0; kk<nSteps; ++kk)
+   {
+      const double* V = &scratch.V[cur][0];
+      double* Vnext = &scratch.V[1-cur][0];
+      int nCalc = tile.nWithin[nSteps-1-kk];
+      for (int cc=0; cc<nCalc; ++cc)
+      {
+         scratch.Vm[cc] = V[pos[cc]];
+         scratch.iStim[cc] = iStim[kk][cell[cc]];
+      }
+      reaction.pointCalc(dt, nCalc, &scratch.Vm[0], &scratch.iStim[0],
+                         nStates > 0 ? &scratch.state[0] : 0, &scratch.dVmR[0]);
+      for (int cc=0; cc<nCalc; ++cc)
+      {
+         unsigned ib = stencil_.blockIndex[cell[cc]];
+         const double* phi = V + pos[cc];
+         const WeightType* A = stencil_.weight[ib].A;
+         double tmp = stencil_.A0[ib] * (*(phi+offset[0]));
+         for (unsigned ii=1; ii<19; ++ii)
+            tmp += A[ii] * ( *(phi+offset[ii]));
+         scratch.dVmD[cc] = tmp*scale;
+         Vnext[pos[cc]] = scratch.Vm[cc]
+            + dt*(scratch.dVmR[cc]+scratch.dVmD[cc]+scratch.iStim[cc]);
+      }
+      cur = 1-cur;
+   }
+
+   int nOwn = tile.nWithin[0];
+   for (int cc=0; cc<nOwn; ++cc)
+   {
+      Vm[cell[cc]] = scratch.V[cur][pos[cc]];
+      dVmR[cell[cc]] = scratch.dVmR[cc];
+      dVmD[cell[cc]] = scratch.dVmD[cc];
+      if (nStates > 0)
+         reaction.setPointState(cell[cc], &scratch.state[nStates*cc]);
+   }
+}
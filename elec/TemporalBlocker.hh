@@ -0,0 +1,77 @@
+#ifndef TEMPORAL_BLOCKER_HH
+#define TEMPORAL_BLOCKER_HH
+
+#include <vector>
+#include "FGRUtils.hh"
+
+class ReactionManager;
+
+/** Advances the membrane voltage of a single rank through several
+ *  time steps per pass over memory.
+ *
+ *  The local grid is cut into tiles of tileSize^3 voxels.  Each tile
+ *  is copied, together with a halo of maxSteps voxels, into per thread
+ *  buffers that stay in cache.  The reaction, the diffusion stencil
+ *  and the integrator are then applied in turn for every step, with
+ *  the region that is updated shrinking by one voxel per step
+ *  (overlapping trapezoidal tiles).  After the last step only the
+ *  voltages and cell states of the tile itself are written back.
+ *
+ *  The halo cells are computed redundantly by all the tiles that
+ *  touch them.  The arithmetic of each cell is the same as in
+ *  simulationLoop so both give the same results bit for bit.
+ *
+ *  Requirements: no remote cells, a diffusion class that provides a
+ *  Stencil and a reaction that supports pointCalc.
+ */
+class TemporalBlocker
+{
+ public:
+   TemporalBlocker(const FGRUtils::Stencil& stencil, int nLocal,
+                   int tileSize, int maxSteps);
+
+   int maxSteps() const {return maxSteps_;}
+
+   /** Advances Vm and the reaction state by nSteps <= maxSteps steps of
+    *  dt.  iStim[k] is the stimulus for step k.  dVmR and dVmD are set
+    *  to the rates of the last step. */
+   void advance(ReactionManager& reaction, double dt, int nSteps,
+                double* Vm, const std::vector<const double*>& iStim,
+                double* dVmR, double* dVmD);
+
+ private:
+   struct Tile
+   {
+      int origin[3]; // grid coordinates of buffer element 0
+      int extent[3]; // size of the buffer
+      std::vector<int> cell;    // local cells, sorted by distance
+      std::vector<int> pos;     // their buffer index
+      std::vector<int> nWithin; // number of cells at distance <= d
+   };
+
+   struct Scratch
+   {
+      std::vector<double> V[2];
+      std::vector<double> Vm;
+      std::vector<double> iStim;
+      std::vector<double> dVmR;
+      std::vector<double> dVmD;
+      std::vector<double> state;
+   };
+
+   void advanceTile(const Tile& tile, Scratch& scratch,
+                    ReactionManager& reaction, double dt, int nSteps,
+                    double* Vm, const std::vector<const double*>& iStim,
+                    double* dVmR, double* dVmD);
+
+   FGRUtils::Stencil stencil_;
+   int nLocal_;
+   int maxSteps_;
+   int displacement_[19][3];
+   std::vector<Tile> tile_;
+   std::vector<Scratch> scratch_;
+   std::vector<double> VmIn_;
+   std::vector<double> stateIn_;
+};
+
+#endif
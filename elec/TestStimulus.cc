@@ -10,7 +10,7 @@ TestStimulus::TestStimulus(const TestStimulusParms& p, Pulse* pulse)
   targetCell_(p.cell),
   pulse_(pulse)
 {
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank_);
+   MPI_Comm_rank(p.baseParms.comm, &myRank_);
 }
 
 int TestStimulus::subClassStim(double time,
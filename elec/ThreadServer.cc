@@ -176,3 +176,9 @@ ThreadTeam ThreadServer::getThreadTeam(const vector<unsigned>& coreID)
    return team;
 }
 
+void ThreadServer::releaseThreadTeam(const ThreadTeam& team)
+{
+   for (int ii=0; ii<team.nThreads(); ++ii)
+      availableThreads_.push_back(team.hwInfo(ii));
+   sort(availableThreads_.begin(), availableThreads_.end());
+}
@@ -63,6 +63,8 @@ class ThreadServer
  public:
    static ThreadServer& getInstance();
    ThreadTeam getThreadTeam(const std::vector<unsigned>& coreID);
+   /** Makes the threads of team available to getThreadTeam again. */
+   void releaseThreadTeam(const ThreadTeam& team);
    
  private:
    ThreadServer();
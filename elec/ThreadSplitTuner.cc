@@ -0,0 +1,150 @@
+#include "ThreadSplitTuner.hh"
+
+#include <cassert>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include "Simulate.hh"
+#include "ThreadServer.hh"
+#include "Diffusion.hh"
+#include "diffusionFactory.hh"
+#include "ddcMalloc.h"
+
+using namespace std;
+
+namespace
+{
+   // A neighboring split has to beat the best one by this fraction to
+   // count as an improvement.  Keeps the search from wandering on noise.
+   const double minGain = 0.01;
+}
+
+ThreadSplitTuner::ThreadSplitTuner(int nCores, int nDiffusionCores, MPI_Comm comm)
+: comm_(comm),
+  nCores_(nCores),
+  current_(nDiffusionCores),
+  best_(nDiffusionCores),
+  direction_(0),
+  turned_(false),
+  settled_(nCores < 2)
+{
+}
+
+int ThreadSplitTuner::nextSplit(double stepTime, double diffusionWait, double reactionWait)
+{
+   if (settled_)
+      return current_;
+
+   double maxTime;
+   double wait[2] = {diffusionWait, reactionWait};
+   double sumWait[2];
+   MPI_Allreduce(&stepTime, &maxTime, 1, MPI_DOUBLE, MPI_MAX, comm_);
+   MPI_Allreduce(wait, sumWait, 2, MPI_DOUBLE, MPI_SUM, comm_);
+
+   int myRank;
+   MPI_Comm_rank(comm_, &myRank);
+   if (myRank == 0)
+      cout << "ThreadSplitTuner: nDiffusionCores = " << current_
+           << " step time = " << maxTime*1e6 << " us"
+           << " diffusion wait = " << sumWait[0]
+           << " reaction wait = " << sumWait[1] << endl;
+
+   stepTime_[current_] = maxTime;
+   bool improved = (current_ == best_ || maxTime < stepTime_[best_]*(1.0-minGain));
+   if (improved)
+      best_ = current_;
+
+   if (direction_ == 0)
+   {
+      // First trial.  Whoever waited has cores to spare.
+      direction_ = (sumWait[1] > sumWait[0]) ? 1 : -1;
+      if (tryMove(current_ + direction_))
+         return current_;
+      direction_ = -direction_;
+      turned_ = true;
+      if (tryMove(current_ + direction_))
+         return current_;
+   }
+   else if (improved && tryMove(current_ + direction_))
+      return current_;
+   else if (!turned_)
+   {
+      turned_ = true;
+      direction_ = -direction_;
+      if (tryMove(best_ + direction_))
+         return current_;
+   }
+
+   settled_ = true;
+   current_ = best_;
+   if (myRank == 0)
+      cout << "ThreadSplitTuner: settled on nDiffusionCores = " << best_ << endl;
+   return current_;
+}
+
+bool ThreadSplitTuner::tryMove(int candidate)
+{
+   if (candidate < 1 || candidate >= nCores_)
+      return false;
+   if (stepTime_.count(candidate) > 0)
+      return false;
+   current_ = candidate;
+   return true;
+}
+
+
+bool countTeamCores(const Simulate& sim, int& nDiffusionCores, int& nCores)
+{
+   set<int> diffusion;
+   set<int> reaction;
+   for (int ii=0; ii<sim.diffusionThreads_.nThreads(); ++ii)
+      diffusion.insert(sim.diffusionThreads_.hwInfo(ii).coreID_);
+   for (int ii=0; ii<sim.reactionThreads_.nThreads(); ++ii)
+      reaction.insert(sim.reactionThreads_.hwInfo(ii).coreID_);
+   nDiffusionCores = diffusion.size();
+   nCores = diffusion.size() + reaction.size();
+   for (set<int>::const_iterator iter=diffusion.begin(); iter!=diffusion.end(); ++iter)
+      if (reaction.count(*iter) > 0)
+         return false;
+   return true;
+}
+
+void rebuildThreadTeams(Simulate& sim, int nDiffusionCores)
+{
+   // Every hardware thread of the first nDiffusionCores cores goes to
+   // diffusion, just as buildCoreList in initializeSimulate does.
+   vector<int> coreOfThread;
+   for (int ii=0; ii<sim.diffusionThreads_.nThreads(); ++ii)
+      coreOfThread.push_back(sim.diffusionThreads_.hwInfo(ii).coreID_);
+   for (int ii=0; ii<sim.reactionThreads_.nThreads(); ++ii)
+      coreOfThread.push_back(sim.reactionThreads_.hwInfo(ii).coreID_);
+   sort(coreOfThread.begin(), coreOfThread.end());
+   vector<int> cores(coreOfThread);
+   cores.erase(unique(cores.begin(), cores.end()), cores.end());
+   assert(nDiffusionCores > 0 && nDiffusionCores < cores.size());
+
+   vector<unsigned> diffusionCores;
+   for (unsigned ii=0; ii<coreOfThread.size(); ++ii)
+      if (coreOfThread[ii] < cores[nDiffusionCores])
+         diffusionCores.push_back(coreOfThread[ii]);
+
+   // The diffusion and reaction objects keep references to these
+   // teams, so they are assigned in place.
+   ThreadServer& threadServer = ThreadServer::getInstance();
+   threadServer.releaseThreadTeam(sim.diffusionThreads_);
+   threadServer.releaseThreadTeam(sim.reactionThreads_);
+   sim.diffusionThreads_ = threadServer.getThreadTeam(diffusionCores);
+   sim.reactionThreads_ = threadServer.getThreadTeam(vector<unsigned>());
+
+   // The diffusion classes carve up their work by thread when they are
+   // built.  Building a new one is simpler than teaching all of them to
+   // repartition and costs about as much as a few time steps.
+   ddcMemSetTag(DDCMEM_DIFFUSION);
+   delete sim.diffusion_;
+   sim.diffusion_ = diffusionFactory(sim.diffusionName_, sim.anatomy_,
+                                     sim.diffusionThreads_, sim.reactionThreads_,
+                                     sim.loopType_, sim.diffusionVariant_);
+   ddcMemSetTag(DDCMEM_OTHER);
+}
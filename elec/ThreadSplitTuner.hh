@@ -0,0 +1,58 @@
+#ifndef THREAD_SPLIT_TUNER_HH
+#define THREAD_SPLIT_TUNER_HH
+
+#include <map>
+#include <mpi.h>
+
+class Simulate;
+
+/** Online search for the number of cores to give to the diffusion team
+ *  of the parallel diffusion/reaction loop.
+ *
+ *  The loop runs each trial split for a warm up window (not measured)
+ *  followed by a measurement window and reports the time per step and
+ *  the time the diffusion and reaction teams spent waiting for each
+ *  other.  The first move goes toward the team that did not wait:
+ *  when the reaction team waits on diffusion, diffusion gets another
+ *  core and vice versa.  The tuner keeps moving in that direction as
+ *  long as the step time improves, tries the other side of the best
+ *  split once, and then settles on the fastest split seen.
+ *
+ *  Timings are reduced over comm (max step time, summed waits) so that
+ *  all tasks make the same decisions.
+ */
+class ThreadSplitTuner
+{
+ public:
+   ThreadSplitTuner(int nCores, int nDiffusionCores, MPI_Comm comm);
+
+   bool settled() const {return settled_;}
+   int nDiffusionCores() const {return current_;}
+
+   /** Returns the number of diffusion cores for the next trial (or the
+    *  final choice once settled()). */
+   int nextSplit(double stepTime, double diffusionWait, double reactionWait);
+
+ private:
+   bool tryMove(int candidate);
+
+   MPI_Comm comm_;
+   int nCores_;
+   int current_;
+   int best_;
+   int direction_;
+   bool turned_;
+   bool settled_;
+   std::map<int, double> stepTime_;
+};
+
+/** Moves the first nDiffusionCores cores to the diffusion team and the
+ *  rest to the reaction team and rebuilds the diffusion object for the
+ *  new teams.  Call only from outside parallel regions. */
+void rebuildThreadTeams(Simulate& sim, int nDiffusionCores);
+
+/** Number of distinct cores in the diffusion team and in both teams
+ *  together.  Returns false if a core is shared by the teams. */
+bool countTeamCores(const Simulate& sim, int& nDiffusionCores, int& nCores);
+
+#endif
@@ -3,6 +3,7 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <cmath>
 
 #include "pio.h"
 #include "ioUtils.h"
@@ -11,8 +12,10 @@
 #include "GridAssignmentObject.h"
 #include "mpiUtils.h"
 #include "IndexToThreeVector.hh"
+#include "PerformanceTimers.hh"
 
 using namespace std;
+using PerformanceTimers::reproducibleSumTimer;
 
 //#define DEBUG
 
@@ -178,10 +181,17 @@ int VoronoiCoarsening::gaoColoring(const double maxDistance,
                                           sizeof(THREE_VECTOR));
    
    const int nLocal = anatomy_.nLocal();
+   vector<THREE_VECTOR> rCells(nLocal);
+   vector<int> nearest(nLocal);
+   for (unsigned iCell=0; iCell<nLocal; ++iCell)
+      rCells[iCell] = indexTo3Vector(anatomy_.gid(iCell));
+   if (nLocal > 0)
+      gao_nearestCenters(gao, nLocal, (const void*) &rCells[0], sizeof(THREE_VECTOR), &nearest[0]);
+   
    for (unsigned iCell=0; iCell<nLocal; ++iCell)
    {
-      THREE_VECTOR rCell = indexTo3Vector(anatomy_.gid(iCell));
-      int nearestSensor = gao_nearestCenter(gao, rCell);
+      THREE_VECTOR rCell = rCells[iCell];
+      int nearestSensor = nearest[iCell];
       THREE_VECTOR rSensor = sensorLocation[nearestSensor];
       
       double rr = DIFFSQ(rCell, rSensor);
@@ -450,6 +460,12 @@ void VoronoiCoarsening::computeRemoteTasks()
 
 void VoronoiCoarsening::exchangeAndSum(LocalSums& valcolors)
 {
+   if( valcolors.folded() )
+   {
+      exchangeAndSum(vector<LocalSums*>(1,&valcolors));
+      return;
+   }
+
    // set up send buffer
    if( valcolors.size()==0 )
    {
@@ -537,6 +553,24 @@ void VoronoiCoarsening::exchangeAndSum(LocalSums& valcolors)
 
 void VoronoiCoarsening::exchangeAndSum(vector<LocalSums*> valcolors)
 {
+   // Fold sums add up exactly, whatever the order of the messages.
+   if( valcolors[0]->folded() )
+   {
+      startTimer(reproducibleSumTimer);
+      const int nFolds=ReproducibleSum::nFolds;
+      vector<LocalSums> parts(nFolds*valcolors.size());
+      vector<LocalSums*> pparts;
+      for(unsigned short i=0;i<valcolors.size();i++)
+         valcolors[i]->splitFolds(&parts[nFolds*i]);
+      for(unsigned k=0;k<parts.size();k++)
+         pparts.push_back(&parts[k]);
+      exchangeAndSum(pparts);
+      for(unsigned short i=0;i<valcolors.size();i++)
+         valcolors[i]->mergeFolds(&parts[nFolds*i]);
+      stopTimer(reproducibleSumTimer);
+      return;
+   }
+
    const unsigned short nvect=(unsigned short)valcolors.size();
    if( valcolors[0]->size()==0 )
    {
@@ -635,6 +669,23 @@ void VoronoiCoarsening::accumulateValues(ro_array_ptr<double> val, LocalSums& va
 {
    valcolors.clear();
    const int nLocal = cell_colors_.size();
+   if( ReproducibleSum::enabled() )
+   {
+      startTimer(reproducibleSumTimer);
+      double bound = 0.;
+      for(int ic=0;ic<nLocal;++ic)
+         if( cell_colors_[ic]>=0 )
+            bound = max(bound, fabs(val[ic]));
+      bound = ReproducibleSum::globalBound(bound, comm_);
+      valcolors.setFolding(ReproducibleSum(bound, anatomy_.nGlobal()));
+      for(int ic=0;ic<nLocal;++ic)
+      {
+         if( cell_colors_[ic]>=0 )
+            valcolors.add1value(cell_colors_[ic],val[ic]);
+      }
+      stopTimer(reproducibleSumTimer);
+      return;
+   }
    for(int ic=0;ic<nLocal;++ic)
    {
       if( cell_colors_[ic]>=0 )
@@ -6,6 +6,7 @@
 #include "IndexToVector.hh"
 #include "Long64.hh"
 #include "lazy_array.hh"
+#include "ReproducibleSum.hh"
 
 #include <mpi.h>
 
@@ -102,9 +103,22 @@ class LocalSums
  private:
    std::map<int,int>    nval_; // number of values summed up for each color
    std::map<int,double> sum_;  // sum of values for each color
+   // Folded sums of each color after setFolding, used instead of sum_.
+   std::map<int, std::vector<double> > folds_;
+   ReproducibleSum folding_;
+   bool useFolds_;
+   
+   void deposit(const int color, const double value)
+   {
+      std::vector<double>& ff = folds_[color];
+      if( ff.empty() )
+         ff.resize(ReproducibleSum::nFolds, 0.);
+      folding_.deposit(value, &ff[0]);
+   }
    
  public:
    LocalSums()
+   : useFolds_(false)
    {
    }
    
@@ -116,13 +130,19 @@ class LocalSums
    void increaseValue(const int color, const double value)
    {
       //assert( value==value );
-      sum_[color]+=value;
+      if( useFolds_ )
+         deposit(color,value);
+      else
+         sum_[color]+=value;
    }
    void add1value(const int color, const double value)
    {
       //assert( value==value );
       nval_[color]++;
-      sum_[color]+=value;
+      if( useFolds_ )
+         deposit(color,value);
+      else
+         sum_[color]+=value;
    }
    void setSum(const int color, const int nval, const double sum)
    {
@@ -169,24 +189,70 @@ class LocalSums
    {
       nval_.clear();
       sum_.clear();
+      folds_.clear();
+      useFolds_=false;
+   }
+
+   bool folded()const
+   {
+      return useFolds_;
+   }
+   // Until the next clear add1value and increaseValue deposit into
+   // folds, which exchangeAndSum sums exactly, so the sums don't depend
+   // on the order of the values.
+   void setFolding(const ReproducibleSum& folding)
+   {
+      folding_ = folding;
+      useFolds_ = true;
+   }
+   // Fold k of each color goes to parts[k] so that the folds can be
+   // exchanged like plain sums.
+   void splitFolds(LocalSums* parts)const
+   {
+      const std::vector<double> none(ReproducibleSum::nFolds, 0.);
+      for(std::map<int,int>::const_iterator itn  = nval_.begin();
+                                            itn != nval_.end();
+                                          ++itn)
+      {
+         std::map<int, std::vector<double> >::const_iterator it=folds_.find(itn->first);
+         const std::vector<double>& ff = (it==folds_.end() ? none : it->second);
+         for(int k=0;k<ReproducibleSum::nFolds;k++)
+            parts[k].setSum(itn->first, itn->second, ff[k]);
+      }
+   }
+   void mergeFolds(const LocalSums* parts)
+   {
+      for(std::map<int,int>::const_iterator itn  = parts[0].nval_.begin();
+                                            itn != parts[0].nval_.end();
+                                          ++itn)
+      {
+         const int color = itn->first;
+         std::vector<double>& ff = folds_[color];
+         ff.resize(ReproducibleSum::nFolds);
+         for(int k=0;k<ReproducibleSum::nFolds;k++)
+            ff[k] = parts[k].value(color);
+         nval_[color] = itn->second;
+      }
    }
    
    double averageValue(const int color)const
    {
       assert( nval_.find(color)!=nval_.end() );
-      std::map<int,double>::const_iterator is=sum_.find(color);
       std::map<int,int>::const_iterator in=nval_.find(color);
-      assert( is!=sum_.end() );
       assert( in!=nval_.end() );
       assert( in->second>0 );
-      if( is->second!=is->second )
-         std::cerr<<"ERROR!!! is->second="<<is->second<<std::endl;
       
-      return is->second/(double)(in->second);
+      return value(color)/(double)(in->second);
    }
    
    double value(const int color)const
    {
+      if( useFolds_ )
+      {
+         std::map<int, std::vector<double> >::const_iterator it=folds_.find(color);
+         assert( it!=folds_.end() );
+         return ReproducibleSum::value(&it->second[0]);
+      }
       //assert( sum_.size()>0 );
       std::map<int,double>::const_iterator is=sum_.find(color);
       //if( is==sum_.end() )
@@ -11,6 +11,7 @@
 #include "object_cc.hh"
 #include "ioUtils.h"
 #include "Koradi.hh"
+#include "GraphPartitioner.hh"
 #include "writeCells.hh"
 #include "Simulate.hh"
 #include "GDLoadBalancer.hh"
@@ -29,6 +30,7 @@ using namespace std;
 namespace
 {
     void koradiBalancer(Simulate& sim, OBJECT* obj, MPI_Comm comm);
+    void graphBalancer(Simulate& sim, OBJECT* obj, MPI_Comm comm);
     LoadLevel gridBalancer(Simulate& sim, OBJECT* obj, MPI_Comm comm);
     void blockBalancer(Simulate& sim, OBJECT* obj, MPI_Comm comm);
     LoadLevel workBoundScan(Simulate& sim, OBJECT* obj, MPI_Comm comm);
@@ -55,6 +57,8 @@ LoadLevel assignCellsToTasks(Simulate& sim, const string& name, MPI_Comm comm)
    profileStart("Assignment");
    if (method == "koradi")
       koradiBalancer(sim, obj, comm);
+   else if (method == "graph")
+      graphBalancer(sim, obj, comm);
    else if (method == "grid")
       loadLevel = gridBalancer(sim, obj, comm);
    else if (method == "block")
@@ -152,7 +156,7 @@ namespace
       assert(nCenters > 0);
       
       profileStart("Koradi");
-      Koradi balancer(sim.anatomy_, kp);
+      Koradi balancer(sim.anatomy_, kp, comm);
       profileStop("Koradi");
 
       vector<AnatomyCell>& cells = sim.anatomy_.cellArray();
@@ -164,6 +168,38 @@ namespace
    }
 }
 
+namespace
+{
+   // Multilevel partitioning of the voxel graph that trades load
+   // balance against cut faces and neighbor count (see
+   // GraphPartitioner.hh).  Keywords:
+   //   imbalance     allowed max/average load - 1 (0.03)
+   //   nbrWeight     cost of a neighbor task in cut faces (4)
+   //   maxVertices   block graph size for each bisection (65536)
+   //   nTrials       initial bisections of the coarsest graph (4)
+   //   refineSweeps  parallel k-way refinement sweeps (8)
+   void graphBalancer(Simulate& sim, OBJECT* obj, MPI_Comm comm)
+   {
+      GraphPartitionerParms gp;
+      objectGet(obj, "verbose",      gp.verbose,      "1");
+      objectGet(obj, "imbalance",    gp.imbalance,    "0.03");
+      objectGet(obj, "nbrWeight",    gp.nbrWeight,    "4");
+      objectGet(obj, "maxVertices",  gp.maxVertices,  "65536");
+      objectGet(obj, "nTrials",      gp.nTrials,      "4");
+      objectGet(obj, "refineSweeps", gp.refineSweeps, "8");
+
+      profileStart("GraphPartitioner");
+      GraphPartitioner partitioner(sim.anatomy_, gp, comm);
+      profileStop("GraphPartitioner");
+
+      int nTasks;
+      MPI_Comm_size(comm, &nTasks);
+      vector<AnatomyCell>& cells = sim.anatomy_.cellArray();
+      computeNCellsHistogram(sim,cells,nTasks,comm);
+      computeVolHistogram(sim,cells,nTasks,comm);
+   }
+}
+
 namespace
 {
     // The grid load balancer assigns cells to a 3D process grid by minimizing
@@ -264,7 +300,7 @@ namespace
       string minimize;
       objectGet(obj, "minimize", minimize, "work");
       
-      timestampBarrier("computing grid load assignment", MPI_COMM_WORLD);
+      timestampBarrier("computing grid load assignment", comm);
       profileStart("gd_assign_init");
       if (minimize == "volume")
          loadbal.initialDistByVol(cells, sim.nx_, sim.ny_, sim.nz_);
@@ -275,7 +311,7 @@ namespace
       }
       profileStop("gd_assign_init");
 
-      timestampBarrier("computing load histograms", MPI_COMM_WORLD);
+      timestampBarrier("computing load histograms", comm);
       computeNCellsHistogram(sim,cells,npegrid,comm);
       computeVolHistogram(sim,cells,npegrid,comm);
       computeWorkHistogram(sim,cells,npegrid,comm, diffCost);
@@ -300,7 +336,7 @@ namespace
         if (myRank == 0)
            DirTestCreate(fullname.c_str());
         fullname += "/domains";
-        writeCells(sim.anatomy_.cellArray(), sim.nx_, sim.ny_, sim.nz_, fullname.c_str());
+        writeCells(sim.anatomy_.cellArray(), sim.nx_, sim.ny_, sim.nz_, fullname.c_str(), comm);
       }
       
       bool testingOnly = (npegrid != nTasks);
@@ -650,7 +686,7 @@ namespace
         if (myRank == 0)
            DirTestCreate(fullname.c_str());
         fullname += "/domains";
-        writeCells(sim.anatomy_.cellArray(), sim.nx_, sim.ny_, sim.nz_, fullname.c_str());
+        writeCells(sim.anatomy_.cellArray(), sim.nx_, sim.ny_, sim.nz_, fullname.c_str(), comm);
       }
       
       bool testingOnly = (npes > nTasks);
@@ -8,6 +8,9 @@
 #include <mpi.h>
 #include <cstdlib>
 #include <sstream>
+#include <functional>
+#include <climits>
+#include <unistd.h>
 #ifdef USE_CUDA
 #include <cuda.h>
 #include <cuda_runtime.h>
@@ -22,6 +25,7 @@
 
 #include "initializeSimulate.hh"
 #include "simulationLoop.hh"
+#include "RunPlanner.hh"
 #include "heap.h"
 #include "object_cc.hh"
 #include "Version.hh"
@@ -37,6 +41,11 @@ using namespace std;
 namespace
 {
    void parseCommandLineAndReadInputFile(int argc, char** argv, MPI_Comm comm);
+   void readInputFiles(const vector<string>& objectFiles, MPI_Comm comm);
+   MPI_Comm joinEnsemble(const string& ensembleFile);
+   MPI_Comm anatomyPeers(MPI_Comm simComm);
+   string ensembleFileName(int argc, char** argv);
+   bool removePlanFlag(int& argc, char** argv);
    void printBanner();
 }
 
@@ -92,13 +101,29 @@ int main(int argc, char** argv)
 
    if (mype == 0)
      printBanner();
-   parseCommandLineAndReadInputFile(argc, argv, MPI_COMM_WORLD);
 
+   MPI_Comm simComm = MPI_COMM_WORLD;
+   bool plan = removePlanFlag(argc, argv);
+   string ensembleFile = ensembleFileName(argc, argv);
+   if (ensembleFile.empty())
+      parseCommandLineAndReadInputFile(argc, argv, simComm);
+   else
+      simComm = joinEnsemble(ensembleFile);
+   MPI_Comm peers = anatomyPeers(simComm);
    
-   timestampBarrier("Starting initializeSimulate", MPI_COMM_WORLD);
+   timestampBarrier("Starting initializeSimulate", simComm);
    Simulate sim;
-   initializeSimulate("simulate", sim);
-   timestampBarrier("Finished initializeSimulate", MPI_COMM_WORLD);
+   initializeSimulate("simulate", sim, simComm, peers);
+   timestampBarrier("Finished initializeSimulate", simComm);
+
+   if (plan)
+   {
+      runPlanner(sim, "plan");
+      if (peers != MPI_COMM_NULL)
+         MPI_Comm_free(&peers);
+      MPI_Finalize();
+      return 0;
+   }
 
    //ewd:  turn on mpiP
    //MPI_Barrier(MPI_COMM_WORLD);
@@ -107,7 +132,7 @@ int main(int argc, char** argv)
 #ifdef HPM
   HPM_Start("Loop"); 
 #endif 
-   timestampBarrier("Starting Simulation Loop", MPI_COMM_WORLD);
+   timestampBarrier("Starting Simulation Loop", sim.comm_);
    profileStart_HW("Loop");
    switch (sim.loopType_)
    {
@@ -118,11 +143,17 @@ int main(int argc, char** argv)
      // printf("Cardioid pdr ptr=%p %p %p\n",sim.diffusion_->blockIndex(),sim.diffusion_->dVmBlock(),sim.diffusion_->VmBlock());  fflush(stdout); 
       simulationLoopParallelDiffusionReaction(sim);
       break;
+     case Simulate::task:
+      simulationLoopTaskGraph(sim);
+      break;
+     case Simulate::blocked:
+      simulationLoopBlocked(sim);
+      break;
      default:
       assert(false);
    }
    profileStop_HW("Loop");
-   timestampBarrier("Finished Simulation Loop", MPI_COMM_WORLD);
+   timestampBarrier("Finished Simulation Loop", sim.comm_);
 #ifdef HPM
   HPM_Stop("Loop"); 
 #endif 
@@ -161,6 +192,9 @@ int main(int argc, char** argv)
    dirname << "snapshot."<<setfill('0')<<setw(12)<<sim.loop_;
    //profileDumpAll(dirname.str());
    heap_deallocate();
+   if (peers != MPI_COMM_NULL)
+      MPI_Comm_free(&peers);
+   MPI_Barrier(MPI_COMM_WORLD);
    MPI_Finalize();
    
    return 0;
@@ -177,18 +211,19 @@ void parseCommandLineAndReadInputFile(int argc, char** argv, MPI_Comm comm)
    // get input file name from command line argument
    for (int argvCursor=1; argvCursor<argc; argvCursor++)
    {
-      if (argv[argvCursor] == "-h" ||
-          argv[argvCursor] == "--help")
+      if (string(argv[argvCursor]) == "-h" ||
+          string(argv[argvCursor]) == "--help")
       {
          if (myRank == 0)
-            cout << "Usage:  cardioid [input files]" << endl;
+            cout << "Usage:  cardioid [input files]\n"
+                    "        cardioid --plan [input files]\n"
+                    "        cardioid --ensemble ensembleFile" << endl;
          exit(1);
       }
    }
 
    // parse input file
    vector<string> objectFiles;
-   string restartFile("restart");
    if (argc == 1)
    {
       objectFiles.push_back("object.data");
@@ -200,7 +235,18 @@ void parseCommandLineAndReadInputFile(int argc, char** argv, MPI_Comm comm)
          objectFiles.push_back(argv[argvCursor]);
       }
    }
+   readInputFiles(objectFiles, comm);
+}
+}
 
+namespace
+{
+void readInputFiles(const vector<string>& objectFiles, MPI_Comm comm)
+{
+   int myRank;
+   MPI_Comm_rank(comm, &myRank);      
+
+   string restartFile("restart");
    if (myRank == 0)
    {
       bool inputDeckExists=true;
@@ -231,7 +277,241 @@ void parseCommandLineAndReadInputFile(int argc, char** argv, MPI_Comm comm)
       printf("----------------------------------------------------------------------\n"
              "End of object database\n\n");
    }
+   object_Bcast(0, comm);
+}
+}
+
+namespace
+{
+string ensembleFileName(int argc, char** argv)
+{
+   for (int argvCursor=1; argvCursor<argc; argvCursor++)
+   {
+      if (string(argv[argvCursor]) != "--ensemble")
+         continue;
+      if (argc != 3 || argvCursor != 1)
+      {
+         if (getRank(-1) == 0)
+            cout << "Usage:  cardioid --ensemble ensembleFile" << endl;
+         exit(1);
+      }
+      return argv[2];
+   }
+   return "";
+}
+
+/** Removes --plan from the arguments.  See the PLAN object. */
+bool removePlanFlag(int& argc, char** argv)
+{
+   bool found = false;
+   int kept = 1;
+   for (int argvCursor=1; argvCursor<argc; argvCursor++)
+   {
+      if (string(argv[argvCursor]) == "--plan")
+         found = true;
+      else
+         argv[kept++] = argv[argvCursor];
+   }
+   argc = kept;
+   return found;
+}
+}
+
+namespace
+{
+/*!
+  @page obj_ENSEMBLE ENSEMBLE object
+
+  Runs several independent simulations in one job.  Start cardioid as
+  "cardioid --ensemble ensembleFile" where ensembleFile defines an
+  ENSEMBLE object called ensemble.  The tasks of the job are split into
+  one group per directory.  Each group changes to its directory, reads
+  object.data (and restart, if present) from there and runs it exactly
+  as a stand alone job would.  Groups that read the same anatomy file
+  with the same number of tasks read it only once.
+
+  @beginkeywords
+    @kw{directories, The run directories.  One simulation is run in each
+      directory., No default}
+    @kw{nTasks, The number of tasks for each directory.  If present it
+      must have one entry per directory and sum to the number of tasks
+      in the job., All tasks are divided as evenly as possible}
+  @endkeywords
+
+  ~~~~
+  ensemble ENSEMBLE
+  {
+    directories = run000 run001 run002 run003;
+    nTasks = 64 64 32 32;
+  }
+  ~~~~
+*/
+MPI_Comm joinEnsemble(const string& ensembleFile)
+{
+   int worldRank, worldSize;
+   MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+   MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+
+   if (worldRank == 0)
+   {
+      if (filetest(ensembleFile.c_str(), S_IFREG) != 0)
+      {
+         printf("ensemble file=%s does not exist or wrong type\n", ensembleFile.c_str());
+         MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      object_compilefile(ensembleFile.c_str());
+   }
    object_Bcast(0, MPI_COMM_WORLD);
+
+   OBJECT* obj = objectFind("ensemble", "ENSEMBLE");
+   vector<string> directories;
+   vector<int> nTasks;
+   objectGet(obj, "directories", directories);
+   objectGet(obj, "nTasks", nTasks);
+   int nSims = directories.size();
+   if (nSims == 0 || nSims > worldSize)
+   {
+      if (worldRank == 0)
+         cout << "ENSEMBLE: need between 1 and " << worldSize
+              << " directories, found " << nSims << endl;
+      MPI_Abort(MPI_COMM_WORLD, 1);
+   }
+   if (nTasks.empty())
+   {
+      for (int ii=0; ii<nSims; ++ii)
+         nTasks.push_back(worldSize/nSims + (ii < worldSize%nSims ? 1 : 0));
+   }
+   int nTotal = 0;
+   for (unsigned ii=0; ii<nTasks.size(); ++ii)
+      nTotal += nTasks[ii];
+   if (nTasks.size() != nSims || nTotal != worldSize)
+   {
+      if (worldRank == 0)
+         cout << "ENSEMBLE: nTasks must have one entry per directory and sum to "
+              << worldSize << endl;
+      MPI_Abort(MPI_COMM_WORLD, 1);
+   }
+
+   int mySim = 0;
+   for (int first=nTasks[0]; first<=worldRank; first+=nTasks[mySim])
+      ++mySim;
+
+   MPI_Comm simComm;
+   MPI_Comm_split(MPI_COMM_WORLD, mySim, worldRank, &simComm);
+   // Library code that has no Simulate at hand (getRank(0) etc.) uses
+   // COMM_LOCAL.
+   COMM_LOCAL = simComm;
+
+   if (chdir(directories[mySim].c_str()) != 0)
+   {
+      cout << "ENSEMBLE: task " << worldRank << " can't change to directory "
+           << directories[mySim] << endl;
+      MPI_Abort(MPI_COMM_WORLD, 1);
+   }
+   if (worldRank == 0)
+      cout << "ENSEMBLE: running " << nSims << " simulations" << endl;
+
+   readInputFiles(vector<string>(1, "object.data"), simComm);
+   return simComm;
+}
+}
+
+namespace
+{
+/** Tasks of different simulations that read the same anatomy file with
+ *  the same number of tasks receive the same share of the file.  The
+ *  returned communicator connects each task to its counterparts in the
+ *  other simulations so that the file needs to be read only once.
+ *  Returns MPI_COMM_NULL if there is nobody to share with.
+ *
+ *  All tasks in MPI_COMM_WORLD must call this function. */
+MPI_Comm anatomyPeers(MPI_Comm simComm)
+{
+   int worldSize, simRank, simSize;
+   MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+   MPI_Comm_rank(simComm, &simRank);
+   MPI_Comm_size(simComm, &simSize);
+   if (simSize == worldSize)
+      return MPI_COMM_NULL;
+
+   string key;
+   OBJECT* simObj = objectFind("simulate", "SIMULATE");
+   string anatomyName;
+   objectGet(simObj, "anatomy", anatomyName, "anatomy");
+   OBJECT* obj = objectFind(anatomyName, "ANATOMY");
+   string method, fileName;
+   objectGet(obj, "method", method, "pio");
+   objectGet(obj, "fileName", fileName, "snapshot.initial/anatomy#");
+   if (method == "pio")
+   {
+      // Name of the directory as the operating system sees it so that
+      // different relative paths to the same file compare equal.
+      string dir = ".";
+      string base = fileName;
+      size_t slash = fileName.rfind('/');
+      if (slash != string::npos)
+      {
+         dir = fileName.substr(0, slash+1);
+         base = fileName.substr(slash+1);
+      }
+      char path[PATH_MAX];
+      if (realpath(dir.c_str(), path) != 0)
+      {
+         stringstream buf;
+         buf << path << "/" << base << " " << simSize;
+         key = buf.str();
+      }
+   }
+
+   unsigned long long mine[2];
+   mine[0] = key.empty() ? 0 : std::hash<string>()(key);
+   mine[1] = simRank;
+   vector<unsigned long long> all(2*worldSize);
+   MPI_Allgather(mine, 2, MPI_UNSIGNED_LONG_LONG,
+                 &all[0], 2, MPI_UNSIGNED_LONG_LONG, MPI_COMM_WORLD);
+   int color = MPI_UNDEFINED;
+   int nPeers = 0;
+   for (int ii=0; ii<worldSize; ++ii)
+   {
+      if (key.empty() || all[2*ii] != mine[0] || all[2*ii+1] != mine[1])
+         continue;
+      if (nPeers++ == 0)
+         color = ii;
+   }
+   // Without anybody to share with the communicator is only overhead.
+   int sharing = (nPeers > 1);
+   int anySharing;
+   MPI_Allreduce(&sharing, &anySharing, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+   if (!anySharing)
+      return MPI_COMM_NULL;
+   if (!sharing)
+      color = MPI_UNDEFINED;
+
+   MPI_Comm peers;
+   MPI_Comm_split(MPI_COMM_WORLD, color, 0, &peers);
+   if (peers == MPI_COMM_NULL)
+      return peers;
+
+   // Guard against hash collisions.
+   int keySize = key.size();
+   MPI_Bcast(&keySize, 1, MPI_INT, 0, peers);
+   string leaderKey(key);
+   leaderKey.resize(keySize);
+   MPI_Bcast(&leaderKey[0], keySize, MPI_CHAR, 0, peers);
+   int same = (leaderKey == key);
+   int allSame;
+   MPI_Allreduce(&same, &allSame, 1, MPI_INT, MPI_MIN, peers);
+   if (!allSame)
+      MPI_Comm_free(&peers);
+   if (simRank == 0 && peers != MPI_COMM_NULL)
+   {
+      int peerRank;
+      MPI_Comm_rank(peers, &peerRank);
+      if (peerRank == 0)
+         cout << "Sharing anatomy " << key << " with " << nPeers-1
+              << " other simulations" << endl;
+   }
+   return peers;
 }
 }
 
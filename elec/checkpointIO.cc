@@ -209,7 +209,7 @@ void writeCheckpoint(const Simulate& sim, MPI_Comm comm)
 void readCheckpoint(const string& filename, Simulate& sim, MPI_Comm comm)
 {
    BucketOfBits* data = 
-      loadAndDistributeState(filename, sim.anatomy_);
+      loadAndDistributeState(filename, sim.anatomy_, comm);
    assert(data->nRecords() == sim.anatomy_.nLocal());
 
    vector<double> unitConvert(data->nFields(), 1.0);
@@ -228,14 +228,26 @@ void readCheckpoint(const string& filename, Simulate& sim, MPI_Comm comm)
       }
    }
    
-   for (unsigned ii=0; ii<sim.anatomy_.nLocal(); ++ii)
+   // Parse the records in parallel into one column per field, then
+   // hand each column to the reaction in one call.
+   int nLocal = sim.anatomy_.nLocal();
+   vector<int> fieldIndex;
+   vector<int> fieldHandle;
+   for (FieldMap::const_iterator iter=fieldMap.begin();
+        iter!=fieldMap.end(); ++iter)
+   {
+      fieldIndex.push_back(iter->first);
+      fieldHandle.push_back(iter->second);
+   }
+   int nFields = fieldIndex.size();
+   vector<vector<double> > column(nFields, vector<double>(nLocal));
+   #pragma omp parallel for
+   for (int ii=0; ii<nLocal; ++ii)
    {
       BucketOfBits::Record iRec = data->getRecord(ii);
-      for (FieldMap::const_iterator iter=fieldMap.begin();
-           iter!=fieldMap.end(); ++iter)
+      for (int jj=0; jj<nFields; ++jj)
       {
-         int iField = iter->first;
-         int handle = iter->second;
+         int iField = fieldIndex[jj];
          double value;
          switch (data->dataType(iField))
          {
@@ -253,16 +265,22 @@ void readCheckpoint(const string& filename, Simulate& sim, MPI_Comm comm)
            default:
             assert(false);
          }
-         value *= unitConvert[iField];
-         sim.reaction_->setValue(ii, handle, value);
+         column[jj][ii] = value*unitConvert[iField];
       }
    }
+   for (int jj=0; jj<nFields; ++jj)
+      sim.reaction_->setValues(fieldHandle[jj], column[jj]);
 
    // Load membrane voltage from checkpoint file into VmArray.
    wo_array_ptr<double> vmarray = sim.vdata_.VmTransport_.useOn(CPU); 
    unsigned vmIndex = data->getIndex("Vm");
    if (vmIndex != data->nFields())
-      for (unsigned ii=0; ii<data->nRecords(); ++ii)
-         data->getRecord(ii).getValue(vmIndex, vmarray.raw()[ii]);
+   {
+      int nRecords = data->nRecords();
+      double* vm = vmarray.raw();
+      #pragma omp parallel for
+      for (int ii=0; ii<nRecords; ++ii)
+         data->getRecord(ii).getValue(vmIndex, vm[ii]);
+   }
    delete data;
 }
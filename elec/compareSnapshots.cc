@@ -2,405 +2,481 @@
 #include <iomanip>
 #include <string>
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <vector>
+#include <set>
+#include <unordered_map>
 #include <mpi.h>
 #include <algorithm>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
-#include "Simulate.hh"
-#include "PerformanceTimers.hh"
-#include "checkpointIO.hh"
 #include "BucketOfBits.hh"
-#include "AnatomyReader.hh"
-#include "stateLoader.hh"
-#include "cellState.hh"
 #include "object_cc.hh"
 #include "readPioFile.hh"
-#include "mpiUtils.h"
+#include "Long64.hh"
 #include "pio.h"
-#include "units.h"
-#include "ioUtils.h"
 
-// compareSnapshots goes through all snapshot subdirectories in two simulation directories and
-// computes the max, min, and rms differences in all floating-point fields for plotting and
-// comparison.
+// compareSnapshots goes through all snapshot subdirectories in two
+// simulation directories and computes the max and rms differences of
+// every floating-point field of every pio file the two have in common
+// (state, activation times, sensor output, ...).
+//
+// Each task reads its share of both pio files a chunk at a time.
+// Records are joined by gid: every gid is owned by the task given by a
+// hash of the gid, records of the first file are sent to and kept by
+// their owner, and records of the second file are sent to the same
+// owner where they are compared and discarded.  Only the owned part of
+// the first file is ever held in memory, both files are read exactly
+// once and the load balance of the two runs does not matter.
+//
+// Fields named tActiv (ActivationTimeSensor) hold 0 for cells that
+// never activated; they are compared only where both runs activated and
+// cells that activated in only one run are counted separately.
+//
+// With -t the comparison stops at the end of the first chunk in which
+// any difference exceeds the tolerance and the exit status is 1.
 
 using namespace std;
+
+MPI_Comm COMM_LOCAL = MPI_COMM_WORLD;
+
 namespace
 {
-    void readAnatomyBucket(Anatomy& anatomy, BucketOfBits* bucketP);
-    BucketOfBits* fillDataBucket(Simulate& sim, string dirName, double &time, int &nrecord);
-}
+   struct FieldStats
+   {
+      FieldStats() : sumSq(0), maxDiff(0), maxGid(0), n(0), activationMismatch(0) {}
+      double sumSq;
+      double maxDiff;
+      Long64 maxGid;
+      Long64 n;
+      Long64 activationMismatch;
+   };
 
-MPI_Comm COMM_LOCAL = MPI_COMM_WORLD;
+   vector<string> commonSnapshots(const string& runDir1, const string& runDir2);
+   vector<string> commonPioFiles(const string& dir1, const string& dir2);
+   bool compareFiles(const string& dir1, const string& dir2, const string& fileName,
+                     double tolerance, unsigned chunkSize, set<string>& openedFiles);
+   bool isDirectory(const string& name);
+}
 
 int main(int argc, char** argv)
 {
    int nTasks, myRank;
    MPI_Init(&argc,&argv);
    MPI_Comm_size(MPI_COMM_WORLD, &nTasks);
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);  
+   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
 
-   if (argc != 3)
+   double tolerance = HUGE_VAL;
+   unsigned chunkSize = 1<<18;
+   int opt;
+   while ((opt = getopt(argc, argv, "t:c:")) != -1)
+   {
+      switch (opt)
+      {
+        case 't':
+         tolerance = atof(optarg);
+         break;
+        case 'c':
+         chunkSize = max(1, atoi(optarg));
+         break;
+        default:
+         argc = 0;
+      }
+   }
+
+   if (argc - optind != 2)
    {
       if (myRank == 0)
-         cout << "Usage:  compareSnapshots [simulation directory 1] [simulation directory 2]" << endl << endl;
+         cout << "Usage:  compareSnapshots [-t tolerance] [-c records per chunk]"
+              << " [simulation directory 1] [simulation directory 2]" << endl << endl;
+      MPI_Finalize();
       exit(1);
    }
-   
-   string runDir1(argv[1]);
-   string runDir2(argv[2]);
-   const string snapshot("snapshot");  // text that identifies snapshot directory name
-
-   // test if runDir1 exists
-   struct stat st1;
-   if (!(stat(runDir1.c_str(),&st1)==0 && S_ISDIR( st1.st_mode )) )
+
+   string runDir1(argv[optind]);
+   string runDir2(argv[optind+1]);
+
+   if (!isDirectory(runDir1))
    {
       if (myRank == 0)
          cout << "ERROR:  " << runDir1 << " does not exist!" << endl;
+      MPI_Finalize();
       exit(1);
    }
 
-   // go through all subdirectories of runDir1, save snapshot directory names
-   vector<string> snapshotDirs1;
-   struct dirent *dptr;
-   DIR *dir = opendir(runDir1.c_str());
-   struct dirent *entry = readdir(dir);
-   while (entry != NULL)
+   vector<string> snapshotUnion = commonSnapshots(runDir1, runDir2);
+   if (snapshotUnion.size() <= 0)
    {
-      if (entry->d_type == DT_DIR)
+      if (myRank == 0)
+         cout << "ERROR: no common snapshot directories in " << runDir1 << " and " << runDir2 << endl;
+      MPI_Finalize();
+      exit(1);
+   }
+
+   set<string> openedFiles;
+   bool exceeded = false;
+   for (unsigned isnap=0; isnap<snapshotUnion.size() && !exceeded; isnap++)
+   {
+      if (myRank == 0)
+      {
+         cout << endl;
+         cout << "Comparing snapshot " << snapshotUnion[isnap] << "..." << endl;
+      }
+
+      string snapshotDir1 = runDir1 + '/' + snapshotUnion[isnap];
+      string snapshotDir2 = runDir2 + '/' + snapshotUnion[isnap];
+      vector<string> files = commonPioFiles(snapshotDir1, snapshotDir2);
+      for (unsigned ii=0; ii<files.size() && !exceeded; ++ii)
+         exceeded = compareFiles(snapshotDir1, snapshotDir2, files[ii],
+                                 tolerance, chunkSize, openedFiles);
+   }
+
+   if (exceeded && myRank == 0)
+      cout << endl << "Tolerance " << tolerance << " exceeded; comparison stopped." << endl;
+
+   MPI_Finalize();
+   return exceeded ? 1 : 0;
+}
+
+namespace
+{
+   bool isDirectory(const string& name)
+   {
+      struct stat st;
+      return (stat(name.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+   }
+
+   bool isFile(const string& name)
+   {
+      struct stat st;
+      return (stat(name.c_str(), &st) == 0 && S_ISREG(st.st_mode));
+   }
+
+   /** Names of the snapshot.* subdirectories present in both run
+    *  directories, sorted. */
+   vector<string> commonSnapshots(const string& runDir1, const string& runDir2)
+   {
+      const string snapshot("snapshot");
+      vector<string> snapshotUnion;
+      DIR* dir = opendir(runDir1.c_str());
+      if (dir == NULL)
+         return snapshotUnion;
+      for (struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
       {
          string subdir(entry->d_name);
-         size_t skipit = subdir.find(snapshot);
-         if (!skipit)
-            snapshotDirs1.push_back(subdir);
+         if (entry->d_type == DT_DIR && subdir.compare(0, snapshot.size(), snapshot) == 0 &&
+             isDirectory(runDir2 + '/' + subdir))
+            snapshotUnion.push_back(subdir);
       }
-      entry = readdir(dir);
+      closedir(dir);
+      sort(snapshotUnion.begin(), snapshotUnion.end());
+      return snapshotUnion;
    }
-   
-   // Compute the subset of snapshot directories that exist in both run directories.
-   // (If runDir2 doesn't exist, this union will be empty and the code will exit without
-   // doing anything.)
-   vector<string> snapshotUnion;
-   struct stat st2;
-   for (int ii=0; ii<snapshotDirs1.size(); ii++)
+
+   /** Names (without the #nnnnnn suffix) of the pio files present in
+    *  both snapshot directories, sorted. */
+   vector<string> commonPioFiles(const string& dir1, const string& dir2)
    {
-      string testdir2 = runDir2 + '/' + snapshotDirs1[ii];
-      if (stat(testdir2.c_str(),&st2)==0 && S_ISDIR(st2.st_mode))
-         snapshotUnion.push_back(snapshotDirs1[ii]);
+      const string firstFile("#000000");
+      vector<string> files;
+      DIR* dir = opendir(dir1.c_str());
+      if (dir == NULL)
+         return files;
+      for (struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+      {
+         string name(entry->d_name);
+         if (name.size() <= firstFile.size() ||
+             name.compare(name.size()-firstFile.size(), firstFile.size(), firstFile) != 0)
+            continue;
+         if (isFile(dir2 + '/' + name))
+            files.push_back(name.substr(0, name.size()-firstFile.size()));
+      }
+      closedir(dir);
+      sort(files.begin(), files.end());
+      return files;
    }
 
-   if (snapshotUnion.size() <= 0)
+   int gidOwner(Long64 gid, int nTasks)
    {
-      if (myRank == 0)
-         cout << "ERROR: no common snapshot directories in " << runDir1 << " and " << runDir1 << endl;
-      exit(1);
+      uint64_t h = gid*0x9E3779B97F4A7C15ull;
+      return (h >> 32) % nTasks;
    }
 
-   // sort snapshotUnion
-   sort(snapshotUnion.begin(),snapshotUnion.end());
-   
+   /** Reads the next chunk of file and sends each record to the owner
+    *  of its gid as (gid, value of each compared field).  On return
+    *  recvBuf holds the items this task owns.  Every task must call
+    *  this the same number of times, so tasks that ran out of data pass
+    *  through with empty buffers. */
+   void exchangeChunk(PFILE* file, BucketOfBits* bucket, unsigned chunkSize,
+                      unsigned gidIndex, const vector<unsigned>& fieldIndex,
+                      vector<double>& recvBuf, unsigned& nRead)
+   {
+      int nTasks;
+      MPI_Comm_size(MPI_COMM_WORLD, &nTasks);
+      const unsigned itemSize = 1 + fieldIndex.size();
+
+      nRead = readPioRecords(file, chunkSize, bucket);
+      vector<int> sendCnt(nTasks, 0);
+      vector<int> dest(nRead);
+      vector<uint64_t> gids(nRead);
+      for (unsigned ii=0; ii<nRead; ++ii)
+      {
+         bucket->getRecord(ii).getValue(gidIndex, gids[ii]);
+         dest[ii] = gidOwner(gids[ii], nTasks);
+         sendCnt[dest[ii]] += itemSize;
+      }
+      vector<int> sendOffset(nTasks+1, 0);
+      for (int ii=0; ii<nTasks; ++ii)
+         sendOffset[ii+1] = sendOffset[ii] + sendCnt[ii];
+
+      vector<double> sendBuf(sendOffset[nTasks]);
+      vector<int> fill(sendOffset.begin(), sendOffset.end()-1);
+      for (unsigned ii=0; ii<nRead; ++ii)
+      {
+         BucketOfBits::Record rec = bucket->getRecord(ii);
+         double* item = &sendBuf[fill[dest[ii]]];
+         fill[dest[ii]] += itemSize;
+         Long64 gid = gids[ii];
+         memcpy(item, &gid, sizeof(double));
+         for (unsigned jj=0; jj<fieldIndex.size(); ++jj)
+            rec.getValue(fieldIndex[jj], item[1+jj]);
+      }
+
+      vector<int> recvCnt(nTasks);
+      MPI_Alltoall(&sendCnt[0], 1, MPI_INT, &recvCnt[0], 1, MPI_INT, MPI_COMM_WORLD);
+      vector<int> recvOffset(nTasks+1, 0);
+      for (int ii=0; ii<nTasks; ++ii)
+         recvOffset[ii+1] = recvOffset[ii] + recvCnt[ii];
+      recvBuf.resize(recvOffset[nTasks]);
+      MPI_Alltoallv(sendBuf.data(), &sendCnt[0], &sendOffset[0], MPI_DOUBLE,
+                    recvBuf.data(), &recvCnt[0], &recvOffset[0], MPI_DOUBLE,
+                    MPI_COMM_WORLD);
+   }
 
-   // compare each set of snapshots across run directories
-   for (int isnap=0; isnap<snapshotUnion.size(); isnap++)
+   /** Compares one pio file between two snapshot directories.  Returns
+    *  true if the tolerance was exceeded. */
+   bool compareFiles(const string& dir1, const string& dir2, const string& fileName,
+                     double tolerance, unsigned chunkSize, set<string>& openedFiles)
    {
-      if (myRank == 0)
+      int myRank;
+      MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+
+      string name1 = dir1 + '/' + fileName + '#';
+      string name2 = dir2 + '/' + fileName + '#';
+      PFILE* file1 = Popen(name1.c_str(), "r", MPI_COMM_WORLD);
+      PFILE* file2 = Popen(name2.c_str(), "r", MPI_COMM_WORLD);
+      BucketOfBits* bucket1 = emptyPioBucket(file1);
+      BucketOfBits* bucket2 = emptyPioBucket(file2);
+
+      double time;
+      objectGet(file1->headerObject, "time", time, "0.0");
+
+      // floating-point fields both files have in common
+      vector<string> fieldNames;
+      vector<unsigned> fieldIndex1;
+      vector<unsigned> fieldIndex2;
+      unsigned gidIndex1 = bucket1->getIndex("gid");
+      unsigned gidIndex2 = bucket2->getIndex("gid");
+      for (unsigned ii=0; ii<bucket1->nFields(); ++ii)
       {
-         cout << endl;
-         cout << "Comparing snapshot " << snapshotUnion[isnap] << "..." << endl;
+         BucketOfBits::DataType type = bucket1->dataType(ii);
+         if (type != BucketOfBits::floatType && type != BucketOfBits::f4Type &&
+             type != BucketOfBits::f8Type)
+            continue;
+         unsigned jj = bucket2->getIndex(bucket1->fieldName(ii));
+         if (jj == bucket2->nFields() || bucket2->dataType(jj) != type)
+            continue;
+         fieldNames.push_back(bucket1->fieldName(ii));
+         fieldIndex1.push_back(ii);
+         fieldIndex2.push_back(jj);
       }
-      
-      string snapshotDir1 = runDir1 + '/' + snapshotUnion[isnap];
-      string snapshotDir2 = runDir2 + '/' + snapshotUnion[isnap];
-      
-      // read state data from first directory
-      Simulate sim1;
-      int nrecord1;
-      double time1;
-      BucketOfBits* data1 = fillDataBucket(sim1,snapshotDir1,time1,nrecord1);
-      
-      // read state data from second directory
-      Simulate sim2;
-      int nrecord2;
-      double time2;
-      BucketOfBits* data2 = fillDataBucket(sim2,snapshotDir2,time2,nrecord2);
-      
-
-      // determine which fields both directories have in common
-      vector<string> fieldUnion;
-      vector<int> fieldIndex1;
-      vector<int> fieldIndex2;
-      int gidindex1 = -1;
-      int gidindex2 = -1;
-      int nFields1 = data1->nFields();
-      int nFields2 = data2->nFields();
-      int nFloats = 0;
-
-      for (int ifield=0; ifield<nFields1; ifield++)
+
+      if (gidIndex1 == bucket1->nFields() || gidIndex2 == bucket2->nFields() ||
+          fieldNames.empty())
+      {
+         if (myRank == 0)
+            cout << "  " << fileName << ": no gid or no common floating-point fields, skipped" << endl;
+         delete bucket1;
+         delete bucket2;
+         Pclose(file1);
+         Pclose(file2);
+         return false;
+      }
+
+      const unsigned nFields = fieldNames.size();
+      const unsigned itemSize = 1 + nFields;
+      vector<char> isActivation(nFields);
+      for (unsigned jj=0; jj<nFields; ++jj)
+         isActivation[jj] = (fieldNames[jj] == "tActiv");
+
+      // Pass over the first file: keep the records we own.
+      unordered_map<Long64, unsigned> owned;
+      vector<double> ownedValues;
+      vector<double> recvBuf;
+      while (true)
+      {
+         unsigned nRead;
+         exchangeChunk(file1, bucket1, chunkSize, gidIndex1, fieldIndex1, recvBuf, nRead);
+         for (unsigned ii=0; ii<recvBuf.size(); ii+=itemSize)
+         {
+            Long64 gid;
+            memcpy(&gid, &recvBuf[ii], sizeof(double));
+            owned[gid] = ownedValues.size();
+            ownedValues.insert(ownedValues.end(), &recvBuf[ii+1], &recvBuf[ii+itemSize]);
+         }
+         int more = (nRead > 0), anyMore;
+         MPI_Allreduce(&more, &anyMore, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+         if (!anyMore)
+            break;
+      }
+
+      // Pass over the second file: compare against what we own.
+      vector<FieldStats> stats(nFields);
+      Long64 unmatched2 = 0;
+      bool exceeded = false;
+      while (true)
       {
-         for (int jfield=0; jfield<nFields2; jfield++)
+         unsigned nRead;
+         exchangeChunk(file2, bucket2, chunkSize, gidIndex2, fieldIndex2, recvBuf, nRead);
+         for (unsigned ii=0; ii<recvBuf.size(); ii+=itemSize)
          {
-            if (data1->fieldName(ifield) == data2->fieldName(jfield))
+            Long64 gid;
+            memcpy(&gid, &recvBuf[ii], sizeof(double));
+            unordered_map<Long64, unsigned>::iterator here = owned.find(gid);
+            if (here == owned.end())
+            {
+               ++unmatched2;
+               continue;
+            }
+            const double* val1 = &ownedValues[here->second];
+            const double* val2 = &recvBuf[ii+1];
+            owned.erase(here);
+            for (unsigned jj=0; jj<nFields; ++jj)
             {
-               if (data1->fieldName(ifield) == "gid")
+               FieldStats& s = stats[jj];
+               if (isActivation[jj] && (val1[jj] == 0 || val2[jj] == 0))
                {
-                  gidindex1 = ifield;
-                  gidindex2 = jfield;
+                  if (val1[jj] != val2[jj])
+                     ++s.activationMismatch;
+                  continue;
                }
-               else
+               double diff = fabs(val1[jj] - val2[jj]);
+               s.sumSq += diff*diff;
+               ++s.n;
+               if (diff > s.maxDiff)
                {
-                  fieldUnion.push_back(data1->fieldName(ifield));
-                  fieldIndex1.push_back(ifield);
-                  fieldIndex2.push_back(jfield);
-                  nFloats++;
+                  s.maxDiff = diff;
+                  s.maxGid = gid;
                }
             }
          }
-      }
-      assert(nFloats > 0);
-      
-      assert(gidindex1 >= 0 && gidindex2 >= 0);
-      assert(sim1.anatomy_.nx() == sim2.anatomy_.nx());
-      assert(sim1.anatomy_.ny() == sim2.anatomy_.ny());
-      assert(sim1.anatomy_.nz() == sim2.anatomy_.nz());
-      
-      const int nGlobal = sim1.anatomy_.nx()*sim1.anatomy_.ny()*sim1.anatomy_.nz();
-      const int nLocal1 = sim1.anatomy_.nLocal();
-      const int nLocal2 = sim2.anatomy_.nLocal();
-      vector<cellState> state1(nLocal1*nFloats);
-      vector<cellState> state2(nLocal2*nFloats);
-      
-      // distribute data across all tasks in a consistent way so we can compare state files
-      // generated with different load balance algorithms
-      
-      // directory 1
-      for (unsigned ii=0; ii<nLocal1; ++ii)
-      {
-         BucketOfBits::Record iRec = data1->getRecord(ii);
-         int gid;
-         iRec.getValue(gidindex1, gid);
-         assert(gid >= 0 && gid < nGlobal);
-         
-         double gidFrac = (double)gid/(double)nGlobal;
-         int dest = gidFrac*nTasks;
-         if (dest >= nTasks) dest = nTasks-1;
-         
-         int floatCnt1 = 0;
-         for (unsigned jj=0; jj<nFloats; ++jj)
+         double local[2] = {0, double(nRead > 0)};
+         for (unsigned jj=0; jj<nFields; ++jj)
+            local[0] = max(local[0], stats[jj].maxDiff);
+         double global[2];
+         MPI_Allreduce(local, global, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+         if (global[0] > tolerance)
          {
-            int find = fieldIndex1[jj];
-            if (data1->dataType(find) == BucketOfBits::floatType)
-            {
-               double value;
-               iRec.getValue(find, value);
-               state1[nFloats*ii + floatCnt1].value_ = value;
-               state1[nFloats*ii + floatCnt1].gid_ = gid;
-               state1[nFloats*ii + floatCnt1].dest_ = dest;
-               state1[nFloats*ii + floatCnt1].sortind_ = nFloats*gid + floatCnt1;
-               floatCnt1++;
-            }
+            exceeded = true;
+            break;
          }
+         if (global[1] == 0)
+            break;
       }
-      
-      // directory 2
-      for (unsigned ii=0; ii<nLocal2; ++ii)
+      Long64 unmatched1 = exceeded ? 0 : owned.size();
+
+      delete bucket1;
+      delete bucket2;
+      Pclose(file1);
+      Pclose(file2);
+
+      // Reduce and report.
+      vector<double> sums(3*nFields+2);
+      for (unsigned jj=0; jj<nFields; ++jj)
       {
-         BucketOfBits::Record iRec = data2->getRecord(ii);
-         int gid;
-         iRec.getValue(gidindex2, gid);
-         assert(gid >= 0 && gid < nGlobal);
-         double gidFrac = (double)gid/(double)nGlobal;
-         int dest = gidFrac*nTasks;
-         if (dest >= nTasks) dest = nTasks-1;
-         
-         int floatCnt2 = 0;
-         for (unsigned jj=0; jj<nFloats; ++jj)
-         {
-            int find = fieldIndex2[jj];
-            if (data2->dataType(find) == BucketOfBits::floatType)
-            {
-               double value;
-               iRec.getValue(find, value);
-               state2[nFloats*ii + floatCnt2].value_ = value;
-               state2[nFloats*ii + floatCnt2].gid_ = gid;
-               state2[nFloats*ii + floatCnt2].dest_ = dest;
-               state2[nFloats*ii + floatCnt2].sortind_ = nFloats*gid + floatCnt2;
-               floatCnt2++;
-            }
-         }
+         sums[3*jj+0] = stats[jj].sumSq;
+         sums[3*jj+1] = stats[jj].n;
+         sums[3*jj+2] = stats[jj].activationMismatch;
+      }
+      sums[3*nFields+0] = unmatched1;
+      sums[3*nFields+1] = unmatched2;
+      vector<double> sumsGlobal(sums.size());
+      MPI_Reduce(&sums[0], &sumsGlobal[0], sums.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+      // max difference and the gid where it occurs
+      struct DoubleInt { double value; int rank; };
+      vector<DoubleInt> maxLocal(nFields), maxGlobal(nFields);
+      for (unsigned jj=0; jj<nFields; ++jj)
+      {
+         maxLocal[jj].value = stats[jj].maxDiff;
+         maxLocal[jj].rank = myRank;
       }
-      unsigned nSize1 = nLocal1*nFloats;
-      unsigned nSize2 = nLocal2*nFloats;
-      
-      // distribute state values
-      
-      // directory 1
-      sort(state1.begin(),state1.end(),cellState::destLessThan);
-      vector<unsigned> dest1(nSize1);
-      for (unsigned ii=0; ii<state1.size(); ++ii)
-         dest1[ii] = state1[ii].dest_;
-      
-      int maxLocbuf1 = nSize1;
-      int nMax1;
-      MPI_Allreduce(&maxLocbuf1, &nMax1, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
-      
-      state1.resize(10*nMax1);
-      assignArray((unsigned char*)&(state1[0]), &nSize1, state1.capacity(),
-                  sizeof(cellState), &(dest1[0]), 0, MPI_COMM_WORLD);
-      
-      assert(nSize1 <= (unsigned)nMax1);
-      state1.resize(nSize1);
-      
-      // directory 2
-      sort(state2.begin(),state2.end(),cellState::destLessThan);
-      vector<unsigned> dest2(nSize2);
-      for (unsigned ii=0; ii<state2.size(); ++ii)
-         dest2[ii] = state2[ii].dest_;
-      
-      int maxLocbuf2 = nSize2;
-      int nMax2;
-      MPI_Allreduce(&maxLocbuf2, &nMax2, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
-      
-      state2.resize(10*nMax2);
-      assignArray((unsigned char*)&(state2[0]), &nSize2, state2.capacity(),
-                  sizeof(cellState), &(dest2[0]), 0, MPI_COMM_WORLD);
-      
-      assert(nSize2 <= (unsigned)nMax2);
-      state2.resize(nSize2);
-      
-      // sort data arrays so that local gids are in same order for both
-      sort(state1.begin(),state1.end(),cellState::indLessThan);
-      sort(state2.begin(),state2.end(),cellState::indLessThan);
-      
-      assert(nSize1 == nSize2);
-      int nLoc = nSize1/nFloats;
-      
-      int floatCnt1 = 0;
-      for (unsigned jj=0; jj<nFloats; ++jj)
+      MPI_Allreduce(&maxLocal[0], &maxGlobal[0], nFields, MPI_DOUBLE_INT, MPI_MAXLOC, MPI_COMM_WORLD);
+      vector<Long64> maxGid(nFields);
+      for (unsigned jj=0; jj<nFields; ++jj)
       {
-         double rmssqLoc = 0.0;
-         int rmscnt = 0;
-         double maxdiffLoc = 0.0;
-         for (unsigned ii=0; ii<nLoc; ++ii)
+         Long64 gid = stats[jj].maxGid;
+         int owner = maxGlobal[jj].rank;
+         if (owner != 0)
          {
-            Long64 gid1 = state1[nFloats*ii+jj].gid_;
-            Long64 gid2 = state2[nFloats*ii+jj].gid_;
-            assert(gid1 == gid2);
-            
-            double val1 = state1[nFloats*ii+jj].value_;
-            double val2 = state2[nFloats*ii+jj].value_;
-            rmssqLoc += (val1-val2)*(val1-val2);
-            rmscnt++;
-            if (abs(val1-val2) > maxdiffLoc) maxdiffLoc = abs(val1-val2);
+            if (myRank == owner)
+               MPI_Send(&gid, 1, MPI_LONG_LONG, 0, jj, MPI_COMM_WORLD);
+            else if (myRank == 0)
+               MPI_Recv(&gid, 1, MPI_LONG_LONG, owner, jj, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
          }
-         double rmssq;
-         MPI_Allreduce(&rmssqLoc, &rmssq, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-         double rms = sqrt(rmssq);
-         double maxdiff;
-         MPI_Allreduce(&maxdiffLoc, &maxdiff, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
-
-         //ewd DEBUG:  print out gid of all cells with Vm difference within 0.95 of max
-         if (fieldUnion[jj] == "Vm")
-         {
-            cout.setf(ios::scientific,ios::floatfield);
-            for (unsigned ii=0; ii<nLoc; ++ii)
-            {
-               Long64 gid1 = state1[nFloats*ii+jj].gid_;
-               Long64 gid2 = state2[nFloats*ii+jj].gid_;
-               assert(gid1 == gid2);
-               
-               double val1 = state1[nFloats*ii+jj].value_;
-               double val2 = state2[nFloats*ii+jj].value_;
-               double diff = abs(val1-val2);
-               if (diff > 0.99*maxdiff && maxdiff > 1.E-9) 
-                  cout << "  gid " << gid1 << ", Vm difference = " << setprecision(10) << diff << ", maximum difference = " << maxdiff << endl;               
-            }
-         }
-         //ewd DEBUG
+         maxGid[jj] = gid;
+      }
 
-         
-         // save output to file
-         if (myRank == 0)
+      if (myRank == 0)
+      {
+         cout << "  " << fileName << " (time " << time << ")";
+         if (sumsGlobal[3*nFields] > 0 || sumsGlobal[3*nFields+1] > 0)
+            cout << ": " << Long64(sumsGlobal[3*nFields]) << " gids only in run 1, "
+                 << Long64(sumsGlobal[3*nFields+1]) << " only in run 2";
+         cout << endl;
+         cout << "    " << setw(16) << left << "field" << right
+              << setw(12) << "n" << setw(18) << "rms diff" << setw(18) << "max diff"
+              << setw(14) << "max gid" << endl;
+         for (unsigned jj=0; jj<nFields; ++jj)
          {
-            string fieldFile = "verif." + fieldUnion[jj] + ".dat";
+            Long64 n = Long64(sumsGlobal[3*jj+1]);
+            double rmsTot = sqrt(sumsGlobal[3*jj]);
+            double rms = (n > 0 ? rmsTot/sqrt(double(n)) : 0.0);
+            double maxDiff = maxGlobal[jj].value;
+            cout.setf(ios::scientific, ios::floatfield);
+            cout << "    " << setw(16) << left << fieldNames[jj] << right
+                 << setw(12) << n << setprecision(8) << setw(18) << rms << setw(18) << maxDiff
+                 << setw(14) << maxGid[jj];
+            if (isActivation[jj])
+               cout << "  activated in one run only: " << Long64(sumsGlobal[3*jj+2]);
+            cout << endl;
+            cout.unsetf(ios::floatfield);
+
+            // save output to file
+            string fieldFile = "verif." + fieldNames[jj] + ".dat";
+            if (fileName != "state")
+               fieldFile = "verif." + fileName + "." + fieldNames[jj] + ".dat";
             ofstream ofout;
-            if (isnap == 0)
+            if (openedFiles.insert(fieldFile).second)
             {
                ofout.open(fieldFile.c_str(),ofstream::out);
-               ofout << "#      time            rms avg            rms tot           max diff" << endl;
+               ofout << "#      time            rms avg            rms tot           max diff"
+                     << "                rms" << endl;
             }
             else
                ofout.open(fieldFile.c_str(),ofstream::app);
-            double rmsavg = (nrecord1 > 0 ? rms/nrecord1 : 0.0);
+            double rmsavg = (n > 0 ? rmsTot/n : 0.0);
             ofout.setf(ios::scientific,ios::floatfield);
-            ofout << setprecision(10) << time1 << "    " << rmsavg << "    " << rms << "    " << maxdiff << endl;
+            ofout << setprecision(10) << time << "    " << rmsavg << "    " << rmsTot
+                  << "    " << maxDiff << "    " << rms << endl;
             ofout.close();
          }
       }
-
-      delete data1;
-      delete data2;
-
+      return exceeded;
    }
-   MPI_Finalize();
-   return 0;
-}
-
-namespace
-{
-    void readAnatomyBucket(Anatomy& anatomy, BucketOfBits* bucketP)
-    {
-       vector<AnatomyCell>& cells = anatomy.cellArray();
-       
-       unsigned nRecords =  bucketP->nRecords();
-       unsigned nFields =   bucketP->nFields();
-       unsigned gidIndex =  bucketP->getIndex("gid");
-       assert( gidIndex != nFields);
-       for (unsigned ii=0; ii<nRecords; ++ii)
-       {
-          AnatomyCell tmp;
-          BucketOfBits::Record rr = bucketP->getRecord(ii);
-          rr.getValue(gidIndex, tmp.gid_);
-          tmp.cellType_ = 100; // hack since state files don't have cell type information
-          cells.push_back(tmp);
-       }
-    }
-    
-    BucketOfBits* fillDataBucket(Simulate& sim, string dirName, double &time, int &nrecord)
-    {
-       string stateFile = dirName + "/state#";
-       PFILE* file = Popen(stateFile.c_str(), "r", MPI_COMM_WORLD);
-       OBJECT* hObj = file->headerObject;
-
-       int nx, ny, nz;
-       objectGet(hObj, "nx", nx, "0");
-       objectGet(hObj, "ny", ny, "0");
-       objectGet(hObj, "nz", nz, "0");
-       assert(nx*ny*nz > 0);
-       objectGet(hObj, "time", time, "0.0");
-       objectGet(hObj, "nrecord", nrecord, "0");
-       
-       
-       //string rTmp;
-       //objectGet(hObj, "reactionMethod", rTmp, "reaction");
-       //sim.reaction_ = reactionFactory(rTmp, sim.anatomy_, sim.reactionThreads_);
-
-       sim.anatomy_.setGridSize(nx,ny,nz);
-
-       // fill sim.anatomy_ with gids, arbitrary cell type
-       BucketOfBits* bucketP = readPioFile(file);
-       Pclose(file);
-       readAnatomyBucket(sim.anatomy_, bucketP);
-       delete bucketP;
-       
-       //cout << "First state directory, myRank = " << myRank << ", grid = " << nx << " x " << ny << " x " << nz << ", sim.nLocal = " << sim.anatomy_.nLocal() << endl;
-
-       BucketOfBits* data = loadAndDistributeState(stateFile, sim.anatomy_);
-       assert(data->nRecords() == sim.anatomy_.nLocal());
-
-       return data;
-    }
-
 }
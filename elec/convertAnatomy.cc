@@ -0,0 +1,252 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <unistd.h>
+#include <mpi.h>
+
+#include "pio.h"
+#include "units.h"
+#include "object_cc.hh"
+#include "BucketOfBits.hh"
+#include "readPioFile.hh"
+#include "CompactAnatomy.hh"
+
+// convertAnatomy turns a pio anatomy file into a compact anatomy file
+// (see CompactAnatomy.hh) that the ANATOMY compact method reads.
+//
+// Files with theta and phi fields keep the angles (16-bit, about 1e-4
+// rad resolution).  Files with the six sigma fields keep the tensor as
+// floats in internal units.  cellType must fit in a byte.
+//
+// Each task reads its share of the pio file a chunk at a time and
+// sends every record to the task that owns its gid (a contiguous
+// range of the grid), so no task ever holds more than its share of the
+// cells.  The owners then sort their cells and write them with
+// collective MPI-IO.
+
+using namespace std;
+
+MPI_Comm COMM_LOCAL = MPI_COMM_WORLD;
+
+namespace
+{
+   struct Cell
+   {
+      Long64 gid;
+      float tensor[6];
+      unsigned short angle[2];
+      unsigned char cellType;
+      bool operator<(const Cell& b) const {return gid < b.gid;}
+   };
+
+   void fail(int myRank, const string& message)
+   {
+      if (myRank == 0)
+         cout << "ERROR: " << message << endl;
+      MPI_Abort(MPI_COMM_WORLD, 1);
+   }
+}
+
+int main(int argc, char** argv)
+{
+   int nTasks, myRank;
+   MPI_Init(&argc,&argv);
+   MPI_Comm_size(MPI_COMM_WORLD, &nTasks);
+   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+
+   units_internal(1e-3, 1e-9, 1e-3, 1e-3, 1, 1e-9, 1);
+   units_external(1e-3, 1e-9, 1e-3, 1e-3, 1, 1e-9, 1);
+
+   unsigned chunkSize = 1<<18;
+   int opt;
+   while ((opt = getopt(argc, argv, "c:")) != -1)
+   {
+      switch (opt)
+      {
+        case 'c':
+         chunkSize = max(1, atoi(optarg));
+         break;
+        default:
+         argc = 0;
+      }
+   }
+   if (argc - optind != 2)
+   {
+      if (myRank == 0)
+         cout << "Usage:  convertAnatomy [-c records per chunk]"
+              << " [pio anatomy file, e.g. snapshot.initial/anatomy#] [compact file]"
+              << endl << endl;
+      MPI_Finalize();
+      exit(1);
+   }
+   string inName(argv[optind]);
+   string outName(argv[optind+1]);
+
+   PFILE* file = Popen(inName.c_str(), "r", COMM_LOCAL);
+   if (file == 0)
+      fail(myRank, "can't open " + inName);
+   int nx, ny, nz;
+   objectGet(file->headerObject, "nx", nx, "0");
+   objectGet(file->headerObject, "ny", ny, "0");
+   objectGet(file->headerObject, "nz", nz, "0");
+   Long64 nGrid = Long64(nx)*ny*nz;
+   if (nGrid == 0)
+      fail(myRank, "no nx, ny, nz in the header of " + inName);
+
+   BucketOfBits* bucket = emptyPioBucket(file);
+   unsigned nFields = bucket->nFields();
+   unsigned gidIndex = bucket->getIndex("gid");
+   unsigned typeIndex = bucket->getIndex("cellType");
+   unsigned thetaIndex = bucket->getIndex("theta");
+   unsigned phiIndex = bucket->getIndex("phi");
+   const char* sigmaName[6] = {"sigma11", "sigma12", "sigma13", "sigma22", "sigma23", "sigma33"};
+   unsigned sigmaIndex[6];
+   double sigmaConvert[6];
+   bool haveTensor = true;
+   for (unsigned ii=0; ii<6; ++ii)
+   {
+      sigmaIndex[ii] = bucket->getIndex(sigmaName[ii]);
+      if (sigmaIndex[ii] == nFields)
+         haveTensor = false;
+      else
+         sigmaConvert[ii] = units_convert(1.0, bucket->units(sigmaIndex[ii]).c_str(),
+                                          "resistivity_internal/length_internal");
+   }
+   if (gidIndex == nFields || typeIndex == nFields)
+      fail(myRank, inName + " has no gid or cellType field");
+
+   int fibreType = CompactAnatomy::noFibre;
+   if (thetaIndex != nFields && phiIndex != nFields)
+      fibreType = CompactAnatomy::angles;
+   else if (haveTensor)
+      fibreType = CompactAnatomy::tensor;
+   bool intAngles = (fibreType == CompactAnatomy::angles &&
+                     bucket->dataType(thetaIndex) == BucketOfBits::intType);
+
+   // Cells go to the task that owns their part of the grid.
+   vector<Cell> owned;
+   vector<int> sendCnt(nTasks), recvCnt(nTasks), sendOff(nTasks), recvOff(nTasks);
+   while (true)
+   {
+      unsigned nRead = readPioRecords(file, chunkSize, bucket);
+      unsigned nMax;
+      MPI_Allreduce(&nRead, &nMax, 1, MPI_UNSIGNED, MPI_MAX, COMM_LOCAL);
+      if (nMax == 0)
+         break;
+
+      vector<Cell> cell(nRead);
+      vector<int> dest(nRead);
+      sendCnt.assign(nTasks, 0);
+      for (unsigned ii=0; ii<nRead; ++ii)
+      {
+         BucketOfBits::Record rr = bucket->getRecord(ii);
+         Cell& cc = cell[ii];
+         int cellType;
+         rr.getValue(gidIndex, cc.gid);
+         rr.getValue(typeIndex, cellType);
+         if (cellType < 0 || cellType > 255 || cc.gid >= nGrid)
+            fail(0, "cellType or gid out of range");
+         cc.cellType = cellType;
+         for (unsigned jj=0; jj<6; ++jj)
+         {
+            double value = 0;
+            if (fibreType == CompactAnatomy::tensor)
+               rr.getValue(sigmaIndex[jj], value);
+            cc.tensor[jj] = value;
+            if (fibreType == CompactAnatomy::tensor)
+               cc.tensor[jj] *= sigmaConvert[jj];
+         }
+         cc.angle[0] = cc.angle[1] = 0;
+         if (fibreType == CompactAnatomy::angles)
+         {
+            double theta, phi;
+            if (intAngles)
+            {
+               int tmp;
+               rr.getValue(thetaIndex, tmp);
+               theta = tmp*(M_PI/256);
+               rr.getValue(phiIndex, tmp);
+               phi = tmp*(M_PI/256);
+            }
+            else
+            {
+               rr.getValue(thetaIndex, theta);
+               rr.getValue(phiIndex, phi);
+            }
+            cc.angle[0] = CompactAnatomy::quantizeAngle(theta);
+            cc.angle[1] = CompactAnatomy::quantizeAngle(phi);
+         }
+         dest[ii] = cc.gid*nTasks/nGrid;
+         sendCnt[dest[ii]] += sizeof(Cell);
+      }
+
+      vector<Cell> sendBuf(nRead);
+      sendOff[0] = 0;
+      for (int ii=1; ii<nTasks; ++ii)
+         sendOff[ii] = sendOff[ii-1] + sendCnt[ii-1];
+      vector<int> pos(sendOff);
+      for (unsigned ii=0; ii<nRead; ++ii)
+      {
+         sendBuf[pos[dest[ii]]/sizeof(Cell)] = cell[ii];
+         pos[dest[ii]] += sizeof(Cell);
+      }
+      MPI_Alltoall(&sendCnt[0], 1, MPI_INT, &recvCnt[0], 1, MPI_INT, COMM_LOCAL);
+      recvOff[0] = 0;
+      for (int ii=1; ii<nTasks; ++ii)
+         recvOff[ii] = recvOff[ii-1] + recvCnt[ii-1];
+      unsigned nRecv = (recvOff[nTasks-1] + recvCnt[nTasks-1])/sizeof(Cell);
+      unsigned nOld = owned.size();
+      owned.resize(nOld + nRecv + 1);
+      MPI_Alltoallv(sendBuf.data(), &sendCnt[0], &sendOff[0], MPI_BYTE,
+                    &owned[nOld], &recvCnt[0], &recvOff[0], MPI_BYTE, COMM_LOCAL);
+      owned.resize(nOld + nRecv);
+   }
+   Pclose(file);
+   delete bucket;
+
+   sort(owned.begin(), owned.end());
+   unsigned nLocal = owned.size();
+   vector<Long64> gid(nLocal);
+   vector<unsigned char> cellType(nLocal);
+   vector<unsigned short> angle;
+   vector<float> tensor;
+   if (fibreType == CompactAnatomy::angles)
+      angle.resize(2*nLocal);
+   if (fibreType == CompactAnatomy::tensor)
+      tensor.resize(6*nLocal);
+   for (unsigned ii=0; ii<nLocal; ++ii)
+   {
+      gid[ii] = owned[ii].gid;
+      cellType[ii] = owned[ii].cellType;
+      if (ii > 0 && gid[ii] == gid[ii-1])
+         fail(0, "duplicate gid in " + inName);
+      if (!angle.empty())
+      {
+         angle[2*ii] = owned[ii].angle[0];
+         angle[2*ii+1] = owned[ii].angle[1];
+      }
+      if (!tensor.empty())
+         copy(owned[ii].tensor, owned[ii].tensor+6, &tensor[6*ii]);
+   }
+   vector<Cell>().swap(owned);
+
+   CompactAnatomy::write(outName, nx, ny, nz, fibreType, gid, cellType, angle, tensor, COMM_LOCAL);
+
+   Long64 nCells = nLocal;
+   Long64 nTotal;
+   MPI_Reduce(&nCells, &nTotal, 1, MPI_UINT64_T, MPI_SUM, 0, COMM_LOCAL);
+   if (myRank == 0)
+   {
+      const char* typeName[] = {"no fibre data", "fibre angles", "conductivity tensors"};
+      cout << "Wrote " << nTotal << " cells with " << typeName[fibreType]
+           << " for a " << nx << " x " << ny << " x " << nz << " grid to "
+           << outName << endl;
+   }
+
+   MPI_Finalize();
+   return 0;
+}
@@ -73,9 +73,15 @@ namespace
                                   const ThreadTeam& reactionThreadInfo,
                                   int simLoopType, string variantHint)
    {
+      // skipQuiescent lets the omp variant reuse last step's stencil
+      // result for blocks of skipBlockSize^3 voxels whose neighborhood
+      // has hardly changed.  See FGRDiffusionOMP::calc.
       FGRUtils::FGRDiffusionParms p;
       objectGet(obj, "diffusionScale", p.diffusionScale_, "1.0", "l^3/capacitance");
       objectGet(obj, "printBBox",      p.printBBox_, "0");
+      objectGet(obj, "skipQuiescent",  p.skipQuiescent_, "0");
+      objectGet(obj, "skipTolerance",  p.skipTolerance_, "0", "voltage/t");
+      objectGet(obj, "skipBlockSize",  p.skipBlockSize_, "4");
       string defaultVariant = "omp";
       if (! variantHint.empty())
          defaultVariant = variantHint;
@@ -72,7 +72,7 @@ using namespace std;
 Drug* drugFactory(const std::string& dosename, const Simulate& sim)
 {
   int myRank;
-  MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+  MPI_Comm_rank(sim.comm_, &myRank);
 
   OBJECT* obj = objectFind(dosename, "DOSE");
   string drugobj;
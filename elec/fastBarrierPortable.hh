@@ -3,55 +3,169 @@
 
 #include <stdint.h>
 #include <cstdlib>
+#include <cassert>
+#include <climits>
+#include <new>
+#include <atomic>
+#include <sched.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 #ifndef FAST_BARRIER_HH
 #error "Do not #include fastBarrierPortable.hh.  #include fastBarrier.hh instead"
 #endif
 
+/** Portable implementation of the BG/Q L2 barrier interface.
+ *
+ *  Arrivals are combined in a tree of counters with fan in
+ *  L2_BARRIER_FANIN, each counter on its own cache line, so no more
+ *  than L2_BARRIER_FANIN threads ever contend for a line.  The last
+ *  thread to arrive at a node carries on to its parent and the thread
+ *  that completes the root publishes the new round in start, which
+ *  lives on a line of its own that the waiters only read.  Every
+ *  counter increment is an acq_rel RMW and start is stored with
+ *  release and read with acquire, so everything written before
+ *  Arrive is visible after WaitAndReset.
+ *
+ *  A handle is given a leaf slot the first time it arrives, so the
+ *  same eventNum handles must arrive every round (as they do when
+ *  eventNum is the size of the team that arrives) and no handle may
+ *  arrive for the next round before the current one has completed.
+ *  Handles that only wait never take a slot.
+ *
+ *  Waiters spin with a pause for L2_BARRIER_SPIN polls, yielding the
+ *  core every 256 polls, and then sleep on a futex so that
+ *  oversubscribed runs make progress.  The waker only makes a system
+ *  call when somebody is actually asleep.
+ */
+
+#ifndef L2_BARRIER_FANIN
+#define L2_BARRIER_FANIN 4
+#endif
+#ifndef L2_BARRIER_MAX_THREADS
+#define L2_BARRIER_MAX_THREADS 1024
+#endif
+#ifndef L2_BARRIER_SPIN
+#define L2_BARRIER_SPIN 20000
+#endif
+
+struct alignas(64) L2_BarrierNode_t
+{
+   std::atomic<uint64_t> count;
+};
 
-struct  L2_Barrier_t
+struct L2_Barrier_t
 {
-   volatile  uint64_t start;  /*!< Thread count at start of current round. */
-   volatile  uint64_t count;  /*!< Current thread count. */
+   alignas(64) std::atomic<uint64_t> start;  /*!< Arrival count at start of current round. */
+   alignas(64) std::atomic<uint32_t> epoch;  /*!< futex word, bumped on every release. */
+   std::atomic<int> sleepers;
+   alignas(64) std::atomic<int> nextSlot;
+   L2_BarrierNode_t node[L2_BARRIER_MAX_THREADS/(L2_BARRIER_FANIN-1) + 16];
 };
 
 
 struct L2_BarrierHandle_t
 {
   uint64_t localStart; // local (private start)
-  volatile uint64_t *localCountPtr; // encoded fetch and inc address
+  int slot;            // leaf slot, assigned at first arrival
 };
 
 
 inline void L2_BarrierWithSync_Init(L2_Barrier_t* b)
 {
-   b->start = b->count = 0;
-} 
+   b->start.store(0);
+   b->epoch.store(0);
+   b->sleepers.store(0);
+   b->nextSlot.store(0);
+   for (unsigned ii=0; ii<sizeof(b->node)/sizeof(b->node[0]); ++ii)
+      b->node[ii].count.store(0);
+}
 
 inline void L2_BarrierWithSync_InitInThread(
    L2_Barrier_t *b,       /* global barrier */
    L2_BarrierHandle_t *h) /* barrier handle private to this thread */
 {
    h->localStart = 0;
-   h->localCountPtr = &b->count;
+   h->slot = -1;
 }
 
+inline void L2_Barrier_pause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+   __builtin_ia32_pause();
+#elif defined(__aarch64__)
+   asm volatile("yield");
+#endif
+}
+
+inline void L2_Barrier_release(L2_Barrier_t *b, uint64_t target)
+{
+   b->start.store(target, std::memory_order_seq_cst);
+#ifdef __linux__
+   b->epoch.fetch_add(1, std::memory_order_seq_cst);
+   if (b->sleepers.load(std::memory_order_seq_cst) > 0)
+      syscall(SYS_futex, &b->epoch, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+inline void L2_Barrier_wait(L2_Barrier_t *b, uint64_t target)
+{
+   for (int ii=0; ii<L2_BARRIER_SPIN; ++ii)
+   {
+      if (b->start.load(std::memory_order_acquire) >= target)
+         return;
+      if ((ii & 255) == 255)
+         sched_yield();
+      else
+         L2_Barrier_pause();
+   }
+   while (b->start.load(std::memory_order_acquire) < target)
+   {
+#ifdef __linux__
+      b->sleepers.fetch_add(1, std::memory_order_seq_cst);
+      uint32_t epoch = b->epoch.load(std::memory_order_seq_cst);
+      if (b->start.load(std::memory_order_seq_cst) < target)
+         syscall(SYS_futex, &b->epoch, FUTEX_WAIT_PRIVATE, epoch, NULL, NULL, 0);
+      b->sleepers.fetch_sub(1, std::memory_order_seq_cst);
+#else
+      sched_yield();
+#endif
+   }
+}
 
 inline void L2_BarrierWithSync_Arrive(
    L2_Barrier_t *b,        /* global barrier */
    L2_BarrierHandle_t *h,  /* barrier handle private to this thread */
    int eventNum)           /* number of arrival events */
 {
-   #pragma omp atomic
-   (*(h->localCountPtr))++;
-//   uint64_t current = count;
-   uint64_t current = *h->localCountPtr;
+   if (h->slot < 0)
+      h->slot = b->nextSlot.fetch_add(1, std::memory_order_relaxed);
+   assert(h->slot < eventNum && eventNum <= L2_BARRIER_MAX_THREADS);
+
    // if reached target, update barrier's start
    uint64_t target = h->localStart + eventNum;
-   if (current == target)
+   uint64_t round = target/eventNum;
+   int nn = eventNum;
+   int index = h->slot;
+   int offset = 0;
+   while (nn > 1)
    {
-      b->start = current;  // advance to next round
+      int group = index/L2_BARRIER_FANIN;
+      int nGroups = (nn + L2_BARRIER_FANIN - 1)/L2_BARRIER_FANIN;
+      int expected = nn - group*L2_BARRIER_FANIN;
+      if (expected > L2_BARRIER_FANIN)
+         expected = L2_BARRIER_FANIN;
+      uint64_t current = b->node[offset+group].count.fetch_add(1, std::memory_order_acq_rel) + 1;
+      if (current != round*expected)
+         return;  // not the last arrival at this node
+      offset += nGroups;
+      index = group;
+      nn = nGroups;
    }
+   L2_Barrier_release(b, target);  // advance to next round
 }
 
 inline void L2_BarrierWithSync_WaitAndReset(
@@ -64,7 +178,8 @@ inline void L2_BarrierWithSync_WaitAndReset(
    // advance local start
    h->localStart = target;
    // wait until barrier's start is advanced
-   while (b->start < target) ;
+   if (b->start.load(std::memory_order_acquire) < target)
+      L2_Barrier_wait(b, target);
 }
 
 inline void L2_BarrierWithSync_Reset(
@@ -91,12 +206,15 @@ inline void L2_BarrierWithSync_Barrier(
  * Caller is responsible to free the returned pointer. */
 inline L2_Barrier_t* L2_BarrierWithSync_InitShared()
 {
-   L2_Barrier_t* bb = (L2_Barrier_t*) malloc(sizeof(L2_Barrier_t));
+   void* mem;
+   if (posix_memalign(&mem, 64, sizeof(L2_Barrier_t)) != 0)
+      abort();
+   L2_Barrier_t* bb = new (mem) L2_Barrier_t;
    L2_BarrierWithSync_Init(bb);
    return bb;
 }
 
-   
+
 
 
 #endif
@@ -14,10 +14,10 @@
 
 using namespace std;
 
-void dumpCells(const Anatomy& anatomy)
+void dumpCells(const Anatomy& anatomy, MPI_Comm comm)
 {
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, & myRank);
+   MPI_Comm_rank(comm, & myRank);
    {
       stringstream buf;
       buf << "cellsLocal."<<myRank;
@@ -55,7 +55,7 @@ void getRemoteCells(Simulate& sim, const string& name, MPI_Comm comm)
    for (unsigned ii=0; ii<anatomy.size(); ++ii)
       myCells[ii] = anatomy.gid(ii);
    
-   GridRouter router(myCells, nx, ny, nz, MPI_COMM_WORLD);
+   GridRouter router(myCells, nx, ny, nz, comm);
    sim.sendMap_ = router.sendMap();
    sim.commTable_ = new CommTable(router.commTable());
 
@@ -83,7 +83,7 @@ void getRemoteCells(Simulate& sim, const string& name, MPI_Comm comm)
    if (printStats)
    {
       int myRank; 
-      MPI_Comm_rank(MPI_COMM_WORLD, & myRank);
+      MPI_Comm_rank(comm, & myRank);
       PFILE* file = Popen("nNbrTasks", "w", comm);
       Pprintf(file, "%d : %d %d %d %d\n", 
       myRank,anatomy.nGlobal(),anatomy.nLocal(),anatomy.nRemote(),sim.commTable_->nNbrs());
@@ -8,6 +8,7 @@
 #include "Anatomy.hh"
 #include "TupleToIndex.hh"
 #include "setConductivity.hh"
+#include "CompactAnatomy.hh"
 #include "BucketOfBits.hh"
 #include "Prand48Object.hh"
 
@@ -17,8 +18,10 @@ namespace
 {
    // Caller is resposible to delete the returned pointer
    BucketOfBits* readUsingPio(Anatomy& anatomy,
-                              OBJECT* obj, MPI_Comm comm);
+                              OBJECT* obj, MPI_Comm comm, MPI_Comm peers);
    BucketOfBits* generateTissueBrick(Anatomy& anatomy, OBJECT* obj, MPI_Comm comm);
+   void readCompact(Anatomy& anatomy, CompactAnatomy::FibreData& fibre,
+                    OBJECT* obj, MPI_Comm comm, MPI_Comm peers);
 }
 
 /*!
@@ -31,15 +34,18 @@ namespace
     @kw{dx, Cell size in the x-direction., 0.2 mm}
     @kw{dy, Cell size in the y-direction., 0.2 mm}
     @kw{dz, Cell size in the z-direction., 0.2 mm}
-    @kw{method, Choose from "brick" or "pio", pio}
+    @kw{method, Choose from "brick"\, "pio" or "compact", pio}
     @endkeywords
 
   @subpage ANATOMY_brick
 
   @subpage ANATOMY_pio
 
+  @subpage ANATOMY_compact
+
 */
-void initializeAnatomy(Anatomy& anatomy, const string& name, MPI_Comm comm)
+void initializeAnatomy(Anatomy& anatomy, const string& name, MPI_Comm comm,
+                       MPI_Comm peers)
 {
    OBJECT* obj = object_find(name.c_str(), "ANATOMY");
 
@@ -62,11 +68,14 @@ void initializeAnatomy(Anatomy& anatomy, const string& name, MPI_Comm comm)
 
 
    BucketOfBits* data = 0;
+   CompactAnatomy::FibreData fibre;
 
    string method;
    objectGet(obj, "method", method, "pio");
    if (method == "pio")
-      data = readUsingPio(anatomy, obj, comm);
+      data = readUsingPio(anatomy, obj, comm, peers);
+   else if (method == "compact")
+      readCompact(anatomy, fibre, obj, comm, peers);
    else if (method == "brick")
       data = generateTissueBrick(anatomy, obj, comm);
    else if (method == "simple")
@@ -97,7 +106,12 @@ void initializeAnatomy(Anatomy& anatomy, const string& name, MPI_Comm comm)
       }
    }
 
-   setConductivity(conductivityName, *data, globalGridSize, anatomy.cellArray());
+   if (data)
+      setConductivity(conductivityName, *data, globalGridSize, anatomy.cellArray());
+   else
+      setConductivity(conductivityName, fibre.theta, fibre.phi,
+                      fibre.fibreType == CompactAnatomy::tensor,
+                      globalGridSize, anatomy.cellArray());
    delete data;
 }
 
@@ -124,7 +138,7 @@ namespace
      @endkeywords
    */
    BucketOfBits* readUsingPio(Anatomy& anatomy,
-                              OBJECT* obj, MPI_Comm comm)
+                              OBJECT* obj, MPI_Comm comm, MPI_Comm peers)
    {
       int myRank;
       MPI_Comm_rank(comm, &myRank);
@@ -134,13 +148,46 @@ namespace
 
       if (myRank==0) cout << "Starting read" <<endl;
 
-      BucketOfBits* bucketP = readAnatomy(fileName, comm, anatomy);
+      BucketOfBits* bucketP = readAnatomy(fileName, comm, anatomy, peers);
       if (myRank==0) cout << "Finished read" <<endl;
       return bucketP;
    }
 }
 
 
+namespace
+{
+   /*!
+     @page ANATOMY_compact ANATOMY compact method
+
+     Reads the anatomy from a compact binary file made by
+     convertAnatomy (see CompactAnatomy.hh).  Gids are stored as runs
+     along x, cell types as bytes and fibre angles as 16-bit integers,
+     so the file is a small fraction of the size of the pio file and
+     is read with a few large MPI-IO reads.  With a fibre
+     CONDUCTIVITY the angles in the file are used.  A file made from
+     tensor data works with the pio CONDUCTIVITY method.
+
+     @beginkeywords
+     @kw{fileName, Path to the compact file., anatomy.compact}
+     @endkeywords
+   */
+   void readCompact(Anatomy& anatomy, CompactAnatomy::FibreData& fibre,
+                    OBJECT* obj, MPI_Comm comm, MPI_Comm peers)
+   {
+      int myRank;
+      MPI_Comm_rank(comm, &myRank);
+
+      string fileName;
+      objectGet(obj, "fileName", fileName, "anatomy.compact");
+
+      if (myRank==0) cout << "Starting read" <<endl;
+      CompactAnatomy::read(fileName, comm, anatomy, fibre, peers);
+      if (myRank==0) cout << "Finished read" <<endl;
+   }
+}
+
+
 namespace
 {
    /*!
@@ -6,6 +6,7 @@
 
 class Anatomy;
 
-void initializeAnatomy(Anatomy& anatomy, const std::string& name, MPI_Comm comm);
+void initializeAnatomy(Anatomy& anatomy, const std::string& name, MPI_Comm comm,
+                       MPI_Comm peers = MPI_COMM_NULL);
 
 #endif
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <sstream>
 #include <map>
+#include <algorithm>
+#include <omp.h>
 
 #include "object_cc.hh"
 #include "Simulate.hh"
@@ -21,16 +23,34 @@
 #include "hardwareInfo.h"
 #include "pio.h"
 #include "heap.h"
+#include "ddcMalloc.h"
 #include "LoadLevel.hh"
+#include "BuddyCheckpoint.hh"
+#include "BulkMemory.hh"
+#include "ReproducibleSum.hh"
 
 using namespace std;
 
 namespace
 {
-   void checkForObsoleteKeywords(OBJECT* obj);
+   void checkForObsoleteKeywords(OBJECT* obj, MPI_Comm comm);
    void buildCoreList(unsigned& nCores, vector<unsigned>& cores);
-   Long64 findGlobalMinGid(const Anatomy& anatomy);
+   Long64 findGlobalMinGid(const Anatomy& anatomy, MPI_Comm comm);
    void writeTorusMap(MPI_Comm comm, const string& filename);
+
+   /** Wall time of the startup phases.  Each phase starts with a
+    *  timestampBarrier so the times are the same on every task. */
+   class StartupPhases
+   {
+    public:
+      StartupPhases(MPI_Comm comm) : comm_(comm), start_(MPI_Wtime()) {}
+      void begin(const string& name);
+      void report();
+    private:
+      MPI_Comm comm_;
+      double start_;
+      vector<pair<string, double> > phases_;
+   };
 }
 
 
@@ -58,12 +78,58 @@ namespace
      simulation., decomposition}
    @kw{diffusion, The name of the DIFFUSION object for this simulation.,
      diffusion}
+   @kw{firstTouch, When set the large arrays (membrane voltages\,
+     reaction state\, diffusion weights) are touched in parallel by all
+     OpenMP threads when they are allocated\, so that their pages are
+     spread over the NUMA nodes rather than all placed on the node of
+     the master thread.  The split does not follow the reaction and
+     diffusion thread teams\, so a page is not necessarily on the node
+     of the thread that works on it., 1}
    @kw{heap, Storage allocated for IO buffers, 500}
+   @kw{hugePages, Page size for the large arrays.  none uses the
+     normal pages.  transparent aligns them to 2 MB and asks the kernel
+     for transparent hugepages.  explicit takes them from the
+     preallocated hugetlbfs pool and falls back to transparent when the
+     pool is exhausted.  The placement of these arrays is reported at
+     the end of initialization., none}
    @kw{dt, The time step., 0.01 msec}
    @kw{loop, The initial loop count for the simulation., 0}
+   @kw{loopType, Selects the simulation loop.  omp runs each phase of a
+     time step as an OpenMP parallel loop.  pdr runs diffusion and
+     reaction concurrently on separate thread teams.  task runs each
+     time step as a graph of per block tasks so that threads do not
+     wait for each other between phases.  blocked advances cache sized
+     tiles of the grid through several time steps at a time (single
+     task runs with FGR diffusion and a reaction model that supports
+     pointCalc, such as Passive)., omp}
    @kw{maxLoop, The maximum value for the loop count., 1000}
+   @kw{memoryCheckpointDir, Node local directory\, normally a memory
+     file system\, that holds the memory checkpoints., /dev/shm}
+   @kw{memoryCheckpointRate, The rate (in time steps) at which each
+     task stores its state in memory on its own node and on a partner
+     node.  These checkpoints are cheap enough to take every few
+     minutes\, but they only survive as long as the nodes do.  Use
+     them together with a lower checkpointRate., -1 (no memory
+     checkpoints)}
+   @kw{memoryRestart, When set the run starts from the latest complete
+     set of memory checkpoints in memoryCheckpointDir.  This needs the
+     same input and number of tasks as the run that wrote them.  The
+     run stops if no complete set survived., 0}
+   @kw{memReportRate, The rate (in time steps) at which a report of
+     the memory high-water mark of each node broken down by subsystem
+     is printed., -1 (no report)}
+   @kw{prefitReactions, When set the interpolants of the reaction
+     models are fit on worker threads while the anatomy is read and
+     the cells are assigned to tasks., 1}
    @kw{printRate, , }
    @kw{reaction, The name of the REACTION object for this simulation., reaction}
+   @kw{reproducibleSums, When set the sums of the ECG\, Voronoi data\,
+     Ca average and gradient sensors are done so that they are bitwise
+     the same for any number of tasks and threads.  ECG sensors then use
+     the exact sum instead of the treecode.  Gradient sensors with
+     algorithm = nocomm write partial sums of each task and are not
+     covered.  The extra time is reported in the ReproducibleSums
+     timer., 0}
    @kw{sensor, The name of the sensor object(s) for this simulation.
      Multiple sensors may be specified., No sensors}
    @kw{stateFile, The name of the file(s) from which to load cell model
@@ -75,19 +141,36 @@ namespace
      not specified there will be no external stimulus in the simulation.}
      {No Stimulus}
    @kw{time, The initial simulation time., 0 msec}
+   @kw{taskBlocksPerThread, Number of cell blocks per thread in the
+     task loop., 4}
+   @kw{timeBlockSize, Edge length in voxels of the tiles of the blocked
+     loop., 32}
+   @kw{timeBlockSteps, Number of time steps the blocked loop takes per
+     pass over a tile.  Each tile carries a halo of that many voxels.,
+     4}
+   @kw{tuneThreads, When set the parallel diffusion/reaction loop
+     searches for the number of diffusion cores that minimizes the time
+     per step.  The search starts from the split given by
+     nDiffusionCores or diffusionThreads and moves one core at a time
+     toward the team that spends less time waiting., 0}
+   @kw{tuneWarmup, Time steps run after each change of the split before
+     timing starts., 20}
+   @kw{tuneWindow, Time steps timed for each trial split., 200}
    @endkeywords
 */
 
-void initializeSimulate(const string& name, Simulate& sim)
+void initializeSimulate(const string& name, Simulate& sim, MPI_Comm comm,
+                        MPI_Comm anatomyPeers)
 {
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(comm, &myRank);
 
    sim.name_ = name;
+   sim.comm_ = comm;
 
    OBJECT* obj = objectFind(name, "SIMULATE");
 
-   checkForObsoleteKeywords(obj);
+   checkForObsoleteKeywords(obj, sim.comm_);
    
    int heapSize;
    objectGet(obj, "heap", heapSize, "500");
@@ -104,6 +187,9 @@ void initializeSimulate(const string& name, Simulate& sim)
    objectGet(obj, "globalSyncRate", sim.globalSyncRate_, "-1");
    objectGet(obj, "printGid", sim.printGid_, "-1");
    objectGet(obj, "checkpointRate", sim.checkpointRate_, "-1");
+   objectGet(obj, "memReportRate", sim.memReportRate_, "-1");
+   objectGet(obj, "memoryCheckpointRate", sim.memoryCheckpointRate_, "-1");
+   objectGet(obj, "memoryRestart", sim.memoryRestart_, "0");
    {
       int tmp; objectGet(obj, "profileAllCounters", tmp, "0");
       if (tmp == 1)
@@ -115,7 +201,7 @@ void initializeSimulate(const string& name, Simulate& sim)
       int tmp;         objectGet(obj, "writeTorusMap", tmp, "1");
       string filename; objectGet(obj, "torusMapFile", filename, "torusMap");
       if (tmp == 1)
-         writeTorusMap(MPI_COMM_WORLD, filename);
+         writeTorusMap(sim.comm_, filename);
    }
    {
       string tmp; objectGet(obj, "checkpointType", tmp, "ascii");
@@ -130,14 +216,55 @@ void initializeSimulate(const string& name, Simulate& sim)
          Pio_setNumWriteFiles(nFiles);
    }
       
-   timestampBarrier("initializing anatomy", MPI_COMM_WORLD);
+   {
+      string pagesName; objectGet(obj, "hugePages", pagesName, "none");
+      int firstTouch;   objectGet(obj, "firstTouch", firstTouch, "1");
+      BulkMemory::Pages pages;
+      if (!BulkMemory::parsePages(pagesName, pages))
+      {
+         if (getRank(0) == 0)
+            cout << "Unknown hugePages " << pagesName
+                 << ".  Use none, transparent or explicit." << endl;
+         abortAll(1);
+      }
+      BulkMemory::setPolicy(pages, firstTouch == 1);
+   }
+   {
+      int reproducible; objectGet(obj, "reproducibleSums", reproducible, "0");
+      ReproducibleSum::setEnabled(reproducible == 1);
+   }
+
+   // The reaction objects only need the cell types to be built, but
+   // their interpolant fits only need the parameters.  Start the fits
+   // now so that they run while the anatomy is read and decomposed.
+   sim.reaction_ = new ReactionManager;
+   {
+      vector<string> reactionNames;
+      objectGet(obj, "reaction", reactionNames);
+      for (int ii=0; ii<reactionNames.size(); ++ii)
+         sim.reaction_->addReaction(reactionNames[ii]);
+      int prefit; objectGet(obj, "prefitReactions", prefit, "1");
+      if (prefit == 1)
+         sim.reaction_->prefit(sim.dt_);
+   }
+
+   StartupPhases phases(sim.comm_);
+   phases.begin("initializing anatomy");
    string nameTmp;
    objectGet(obj, "anatomy", nameTmp, "anatomy");
-   initializeAnatomy(sim.anatomy_, nameTmp, MPI_COMM_WORLD);
+   ddcMemSetTag(DDCMEM_ANATOMY);
+   initializeAnatomy(sim.anatomy_, nameTmp, sim.comm_, anatomyPeers);
    sim.nx_ = sim.anatomy_.nx();
    sim.ny_ = sim.anatomy_.ny();
    sim.nz_ = sim.anatomy_.nz();
 
+   sim.buddyCheckpoint_ = 0;
+   if (sim.memoryCheckpointRate_ > 0 || sim.memoryRestart_)
+   {
+      string dirName; objectGet(obj, "memoryCheckpointDir", dirName, "/dev/shm");
+      sim.buddyCheckpoint_ = new BuddyCheckpoint(dirName, sim, sim.memoryRestart_);
+   }
+
    objectGet(obj, "stateFile", sim.stateFilename_);
    for (unsigned ii=0; ii<sim.stateFilename_.size(); ++ii)
    {
@@ -152,6 +279,10 @@ void initializeSimulate(const string& name, Simulate& sim)
        sim.loopType_ = Simulate::omp;
    else if (tmp == "pdr")
       sim.loopType_ = Simulate::pdr;
+   else if (tmp == "task")
+      sim.loopType_ = Simulate::task;
+   else if (tmp == "blocked")
+      sim.loopType_ = Simulate::blocked;
    else
       assert(false);
    if (object_testforkeyword(obj, "parallelDiffusionReaction"))
@@ -164,10 +295,11 @@ void initializeSimulate(const string& name, Simulate& sim)
       else
          sim.loopType_ = Simulate::omp;
    }
-   timestampBarrier("assigning cells to tasks", MPI_COMM_WORLD);
+   phases.begin("assigning cells to tasks");
    string decompositionName;
    objectGet(obj, "decomposition", decompositionName, "decomposition");
-   LoadLevel loadLevel = assignCellsToTasks(sim, decompositionName, MPI_COMM_WORLD);
+   LoadLevel loadLevel = assignCellsToTasks(sim, decompositionName, sim.comm_);
+   ddcMemSetTag(DDCMEM_OTHER);
 
    // default number of diffusion cores is 1 unless the load leveler
    // said otherwise.
@@ -185,6 +317,13 @@ void initializeSimulate(const string& name, Simulate& sim)
    vector<unsigned> diffusionCores;
    objectGet(obj, "diffusionThreads", diffusionCores);
 
+   objectGet(obj, "tuneThreads", sim.threadTuning_.on,     "0");
+   objectGet(obj, "tuneWarmup",  sim.threadTuning_.warmup, "20");
+   objectGet(obj, "tuneWindow",  sim.threadTuning_.window, "200");
+   objectGet(obj, "taskBlocksPerThread", sim.taskBlocksPerThread_, "4");
+   objectGet(obj, "timeBlockSteps", sim.timeBlockSteps_, "4");
+   objectGet(obj, "timeBlockSize", sim.timeBlockSize_, "32");
+
    if (sim.loopType_ == Simulate::pdr)
    {
       // diffusionThreads overrides nDiffusionCores, but when no thread
@@ -193,28 +332,32 @@ void initializeSimulate(const string& name, Simulate& sim)
          buildCoreList(nDiffusionCores, diffusionCores);
       ThreadServer& threadServer = ThreadServer::getInstance();
       sim.diffusionThreads_ = threadServer.getThreadTeam(diffusionCores);
-      if (getRank(0) == 0)
+      if (myRank == 0)
          cout << "Diffusion Threads: " << sim.diffusionThreads_ << endl;
       sim.reactionThreads_ = threadServer.getThreadTeam(vector<unsigned>());
-      if (getRank(0) == 0)
+      if (myRank == 0)
          cout << "Reaction Threads: " << sim.reactionThreads_ << endl;
    }
    
-   timestampBarrier("building reaction object", MPI_COMM_WORLD);
-   vector<string> reactionNames;
-   objectGet(obj, "reaction", reactionNames);
-   sim.reaction_ = new ReactionManager;
-   for (int ii=0; ii<reactionNames.size(); ++ii) {
-      const string& reactionName(reactionNames[ii]);
-      sim.reaction_->addReaction(reactionName);
-   }
+   phases.begin("building reaction object");
+   ddcMemSetTag(DDCMEM_REACTION);
    std::vector<int> cellTypes(sim.anatomy_.nLocal());
+   #pragma omp parallel for
    for (int ii=0; ii<cellTypes.size(); ii++)
    {
       cellTypes[ii] = sim.anatomy_.cellType(ii);
    }
-   sim.reaction_->create(sim.dt_, cellTypes, sim.reactionThreads_);
-   timestampBarrier("finished building reaction object", MPI_COMM_WORLD);
+   // The task loop integrates the reactions in pieces of about one
+   // block each.
+   int reactionPieceSize = 0;
+   if (sim.loopType_ == Simulate::task)
+   {
+      int nBlocks = max(1, omp_get_max_threads()*sim.taskBlocksPerThread_);
+      reactionPieceSize = max(1, int((cellTypes.size()+nBlocks-1)/nBlocks));
+   }
+   sim.reaction_->create(sim.dt_, cellTypes, sim.reactionThreads_, reactionPieceSize);
+   ddcMemSetTag(DDCMEM_OTHER);
+   phases.begin("finding remote cells");
 
    sim.printIndex_ = -1;
    // -2 -> print index 0 rank 0
@@ -224,7 +367,7 @@ void initializeSimulate(const string& name, Simulate& sim)
    }
    // -1 -> global min gid
    if ( sim.printGid_ == -1 )    
-      sim.printGid_ = findGlobalMinGid(sim.anatomy_);
+      sim.printGid_ = findGlobalMinGid(sim.anatomy_, sim.comm_);
    
    for (unsigned ii=0; ii<sim.anatomy_.nLocal(); ii++)
       if (sim.anatomy_.gid(ii) == sim.printGid_)
@@ -242,41 +385,54 @@ void initializeSimulate(const string& name, Simulate& sim)
    }
    
    
-   getRemoteCells(sim, decompositionName, MPI_COMM_WORLD);
-
-   timestampBarrier("building diffusion object", MPI_COMM_WORLD);
-   objectGet(obj, "diffusion", nameTmp, "diffusion");
-   sim.diffusion_ = diffusionFactory(nameTmp, sim.anatomy_, sim.diffusionThreads_,
+   ddcMemSetTag(DDCMEM_HALO);
+   getRemoteCells(sim, decompositionName, sim.comm_);
+
+   phases.begin("building diffusion object");
+   ddcMemSetTag(DDCMEM_DIFFUSION);
+   objectGet(obj, "diffusion", sim.diffusionName_, "diffusion");
+   sim.diffusionVariant_ = loadLevel.variantHint;
+   // Diffusion in the task and blocked loops behaves as in the omp
+   // loop: calc sets dVm rather than adding to it.
+   int diffusionLoopType = sim.loopType_;
+   if (sim.loopType_ == Simulate::task || sim.loopType_ == Simulate::blocked)
+      diffusionLoopType = Simulate::omp;
+   sim.diffusion_ = diffusionFactory(sim.diffusionName_, sim.anatomy_, sim.diffusionThreads_,
                                      sim.reactionThreads_,
-                                     sim.loopType_,loadLevel.variantHint);
+                                     diffusionLoopType, sim.diffusionVariant_);
+   ddcMemSetTag(DDCMEM_OTHER);
    
-   timestampBarrier("building stimulus object", MPI_COMM_WORLD);
+   phases.begin("building stimulus object");
    vector<string> names;
    objectGet(obj, "stimulus", names);
    for (unsigned ii=0; ii<names.size(); ++ii)
    {
-      Stimulus* stim = stimulusFactory(names[ii], sim.anatomy_);
+      Stimulus* stim = stimulusFactory(names[ii], sim.anatomy_, sim.comm_);
       if (stim->nStim() > 0)
 	 sim.stimulus_.push_back(stim);
       else
 	 delete stim;
    }
 
-   timestampBarrier("building sensor object", MPI_COMM_WORLD);
+   phases.begin("building sensor object");
+   ddcMemSetTag(DDCMEM_IO);
    names.clear();
    objectGet(obj, "sensor", names);
    for (unsigned ii=0; ii<names.size(); ++ii)
       sim.sensor_.push_back(sensorFactory(names[ii], sim));
+   ddcMemSetTag(DDCMEM_OTHER);
 
+   phases.report();
+   BulkMemory::reportPlacement(sim.comm_);
 }
 
 
 namespace
 {
-   void checkForObsoleteKeywords(OBJECT* obj)
+   void checkForObsoleteKeywords(OBJECT* obj, MPI_Comm comm)
    {
       int myRank;
-      MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+      MPI_Comm_rank(comm, &myRank);
       if (myRank != 0) return;
 
       if (object_testforkeyword(obj, "snapshotCellList") != 0)
@@ -315,14 +471,15 @@ namespace
 
 namespace
 {
-   Long64 findGlobalMinGid(const Anatomy& anatomy)
+   Long64 findGlobalMinGid(const Anatomy& anatomy, MPI_Comm comm)
    {
       Long64 minGid=anatomy.nx()*anatomy.ny()*anatomy.nz();
-      for (unsigned ii=0; ii<anatomy.nLocal(); ++ii)
+      #pragma omp parallel for reduction(min:minGid)
+      for (int ii=0; ii<anatomy.nLocal(); ++ii)
          if (anatomy.gid(ii) < minGid)
-            minGid = anatomy.gid(ii); 
+            minGid = anatomy.gid(ii);
       Long64 globalMin;
-      MPI_Allreduce(&minGid, &globalMin, 1, MPI_LONG_LONG, MPI_MIN, MPI_COMM_WORLD);
+      MPI_Allreduce(&minGid, &globalMin, 1, MPI_LONG_LONG, MPI_MIN, comm);
       return globalMin;
    }
 }
@@ -363,3 +520,36 @@ namespace
       Pclose(pfile);      
    }
 }
+
+namespace
+{
+   void StartupPhases::begin(const string& name)
+   {
+      timestampBarrier(name.c_str(), comm_);
+      double now = MPI_Wtime();
+      if (!phases_.empty())
+         phases_.back().second = now - start_;
+      phases_.push_back(make_pair(name, 0.0));
+      start_ = now;
+   }
+
+   void StartupPhases::report()
+   {
+      if (phases_.empty())
+         return;
+      MPI_Barrier(comm_);
+      phases_.back().second = MPI_Wtime() - start_;
+      int myRank;
+      MPI_Comm_rank(comm_, &myRank);
+      if (myRank != 0)
+         return;
+      double total = 0;
+      printf("Startup phases (wall time in seconds):\n");
+      for (unsigned ii=0; ii<phases_.size(); ++ii)
+      {
+         printf("   %-30s %10.3f\n", phases_[ii].first.c_str(), phases_[ii].second);
+         total += phases_[ii].second;
+      }
+      printf("   %-30s %10.3f\n", "total", total);
+   }
+}
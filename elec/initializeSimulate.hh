@@ -2,9 +2,16 @@
 #define INITIALIZE_SIMULATE_HH
 
 #include <string>
+#include <mpi.h>
 
 class Simulate;
-void initializeSimulate(const std::string& name, Simulate& sim);
+
+/** comm holds all of the tasks of this simulation.  anatomyPeers, if
+ *  not MPI_COMM_NULL, connects the tasks of other simulations in the
+ *  same job that read the same anatomy file with the same number of
+ *  tasks; the file is then read once and broadcast to the peers. */
+void initializeSimulate(const std::string& name, Simulate& sim, MPI_Comm comm,
+                        MPI_Comm anatomyPeers = MPI_COMM_NULL);
 
 
 #endif
@@ -22,7 +22,7 @@ namespace
       int nTasks;
       MPI_Comm_size(comm, &nTasks);
       
-      BucketOfBits* data = loadAndDistributeState(filename, sim.anatomy_);
+      BucketOfBits* data = loadAndDistributeState(filename, sim.anatomy_, comm);
       unsigned gidIndex = data->getIndex("gid");
       unsigned domainIndex = data->getIndex("domain");
       assert(gidIndex != data->nFields());
@@ -1,7 +1,10 @@
 #include "reactionFactory.hh"
 
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
+#include <future>
+#include <sstream>
 #include <dlfcn.h>
 #ifndef BGQ //FIXME!!!
 #include <unordered_map>
@@ -14,7 +17,10 @@
 #include "mpiUtils.h"
 #include "ThreadServer.hh"
 #include "Anatomy.hh"
+#include "Reaction.hh"
+#include "Interpolation.hh"
 #include "string.h"
+#include <set>
 
 #include <iostream>
 using namespace std;
@@ -26,24 +32,130 @@ using namespace std;
 #endif
 
 static MAP<string,reactionFactoryFunction> g_factoryFromMethodName;
+static MAP<string,MAP<string,reactionFactoryFunction> > g_variantsFromMethodName;
+static bool g_prefitting = false;
 
-Reaction* reactionFactory(const string& name, double dt, const int numPoints,
-                          const ThreadTeam& group)
+namespace
+{
+   struct PendingFit
+   {
+      double started;
+      future<pair<InterpolantSet,double> > result; // fit and its wall time
+   };
+   // Only touched on the main thread.
+   MAP<string,PendingFit> g_pendingFits;
+   MAP<string,InterpolantSet> g_finishedFits;
+
+   // Wall time in seconds.  Unlike MPI_Wtime it is safe on the fit
+   // threads: MPI is initialized without thread support.
+   double fitClock()
+   {
+      return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+   }
+
+   string fitKey(const string& name, double dt)
+   {
+      stringstream key;
+      key.precision(17);
+      key << name << " " << dt;
+      return key.str();
+   }
+}
+
+/*!
+  @page obj_REACTION REACTION object
+
+  Selects and configures the membrane model.  Apart from the keywords
+  below each model reads its own parameters from the same object.
+
+  @beginkeywords
+    @kw{method, Name of a built in model or path of a compiled model to
+      load at run time., No default}
+    @kw{isa, Instruction set of the built in kernels.  auto picks the
+      widest variant the cpu supports.  baseline\, avx2 or avx512f
+      request a specific one.  If it is not available the baseline
+      kernels are used., auto}
+  @endkeywords
+*/
+
+namespace
+{
+   // Widest first.
+   const char* isaPreference[] = {"avx512f", "avx2", NULL};
+
+   bool cpuSupports(const string& isa)
+   {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+      __builtin_cpu_init();
+      if (isa == "avx512f")
+         return __builtin_cpu_supports("avx512f");
+      if (isa == "avx2")
+         return __builtin_cpu_supports("avx2");
+#endif
+      return false;
+   }
+
+   reactionFactoryFunction selectVariant(const string& name, const string& method,
+                                         const string& isa, reactionFactoryFunction baseline)
+   {
+      string choice = "baseline";
+      reactionFactoryFunction factory = baseline;
+      MAP<string,MAP<string,reactionFactoryFunction> >::const_iterator
+         variants = g_variantsFromMethodName.find(method);
+      for (int ii=0; variants != g_variantsFromMethodName.end() && isaPreference[ii] != NULL; ++ii)
+      {
+         if (isa != "auto" && isa != isaPreference[ii])
+            continue;
+         MAP<string,reactionFactoryFunction>::const_iterator
+            here = variants->second.find(isaPreference[ii]);
+         if (here == variants->second.end() || !cpuSupports(isaPreference[ii]))
+            continue;
+         choice = isaPreference[ii];
+         factory = here->second;
+         break;
+      }
+
+      // The task loop builds one model per piece.  Say it once.
+      static set<string> reported;
+      if (getRank(0) == 0 && reported.insert(name).second)
+      {
+         if (isa != "auto" && isa != choice)
+            cout << "WARNING: isa = " << isa << " is not available for REACTION "
+                 << name << " on this cpu" << endl;
+         cout << "REACTION " << name << " (" << method << ") uses "
+              << choice << " kernels" << endl;
+      }
+      return factory;
+   }
+}
+
+namespace
 {
-   static bool first = true;
-   if (first)
+   void registerOnce()
    {
-      registerBuiltinReactions();
-      first = false;
+      static bool first = true;
+      if (first)
+      {
+         registerBuiltinReactions();
+         first = false;
+      }
    }
+}
+
+Reaction* reactionFactory(const string& name, double dt, const int numPoints,
+                          const ThreadTeam& group)
+{
+   registerOnce();
    
    OBJECT* obj = objectFind(name, "REACTION");
    string method; objectGet(obj, "method", method, "undefined");
+   string isa; objectGet(obj, "isa", isa, "auto");
 
    MAP<string,reactionFactoryFunction>::iterator iter = g_factoryFromMethodName.find(method);
    if (iter != g_factoryFromMethodName.end())
    {
-      return iter->second(obj, dt, numPoints, group);
+      reactionFactoryFunction factory = selectVariant(name, method, isa, iter->second);
+      return factory(obj, dt, numPoints, group);
    }
    string filename = method;
    if (filename[0]!='/')
@@ -70,7 +182,7 @@ Reaction* reactionFactory(const string& name, double dt, const int numPoints,
    }
    {
       int myRank;
-      MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+      myRank = getRank(0);
    
       if (myRank == 0)
          cerr<<"ERROR: Undefined reaction model in reactionFactory"<<endl;
@@ -79,8 +191,86 @@ Reaction* reactionFactory(const string& name, double dt, const int numPoints,
    }
 }
 
+void reactionPrefit(const string& name, double dt)
+{
+   registerOnce();
+   string key = fitKey(name, dt);
+   if (g_pendingFits.count(key) > 0 || g_finishedFits.count(key) > 0)
+      return;
+
+   OBJECT* obj = objectFind(name, "REACTION");
+   string method; objectGet(obj, "method", method, "undefined");
+   string isa; objectGet(obj, "isa", isa, "auto");
+
+   MAP<string,reactionFactoryFunction>::iterator iter = g_factoryFromMethodName.find(method);
+   if (iter == g_factoryFromMethodName.end())
+      return;
+   // Same variant as reactionFactory picks, so the fits are identical.
+   reactionFactoryFunction factory = selectVariant(name, method, isa, iter->second);
+   ThreadTeam noTeam; // as in the omp loop
+   g_prefitting = true;
+   Reaction* reaction = factory(obj, dt, 0, noTeam);
+   g_prefitting = false;
+   delete reaction;
+}
+
+bool reactionPrefitting()
+{
+   return g_prefitting;
+}
+
+void startInterpolantFit(const string& name, double dt,
+                         function<InterpolantSet()> fit)
+{
+   PendingFit& pending = g_pendingFits[fitKey(name, dt)];
+   assert(!pending.result.valid());
+   pending.started = fitClock();
+   pending.result = async(launch::async, [fit]()
+   {
+      double start = fitClock();
+      InterpolantSet result = fit();
+      return make_pair(result, fitClock()-start);
+   });
+}
+
+bool finishInterpolantFit(const string& name, double dt, InterpolantSet& fit,
+                          function<InterpolantSet()> fitHere)
+{
+   string key = fitKey(name, dt);
+   MAP<string,InterpolantSet>::const_iterator done = g_finishedFits.find(key);
+   if (done != g_finishedFits.end())
+   {
+      fit = done->second;
+      return false;
+   }
+
+   MAP<string,PendingFit>::iterator here = g_pendingFits.find(key);
+   if (here == g_pendingFits.end())
+   {
+      fit = fitHere();
+   }
+   else
+   {
+      double waitStart = fitClock();
+      pair<InterpolantSet,double> result = here->second.result.get();
+      double now = fitClock();
+      fit = result.first;
+      if (getRank(0) == 0)
+         cout << "REACTION " << name << ": interpolants fit in " << result.second
+              << " s on a worker thread, ready after " << now-here->second.started
+              << " s, waited " << now-waitStart << " s" << endl;
+      g_pendingFits.erase(here);
+   }
+   g_finishedFits[key] = fit;
+   return true;
+}
+
 void registerReactionFactory(const string method, reactionFactoryFunction scanFunc)
 {
    g_factoryFromMethodName[method] = scanFunc;
 }
 
+void registerReactionVariant(const string method, const string isa, reactionFactoryFunction scanFunc)
+{
+   g_variantsFromMethodName[method][isa] = scanFunc;
+}
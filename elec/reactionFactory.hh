@@ -2,9 +2,13 @@
 #define REACTION_FACTORY_HH
 #include <vector>
 #include <string>
+#include <functional>
 #include "object.h"
 class ThreadTeam;
 class Reaction;
+// Not included: the instruction set variants must see Interpolation.hh
+// first after their target pragma (see reactionIsaVariant.cc.in).
+class Interpolation;
 
 typedef Reaction* (*reactionFactoryFunction)(OBJECT* obj, const double dt, const int numPoints, const ThreadTeam& group);
 
@@ -13,14 +17,44 @@ Reaction* reactionFactory(const std::string& name, double dt, const int numPoint
 
 void registerReactionFactory(const std::string method, reactionFactoryFunction scanFunc);
 
+/** Registers a copy of the kernels of method compiled for instruction
+ *  set isa ("avx2", "avx512f").  reactionFactory uses the widest
+ *  variant the cpu supports. */
+void registerReactionVariant(const std::string method, const std::string isa,
+                             reactionFactoryFunction scanFunc);
+
 void registerBuiltinReactions();
 
+/** Starts the interpolant fits of REACTION name for time step dt on a
+ *  worker thread so that they overlap the rest of the startup.  The
+ *  factory of the model is run on zero cells with reactionPrefitting()
+ *  true.  A model that supports this reads its parameters (on the
+ *  calling thread, the object database isn't thread safe), hands the
+ *  fit to startInterpolantFit and returns NULL.  Other models are just
+ *  built and deleted.  Models loaded at run time are skipped. */
+void reactionPrefit(const std::string& name, double dt);
+bool reactionPrefitting();
+
+typedef std::vector<Interpolation> InterpolantSet;
+/** fit must not use MPI or the object database. */
+void startInterpolantFit(const std::string& name, double dt,
+                         std::function<InterpolantSet()> fit);
+/** Sets fit to the interpolants of (name, dt).  The first call waits
+ *  for the fit started by reactionPrefit, or runs fitHere if there is
+ *  none, and returns true.  The fit is kept, so later calls (the task
+ *  loop builds a model per piece) get a copy and return false. */
+bool finishInterpolantFit(const std::string& name, double dt, InterpolantSet& fit,
+                          std::function<InterpolantSet()> fitHere);
+
 #ifdef DYNAMIC_REACTION
 #define REACTION_FACTORY(name) extern "C" Reaction* factory
 #define FRIEND_FACTORY(name) friend Reaction* ::factory
 #else
-#define REACTION_FACTORY(name) Reaction* reactionFactoryFor##name
-#define FRIEND_FACTORY(name) friend Reaction* ::reactionFactoryFor##name
+// name is expanded before it is pasted so that the instruction set
+// variants can rename a model with a macro (see reactionIsaVariant.cc.in)
+#define REACTION_FACTORY_NAME(name) reactionFactoryFor##name
+#define REACTION_FACTORY(name) Reaction* REACTION_FACTORY_NAME(name)
+#define FRIEND_FACTORY(name) friend Reaction* ::REACTION_FACTORY_NAME(name)
 #endif
 
 #endif
@@ -9,10 +9,11 @@
 using namespace std;
 
 /** Initialize cellVec with gids listed in file filename */
-void readCellList(const string filename, vector<Long64>& cellVec)
+void readCellList(const string filename, vector<Long64>& cellVec,
+                  MPI_Comm comm)
 {
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(comm, &myRank);
 
    // try to open file
    int openfail;
@@ -45,7 +46,7 @@ void readCellList(const string filename, vector<Long64>& cellVec)
       }
    }   
    int nCells = cellVec.size();
-   MPI_Bcast(&nCells, 1, MPI_INT, 0, MPI_COMM_WORLD);
+   MPI_Bcast(&nCells, 1, MPI_INT, 0, comm);
    cellVec.resize(nCells);
-   MPI_Bcast(&cellVec[0], nCells, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+   MPI_Bcast(&cellVec[0], nCells, MPI_LONG_LONG, 0, comm);
 }
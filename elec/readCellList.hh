@@ -4,7 +4,9 @@
 #include "Long64.hh"
 #include <string>
 #include <vector>
+#include <mpi.h>
 
-void readCellList(const std::string filename, std::vector<Long64>& cellVec);
+void readCellList(const std::string filename, std::vector<Long64>& cellVec,
+                  MPI_Comm comm);
 
 #endif
@@ -8,6 +8,7 @@
 #include "BucketOfBits.hh"
 #include "ioUtils.h"
 #include <cstring>
+#include <vector>
 
 using namespace std;
 
@@ -31,6 +32,28 @@ namespace
  *  in the BucketOfBits will include the \n that ends the ascii record.
  */
 BucketOfBits* readPioFile(PFILE* file)
+{
+   BucketOfBits* bucketP = emptyPioBucket(file);
+
+   switch (file->datatype)
+   {
+     case FIXRECORDASCII:
+      fixRecordAscii(file, bucketP);
+      break;
+     case FIXRECORDBINARY:
+      fixRecordBinary(file, bucketP);
+      break;
+     case VARRECORDASCII:
+      varRecordAscii(file, bucketP);
+      break;
+     default:
+      assert(false);
+   }
+
+   return bucketP;
+}
+
+BucketOfBits* emptyPioBucket(PFILE* file)
 {
    OBJECT* hObj = file->headerObject;
    vector<string> fieldNames;
@@ -42,25 +65,52 @@ BucketOfBits* readPioFile(PFILE* file)
       objectGet(hObj, "field_units", fieldUnits);
    else
       fieldUnits.assign(fieldNames.size(), "1");
-   
-   BucketOfBits* bucketP = new BucketOfBits(fieldNames, fieldTypes, fieldUnits);
 
+   return new BucketOfBits(fieldNames, fieldTypes, fieldUnits);
+}
+
+/** Ascii records (fixed or variable length) are newline terminated so
+ *  they are read the same way.  Fixed length binary records are
+ *  read lrec bytes at a time. */
+unsigned readPioRecords(PFILE* file, unsigned maxRecords, BucketOfBits* bucketP)
+{
+   bucketP->clearRecords();
+   unsigned nRead = 0;
    switch (file->datatype)
    {
      case FIXRECORDASCII:
-      fixRecordAscii(file, bucketP);
+     case VARRECORDASCII:
+      {
+         const unsigned maxRec = 2048;
+         char buf[maxRec];
+         while (nRead < maxRecords && Pfgets(buf, maxRec, file) != NULL)
+         {
+            assert(strlen(buf) < maxRec);
+            bucketP->addRecord(buf);
+            ++nRead;
+         }
+      }
       break;
      case FIXRECORDBINARY:
-      fixRecordBinary(file, bucketP);
-      break;
-     case VARRECORDASCII:
-      varRecordAscii(file, bucketP);
+      {
+         PIO_FIXED_RECORD_HELPER* helper = (PIO_FIXED_RECORD_HELPER*) file->helper;
+         unsigned lrec = helper->lrec;
+         unsigned key;
+         objectGet(file->headerObject, "endian_key", key, "0");
+         assert(key != 0);
+         ioUtils_setSwap(key);
+         vector<char> buf(lrec);
+         while (nRead < maxRecords && Pread(&buf[0], lrec, 1, file) == lrec)
+         {
+            bucketP->addRecord(string(&buf[0], lrec));
+            ++nRead;
+         }
+      }
       break;
      default:
       assert(false);
    }
-
-   return bucketP;
+   return nRead;
 }
 
 namespace
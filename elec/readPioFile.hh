@@ -7,4 +7,15 @@ class BucketOfBits;
 /** Caller must delete returned pointer */
 BucketOfBits* readPioFile(pfile_st* file);
 
+/** Returns an empty BucketOfBits with the fields described by the
+ *  header of file.  Caller must delete returned pointer. */
+BucketOfBits* emptyPioBucket(pfile_st* file);
+
+/** Replaces the contents of bucketP with the next (at most) maxRecords
+ *  records of the local part of file.  Returns the number of records
+ *  read, zero once the local data is exhausted.  Lets a caller work
+ *  through a large file in chunks without holding a second copy of all
+ *  of it. */
+unsigned readPioRecords(pfile_st* file, unsigned maxRecords, BucketOfBits* bucketP);
+
 #endif
@@ -6,16 +6,26 @@ use warnings;
 sub usage 
 {
    print <<"_HERE";
-$0: outfile.cc Model1.cc [Model2.cc ...]
+$0: [--isa=isa1,isa2,...] outfile.cc Model1.cc [Model2.cc ...]
 
 Scans the models for scan* functions, and includes them in a function
 to populate the reactionFactory
 
+With --isa every model is also registered with a variant for each
+listed instruction set (built from reactionIsaVariant.cc.in).
+
 _HERE
 
    die(@_) if @_;
 }
 
+my @isas;
+if (scalar(@ARGV) > 0 && $ARGV[0] =~ m,^--isa=(.*)$,)
+{
+   @isas = grep { $_ ne "" } split(/,/, $1);
+   shift @ARGV;
+}
+
 usage("Need at least 1 argument") if scalar(@ARGV) < 1;
 
 my $outfilename = shift @ARGV;
@@ -46,7 +56,11 @@ _HERE
 
 foreach my $reaction (@reactions)
 {
-   print $outfile "REACTION_FACTORY($reaction)(OBJECT* obj, const double dt, const int numPoints, const ThreadTeam& group);\n"
+   print $outfile "REACTION_FACTORY($reaction)(OBJECT* obj, const double dt, const int numPoints, const ThreadTeam& group);\n";
+   foreach my $isa (@isas)
+   {
+      print $outfile "REACTION_FACTORY(${reaction}_$isa)(OBJECT* obj, const double dt, const int numPoints, const ThreadTeam& group);\n";
+   }
 }
 
 print $outfile <<'_HERE';
@@ -58,6 +72,10 @@ _HERE
 foreach my $reaction (@reactions)
 {
    print $outfile qq|   registerReactionFactory("$reaction", reactionFactoryFor$reaction);\n|;
+   foreach my $isa (@isas)
+   {
+      print $outfile qq|   registerReactionVariant("$reaction", "$isa", reactionFactoryFor${reaction}_$isa);\n|;
+   }
 }
 print $outfile <<'_HERE';
 }
@@ -0,0 +1,528 @@
+/**
+ *  restitution: computes restitution and alternans biomarkers for one
+ *  or more reaction models in a single run.
+ *
+ *  Usage:  restitution [objectFile ...]
+ *
+ *  The object file(s) (default restitution.data) must contain a
+ *  RESTITUTION object named "restitution" plus the REACTION objects it
+ *  refers to.  Each REACTION object is one parameter set.  Every
+ *  (reaction, protocol, cycle length) combination is an independent
+ *  job.  Jobs are dealt out round-robin over the MPI ranks and each
+ *  rank runs all of its jobs for a given reaction as the cells of a
+ *  single Reaction object, so the reaction's own threading and SIMD
+ *  apply across cycle lengths.  APD, DI and alternans are measured
+ *  in-situ as the simulation runs; no trace output is written.
+ *
+ *  Protocols:
+ *  - S1S2: s1Count beats at s1Bcl followed by one S2 beat at each
+ *    coupling interval in s2.  Reports APD of the S2 beat against the
+ *    DI that preceded it.
+ *  - dynamic: dynamicBeats beats at each cycle length in dynamicBcl,
+ *    each cycle length started from the initial state.  Reports APD of
+ *    the last beat, the DI that preceded it and the beat-to-beat APD
+ *    difference of the last two beats.
+ *
+ *  Restitution slopes are dAPD/dDI computed from neighbouring points
+ *  of the same (reaction, protocol) curve.  Alternans onset is the
+ *  largest dynamic cycle length at which the last two APDs differ by
+ *  more than alternansThreshold, or at which a stimulus fails to
+ *  capture.
+ *
+ *  restitution RESTITUTION
+ *  {
+ *     reaction = tt06 tt06_gKr50;     // REACTION objects to compare
+ *     protocol = S1S2 dynamic;        // default is both
+ *     dt = 0.02 ms;
+ *     s1Bcl = 1000 ms;
+ *     s1Count = 10;
+ *     s2 = 1000 800 600 500 400 350 300 280 260;   // ms
+ *     dynamicBcl = 1000 800 600 500 400 350 300;   // ms
+ *     dynamicBeats = 20;
+ *     stimStrength = 60 mV/ms;
+ *     stimDuration = 1 ms;
+ *     tail = 1000 ms;                 // time simulated after the last S2
+ *     apdThreshold = 0.9;             // 0.9 -> APD90
+ *     captureVm = 0 mV;               // beats that stay below are no capture
+ *     alternansThreshold = 5 ms;
+ *     output = restitution.dat;
+ *  }
+ */
+
+#include <mpi.h>
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "Reaction.hh"
+#include "reactionFactory.hh"
+#include "ThreadServer.hh"
+#include "object.h"
+#include "object_cc.hh"
+#include "lazy_array.hh"
+
+using namespace std;
+
+MPI_Comm COMM_LOCAL = MPI_COMM_WORLD;
+
+namespace
+{
+   enum Protocol { S1S2, DYNAMIC, NPROTOCOLS };
+   const char* protocolName[NPROTOCOLS] = {"S1S2", "dynamic"};
+
+   struct Parms
+   {
+      vector<string> reactionNames;
+      vector<int> protocols;
+      double dt;
+      double s1Bcl;
+      int s1Count;
+      vector<double> s2;
+      vector<double> dynamicBcl;
+      int dynamicBeats;
+      double stimStrength;
+      double stimDuration;
+      double tail;
+      double apdThreshold;
+      double captureVm;
+      double alternansThreshold;
+      string outputFile;
+   };
+
+   struct Job
+   {
+      int reaction;
+      int protocol;
+      double bcl;
+      double s2;       // coupling interval; S1S2 only
+      double duration;
+      vector<double> stimTimes;
+   };
+
+   /** Values reported per job.  Kept as a flat array of doubles so the
+    *  results can be combined with a single MPI_Reduce. */
+   enum Result { APD, DI, APD_PREV, CAPTURED, NRESULTS };
+
+   /** Measures activation time, APD and preceding DI of every beat of
+    *  one cell from the Vm trace, one timestep at a time.  A beat runs
+    *  from one stimulus to the next.  Activation is the time of maximum
+    *  dVm/dt; repolarization is the first downward crossing of
+    *  vRest + (1-threshold)*(vPeak-vRest), linearly interpolated. */
+   class BeatTracker
+   {
+    public:
+      BeatTracker()
+      : inBeat_(false), captureVm_(0), lastRepol_(NAN)
+      {}
+
+      void stimulus(double time, double Vm)
+      {
+         if (inBeat_)
+            endBeat();
+         inBeat_ = true;
+         vRest_ = Vm;
+         vPeak_ = Vm;
+         vPrev_ = Vm;
+         tPrev_ = time;
+         maxDvdt_ = 0;
+         tUp_ = time;
+         tRepol_ = NAN;
+      }
+
+      void sample(double time, double Vm, double threshold)
+      {
+         if (!inBeat_)
+            return;
+         double dvdt = (Vm - vPrev_)/(time - tPrev_);
+         if (Vm > vPeak_)
+         {
+            vPeak_ = Vm;
+            if (dvdt > maxDvdt_)
+            {
+               maxDvdt_ = dvdt;
+               tUp_ = 0.5*(time + tPrev_);
+            }
+         }
+         if (std::isnan(tRepol_) && Vm < vPrev_)
+         {
+            double level = vRest_ + (1-threshold)*(vPeak_ - vRest_);
+            if (Vm < level && vPrev_ >= level)
+               tRepol_ = tPrev_ + (time - tPrev_)*(vPrev_ - level)/(vPrev_ - Vm);
+         }
+         vPrev_ = Vm;
+         tPrev_ = time;
+      }
+
+      void finish()
+      {
+         if (inBeat_)
+            endBeat();
+         inBeat_ = false;
+      }
+
+      /** APD of beat ii, NaN if the cell did not repolarize before the
+       *  next stimulus, 0 if the stimulus did not capture.  A beat
+       *  captures if Vm exceeds captureVm. */
+      double apd(int ii) const { return apd_[ii]; }
+      double di(int ii) const { return di_[ii]; }
+      bool captured(int ii) const { return captured_[ii]; }
+      int nBeats() const { return apd_.size(); }
+      void setCaptureVm(double captureVm) { captureVm_ = captureVm; }
+
+    private:
+      void endBeat()
+      {
+         bool captured = (vPeak_ >= captureVm_);
+         captured_.push_back(captured);
+         if (captured)
+         {
+            apd_.push_back(tRepol_ - tUp_);
+            di_.push_back(tUp_ - lastRepol_);
+            lastRepol_ = tRepol_;
+         }
+         else
+         {
+            apd_.push_back(0);
+            di_.push_back(NAN);
+         }
+      }
+
+      bool inBeat_;
+      double captureVm_;
+      double vRest_, vPeak_, vPrev_, tPrev_;
+      double maxDvdt_, tUp_, tRepol_;
+      double lastRepol_;
+      vector<double> apd_;
+      vector<double> di_;
+      vector<char> captured_;
+   };
+
+   void getParms(Parms& p)
+   {
+      OBJECT* obj = objectFind("restitution", "RESTITUTION");
+      objectGet(obj, "reaction", p.reactionNames);
+      vector<string> protocols;
+      objectGet(obj, "protocol", protocols);
+      if (protocols.empty())
+      {
+         protocols.push_back("S1S2");
+         protocols.push_back("dynamic");
+      }
+      for (unsigned ii=0; ii<protocols.size(); ++ii)
+      {
+         if (protocols[ii] == "S1S2")
+            p.protocols.push_back(S1S2);
+         else if (protocols[ii] == "dynamic")
+            p.protocols.push_back(DYNAMIC);
+         else
+         {
+            fprintf(stderr, "Unknown restitution protocol %s\n", protocols[ii].c_str());
+            MPI_Abort(MPI_COMM_WORLD, -1);
+         }
+      }
+      objectGet(obj, "dt",                 p.dt,                 "0.02", "t");
+      objectGet(obj, "s1Bcl",              p.s1Bcl,              "1000", "t");
+      objectGet(obj, "s1Count",            p.s1Count,            "10");
+      objectGet(obj, "s2",                 p.s2);
+      objectGet(obj, "dynamicBcl",         p.dynamicBcl);
+      objectGet(obj, "dynamicBeats",       p.dynamicBeats,       "20");
+      objectGet(obj, "stimStrength",       p.stimStrength,       "60", "voltage/t");
+      objectGet(obj, "stimDuration",       p.stimDuration,       "1", "t");
+      objectGet(obj, "tail",               p.tail,               "1000", "t");
+      objectGet(obj, "apdThreshold",       p.apdThreshold,       "0.9");
+      objectGet(obj, "captureVm",          p.captureVm,          "0", "voltage");
+      objectGet(obj, "alternansThreshold", p.alternansThreshold, "5", "t");
+      objectGet(obj, "output",             p.outputFile,         "restitution.dat");
+
+      if (p.reactionNames.empty())
+      {
+         fprintf(stderr, "restitution: no reaction specified\n");
+         MPI_Abort(MPI_COMM_WORLD, -1);
+      }
+      if (p.s1Count < 1 || p.dynamicBeats < 2)
+      {
+         fprintf(stderr, "restitution: need s1Count >= 1 and dynamicBeats >= 2\n");
+         MPI_Abort(MPI_COMM_WORLD, -1);
+      }
+   }
+
+   void buildJobs(const Parms& p, vector<Job>& jobs)
+   {
+      for (unsigned ir=0; ir<p.reactionNames.size(); ++ir)
+      {
+         for (unsigned ip=0; ip<p.protocols.size(); ++ip)
+         {
+            Job job;
+            job.reaction = ir;
+            job.protocol = p.protocols[ip];
+            if (job.protocol == S1S2)
+            {
+               for (unsigned ii=0; ii<p.s2.size(); ++ii)
+               {
+                  job.bcl = p.s1Bcl;
+                  job.s2 = p.s2[ii];
+                  job.stimTimes.clear();
+                  for (int ibeat=0; ibeat<p.s1Count; ++ibeat)
+                     job.stimTimes.push_back(ibeat*p.s1Bcl);
+                  job.stimTimes.push_back(job.stimTimes.back() + job.s2);
+                  job.duration = job.stimTimes.back() + p.tail;
+                  jobs.push_back(job);
+               }
+            }
+            else
+            {
+               for (unsigned ii=0; ii<p.dynamicBcl.size(); ++ii)
+               {
+                  job.bcl = p.dynamicBcl[ii];
+                  job.s2 = 0;
+                  job.stimTimes.clear();
+                  for (int ibeat=0; ibeat<p.dynamicBeats; ++ibeat)
+                     job.stimTimes.push_back(ibeat*job.bcl);
+                  job.duration = p.dynamicBeats*job.bcl;
+                  jobs.push_back(job);
+               }
+            }
+         }
+      }
+   }
+
+   /** Runs all of the given jobs (which must share a reaction) as the
+    *  cells of one Reaction object and stores their results. */
+   void runJobs(const Parms& p, const vector<Job>& jobs, const vector<int>& jobIndex,
+                const ThreadTeam& threads, vector<double>& results)
+   {
+      const int nCells = jobIndex.size();
+      const string& reactionName = p.reactionNames[jobs[jobIndex[0]].reaction];
+      const double dt = p.dt;
+      Reaction* reaction = reactionFactory(reactionName, dt, nCells, threads);
+
+      lazy_array<double> VmTransport;
+      VmTransport.resize(nCells);
+      lazy_array<double> iStimTransport;
+      iStimTransport.resize(nCells);
+      lazy_array<double> dVmTransport;
+      dVmTransport.resize(nCells);
+      lazy_array<int> indexTransport;
+      indexTransport.resize(nCells);
+      {
+         wo_array_ptr<int> indexArray = indexTransport.useOn(CPU);
+         for (int ii=0; ii<nCells; ii++)
+            indexArray[ii] = ii;
+      }
+      initializeMembraneState(reaction, reactionName, indexTransport, VmTransport);
+
+      // stimulus schedule and end of each cell, in timesteps
+      vector<vector<int> > stimSteps(nCells);
+      vector<int> nextStim(nCells, 0);
+      vector<int> stimLeft(nCells, 0);
+      vector<int> endStep(nCells);
+      vector<BeatTracker> tracker(nCells);
+      int maxSteps = 0;
+      for (int ii=0; ii<nCells; ++ii)
+      {
+         const Job& job = jobs[jobIndex[ii]];
+         for (unsigned jj=0; jj<job.stimTimes.size(); ++jj)
+            stimSteps[ii].push_back(lround(job.stimTimes[jj]/dt));
+         endStep[ii] = lround(job.duration/dt);
+         maxSteps = max(maxSteps, endStep[ii]);
+         tracker[ii].setCaptureVm(p.captureVm);
+      }
+      const int stimSteps0 = max(1L, lround(p.stimDuration/dt));
+
+      for (int itime=0; itime<maxSteps; ++itime)
+      {
+         const double time = itime*dt;
+         {
+            ro_array_ptr<double> Vm = VmTransport.useOn(CPU);
+            wo_array_ptr<double> iStim = iStimTransport.useOn(CPU);
+            for (int ii=0; ii<nCells; ++ii)
+            {
+               if (nextStim[ii] < stimSteps[ii].size() && itime == stimSteps[ii][nextStim[ii]])
+               {
+                  ++nextStim[ii];
+                  stimLeft[ii] = stimSteps0;
+                  tracker[ii].stimulus(time, Vm[ii]);
+               }
+               iStim[ii] = 0;
+               if (stimLeft[ii] > 0)
+               {
+                  iStim[ii] = p.stimStrength;
+                  --stimLeft[ii];
+               }
+            }
+         }
+         reaction->calc(dt, indexTransport, VmTransport, iStimTransport, dVmTransport);
+         {
+            rw_array_ptr<double> Vm = VmTransport.useOn(CPU);
+            ro_array_ptr<double> iStim = iStimTransport.useOn(CPU);
+            ro_array_ptr<double> dVm = dVmTransport.useOn(CPU);
+            for (int ii=0; ii<nCells; ++ii)
+            {
+               Vm[ii] += dt*(dVm[ii]+iStim[ii]);
+               if (itime < endStep[ii])
+                  tracker[ii].sample(time+dt, Vm[ii], p.apdThreshold);
+            }
+         }
+      }
+
+      for (int ii=0; ii<nCells; ++ii)
+      {
+         BeatTracker& t = tracker[ii];
+         t.finish();
+         int last = t.nBeats()-1;
+         double* r = &results[NRESULTS*jobIndex[ii]];
+         r[APD] = t.apd(last);
+         r[DI] = t.di(last);
+         r[APD_PREV] = t.apd(last-1);
+         r[CAPTURED] = (t.captured(last) && t.captured(last-1)) ? 1 : 0;
+      }
+      delete reaction;
+   }
+
+   /** Restitution slope dAPD/dDI at each point of one curve.  Points
+    *  without a valid APD and DI get NaN and are skipped as
+    *  neighbours. */
+   void computeSlopes(const vector<double>& results, const vector<int>& curve,
+                      vector<double>& slope)
+   {
+      vector<pair<double, int> > valid;
+      for (unsigned ii=0; ii<curve.size(); ++ii)
+      {
+         const double* r = &results[NRESULTS*curve[ii]];
+         if (r[CAPTURED] != 0 && std::isfinite(r[APD]) && std::isfinite(r[DI]))
+            valid.push_back(make_pair(r[DI], curve[ii]));
+      }
+      sort(valid.begin(), valid.end());
+      for (unsigned ii=0; ii<valid.size(); ++ii)
+      {
+         unsigned lo = (ii == 0) ? 0 : ii-1;
+         unsigned hi = min<unsigned>(ii+1, valid.size()-1);
+         if (lo == hi)
+            continue;
+         double dDI = valid[hi].first - valid[lo].first;
+         double dAPD = results[NRESULTS*valid[hi].second+APD] - results[NRESULTS*valid[lo].second+APD];
+         if (dDI > 0)
+            slope[valid[ii].second] = dAPD/dDI;
+      }
+   }
+
+   void writeTable(const Parms& p, const vector<Job>& jobs, const vector<double>& results)
+   {
+      FILE* file = fopen(p.outputFile.c_str(), "w");
+      if (file == NULL)
+      {
+         perror(("Can't open " + p.outputFile + " for writing").c_str());
+         return;
+      }
+
+      vector<double> slope(jobs.size(), NAN);
+      vector<double> maxSlope(p.reactionNames.size()*NPROTOCOLS, NAN);
+      vector<double> onset(p.reactionNames.size(), NAN);
+      for (unsigned ir=0; ir<p.reactionNames.size(); ++ir)
+      {
+         for (int ip=0; ip<NPROTOCOLS; ++ip)
+         {
+            vector<int> curve;
+            for (unsigned jj=0; jj<jobs.size(); ++jj)
+               if (jobs[jj].reaction == ir && jobs[jj].protocol == ip)
+                  curve.push_back(jj);
+            computeSlopes(results, curve, slope);
+            double& m = maxSlope[ir*NPROTOCOLS+ip];
+            for (unsigned ii=0; ii<curve.size(); ++ii)
+               if (std::isfinite(slope[curve[ii]]) && !(slope[curve[ii]] <= m))
+                  m = slope[curve[ii]];
+            if (ip != DYNAMIC)
+               continue;
+            for (unsigned ii=0; ii<curve.size(); ++ii)
+            {
+               const double* r = &results[NRESULTS*curve[ii]];
+               bool alternans = (r[CAPTURED] == 0 ||
+                                 !(fabs(r[APD] - r[APD_PREV]) <= p.alternansThreshold));
+               if (alternans && !(jobs[curve[ii]].bcl <= onset[ir]))
+                  onset[ir] = jobs[curve[ii]].bcl;
+            }
+         }
+      }
+
+      fprintf(file, "# APD%g restitution summary\n", 100*p.apdThreshold);
+      fprintf(file, "# %-18s %14s %14s %14s\n",
+              "reaction", "maxSlopeS1S2", "maxSlopeDyn", "alternansBcl");
+      for (unsigned ir=0; ir<p.reactionNames.size(); ++ir)
+         fprintf(file, "# %-18s %14.4f %14.4f %14.2f\n", p.reactionNames[ir].c_str(),
+                 maxSlope[ir*NPROTOCOLS+S1S2], maxSlope[ir*NPROTOCOLS+DYNAMIC], onset[ir]);
+      fprintf(file, "#\n");
+      fprintf(file, "# %-18s %8s %10s %10s %10s %10s %10s %10s %10s %8s\n",
+              "reaction", "protocol", "bcl", "s2", "apd", "di", "apdPrev",
+              "dApd", "slope", "captured");
+      for (unsigned jj=0; jj<jobs.size(); ++jj)
+      {
+         const Job& job = jobs[jj];
+         const double* r = &results[NRESULTS*jj];
+         fprintf(file, "  %-18s %8s %10.2f %10.2f %10.3f %10.3f %10.3f %10.3f %10.4f %8d\n",
+                 p.reactionNames[job.reaction].c_str(), protocolName[job.protocol],
+                 job.bcl, job.s2, r[APD], r[DI], r[APD_PREV],
+                 r[APD]-r[APD_PREV], slope[jj], int(r[CAPTURED]));
+      }
+      fclose(file);
+   }
+}
+
+
+int main(int argc, char* argv[])
+{
+   int npes, mype;
+   MPI_Init(&argc, &argv);
+   MPI_Comm_size(MPI_COMM_WORLD, &npes);
+   MPI_Comm_rank(MPI_COMM_WORLD, &mype);
+
+   if (argc < 2)
+      object_compilefile("restitution.data");
+   for (int ii=1; ii<argc; ++ii)
+      object_compilefile(argv[ii]);
+
+   Parms p;
+   getParms(p);
+   vector<Job> jobs;
+   buildJobs(p, jobs);
+   if (jobs.empty())
+   {
+      if (mype == 0)
+         fprintf(stderr, "restitution: no s2 or dynamicBcl values given\n");
+      MPI_Abort(MPI_COMM_WORLD, -1);
+   }
+
+   // Deal jobs out longest first so every rank gets a similar mix of
+   // short and long simulations.
+   vector<pair<double, int> > order;
+   for (unsigned jj=0; jj<jobs.size(); ++jj)
+      order.push_back(make_pair(-jobs[jj].duration, jj));
+   stable_sort(order.begin(), order.end());
+   vector<vector<int> > myJobs(p.reactionNames.size());
+   for (unsigned ii=mype; ii<order.size(); ii+=npes)
+      myJobs[jobs[order[ii].second].reaction].push_back(order[ii].second);
+
+   ThreadServer& threadServer = ThreadServer::getInstance();
+   ThreadTeam threads = threadServer.getThreadTeam(vector<unsigned>());
+
+   vector<double> results(NRESULTS*jobs.size(), 0.0);
+   for (unsigned ir=0; ir<myJobs.size(); ++ir)
+      if (!myJobs[ir].empty())
+         runJobs(p, jobs, myJobs[ir], threads, results);
+
+   vector<double> allResults(results.size());
+   MPI_Reduce(&results[0], &allResults[0], results.size(), MPI_DOUBLE, MPI_SUM,
+              0, MPI_COMM_WORLD);
+
+   if (mype == 0)
+   {
+      writeTable(p, jobs, allResults);
+      printf("restitution: %zu jobs on %d tasks written to %s\n",
+             jobs.size(), npes, p.outputFile.c_str());
+   }
+
+   MPI_Finalize();
+   return 0;
+}
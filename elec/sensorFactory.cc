@@ -18,6 +18,7 @@
 #include "ECGSensor.hh"
 #include "Simulate.hh"
 #include "readCellList.hh"
+#include "mpiUtils.h"
 
 using namespace std;
 
@@ -116,6 +117,7 @@ Sensor* sensorFactory(const std::string& name, const Simulate& sim)
   objectGet(obj, "printRate", sp.printRate, "1");
   objectGet(obj, "evalRate",  sp.evalRate,  "-1");
   if(sp.evalRate == -1)sp.evalRate=sp.printRate;
+  sp.comm = sim.comm_;
 
   if (method == "undefined")
     assert(false);
@@ -125,10 +127,8 @@ Sensor* sensorFactory(const std::string& name, const Simulate& sim)
      return scanActivationAndRecoverySensor(obj, sp, sim.anatomy_,sim.vdata_);
   else if (method == "averageCa")
      return scanCaSensor(obj, sp, sim.anatomy_,*sim.reaction_, sim);
-#ifdef USE_CUDA
   else if (method == "ECG")
      return scanECGSensor(obj, sp, sim);
-#endif
   else if (method == "maxDV")
      return scanMaxDvSensor(obj, sp, sim.anatomy_,sim.vdata_);
   else if (method == "DVThresh")
@@ -146,7 +146,7 @@ Sensor* sensorFactory(const std::string& name, const Simulate& sim)
 
 
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(sim.comm_, &myRank);
    if(myRank==0)cerr<<"Sensor ERROR: unknown method "<<method<<endl;
 
    assert(false); // reachable only due to bad input
@@ -266,7 +266,7 @@ namespace
       objectGet(obj, "cellList", cellListFilename, "");
 
       vector<Long64> cellVec;
-      readCellList(cellListFilename, cellVec);
+      readCellList(cellListFilename, cellVec, sp.comm);
 
       string filename;
       objectGet(obj, "filename",  filename,  "coarsened_anatomy");
@@ -307,13 +307,13 @@ namespace
                         const Simulate& sim)
    {
       int myRank;
-      MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+      MPI_Comm_rank(sp.comm, &myRank);
 
       string cellListFilename;
       objectGet(obj, "cellList", cellListFilename, "");
 
       vector<Long64> cellVec;
-      readCellList(cellListFilename, cellVec);
+      readCellList(cellListFilename, cellVec, sp.comm);
 
       string filename;
       objectGet(obj, "filename",  filename,  "coarsened_Ca");
@@ -343,7 +343,7 @@ namespace
       string filename;
       objectGet(obj, "filename",  filename,  "cout");
 
-      return new MaxDVSensor(sp, anatomy, vdata, MPI_COMM_WORLD, filename);
+      return new MaxDVSensor(sp, anatomy, vdata, sp.comm, filename);
    }
 }
 namespace
@@ -366,7 +366,7 @@ namespace
       double val;
       objectGet(obj, "threshold",  val,  "-1.0");
       sp.value = val;
-      return new DVThreshSensor(sp, anatomy, vdata, MPI_COMM_WORLD);
+      return new DVThreshSensor(sp, anatomy, vdata, sp.comm);
    }
 }
 namespace
@@ -389,9 +389,38 @@ namespace
       return new StateVariableSensor(sp, p, sim);      
    }
 }
-#ifdef USE_CUDA
 namespace
 {
+   /*!
+     @page SENSOR_ECG SENSOR ECG method
+
+     Computes the pseudo-ECG at a list of electrodes: kconst times the
+     volume integral of the diffusion current divided by the distance
+     to the electrode.
+
+     By default the inverse distances of all cells to all electrodes
+     are stored and summed every evaluation.  With theta > 0 a treecode
+     is used instead: groups of cells whose radius is less than theta
+     times their distance to an electrode contribute through a
+     quadrupole expansion.  Only the cells near an electrode use the
+     exact kernel.  Use this for body surface maps with many
+     electrodes.  The error of each term is of order theta^3, but the
+     diffusion current sums to about zero so the error relative to the
+     ECG is larger: about 1% at theta = 0.3 and 5% at 0.5.  The
+     treecode is not used when reproducibleSums is set in the SIMULATE
+     object.
+
+     @beginkeywords
+     @kw{ecgPoints, Names of the POINT objects (keywords x\, y and z)
+       that give the electrode positions., No default}
+     @kw{filename, Name for output file., ecgData}
+     @kw{kconst, Scale factor of the sum., 0.8}
+     @kw{leafSize, Maximum number of cells in a leaf of the treecode., 32}
+     @kw{nFiles, Number of files the output is written to., 0}
+     @kw{theta, Opening angle of the treecode.  Must be less than 1.
+       0 stores the full table., 0}
+     @endkeywords
+   */
    Sensor* scanECGSensor(OBJECT* obj, const SensorParms& sp, const Simulate& sim)
    {
       ECGSensorParms p;
@@ -400,6 +429,15 @@ namespace
       //objectGet(obj, "nSensorPoints", p.nSensorPoints, "4");
       objectGet(obj, "nFiles",        p.nFiles,        "0");
       objectGet(obj, "kconst",        p.kconst,        "0.8");
+      objectGet(obj, "theta",         p.theta,         "0");
+      objectGet(obj, "leafSize",      p.leafSize,      "32");
+      if (p.theta < 0 || p.theta >= 1 || p.leafSize < 1)
+      {
+         if (getRank(0) == 0)
+            cout << "ERROR: ECG sensor " << obj->name
+                 << " needs 0 <= theta < 1 and leafSize >= 1" << endl;
+         abortAll(1);
+      }
       std::vector<std::string> ecgNames;
       objectGet(obj, "ecgPoints",     ecgNames);
       
@@ -418,4 +456,3 @@ namespace
       return new ECGSensor(sp, p, sim);      
    }
 }
-#endif
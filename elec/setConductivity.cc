@@ -36,6 +36,10 @@ namespace
    void fibreConductivity(OBJECT* obj,
                           const BucketOfBits& data,
                           vector<AnatomyCell>& cell);
+   void fibreConductivity(OBJECT* obj,
+                          const vector<double>& theta,
+                          const vector<double>& phi,
+                          vector<AnatomyCell>& cell);
    void jhuConductivity(OBJECT* obj,
                         const Tuple& globalGridSize,
                         vector<AnatomyCell> cell);
@@ -71,6 +75,40 @@ void setConductivity(const string& name,
       assert(false);
 }
 
+void setConductivity(const string& name,
+                     const vector<double>& theta,
+                     const vector<double>& phi,
+                     bool haveTensor,
+                     const Tuple& globalGridSize,
+                     vector<AnatomyCell>& cell)
+{
+   OBJECT* obj = 0;
+   if (object_exists(name.c_str(), "CONDUCTIVITY"))
+      obj = objectFind(name, "CONDUCTIVITY");
+   string method = "pio";
+   if (obj)
+      objectGet(obj, "method", method, "pio");
+
+   if (method == "pio")
+   {
+      if (!haveTensor)
+         missingFieldError();
+   }
+   else if (method == "fiber" || method == "fibre")
+   {
+      if (theta.empty())
+         fibreConductivity(obj, vector<double>(cell.size()), vector<double>(cell.size()), cell);
+      else
+         fibreConductivity(obj, theta, phi, cell);
+   }
+   else if (method == "JHU")
+      jhuConductivity(obj, globalGridSize, cell);
+   else if (method == "uniform")
+      uniformConductivity(obj, cell);
+   else
+      assert(false);
+}
+
 namespace
 {
    void pioConductivity(const BucketOfBits& data,
@@ -143,11 +181,6 @@ namespace
                           const BucketOfBits& data,
                           vector<AnatomyCell>& cell)
    {
-      FibreConductivityParms p;
-      objectGet(obj, "sigmaTi", p.sigmaTi, "0.0315e-3", "resistivity/l");
-      objectGet(obj, "sigmaLi", p.sigmaLi, "0.3e-3",    "resistivity/l");
-      FibreConductivity fibre(p);
-
       vector<double> theta(cell.size()); // angles default to zero
       vector<double> phi(cell.size());
       
@@ -194,6 +227,19 @@ namespace
          }
       }
       
+      fibreConductivity(obj, theta, phi, cell);
+   }
+
+   void fibreConductivity(OBJECT* obj,
+                          const vector<double>& theta,
+                          const vector<double>& phi,
+                          vector<AnatomyCell>& cell)
+   {
+      FibreConductivityParms p;
+      objectGet(obj, "sigmaTi", p.sigmaTi, "0.0315e-3", "resistivity/l");
+      objectGet(obj, "sigmaLi", p.sigmaLi, "0.3e-3",    "resistivity/l");
+      FibreConductivity fibre(p);
+
       for (unsigned ii=0; ii<cell.size(); ++ii)
          fibre.compute(theta[ii], phi[ii], cell[ii].sigma_);
    }
@@ -251,7 +297,7 @@ namespace
    void unitConsistencyError()
    {
       int myRank;
-      MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+      myRank = getRank(0);
       if (myRank == 0)
          cout << "Fatal Error in anatomy file.\n"
             "Anatomy files that contain conductivity tensor data must specify\n"
@@ -266,7 +312,7 @@ namespace
    void missingFieldError()
    {
       int myRank;
-      MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+      myRank = getRank(0);
       if (myRank == 0)
          cout << "Fatal Error in anatomy file.\n"
             "You have chosen to read conductivty tensor data from the anatomy\n"
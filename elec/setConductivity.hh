@@ -14,4 +14,14 @@ void setConductivity(const std::string& name,
                      const Tuple& globalGridSize,
                      std::vector<AnatomyCell>& cell);
 
+/** For readers that decode the fibre data themselves (compact anatomy
+ *  files).  theta and phi are indexed like cell and may be empty.  If
+ *  haveTensor the tensors already in cell are used by method pio. */
+void setConductivity(const std::string& name,
+                     const std::vector<double>& theta,
+                     const std::vector<double>& phi,
+                     bool haveTensor,
+                     const Tuple& globalGridSize,
+                     std::vector<AnatomyCell>& cell);
+
 #endif
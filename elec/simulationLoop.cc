@@ -1,6 +1,8 @@
 #include "simulationLoop.hh"
 
 #include <vector>
+#include <set>
+#include <map>
 #include <utility>
 #include <algorithm>
 #include <iostream>
@@ -19,9 +21,11 @@
 #include "ioUtils.h"
 #include "writeCells.hh"
 #include "checkpointIO.hh"
+#include "BuddyCheckpoint.hh"
 #include "PerformanceTimers.hh"
 #include "fastBarrier.hh"
 #include "mpiUtils.h"
+#include "ddcMalloc.h"
 #include "ReactionManager.hh"
 #include "DeviceFor.hh"
 #include  "cudaNVTX.h"
@@ -45,6 +49,10 @@
 #include "object_cc.hh"
 #include "clooper.h"
 #include "ThreadUtils.hh"
+#include "ThreadSplitTuner.hh"
+#include "TaskGraph.hh"
+#include "TemporalBlocker.hh"
+#include "FGRUtils.hh"
 
 //#define timebase(x) asm volatile ("mftb %0" : "=r"(x) : )
 
@@ -113,7 +121,13 @@ void simulationProlog(Simulate& sim)
    // did.
    for (unsigned ii = 0; ii < sim.stateFilename_.size(); ++ii)
    {
-      readCheckpoint(sim.stateFilename_[ii], sim, MPI_COMM_WORLD);
+      readCheckpoint(sim.stateFilename_[ii], sim, sim.comm_);
+   }
+
+   if (sim.memoryRestart_ && !sim.buddyCheckpoint_->restore(sim))
+   {
+      MPI_Barrier(sim.comm_);
+      exit(1);
    }
 }
 
@@ -121,7 +135,7 @@ void loopIO(const Simulate& sim, int firstCall)
 {
    if (firstCall) { return; }
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(sim.comm_, &myRank);
    const Anatomy& anatomy = sim.anatomy_;
 
    int loop = sim.loop_;
@@ -129,6 +143,7 @@ void loopIO(const Simulate& sim, int firstCall)
    // SENSORS
    #pragma omp critical
    {
+      DdcMemTagScope memTag(DDCMEM_IO);
       startTimer(sensorTimer);
       for (unsigned ii = 0; ii < sim.sensor_.size(); ++ii)
       {
@@ -139,7 +154,15 @@ void loopIO(const Simulate& sim, int firstCall)
       startTimer(loopIOTimer);
       if (sim.loop_ > 0 && sim.checkpointRate_ > 0 && sim.loop_ % sim.checkpointRate_ == 0)
       {
-         writeCheckpoint(sim, MPI_COMM_WORLD);
+         writeCheckpoint(sim, sim.comm_);
+      }
+      if (sim.loop_ > 0 && sim.memoryCheckpointRate_ > 0 && sim.loop_ % sim.memoryCheckpointRate_ == 0)
+      {
+         sim.buddyCheckpoint_->write(sim);
+      }
+      if (sim.loop_ > 0 && sim.memReportRate_ > 0 && sim.loop_ % sim.memReportRate_ == 0)
+      {
+         ddcMemTagReport(sim.comm_, stdout);
       }
 
    }// critical section
@@ -159,7 +182,7 @@ void simulationLoop(Simulate& sim)
 
 #if defined(SPI) && defined(TRACESPI)
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(sim.comm_, &myRank);
    cout << "Rank[" << myRank << "]: numOfNeighborToSend=" << sim.commTable_->_sendTask.size() << " numOfNeighborToRecv=" << sim.commTable_->_recvTask.size() << " numOfBytesToSend=" << sim.commTable_->_sendOffset[sim.commTable_->_sendTask.size()] * sizeof (double) << " numOfBytesToRecv=" << sim.commTable_->_recvOffset[sim.commTable_->_recvTask.size()] * sizeof (double) << endl;
 #endif
 
@@ -263,6 +286,11 @@ struct SimLoopData
       : voltageExchange(sim.sendMap_, (sim.commTable_))
    {
       stimIsNonZero = 1;
+      firstSegment = true;
+      endLoop = sim.maxLoop_;
+      measureBegin = sim.maxLoop_;
+      tBegin = tEnd = 0.0;
+      diffusionWait = reactionWait = 0.0;
       diffMiscBarrier = L2_BarrierWithSync_InitShared();
       reactionBarrier = L2_BarrierWithSync_InitShared();
       diffusionBarrier = L2_BarrierWithSync_InitShared();
@@ -274,6 +302,7 @@ struct SimLoopData
          const int
          nsq = sim.reactionThreads_.nSquads(),
          sqsz = sim.reactionThreads_.nThreads() / nsq /*sim.reactionThreads_.squadSize()*/;
+         nSquads = nsq;
          core_barrier = (L2_Barrier_t **) malloc(sizeof (L2_Barrier_t *) * nsq);
          for (int i = 0; i < nsq; i++)
          {
@@ -327,14 +356,31 @@ struct SimLoopData
 
    ~SimLoopData()
    {
+#ifdef PER_SQUAD_BARRIER
+      for (int ii = 0; ii < nSquads; ++ii)
+      {
+         free(core_barrier[ii]);
+      }
+      free(core_barrier);
+#endif
       free(reactionWaitOnNonGateBarrier);
       free(diffusionBarrier);
       free(reactionBarrier);
       free(timingBarrier);
+      free(diffMiscBarrier);
    }
 
 
    int stimIsNonZero;
+   // The loops run from sim.loop_ to endLoop.  Steps from measureBegin
+   // on are timed for the ThreadSplitTuner.
+   bool firstSegment;
+   uint64_t endLoop;
+   uint64_t measureBegin;
+   double tBegin;
+   double tEnd;
+   double diffusionWait;
+   double reactionWait;
    L2_Barrier_t* diffMiscBarrier;
    L2_Barrier_t* reactionBarrier;
    L2_Barrier_t* diffusionBarrier;
@@ -346,6 +392,7 @@ struct SimLoopData
    L2_Barrier_t* timingBarrier;
 
 #ifdef PER_SQUAD_BARRIER
+   int nSquads;
    L2_Barrier_t **core_barrier;
    vector<int> integratorOffset_psb;
 #endif
@@ -390,7 +437,7 @@ void diffusionLoop(Simulate& sim,
    //  if globalSyncCnt >   0  sync at start of loop and then every globalSyncCnt timestep;
    int globalSyncCnt = 1;
    if (globalSyncRate == -1) { globalSyncCnt = -1; }
-   while (loopLocal < sim.maxLoop_)
+   while (loopLocal < loopData.endLoop)
    {
       if (globalSyncCnt >= 0) { globalSyncCnt--; }
       if (globalSyncCnt == 0)
@@ -510,9 +557,12 @@ void diffusionLoop(Simulate& sim,
 
       // wait for reaction (integration) to finish
       startTimer(diffusionWaitTimer);
+      double tWait = 0.0;
+      if (tid == 0 && loopLocal >= loopData.measureBegin) { tWait = omp_get_wtime(); }
       L2_BarrierWithSync_WaitAndReset(loopData.reactionBarrier,
                                       &reactionHandle,
                                       sim.reactionThreads_.nThreads());
+      if (tid == 0 && loopLocal >= loopData.measureBegin) { loopData.diffusionWait += omp_get_wtime() - tWait; }
       stopTimer(diffusionWaitTimer);
       ++loopLocal;
       //      startTimer(dummyTimer);
@@ -542,15 +592,16 @@ void reactionLoop(Simulate& sim, SimLoopData& loopData, L2_BarrierHandle_t& reac
 #endif
 
 
-   if (tid == 0)
+   if (tid == 0 && loopData.firstSegment)
    {
       printData(sim);
       loopIO(sim, 1);
    }
    uint64_t loopLocal = sim.loop_;
-   while (loopLocal < sim.maxLoop_)
+   while (loopLocal < loopData.endLoop)
    {
       threadBarrier(timingBarrierTimer, loopData.timingBarrier, &timingHandle, nTotalThreads);
+      if (tid == 0 && loopLocal == loopData.measureBegin) { loopData.tBegin = omp_get_wtime(); }
 
       startTimer(reactionTimer);
       startTimer(nonGateRLTimer);
@@ -579,6 +630,8 @@ void reactionLoop(Simulate& sim, SimLoopData& loopData, L2_BarrierHandle_t& reac
       stopTimer(reactionTimer);
 
       startTimer(reactionWaitTimer);
+      double tWait = 0.0;
+      if (tid == 0 && loopLocal >= loopData.measureBegin) { tWait = omp_get_wtime(); }
       /*
          The following barrier makes sure the integrator does not write to data still being read by some
          threads still in updateGate(). With the modified loop order in integratorOffset_psb[], only per
@@ -596,6 +649,7 @@ void reactionLoop(Simulate& sim, SimLoopData& loopData, L2_BarrierHandle_t& reac
 #endif
 
       L2_BarrierWithSync_WaitAndReset(loopData.diffusionBarrier, &diffusionHandle, sim.diffusionThreads_.nThreads());
+      if (tid == 0 && loopLocal >= loopData.measureBegin) { loopData.reactionWait += omp_get_wtime() - tWait; }
       stopTimer(reactionWaitTimer);
 
       startTimer(dummyTimer);
@@ -702,53 +756,436 @@ void reactionLoop(Simulate& sim, SimLoopData& loopData, L2_BarrierHandle_t& reac
       stopTimer(reactionL2ResetTimer);
       //#pragma omp barrier
    }
+   if (tid == 0) { loopData.tEnd = omp_get_wtime(); }
    profileStop(reactionLoopTimer);
 }
 
 void simulationLoopParallelDiffusionReaction(Simulate& sim)
 {
-   SimLoopData loopData(sim);
+   SimLoopData* loopData = new SimLoopData(sim);
 
    simulationProlog(sim);
 
 #if defined(SPI) && defined(TRACESPI)
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(sim.comm_, &myRank);
    cout << "Rank[" << myRank << "]: numOfNeighborToSend=" << sim.commTable_->_sendTask.size() << " numOfNeighborToRecv=" << sim.commTable_->_recvTask.size() << " numOfBytesToSend=" << sim.commTable_->_sendOffset[sim.commTable_->_sendTask.size()] * sizeof (double) << " numOfBytesToRecv=" << sim.commTable_->_recvOffset[sim.commTable_->_recvTask.size()] * sizeof (double) << endl;
 #endif
 
-   timestampBarrier("Entering threaded region", MPI_COMM_WORLD);
-
-   #pragma omp parallel
+   // With tuneThreads the loop runs in segments of tuneWarmup +
+   // tuneWindow steps.  Between segments the ThreadSplitTuner may move
+   // a core from one team to the other.  Once it settles the rest of
+   // the run is a single segment.
+   int nDiffusionCores = 0;
+   int nCores = 0;
+   bool tuning = sim.threadTuning_.on && sim.threadTuning_.window > 0;
+   if (tuning && !countTeamCores(sim, nDiffusionCores, nCores))
    {
-      int ompTid = omp_get_thread_num();
+      if (getRank(0) == 0)
+         cout << "tuneThreads ignored: diffusion and reaction teams share cores" << endl;
+      tuning = false;
+   }
+   ThreadSplitTuner tuner(tuning ? nCores : 0, tuning ? nDiffusionCores : 0, sim.comm_);
+   if (tuning && tuner.settled() && getRank(0) == 0)
+      cout << "tuneThreads ignored: fewer than two cores" << endl;
+
+   timestampBarrier("Entering threaded region", sim.comm_);
 
-      L2_BarrierHandle_t reactionHandle;
-      L2_BarrierHandle_t diffusionHandle;
-      L2_BarrierWithSync_InitInThread(loopData.reactionBarrier, &reactionHandle);
-      L2_BarrierWithSync_InitInThread(loopData.diffusionBarrier, &diffusionHandle);
+   while (sim.loop_ < sim.maxLoop_)
+   {
+      if (tuning && !tuner.settled())
+      {
+         loopData->measureBegin = sim.loop_ + sim.threadTuning_.warmup;
+         loopData->endLoop = min<uint64_t>(loopData->measureBegin + sim.threadTuning_.window, sim.maxLoop_);
+      }
 
-      // setup matrix voltages for first timestep.
+      #pragma omp parallel
       {
+         int ompTid = omp_get_thread_num();
+
+         L2_BarrierHandle_t reactionHandle;
+         L2_BarrierHandle_t diffusionHandle;
+         L2_BarrierWithSync_InitInThread(loopData->reactionBarrier, &reactionHandle);
+         L2_BarrierWithSync_InitInThread(loopData->diffusionBarrier, &diffusionHandle);
+
+         // setup matrix voltages for first timestep.
+         {
+            if (sim.reactionThreads_.teamRank() >= 0)
+            {
+               sim.diffusion_->updateLocalVoltage(sim.vdata_.VmTransport_);
+            }
+            if (sim.reactionThreads_.teamRank() == 0)
+            {
+               loopData->voltageExchange.fillSendBuffer(sim.vdata_.VmTransport_);
+            }
+         }
+         #pragma omp barrier
+         profileStart(simulationLoopTimer);
+         if (sim.diffusionThreads_.teamRank() >= 0)
+         {
+            diffusionLoop(sim, *loopData, reactionHandle, diffusionHandle);
+         }
          if (sim.reactionThreads_.teamRank() >= 0)
          {
-            sim.diffusion_->updateLocalVoltage(sim.vdata_.VmTransport_);
+            reactionLoop(sim, *loopData, reactionHandle, diffusionHandle, integrateLoop);
+         }
+         profileStop(simulationLoopTimer);
+      }
+
+      if (sim.loop_ >= sim.maxLoop_)
+         break;
+
+      // The barriers count rounds from zero, so every segment needs a
+      // fresh set even when the split does not change.
+      int split = tuner.nDiffusionCores();
+      if (loopData->endLoop > loopData->measureBegin)
+      {
+         double stepTime = (loopData->tEnd - loopData->tBegin) / (loopData->endLoop - loopData->measureBegin);
+         split = tuner.nextSplit(stepTime, loopData->diffusionWait, loopData->reactionWait);
+      }
+      delete loopData;
+      if (split != nDiffusionCores)
+      {
+         rebuildThreadTeams(sim, split);
+         nDiffusionCores = split;
+      }
+      loopData = new SimLoopData(sim);
+      loopData->firstSegment = false;
+   }
+   delete loopData;
+}
+
+namespace
+{
+
+/** Builds the task graph for one time step of the task graph loop.
+ *
+ *  The local cells are split into contiguous blocks.  For every block
+ *  there is a task that copies Vm into the diffusion matrix (L), one
+ *  that computes diffusion (D) and one that integrates (I).  The
+ *  reaction runs in pieces (R) made by the ReactionManager.  One more
+ *  task (H) waits for the halo exchange on the master thread.
+ *
+ *  D for a block needs L of every block that holds a stencil
+ *  neighbor of its cells, and H if any neighbor is a remote cell.  I
+ *  needs D of its block and every R piece that shares a cell with
+ *  it.  There are no other dependencies, so a thread that finishes
+ *  its share early picks up reaction or diffusion work of another
+ *  block instead of waiting at a barrier.
+ */
+void buildStepGraph(Simulate& sim, HaloExchangeBase<double>& voltageExchange,
+                    lazy_array<double>& iStimTransport, TaskGraph& graph)
+{
+   const Anatomy& anatomy = sim.anatomy_;
+   int nLocal = anatomy.nLocal();
+   int nThreads = omp_get_max_threads();
+   int nBlocks = max(1, min(nLocal, nThreads*sim.taskBlocksPerThread_));
+   vector<int> blockOffset(nBlocks+1);
+   for (int ib = 0; ib <= nBlocks; ++ib)
+   {
+      blockOffset[ib] = (Long64(nLocal)*ib)/nBlocks;
+   }
+   vector<int> blockOfCell(nLocal);
+   for (int ib = 0; ib < nBlocks; ++ib)
+   {
+      for (int ii = blockOffset[ib]; ii < blockOffset[ib+1]; ++ii)
+      {
+         blockOfCell[ii] = ib;
+      }
+   }
+
+   // Which blocks hold stencil neighbors of each block.  The 26 cell
+   // neighborhood is a superset of the 19 point stencil.
+   vector<set<int> > neighborBlocks(nBlocks);
+   vector<bool> needsHalo(nBlocks, false);
+   {
+      map<Long64, int> indexFromGid;
+      for (unsigned ii = 0; ii < anatomy.size(); ++ii)
+      {
+         indexFromGid[anatomy.gid(ii)] = ii;
+      }
+      int nx = anatomy.nx();
+      int ny = anatomy.ny();
+      int nz = anatomy.nz();
+      for (int ii = 0; ii < nLocal; ++ii)
+      {
+         int ib = blockOfCell[ii];
+         Tuple tt = anatomy.globalTuple(ii);
+         for (int dz = -1; dz <= 1; ++dz)
+         for (int dy = -1; dy <= 1; ++dy)
+         for (int dx = -1; dx <= 1; ++dx)
+         {
+            int x = tt.x()+dx;
+            int y = tt.y()+dy;
+            int z = tt.z()+dz;
+            if (x < 0 || y < 0 || z < 0 || x >= nx || y >= ny || z >= nz)
+            {
+               continue;
+            }
+            map<Long64, int>::const_iterator here =
+               indexFromGid.find(x + Long64(nx)*(y + Long64(ny)*z));
+            if (here == indexFromGid.end())
+            {
+               continue;
+            }
+            if (here->second < nLocal)
+            {
+               neighborBlocks[ib].insert(blockOfCell[here->second]);
+            }
+            else
+            {
+               needsHalo[ib] = true;
+            }
+         }
+      }
+   }
+
+   PotentialData& vdata = sim.vdata_;
+   int halo = graph.addTask([&sim, &voltageExchange]()
+   {
+      startTimer(haloWaitTimer);
+      voltageExchange.wait();
+      stopTimer(haloWaitTimer);
+      sim.diffusion_->updateRemoteVoltage(voltageExchange.getRecvBuf());
+   }, 0, true);
+
+   vector<int> localVoltage(nBlocks);
+   vector<int> diffusion(nBlocks);
+   vector<int> integrate(nBlocks);
+   for (int ib = 0; ib < nBlocks; ++ib)
+   {
+      int begin = blockOffset[ib];
+      int end = blockOffset[ib+1];
+      int home = (ib*nThreads)/nBlocks;
+      localVoltage[ib] = graph.addTask([&sim, &vdata, begin, end]()
+      {
+         sim.diffusion_->updateLocalVoltageRange(vdata.VmTransport_, begin, end);
+      }, home);
+      diffusion[ib] = graph.addTask([&sim, &vdata, begin, end]()
+      {
+         startTimer(diffusionCalcTimer);
+         sim.diffusion_->calcRange(vdata.dVmDiffusionTransport_, begin, end);
+         stopTimer(diffusionCalcTimer);
+      }, home);
+      integrate[ib] = graph.addTask([&sim, &vdata, &iStimTransport, begin, end]()
+      {
+         startTimer(integratorTimer);
+         if (sim.checkRange_.on)
+         {
+            sim.checkRanges(begin, end, vdata.VmTransport_, vdata.dVmReactionTransport_, vdata.dVmDiffusionTransport_);
          }
-         if (sim.reactionThreads_.teamRank() == 0)
+         rw_array_ptr<double> Vm = vdata.VmTransport_.readwrite(CPU);
+         ro_array_ptr<double> dVmR = vdata.dVmReactionTransport_.readonly(CPU);
+         ro_array_ptr<double> dVmD = vdata.dVmDiffusionTransport_.readonly(CPU);
+         ro_array_ptr<double> iStim = iStimTransport.readonly(CPU);
+         double dt = sim.dt_;
+         for (int ii = begin; ii < end; ++ii)
+         {
+            Vm[ii] += dt*(dVmR[ii]+dVmD[ii]+iStim[ii]);
+         }
+         stopTimer(integratorTimer);
+      }, home);
+      graph.addDependency(diffusion[ib], integrate[ib]);
+      if (needsHalo[ib])
+      {
+         graph.addDependency(halo, diffusion[ib]);
+      }
+   }
+   for (int ib = 0; ib < nBlocks; ++ib)
+   {
+      graph.addDependency(localVoltage[ib], diffusion[ib]);
+      for (set<int>::const_iterator iter = neighborBlocks[ib].begin(); iter != neighborBlocks[ib].end(); ++iter)
+      {
+         if (*iter != ib)
          {
-            loopData.voltageExchange.fillSendBuffer(sim.vdata_.VmTransport_);
+            graph.addDependency(localVoltage[*iter], diffusion[ib]);
          }
       }
-      #pragma omp barrier
-      profileStart(simulationLoopTimer);
-      if (sim.diffusionThreads_.teamRank() >= 0)
+   }
+
+   ReactionManager& reaction = *sim.reaction_;
+   for (int ip = 0; ip < reaction.nPieces(); ++ip)
+   {
+      ro_array_ptr<int> cells = reaction.pieceCells(ip).useOn(CPU);
+      set<int> blocks;
+      for (unsigned ii = 0; ii < cells.size(); ++ii)
       {
-         diffusionLoop(sim, loopData, reactionHandle, diffusionHandle);
+         blocks.insert(blockOfCell[cells[ii]]);
       }
-      if (sim.reactionThreads_.teamRank() >= 0)
+      int home = blocks.empty() ? 0 : (*blocks.begin()*nThreads)/nBlocks;
+      int task = graph.addTask([&sim, &vdata, &iStimTransport, ip]()
+      {
+         startTimer(reactionTimer);
+         sim.reaction_->calc(ip, sim.dt_, vdata.VmTransport_, iStimTransport, vdata.dVmReactionTransport_);
+         stopTimer(reactionTimer);
+      }, home);
+      for (set<int>::const_iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
       {
-         reactionLoop(sim, loopData, reactionHandle, diffusionHandle, integrateLoop);
+         graph.addDependency(task, integrate[*iter]);
       }
-      profileStop(simulationLoopTimer);
    }
 }
+
+}
+
+/** Same physics as simulationLoop, but each time step runs as a task
+ *  graph (see buildStepGraph) instead of a sequence of parallel loops
+ *  separated by barriers.  Needs a diffusion class with hasRangeCalc.
+ */
+void simulationLoopTaskGraph(Simulate& sim)
+{
+   if (!sim.diffusion_->hasRangeCalc())
+   {
+      if (getRank(0) == 0)
+         cout << "loopType = task needs a diffusion class with range support.\n"
+              << "Running the omp loop instead." << endl;
+      simulationLoop(sim);
+      return;
+   }
+
+   lazy_array<double> iStimTransport;
+   iStimTransport.resize(sim.anatomy_.nLocal());
+
+   simulationProlog(sim);
+   HaloExchangeDevice<double> voltageExchange(sim.sendMap_, (sim.commTable_));
+
+   PotentialData& vdata = sim.vdata_;
+
+   TaskGraph graph;
+   buildStepGraph(sim, voltageExchange, iStimTransport, graph);
+
+   printData(sim);
+   loopIO(sim, 1);
+   profileStart(simulationLoopTimer);
+
+   while (sim.loop_ < sim.maxLoop_)
+   {
+      {
+         voltageExchange.fillSendBuffer(vdata.VmTransport_);
+         voltageExchange.startComm();
+      }
+
+      startTimer(stimulusTimer);
+      {
+         {
+            wo_array_ptr<double> iStim = iStimTransport.useOn(CPU);
+            HOST_PARALLEL_FORALL(iStim.size(), ii, iStim[ii] = 0);
+         }
+         for (unsigned ii = 0; ii < sim.stimulus_.size(); ++ii)
+         {
+            sim.stimulus_[ii]->stim(sim.time_, iStimTransport);
+         }
+      }
+      stopTimer(stimulusTimer);
+
+      // The tasks only ever ask for CPU pointers.  Asking here first
+      // means none of them has to move data or update the bookkeeping
+      // in lazy_array.
+      vdata.VmTransport_.readwrite(CPU);
+      vdata.dVmReactionTransport_.readwrite(CPU);
+      vdata.dVmDiffusionTransport_.readwrite(CPU);
+      iStimTransport.readonly(CPU);
+
+      graph.execute();
+
+      sim.time_ += sim.dt_;
+      ++sim.loop_;
+
+      if (sim.checkIO()) { sim.bufferReactionData(); }
+
+      if (sim.loop_ % sim.printRate_ == 0)
+      {
+         printData(sim);
+      }
+      loopIO(sim, 0);
+   }
+   profileStop(simulationLoopTimer);
+}
+
+/** Same physics as simulationLoop, but the steps are taken several at
+ *  a time by a TemporalBlocker.  A block always ends at a step that
+ *  prints, checkpoints or runs a sensor, so all IO sees the same data
+ *  as in the omp loop.  Runs the omp loop instead when the requirements
+ *  of TemporalBlocker are not met.
+ */
+void simulationLoopBlocked(Simulate& sim)
+{
+   int nTasks;
+   MPI_Comm_size(sim.comm_, &nTasks);
+   FGRUtils::Stencil stencil;
+   if (nTasks > 1 || !sim.diffusion_->getStencil(stencil)
+       || sim.reaction_->nPointStates() < 0)
+   {
+      if (getRank(0) == 0)
+         cout << "loopType = blocked needs a single task, FGR diffusion and a\n"
+              << "reaction model with pointCalc.  Running the omp loop instead." << endl;
+      simulationLoop(sim);
+      return;
+   }
+
+   int nLocal = sim.anatomy_.nLocal();
+   simulationProlog(sim);
+   TemporalBlocker blocker(stencil, nLocal, sim.timeBlockSize_, sim.timeBlockSteps_);
+   vector<lazy_array<double> > iStimTransport(blocker.maxSteps());
+   for (unsigned ii=0; ii<iStimTransport.size(); ++ii)
+      iStimTransport[ii].resize(nLocal);
+
+   PotentialData& vdata = sim.vdata_;
+
+   printData(sim);
+   loopIO(sim, 1);
+   profileStart(simulationLoopTimer);
+
+   while (sim.loop_ < sim.maxLoop_)
+   {
+      int nSteps = 1;
+      while (nSteps < blocker.maxSteps() && sim.loop_+nSteps < sim.maxLoop_
+             && !sim.checkIO(sim.loop_+nSteps)
+             && (sim.loop_+nSteps) % sim.printRate_ != 0)
+         ++nSteps;
+
+      startTimer(stimulusTimer);
+      vector<const double*> iStim(nSteps);
+      double time = sim.time_;
+      for (int kk=0; kk<nSteps; ++kk)
+      {
+         {
+            wo_array_ptr<double> iStimK = iStimTransport[kk].useOn(CPU);
+            HOST_PARALLEL_FORALL(iStimK.size(), ii, iStimK[ii] = 0);
+         }
+         for (unsigned ii = 0; ii < sim.stimulus_.size(); ++ii)
+         {
+            sim.stimulus_[ii]->stim(time, iStimTransport[kk]);
+         }
+         iStim[kk] = iStimTransport[kk].readonly(CPU).raw();
+         time += sim.dt_;
+      }
+      stopTimer(stimulusTimer);
+
+      {
+         rw_array_ptr<double> Vm = vdata.VmTransport_.readwrite(CPU);
+         rw_array_ptr<double> dVmR = vdata.dVmReactionTransport_.readwrite(CPU);
+         rw_array_ptr<double> dVmD = vdata.dVmDiffusionTransport_.readwrite(CPU);
+         blocker.advance(*sim.reaction_, sim.dt_, nSteps,
+                         Vm.raw(), iStim, dVmR.raw(), dVmD.raw());
+      }
+
+      for (int kk=0; kk<nSteps; ++kk)
+         sim.time_ += sim.dt_;
+      sim.loop_ += nSteps;
+
+      if (sim.checkRange_.on)
+      {
+         sim.checkRanges(vdata.VmTransport_, vdata.dVmReactionTransport_, vdata.dVmDiffusionTransport_);
+      }
+
+      if (sim.checkIO()) { sim.bufferReactionData(); }
+
+      if (sim.loop_ % sim.printRate_ == 0)
+      {
+         printData(sim);
+      }
+      loopIO(sim, 0);
+   }
+   profileStop(simulationLoopTimer);
+}
@@ -3,7 +3,11 @@
 
 class Simulate;
 
+/** Sets up Vm and the reaction state and reads the state files. */
+void simulationProlog(Simulate& sim);
 void simulationLoop(Simulate& sim);
 void simulationLoopParallelDiffusionReaction(Simulate& sim);
+void simulationLoopTaskGraph(Simulate& sim);
+void simulationLoopBlocked(Simulate& sim);
 
 #endif
@@ -9,10 +9,14 @@
 #include "Vector.hh"
 #include "IndexToVector.hh"
 #include "IndexToThreeVector.hh"
+#include "IndexToTuple.hh"
 #include "GridAssignmentObject.h"
 #include "readPioFile.hh"
 #include <algorithm>
 #include <map>
+#include <unordered_map>
+#include <climits>
+#include <cmath>
 //ddt #include <iostream>
 
 using namespace std;
@@ -106,18 +110,16 @@ BucketOfBits* readStateData(const string& filename, MPI_Comm comm,
 
    unsigned gidIndex = bucket->getIndex("gid");
    assert(gidIndex < bucket->nFields());
-   unsigned nRecords = bucket->nRecords();
+   int nRecords = bucket->nRecords();
    gid.resize(nRecords);
-   records.reserve(nRecords*lRec);
-   for (unsigned ii=0; ii<nRecords; ++ii)
+   records.resize(size_t(nRecords)*lRec);
+   #pragma omp parallel for
+   for (int ii=0; ii<nRecords; ++ii)
    {
       BucketOfBits::Record rr = bucket->getRecord(ii);
       rr.getValue(gidIndex, gid[ii]);
       const char* src = rr.getRawData().data();
-      records.push_back('\0'); 
-      unsigned char* dest = &records.back();
-      records.resize(records.size()+lRec-1);
-      copyBytes(dest, src, lRec);
+      copyBytes(&records[size_t(ii)*lRec], src, lRec);
    }
 
    Pclose(file);
@@ -160,19 +162,18 @@ void findDestinations(const Anatomy& anatomy,
                                           sizeof(Vector));
    
    IndexToThreeVector indexTo3Vector(anatomy.nx(), anatomy.ny(), anatomy.nz());
-   recordDest.resize(gid.size());
+   unsigned nPoints = gid.size() + anatomy.nLocal();
+   vector<THREE_VECTOR> r(nPoints);
+   vector<int> dest(nPoints);
    for (unsigned ii=0; ii<gid.size(); ++ii)
-   {
-      THREE_VECTOR r = indexTo3Vector(gid[ii]);
-      recordDest[ii] = gao_nearestCenter(gao, r);
-   }
-
-   requestDest.resize(anatomy.nLocal());
+      r[ii] = indexTo3Vector(gid[ii]);
    for (unsigned ii=0; ii<anatomy.nLocal(); ++ii)
-   {
-      THREE_VECTOR r = indexTo3Vector(anatomy.gid(ii));
-      requestDest[ii] = gao_nearestCenter(gao, r);
-   }
+      r[gid.size()+ii] = indexTo3Vector(anatomy.gid(ii));
+   if (nPoints > 0)
+      gao_nearestCenters(gao, nPoints, (const void*) &r[0], sizeof(THREE_VECTOR), &dest[0]);
+
+   recordDest.assign(dest.begin(), dest.begin()+gid.size());
+   requestDest.assign(dest.begin()+gid.size(), dest.end());
 
    testDestinations(recordDest, requestDest, comm);
    
@@ -334,10 +335,178 @@ void sendRecordsToRequests(const vector<RecordRequest>& requests,
 }
 
 
+namespace
+{
+   struct GidBox
+   {
+      int lo[3];
+      int hi[3];
+      bool contains(const Tuple& tt) const
+      {
+         return tt.x() >= lo[0] && tt.x() <= hi[0]
+            && tt.y() >= lo[1] && tt.y() <= hi[1]
+            && tt.z() >= lo[2] && tt.z() <= hi[2];
+      }
+   };
+}
+
+/** Sends every record directly to the task that owns its gid in one
+ *  personalized exchange.  The readers don't know the owners, so a
+ *  record goes to every task whose bounding box (in grid coordinates)
+ *  contains it and the receivers keep the records of their own cells.
+ *  For the compact domains the decompositions produce a record is
+ *  sent to one or two tasks.  When the boxes overlap so much that more
+ *  than twice the data would be sent this returns false on every task
+ *  without sending anything and the caller should go through the drop
+ *  off sites instead.
+ *
+ *  On success localRecords holds the record of local cell ii at
+ *  localRecords[ii*lRec]. */
+bool sendRecordsToOwners(const Anatomy& anatomy,
+                         const vector<Long64>& gid,
+                         const vector<unsigned char>& records,
+                         unsigned lRec,
+                         MPI_Comm comm,
+                         vector<unsigned char>& localRecords)
+{
+   int nTasks;
+   int myRank;
+   MPI_Comm_size(comm, &nTasks);
+   MPI_Comm_rank(comm, &myRank);
+   IndexToTuple indexToTuple(anatomy.nx(), anatomy.ny(), anatomy.nz());
+
+   // An empty box has lo > hi.
+   vector<GidBox> box(nTasks);
+   GidBox& myBox = box[myRank];
+   for (int kk=0; kk<3; ++kk)
+   {
+      myBox.lo[kk] = INT_MAX;
+      myBox.hi[kk] = INT_MIN;
+   }
+   for (unsigned ii=0; ii<anatomy.nLocal(); ++ii)
+   {
+      Tuple tt = indexToTuple(anatomy.gid(ii));
+      int xyz[3] = {tt.x(), tt.y(), tt.z()};
+      for (int kk=0; kk<3; ++kk)
+      {
+         myBox.lo[kk] = min(myBox.lo[kk], xyz[kk]);
+         myBox.hi[kk] = max(myBox.hi[kk], xyz[kk]);
+      }
+   }
+   allGather(box, comm);
+
+   // Bin the boxes on a coarse grid so that each record is only
+   // tested against the boxes that overlap its bin.
+   int nBin[3];
+   int gridSize[3] = {int(anatomy.nx()), int(anatomy.ny()), int(anatomy.nz())};
+   int nb = max(1, int(cbrt(double(nTasks))));
+   for (int kk=0; kk<3; ++kk)
+      nBin[kk] = min(nb, gridSize[kk]);
+   vector<vector<int> > binTasks(nBin[0]*nBin[1]*nBin[2]);
+   for (int iTask=0; iTask<nTasks; ++iTask)
+   {
+      const GidBox& bb = box[iTask];
+      if (bb.lo[0] > bb.hi[0])
+         continue;
+      int first[3], last[3];
+      for (int kk=0; kk<3; ++kk)
+      {
+         first[kk] = Long64(bb.lo[kk])*nBin[kk]/gridSize[kk];
+         last[kk] = Long64(bb.hi[kk])*nBin[kk]/gridSize[kk];
+      }
+      for (int iz=first[2]; iz<=last[2]; ++iz)
+         for (int iy=first[1]; iy<=last[1]; ++iy)
+            for (int ix=first[0]; ix<=last[0]; ++ix)
+               binTasks[ix + nBin[0]*(iy + nBin[1]*iz)].push_back(iTask);
+   }
+
+   unsigned nRecords = gid.size();
+   vector<vector<unsigned> > sendIndex(nTasks);
+   for (unsigned ii=0; ii<nRecords; ++ii)
+   {
+      Tuple tt = indexToTuple(gid[ii]);
+      int ib = Long64(tt.x())*nBin[0]/gridSize[0]
+         + nBin[0]*(Long64(tt.y())*nBin[1]/gridSize[1]
+                    + nBin[1]*(Long64(tt.z())*nBin[2]/gridSize[2]));
+      const vector<int>& candidates = binTasks[ib];
+      for (unsigned jj=0; jj<candidates.size(); ++jj)
+         if (box[candidates[jj]].contains(tt))
+            sendIndex[candidates[jj]].push_back(ii);
+   }
+
+   double volume[2] = {0, double(nRecords)};
+   for (int ii=0; ii<nTasks; ++ii)
+   {
+      volume[0] += sendIndex[ii].size();
+      if (sendIndex[ii].size() > INT_MAX)
+         volume[0] = 1e300;
+   }
+   MPI_Allreduce(MPI_IN_PLACE, volume, 2, MPI_DOUBLE, MPI_SUM, comm);
+   if (volume[0] > 2*volume[1])
+      return false;
+
+   unsigned itemSize = lRec + sizeof(Long64);
+   vector<int> sendCnt(nTasks), sendOff(nTasks+1, 0);
+   for (int ii=0; ii<nTasks; ++ii)
+   {
+      sendCnt[ii] = sendIndex[ii].size();
+      sendOff[ii+1] = sendOff[ii] + sendCnt[ii];
+   }
+   vector<unsigned char> sendBuf(size_t(sendOff[nTasks])*itemSize + 1);
+   for (int iTask=0; iTask<nTasks; ++iTask)
+   {
+      const vector<unsigned>& index = sendIndex[iTask];
+      int nSend = index.size();
+      #pragma omp parallel for
+      for (int jj=0; jj<nSend; ++jj)
+      {
+         unsigned char* to = &sendBuf[size_t(sendOff[iTask]+jj)*itemSize];
+         copyBytes(to, &gid[index[jj]], sizeof(Long64));
+         copyBytes(to+sizeof(Long64), &records[size_t(index[jj])*lRec], lRec);
+      }
+   }
+
+   vector<int> recvCnt(nTasks), recvOff(nTasks+1, 0);
+   MPI_Alltoall(&sendCnt[0], 1, MPI_INT, &recvCnt[0], 1, MPI_INT, comm);
+   for (int ii=0; ii<nTasks; ++ii)
+      recvOff[ii+1] = recvOff[ii] + recvCnt[ii];
+   vector<unsigned char> recvBuf(size_t(recvOff[nTasks])*itemSize + 1);
+
+   MPI_Datatype itemType;
+   MPI_Type_contiguous(itemSize, MPI_BYTE, &itemType);
+   MPI_Type_commit(&itemType);
+   MPI_Alltoallv(&sendBuf[0], &sendCnt[0], &sendOff[0], itemType,
+                 &recvBuf[0], &recvCnt[0], &recvOff[0], itemType, comm);
+   MPI_Type_free(&itemType);
+
+   unsigned nLocal = anatomy.nLocal();
+   unordered_map<Long64, unsigned> localIndex(2*nLocal);
+   for (unsigned ii=0; ii<nLocal; ++ii)
+      localIndex[anatomy.gid(ii)] = ii;
+
+   localRecords.resize(size_t(nLocal)*lRec);
+   int nRecv = recvOff[nTasks];
+   unsigned nFound = 0;
+   #pragma omp parallel for reduction(+:nFound)
+   for (int ii=0; ii<nRecv; ++ii)
+   {
+      const unsigned char* item = &recvBuf[size_t(ii)*itemSize];
+      Long64 gidRecv;
+      copyBytes(&gidRecv, item, sizeof(Long64));
+      unordered_map<Long64, unsigned>::const_iterator here = localIndex.find(gidRecv);
+      if (here == localIndex.end())
+         continue;
+      copyBytes(&localRecords[size_t(here->second)*lRec], item+sizeof(Long64), lRec);
+      ++nFound;
+   }
+   assert(nFound == nLocal);
+   return true;
+}
+
 BucketOfBits* loadAndDistributeState(const std::string& filename,
-                                    const Anatomy& anatomy)
+                                    const Anatomy& anatomy,
+                                    MPI_Comm comm)
 {
-   MPI_Comm comm = MPI_COMM_WORLD;
 
    vector<unsigned char> records;
    vector<Long64> gid;
@@ -356,6 +525,14 @@ BucketOfBits* loadAndDistributeState(const std::string& filename,
 
 
    
+   vector<unsigned char> localRecords;
+   if (sendRecordsToOwners(anatomy, gid, records, lRec, comm, localRecords))
+   {
+      for (unsigned ii=0; ii<anatomy.nLocal(); ++ii)
+         bucket->addRecord(string((char*) &localRecords[size_t(ii)*lRec], lRec));
+      return bucket;
+   }
+
    vector<unsigned> recordDest;
    vector<unsigned> requestDest;
    findDestinations(anatomy, gid, comm, // inputs
@@ -2,13 +2,15 @@
 #define STATE_LOADER_HH
 
 #include <string>
+#include <mpi.h>
 
 class BucketOfBits;
 class Anatomy;
 
 /** Caller must delete returned pointer */
 BucketOfBits* loadAndDistributeState(const std::string& filename,
-                                     const Anatomy& anatomy);
+                                     const Anatomy& anatomy,
+                                     MPI_Comm comm);
 
 
 #endif
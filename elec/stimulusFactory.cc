@@ -21,11 +21,13 @@ namespace
 }
 
 
-Stimulus* stimulusFactory(const std::string& name, const Anatomy& anatomy)
+Stimulus* stimulusFactory(const std::string& name, const Anatomy& anatomy,
+                          MPI_Comm comm)
 {
    OBJECT* obj = objectFind(name, "STIMULUS");
    string method;
    StimulusBaseParms p;
+   p.comm = comm;
    objectGet(obj, "method", method, "undefined");
    objectGet(obj, "t0", p.t0, "-1000", "t");
    objectGet(obj, "tf", p.tf, "1e30",  "t");
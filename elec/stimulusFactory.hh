@@ -2,9 +2,11 @@
 #define STIMULUS_FACTORY
 
 #include <string>
+#include <mpi.h>
 class Stimulus;
 class Anatomy;
 
-Stimulus* stimulusFactory(const std::string& name, const Anatomy& anatomy);
+Stimulus* stimulusFactory(const std::string& name, const Anatomy& anatomy,
+                          MPI_Comm comm);
 
 #endif
@@ -18,6 +18,7 @@
 #include <cassert>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 
@@ -80,12 +81,38 @@ static const char* interpName[] = {
          }
       }
 
+      if (reactionPrefitting())
+      {
+         if (reusingInterpolants || funcCount == 0)
+         {
+            delete reaction;
+            return NULL;
+         }
+         // The worker owns the parameterized model from here on.  It
+         // can't call MPI, so it gets the rank from here.
+         int myRank = getRank(0);
+         startInterpolantFit(obj->name, _dt, [reaction, _dt, funcCount, myRank]()
+         {
+            reaction->createInterpolants(_dt, myRank);
+            InterpolantSet fit(reaction->_interpolant, reaction->_interpolant+funcCount);
+            delete reaction;
+            return fit;
+         });
+         return NULL;
+      }
+
       if (!reusingInterpolants)
       {
-      reaction->createInterpolants(_dt);
+      InterpolantSet fit;
+      bool newFit = finishInterpolantFit(obj->name, _dt, fit, [reaction, _dt, funcCount]()
+      {
+         reaction->createInterpolants(_dt, getRank(0));
+         return InterpolantSet(reaction->_interpolant, reaction->_interpolant+funcCount);
+      });
+      copy(fit.begin(), fit.end(), reaction->_interpolant);
 
-      //save the interpolants
-      if (funcCount > 0 && getRank(0) == 0)
+      //save the interpolants, once for all the pieces of the task loop
+      if (newFit && funcCount > 0 && getRank(0) == 0)
       {
          ofstream outfile((string(obj->name) +".fit.data").c_str());
          outfile.precision(16);
@@ -124,7 +151,7 @@ static const char* interpName[] = {
 namespace sundnes_et_al_2016_FHN 
 {
 
-void ThisReaction::createInterpolants(const double _dt) {
+void ThisReaction::createInterpolants(const double _dt, const int myRank) {
 
 }
 
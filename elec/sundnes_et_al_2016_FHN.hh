@@ -35,7 +35,7 @@ namespace sundnes_et_al_2016_FHN
       ThisReaction(const int numPoints, const double __dt);
       std::string methodName() const;
       
-      void createInterpolants(const double _dt);
+      void createInterpolants(const double _dt, const int myRank);
       //void updateNonGate(double dt, const VectorDouble32&Vm, VectorDouble32&dVR);
       //void updateGate   (double dt, const VectorDouble32&Vm) ;
       virtual void getCheckpointInfo(std::vector<std::string>& fieldNames,
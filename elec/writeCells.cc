@@ -18,16 +18,16 @@ using namespace std;
 /** Writes all the cells in the cell array. */
 void writeCells(const vector<AnatomyCell>& cells,
                 int nx, int ny, int nz,
-                const std::string& filename)
+                const std::string& filename, MPI_Comm comm)
 {
    int myRank;
-   MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+   MPI_Comm_rank(comm, &myRank);
 
    Long64 nLocal = cells.size();
    Long64 nGlobal;
-   MPI_Allreduce(&nLocal, &nGlobal, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+   MPI_Allreduce(&nLocal, &nGlobal, 1, MPI_LONG_LONG, MPI_SUM, comm);
    
-   PFILE* file = Popen(filename.c_str(), "w", MPI_COMM_WORLD);
+   PFILE* file = Popen(filename.c_str(), "w", comm);
 
    char fmt[] = "%12llu %4u %8u";
    int lRec = 27;
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <mpi.h>
 class Simulate;
 class AnatomyCell;
 
@@ -15,6 +16,6 @@ class AnatomyCell;
 // of them into the file producing a file with duplicate cells.
 void writeCells(const std::vector<AnatomyCell>& cells,
                 int nx, int ny, int nz,
-                const std::string& filename);
+                const std::string& filename, MPI_Comm comm);
 
 #endif
@@ -99,26 +99,32 @@ void orient(DenseMatrix& Qp, DenseMatrix& Q, double a, double b){
        
 }
 
-double quatdot(Vector &q1, Vector &q2){
-    MFEM_ASSERT(q1.Size()==4, "quatdot Dimension of quaternion1 should be 4");
-    MFEM_ASSERT(q2.Size()==4, "quatdot Dimension of quaternion2 should be 4");
+// Quaternions are double[4] (w, x, y, z) on the stack.  bislerp is
+// called up to twice per vertex and mfem Vectors would allocate on
+// every call.  The fixed length loops are left to the compiler to
+// vectorize.
+double quatdot(const double *q1, const double *q2){
     double sum=0.0;
-    for(int i=0; i<q1.Size(); i++){
-        sum=sum+q1(i)*q2(i);
+    for(int i=0; i<4; i++){
+        sum=sum+q1[i]*q2[i];
     }    
     return sum;
 }
 
-void quatNormalized(Vector &q){
-    double sum=0.0;
-    for(int i=0; i<q.Size(); i++){
-        sum=sum+q(i)*q(i);
-    } 
-    q/=(sqrt(sum));    
+bool quatisnorm(const double *q){
+    double sum=quatdot(q, q);
+    return (sum>0.99 && sum <=1.01);
 }
 
-void rot2quat(Vector &q, DenseMatrix& Q){
-    q.SetSize(4); // quaternion q=w+x*i+y*j+z*k
+void quatNormalized(double *q){
+    double scale=1.0/sqrt(quatdot(q, q));
+    for(int i=0; i<4; i++){
+        q[i]*=scale;
+    }
+}
+
+void rot2quat(double *q, DenseMatrix& Q){
+    // quaternion q=w+x*i+y*j+z*k
     double M11=Q(0,0);
     double M21=Q(1,0);
     double M31=Q(2,0);
@@ -133,53 +139,45 @@ void rot2quat(Vector &q, DenseMatrix& Q){
     double error=0.000001;
     if(w2>error){
         double w=sqrt(w2);
-        q(0)=w;
+        q[0]=w;
         double wq=4*w;
-        q(1)=(M23-M32)/wq;  //x
-        q(2)=(M31-M13)/wq;  //y
-        q(3)=(M12-M21)/wq;  //z
+        q[1]=(M23-M32)/wq;  //x
+        q[2]=(M31-M13)/wq;  //y
+        q[3]=(M12-M21)/wq;  //z
     }else{
-        q(0)=0; //w
+        q[0]=0; //w
         double x2=-0.5*(M22+M33);
         if(x2>error){
             double x=sqrt(x2);
-            q(1)=x;
-            q(2)=M12/(2*x); //y
-            q(3)=M13/(2*x); //z
+            q[1]=x;
+            q[2]=M12/(2*x); //y
+            q[3]=M13/(2*x); //z
         }else{
-            q(1)=0; //x
+            q[1]=0; //x
             double y2=0.5*(1-M33);
             if(y2>error){
                 double y=sqrt(y2);
-                q(2)=y;
-                q(3)=M23/(2*y); //z
+                q[2]=y;
+                q[3]=M23/(2*y); //z
             }else{
-                q(2)=0; // y
-                q(3)=1; // z
+                q[2]=0; // y
+                q[3]=1; // z
             }
             
         }
         
     }
-    if(!vecisnorm(q)){
-        //cout << "Warning rot2quat: quaternion is not normalized" << endl;
+    if(!quatisnorm(q)){
         // This matrix to quaternion method is numerical instable when w is small.
         quatNormalized(q);
     }
-//    quatNormalized(q);
-//    for(int i=0; i <q.Size(); i++){
-//        cout << q(i) << endl;
-//    }
-//    MFEM_ASSERT(vecisnorm(q), "rot2quat: quaternion is not normalized");
 }
 
-void quat2rot(DenseMatrix& Q, Vector &q){
-    MFEM_ASSERT(q.Size()==4, "quat2rot: Dimension of quaternion should be 4");
-    //MFEM_ASSERT(vecisnorm(q), "quat2rot: quaternion is not normalized");
-    double w=q(0);
-    double x=q(1);
-    double y=q(2);
-    double z=q(3);
+void quat2rot(DenseMatrix& Q, const double *q){
+    double w=q[0];
+    double x=q[1];
+    double y=q[2];
+    double z=q[3];
     
     double x2=x*x;
     double y2=y*y;
@@ -206,85 +204,62 @@ void quat2rot(DenseMatrix& Q, Vector &q){
 }
 
 
-void slerp(Vector &q, Vector &q1, Vector &q2, double t) {
+void slerp(double *q, const double *q1, const double *q2, double t) {
     double dot = quatdot(q1, q2);
-    Vector q3=q2;
+    double q3[4];
+    double sign = 1;
     if (dot < 0) {
         dot = -dot;
-        //MFEM_ASSERT(dot>=0 && dot<=1, "slerp: dot is not in the range from 0 to 1");
-        q3.Neg();
+        sign = -1;
     } 
+    for(int i=0; i<4; i++){
+        q3[i]=sign*q2[i];
+    }
     
-//    if(dot>1){
-//        cout << "slerp: Warning: dot is " << dot << ", use linear interpolation. "<< endl;
-//    }
-    
+    double a, b;
     if (dot < 0.9999) {
         double angle = acos(dot);
-        double a=sin(angle * (1 - t))/sin(angle);
-        double b=sin(angle * t) / sin(angle);
-        add(a, q1, b, q3, q); //q = (q1 * sin(angle * (1 - t)) + q2 * sin(angle * t)) / sin(angle);
-        //MFEM_ASSERT(vecisnorm(q), "slerp: quaternion is not normalized");
+        a=sin(angle * (1 - t))/sin(angle);
+        b=sin(angle * t) / sin(angle);
     } else { // if the angle is small dot>0.999, use linear interpolation								
-        add((1-t), q1, t, q3, q); //q=q1*(1-t)+q2*t;
-        
+        a=1-t;
+        b=t;
     }	
-//    quatNormalized(q);
+    //q = (q1 * sin(angle * (1 - t)) + q2 * sin(angle * t)) / sin(angle);
+    for(int i=0; i<4; i++){
+        q[i]=a*q1[i]+b*q3[i];
+    }
 }
 
 void bislerp(DenseMatrix& Q, DenseMatrix& Qa, DenseMatrix& Qb, double t){    
-    Vector qa;
+    double qa[4];
     rot2quat(qa, Qa);
-    Vector qb;
+    double qb[4];
     rot2quat(qb, Qb);
-    double a=qa(0);
-    double b=qa(1);
-    double c=qa(2);
-    double d=qa(3);
+    double a=qa[0];
+    double b=qa[1];
+    double c=qa[2];
+    double d=qa[3];
    
-    vector<Vector> qavec;
-    Vector qa1(4);    
-    qa1(0)=a;
-    qa1(1)=b;
-    qa1(2)=c;
-    qa1(3)=d;
-    qavec.push_back(qa1);
+    // qa times i, j and k
+    const double qavec[4][4]={
+        { a,  b,  c,  d},
+        {-b,  a, -d,  c},
+        {-c,  d,  a, -b},
+        {-d, -c,  b,  a}};
     
-    Vector qa2(4);    
-    qa2(0)=-b;
-    qa2(1)=a;
-    qa2(2)=-d;
-    qa2(3)=c;
-    qavec.push_back(qa2); 
- 
-    Vector qa3(4);    
-    qa3(0)=-c;
-    qa3(1)=d;
-    qa3(2)=a;
-    qa3(3)=-b;
-    qavec.push_back(qa3); 
-    
-    Vector qa4(4);    
-    qa4(0)=-d;
-    qa4(1)=-c;
-    qa4(2)=b;
-    qa4(3)=a;
-    qavec.push_back(qa4);   
-    
-    Vector qm(4);
+    int imax=0;
     double maxdot=-1;
-    for(unsigned i=0; i<qavec.size(); i++){
-        Vector qai=qavec[i];
-        //MFEM_ASSERT(vecisnorm(qai), "bislerp: quaternion qai is not normalized");
-        double dot=abs(quatdot(qai, qb));
+    for(int i=0; i<4; i++){
+        double dot=abs(quatdot(qavec[i], qb));
         if(maxdot<dot){
             maxdot=dot;
-            qm=qai;
+            imax=i;
         }     
     }
     
-    Vector qab(4);
-    slerp(qab, qm, qb, t);
+    double qab[4];
+    slerp(qab, qavec[imax], qb, t);
     quat2rot(Q, qab);
     
 }
@@ -467,8 +442,13 @@ void genfiber(vector<DenseMatrix>& QPfibVectors,
         ){
     
     unsigned nv=psi_ab.size();
+    unsigned first=QPfibVectors.size();
+    QPfibVectors.resize(first+nv, DenseMatrix(dim,dim));
     // Line 7 start for-loop
-    for(unsigned i=0; i <nv; i++){  
+    // The vertices are independent.  The cost per vertex depends on
+    // which gradients are zero, hence the dynamic schedule.
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for(int i=0; i <(int)nv; i++){  
 //        MFEM_ASSERT(phi_lv[i]>=0 && phi_lv[i] <=1, "phi_lv is not in range 0 to 1");
 //        MFEM_ASSERT(phi_rv[i]>=0 && phi_rv[i] <=1, "phi_rv is not in range 0 to 1");
 //        MFEM_ASSERT(phi_epi[i]>=0 && phi_epi[i] <=1, "phi_epi is not in range 0 to 1");
@@ -478,15 +458,10 @@ void genfiber(vector<DenseMatrix>& QPfibVectors,
         //if(phi_epi[i] <0) phi_epi[i]=0;
         //if(psi_ab[i] <0) psi_ab[i]=0;
 
-        Vector psi_ab_vec=psi_ab_grads[i];
-        Vector phi_lv_vec=phi_lv_grads[i];
-        Vector phi_rv_vec=phi_rv_grads[i];
-        Vector phi_epi_vec=phi_epi_grads[i];
-        DenseMatrix QPfib(dim,dim);
-        
-        biSlerpCombo(QPfib, psi_ab[i], psi_ab_vec, phi_epi[i], phi_epi_vec, phi_lv[i], phi_lv_vec, phi_rv[i], phi_rv_vec, options);
+        // biSlerpCombo only reads the gradients, so they are not copied.
+        biSlerpCombo(QPfibVectors[first+i], psi_ab[i], psi_ab_grads[i], phi_epi[i], phi_epi_grads[i], 
+                phi_lv[i], phi_lv_grads[i], phi_rv[i], phi_rv_grads[i], options);
 
-        QPfibVectors.push_back(QPfib);
 //        vector<Vector> qpVecs;
 //        for(int j=0; j<dim; j++){
 //            Vector vec;
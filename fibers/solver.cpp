@@ -160,41 +160,58 @@ void getVetecesGradients(Mesh *mesh, GridFunction& x, vector<vector<int> >& vert
     }
     
     const FiniteElementSpace *fes=x.FESpace();
-    unsigned nv = fes->GetNV();
-    for (unsigned i = 0; i < nv; i++) {
-        vector<int> elements = vert2Elements[i];
-        Vector grad(3);
-        Vector grad_ele(3);
-        grad=0.0;
-        stringstream msg;
-        msg << "laplace : vertex[" << i << "] size is zero";
-        MFEM_ASSERT(elements.size()!=0, msg.str());
-        for (unsigned j = 0; j < elements.size(); j++) {
-            ElementTransformation * tr = fes->GetElementTransformation(elements[j]);
-            const IntegrationRule &ir = fes->GetFE(elements[j])->GetNodes();  // Get the parametric integration rule
-            grad_ele= 0.0;
+    int nv = fes->GetNV();
+    int ne = fes->GetNE();
+
+    // Average gradient over the nodes of each element.  Each element is
+    // done once here instead of once for every one of its vertices.
+    vector<double> eleGrads(3*ne);
+#ifdef MFEM_THREAD_SAFE
+    // Otherwise the finite elements keep their scratch space in members
+    // and GetGradient can't be called from several threads.
+    #pragma omp parallel
+#endif
+    {
+        IsoparametricTransformation tr;
+        Vector grad_point(3);
+        #pragma omp for schedule(static)
+        for (int e = 0; e < ne; e++) {
+            fes->GetElementTransformation(e, &tr);
+            const IntegrationRule &ir = fes->GetFE(e)->GetNodes();  // Get the parametric integration rule
+            double *grad_ele = &eleGrads[3*e];
+            grad_ele[0] = grad_ele[1] = grad_ele[2] = 0.0;
             for (int k=0; k < ir.GetNPoints(); k++) {
-               Vector grad_point(3);
                grad_point = 0.0;
                const IntegrationPoint &ip = ir.IntPoint(k); // Get the current integration point
-               tr->SetIntPoint(&ip); // Set the integration point for the transformation
-               x.GetGradient((*tr), grad_point);
-               grad_ele += grad_point;
+               tr.SetIntPoint(&ip); // Set the integration point for the transformation
+               x.GetGradient(tr, grad_point);
+               for (int d = 0; d < 3; d++) {
+                  grad_ele[d] += grad_point(d);
+               }
+            }
+            double scale = 1.0/ir.GetNPoints();
+            for (int d = 0; d < 3; d++) {
+               grad_ele[d] *= scale;
             }
-            grad_ele /= ir.GetNPoints();
-            grad+=grad_ele;
         }
-        grad/=elements.size();
-        gradients.push_back(grad);
-
-//        if (i < 5) {
-//            cout << "grad ";
-//            for (int j = 0; j < grad.Size(); j++) {
-//                cout << grad[j] << " ";
-//            }
-//            cout << endl;
-//        }
+    }
 
+    // Project to the vertices: average over the elements of each vertex.
+    unsigned first = gradients.size();
+    gradients.resize(first + nv, Vector(3));
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < nv; i++) {
+        const vector<int>& elements = vert2Elements[i];
+        MFEM_ASSERT(elements.size()!=0, "laplace : vertex[" << i << "] size is zero");
+        Vector& grad = gradients[first + i];
+        grad = 0.0;
+        for (unsigned j = 0; j < elements.size(); j++) {
+            const double *grad_ele = &eleGrads[3*elements[j]];
+            for (int d = 0; d < 3; d++) {
+                grad(d) += grad_ele[d];
+            }
+        }
+        grad/=elements.size();
     }
 
     // 12. Save the refined mesh and the solution. This output can be viewed later
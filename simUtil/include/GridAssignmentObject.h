@@ -52,6 +52,20 @@ void gao_destroy(GRID_ASSIGNMENT_OBJECT* gao);
 
 int gao_nearestCenter(GRID_ASSIGNMENT_OBJECT* gao, const THREE_VECTOR r);
 
+/** Finds the nearest center for each of nPoints points.  The points
+ *  are THREE_VECTORs located stride bytes apart starting at rP.  The
+ *  index of the nearest center of point ii is stored in nearest[ii].
+ *  Ties are broken in favor of the lowest center index, so the result
+ *  is the same as calling gao_nearestCenter for each point.
+ *
+ *  The points are sorted by grid cell and every cell is a batch.  A
+ *  list of candidate centers sorted by their distance from the
+ *  bounding box of the batch is built once and shared by all points in
+ *  the batch.  Batches are processed in an OpenMP loop. */
+void gao_nearestCenters(const GRID_ASSIGNMENT_OBJECT* gao,
+                        int nPoints, const void* rP, int stride,
+                        int* nearest);
+
 
 #ifdef __cplusplus
 }
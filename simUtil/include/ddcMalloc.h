@@ -5,6 +5,9 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
 
 struct pfile_st; // avoid including pio.h
 
@@ -38,11 +41,42 @@ extern "C"{
 
 #endif
 
+/** Every tracked block is charged to the tag that is current on the
+ *  allocating thread.  Callers set the tag around the code that owns
+ *  the memory (see DdcMemTagScope).  realloc keeps the original tag. */
+enum DDCMEM_TAG
+{
+   DDCMEM_OTHER,
+   DDCMEM_ANATOMY,
+   DDCMEM_DIFFUSION,
+   DDCMEM_REACTION,
+   DDCMEM_HALO,
+   DDCMEM_IO,
+   DDCMEM_NTAGS
+};
+
 void ddcMemSetVerbose(int task);
 void ddcMemInit(void);
 void ddcMemSummary(FILE*);
 void ddcMemReport(FILE*);
 
+/** Sets the tag for the calling thread and returns the previous tag. */
+int  ddcMemSetTag(int tag);
+int  ddcMemGetTag(void);
+const char* ddcMemTagName(int tag);
+/** Current, peak, and at-peak usage for each tag on this task. */
+void ddcMemTagSummary(FILE*);
+#ifdef WITH_MPI
+/** Collective on comm.  Reports which tags set the memory high-water
+ *  mark on each node. */
+void ddcMemTagReport(MPI_Comm comm, FILE*);
+#endif
+
+/** Add or remove memory that was not allocated by ddcMalloc (for
+ *  example by a C++ allocator) to the block table. */
+void ddcMemTrack(void* ptr, size_t size, const char* location);
+void ddcMemUntrack(void* ptr);
+
 void ddcMemSummary_pio(struct pfile_st*);
 void ddcMemReport_pio(struct pfile_st*);
 void freeNull(void **ptr) ;
@@ -58,6 +92,19 @@ char* _ddcLine(const char* file, int lineNum);
 
 #ifdef __cplusplus
 }
+
+/** Sets the ddcMalloc tag for the calling thread for the lifetime of
+ *  the object. */
+class DdcMemTagScope
+{
+ public:
+   explicit DdcMemTagScope(int tag) : oldTag_(ddcMemSetTag(tag)) {}
+   ~DdcMemTagScope() {ddcMemSetTag(oldTag_);}
+ private:
+   DdcMemTagScope(const DdcMemTagScope&);
+   DdcMemTagScope& operator=(const DdcMemTagScope&);
+   int oldTag_;
+};
 #endif
 
 #endif
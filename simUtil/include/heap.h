@@ -61,6 +61,18 @@ extern "C" {
  *      idea that the scratch heap is temporary storage that must be
  *      released when a module goes out of scope.  It will also prevent
  *      fragmentation of the heap.
+ *
+ *  Each thread has its own scratch heap (an arena).  The rules above
+ *  apply separately to each thread, so threads can use the heap
+ *  concurrently without coordinating with each other.  A block must be
+ *  ended and freed by the thread that got it.
+ *
+ *  The heap is not a fixed size.  It is made of chunks obtained from
+ *  the OS (huge page backed when available) and heapGrow moves an open
+ *  block to a new, larger chunk when the caller runs out of space.
+ *  Since the block may move, heapGrow returns the new location and any
+ *  pointers into the old location are invalid after the call.
+ *  heap_allocate (and heap_start) only set the size of the first chunk.
  */
    
 typedef struct heap_st
@@ -86,14 +98,20 @@ void heap_setVerbse(int flag);
 #define heapFree(blockNumber) _heapFree(blockNumber, __FILE__, __LINE__)
 #define heapEndBlock(blockNumber, blockSize) _heapEndBlock(blockNumber, blockSize, __FILE__, __LINE__)
 #define heapTestAvailable(blockNumber, blockSize) _heapTestAvailable(blockNumber, blockSize, __FILE__, __LINE__)
+#define heapGrow(blockNumber, used, blockSize) _heapGrow(blockNumber, used, blockSize, __FILE__, __LINE__)
    
 void* _heapGet(unsigned *blockNumber, char* file, int line);
 void  _heapFree(unsigned blockNumber, const char* file, int line);
 void  _heapEndBlock(unsigned blockNumber, size_t size, const char* file, int line);
 void  _heapTestAvailable(unsigned blockNumber, size_t size, const char* file, int line);
+/** Ensures the open block has room for size bytes and returns its
+ *  (possibly new) start.  The first used bytes of the block are
+ *  preserved. */
+void* _heapGrow(unsigned blockNumber, size_t used, size_t size, const char* file, int line);
 size_t heapAvailable(void);
 
-/** Returns total size of heap. (I.e., the size that was allocated.) */
+/** Returns total size of the calling thread's heap. (I.e., the size
+ *  of all chunks that were allocated.) */
 size_t  heapSize(void);
 
 /** Returns the size of the specified block.  If heapEndBlock has not
@@ -121,12 +139,10 @@ void heapSummary(FILE* file);
 //     be interprested as a regular expression that would match
 //     task numbers?  How can we use task numbers without introducing
 //     MPI into this module?
-// 2.  How concerned should we be about the fact that basename isn't
-//     re-entrant?
-// 3.  Code for verbose tracking isn't written
-// 4.  Error messages don't report task number.
-// 5.  Better way to die than MPI_Abort
-// 6.  heapAlreadyAllocatedWarning doesn't do anything.
+// 2.  Code for verbose tracking isn't written
+// 3.  Error messages don't report task number.
+// 4.  Better way to die than MPI_Abort
+// 5.  heapAlreadyAllocatedWarning doesn't do anything.
 
 
 
@@ -85,10 +85,14 @@ typedef struct pfile_st
 	MPI_Comm comm;
 } PFILE;
 
-/** When writing data pio requires a scratch heap large enough to hold
- *  the output message plus the mpi buffer to recive that message on the
- *  writer task.  So, allocate a scratch heap at least twice the size of
- *  the maximum data written per task.
+/** When writing data pio uses the scratch heap to hold the output
+ *  message plus the mpi buffer to recive that message on the writer
+ *  task.  The heap grows as needed, so it need not be sized for the
+ *  maximum data written per task.  The heap is per thread, so a file
+ *  opened for writing must be written and closed by the same thread.
+ *  Pwrite and Pclose make MPI calls, so writing files from several
+ *  threads at once also needs MPI initialized with
+ *  MPI_THREAD_MULTIPLE and a communicator per file.
  *
  *  When reading data pio does not require a scratch heap (it gets
  *  memory from malloc).
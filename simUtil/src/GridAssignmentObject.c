@@ -2,6 +2,9 @@
 
 #include <assert.h>
 #include <math.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "three_algebra.h"
 #include "ddcMalloc.h"
@@ -17,6 +20,25 @@ static double minDist2(const GRID_ASSIGNMENT_OBJECT* this, const THREE_VECTOR r,
 static void addTupleToQueue(GRID_ASSIGNMENT_OBJECT*this, THREE_INT iTuple);
 static void addNbrsToQueue(GRID_ASSIGNMENT_OBJECT* this, int iCell);
 
+typedef struct GaoCandidate_st
+{
+   double key;
+   int index;
+}
+GAO_CANDIDATE;
+
+typedef struct GaoCandidateList_st
+{
+   GAO_CANDIDATE* list;
+   int size;
+   int capacity;
+}
+GAO_CANDIDATE_LIST;
+
+static void buildCandidates(const GRID_ASSIGNMENT_OBJECT* this, int iCell,
+                            THREE_VECTOR lo, THREE_VECTOR hi,
+                            GAO_CANDIDATE_LIST* candidates);
+
 /** The present implementation of GRID_ASSIGNMENT_OBJECT is judged to be
  *  sufficiently fast to meet the needs of initial assignment of 
  *  particles to domains.  The best way to speed up the code would be to
@@ -102,6 +124,7 @@ void gao_destroy(GRID_ASSIGNMENT_OBJECT* this)
    intQueue_destroy(this->burnList);
    intQueue_destroy(this->floodQueue);
    ddcFree(this->nextCenter);
+   ddcFree(this);
 }
 
 int gao_nearestCenter(GRID_ASSIGNMENT_OBJECT* this, const THREE_VECTOR r)
@@ -145,6 +168,109 @@ int gao_nearestCenter(GRID_ASSIGNMENT_OBJECT* this, const THREE_VECTOR r)
    return minCenter;
 }
 
+
+void gao_nearestCenters(const GRID_ASSIGNMENT_OBJECT* this,
+                        int nPoints, const void* rP, int stride,
+                        int* nearest)
+{
+   if (nPoints <= 0)
+      return;
+   
+   // counting sort of the points by grid cell
+   int nCells = this->nx * this->ny * this->nz;
+   int* pointCell = ddcMalloc(nPoints*sizeof(int));
+   int* cellStart = ddcMalloc((nCells+1)*sizeof(int));
+   int* order = ddcMalloc(nPoints*sizeof(int));
+   for (int ii=0; ii<=nCells; ++ii)
+      cellStart[ii] = 0;
+   for (int ii=0; ii<nPoints; ++ii)
+   {
+      THREE_VECTOR r = *(const THREE_VECTOR*)(((const char*)rP) + ii*stride);
+      pointCell[ii] = whichCell(this, r);
+      ++cellStart[pointCell[ii]+1];
+   }
+   for (int ii=0; ii<nCells; ++ii)
+      cellStart[ii+1] += cellStart[ii];
+   {
+      int* next = ddcMalloc(nCells*sizeof(int));
+      memcpy(next, cellStart, nCells*sizeof(int));
+      for (int ii=0; ii<nPoints; ++ii)
+         order[next[pointCell[ii]]++] = ii;
+      ddcFree(next);
+   }
+
+   // list of non-empty cells.  These are the batches.
+   int nBatch = 0;
+   int* batch = ddcMalloc(nCells*sizeof(int));
+   for (int ii=0; ii<nCells; ++ii)
+      if (cellStart[ii+1] > cellStart[ii])
+         batch[nBatch++] = ii;
+
+   #pragma omp parallel
+   {
+      GAO_CANDIDATE_LIST candidates;
+      candidates.size = 0;
+      candidates.capacity = 64;
+      candidates.list = malloc(candidates.capacity*sizeof(GAO_CANDIDATE));
+      
+      #pragma omp for schedule(dynamic, 8)
+      for (int iBatch=0; iBatch<nBatch; ++iBatch)
+      {
+         int iCell = batch[iBatch];
+         int begin = cellStart[iCell];
+         int end = cellStart[iCell+1];
+
+         // Points outside the grid are clamped to the boundary cells
+         // so use the bounding box of the points, not the cell.
+         THREE_VECTOR lo = *(const THREE_VECTOR*)(((const char*)rP) + order[begin]*stride);
+         THREE_VECTOR hi = lo;
+         for (int jj=begin+1; jj<end; ++jj)
+         {
+            THREE_VECTOR r = *(const THREE_VECTOR*)(((const char*)rP) + order[jj]*stride);
+            lo.x = MIN(lo.x, r.x); hi.x = MAX(hi.x, r.x);
+            lo.y = MIN(lo.y, r.y); hi.y = MAX(hi.y, r.y);
+            lo.z = MIN(lo.z, r.z); hi.z = MAX(hi.z, r.z);
+         }
+
+         buildCandidates(this, iCell, lo, hi, &candidates);
+         const GAO_CANDIDATE* list = candidates.list;
+         int nCandidates = candidates.size;
+
+         for (int jj=begin; jj<end; ++jj)
+         {
+            int iPoint = order[jj];
+            THREE_VECTOR r = *(const THREE_VECTOR*)(((const char*)rP) + iPoint*stride);
+            double r2Min = DBL_MAX;
+            int minCenter = -1;
+            for (int kk=0; kk<nCandidates; ++kk)
+            {
+               // candidates are sorted by a lower bound of their
+               // distance to any point in the batch.
+               if (list[kk].key > r2Min)
+                  break;
+               int iCenter = list[kk].index;
+               THREE_VECTOR rCenter =
+                  *(const THREE_VECTOR*)(((const char*)this->centerP) + iCenter*this->stride);
+               double r2 = DIFFSQ(r, rCenter);
+               if (r2 < r2Min || (r2 == r2Min && iCenter < minCenter))
+               {
+                  r2Min = r2;
+                  minCenter = iCenter;
+               }
+            }
+            assert(minCenter >= 0);
+            nearest[iPoint] = minCenter;
+         }
+      }
+      free(candidates.list);
+   }
+
+   ddcFree(batch);
+   ddcFree(order);
+   ddcFree(cellStart);
+   ddcFree(pointCell);
+}
+
       
 THREE_INT whichCellTuple(const GRID_ASSIGNMENT_OBJECT* this, const THREE_VECTOR r)
 {
@@ -224,3 +350,102 @@ void addNbrsToQueue(GRID_ASSIGNMENT_OBJECT* this, int iCell)
    iTuple.z += 1;
 }
 
+static int compareCandidates(const void* a, const void* b)
+{
+   const GAO_CANDIDATE* ca = (const GAO_CANDIDATE*) a;
+   const GAO_CANDIDATE* cb = (const GAO_CANDIDATE*) b;
+   if (ca->key < cb->key) return -1;
+   if (ca->key > cb->key) return 1;
+   return ca->index - cb->index;
+}
+
+static double boxDist2(THREE_VECTOR lo, THREE_VECTOR hi, THREE_VECTOR r)
+{
+   double x = MAX(0, MAX(lo.x - r.x, r.x - hi.x));
+   double y = MAX(0, MAX(lo.y - r.y, r.y - hi.y));
+   double z = MAX(0, MAX(lo.z - r.z, r.z - hi.z));
+   return x*x + y*y + z*z;
+}
+
+static double boxMaxDist2(THREE_VECTOR lo, THREE_VECTOR hi, THREE_VECTOR r)
+{
+   double x = MAX(fabs(r.x - lo.x), fabs(r.x - hi.x));
+   double y = MAX(fabs(r.y - lo.y), fabs(r.y - hi.y));
+   double z = MAX(fabs(r.z - lo.z), fabs(r.z - hi.z));
+   return x*x + y*y + z*z;
+}
+
+static void pushCandidate(GAO_CANDIDATE_LIST* candidates, double key, int index)
+{
+   if (candidates->size == candidates->capacity)
+   {
+      candidates->capacity *= 2;
+      candidates->list = realloc(candidates->list, candidates->capacity*sizeof(GAO_CANDIDATE));
+   }
+   candidates->list[candidates->size].key = key;
+   candidates->list[candidates->size].index = index;
+   ++candidates->size;
+}
+
+/** Collects every center that could be the nearest center of some
+ *  point in the box [lo, hi], sorted by the minimum distance from the
+ *  box to the center.  Any one center gives an upper bound U of the
+ *  nearest distance for all points in the box: its maximum distance
+ *  from the box.  So we first grow shells of grid cells around iCell
+ *  until we find a center and then keep every center within U of the
+ *  box. */
+void buildCandidates(const GRID_ASSIGNMENT_OBJECT* this, int iCell,
+                     THREE_VECTOR lo, THREE_VECTOR hi,
+                     GAO_CANDIDATE_LIST* candidates)
+{
+   THREE_INT c = indexToTuple(this, iCell);
+   double u2 = DBL_MAX;
+   int maxShell = MAX(this->nx, MAX(this->ny, this->nz));
+   for (int kk=0; kk<=maxShell && u2 == DBL_MAX; ++kk)
+   {
+      int x0 = MAX(0, c.x-kk), x1 = MIN(this->nx-1, c.x+kk);
+      int y0 = MAX(0, c.y-kk), y1 = MIN(this->ny-1, c.y+kk);
+      int z0 = MAX(0, c.z-kk), z1 = MIN(this->nz-1, c.z+kk);
+      for (int iz=z0; iz<=z1; ++iz)
+         for (int iy=y0; iy<=y1; ++iy)
+            for (int ix=x0; ix<=x1; ++ix)
+            {
+               THREE_INT t = {ix, iy, iz};
+               for (int iCenter = this->grid[tupleToIndex(this, t)].first;
+                    iCenter >= 0; iCenter = this->nextCenter[iCenter])
+               {
+                  THREE_VECTOR rCenter =
+                     *(const THREE_VECTOR*)(((const char*)this->centerP) + iCenter*this->stride);
+                  u2 = MIN(u2, boxMaxDist2(lo, hi, rCenter));
+               }
+            }
+   }
+   assert(u2 < DBL_MAX);
+
+   // Centers are binned with rounding so pad the range by one cell.
+   double u = sqrt(u2);
+   int x0 = MAX(0,          (int)floor((lo.x - u - this->corner.x)/this->dx) - 1);
+   int x1 = MIN(this->nx-1, (int)floor((hi.x + u - this->corner.x)/this->dx) + 1);
+   int y0 = MAX(0,          (int)floor((lo.y - u - this->corner.y)/this->dy) - 1);
+   int y1 = MIN(this->ny-1, (int)floor((hi.y + u - this->corner.y)/this->dy) + 1);
+   int z0 = MAX(0,          (int)floor((lo.z - u - this->corner.z)/this->dz) - 1);
+   int z1 = MIN(this->nz-1, (int)floor((hi.z + u - this->corner.z)/this->dz) + 1);
+
+   candidates->size = 0;
+   for (int iz=z0; iz<=z1; ++iz)
+      for (int iy=y0; iy<=y1; ++iy)
+         for (int ix=x0; ix<=x1; ++ix)
+         {
+            THREE_INT t = {ix, iy, iz};
+            for (int iCenter = this->grid[tupleToIndex(this, t)].first;
+                 iCenter >= 0; iCenter = this->nextCenter[iCenter])
+            {
+               THREE_VECTOR rCenter =
+                  *(const THREE_VECTOR*)(((const char*)this->centerP) + iCenter*this->stride);
+               double key = boxDist2(lo, hi, rCenter);
+               if (key <= u2)
+                  pushCandidate(candidates, key, iCenter);
+            }
+         }
+   qsort(candidates->list, candidates->size, sizeof(GAO_CANDIDATE), compareCandidates);
+}
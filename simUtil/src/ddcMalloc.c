@@ -8,6 +8,8 @@
 #include <assert.h>
 #include <libgen.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
 #ifndef __APPLE__
 #include <malloc.h>
 #endif
@@ -17,10 +19,9 @@
 #endif
 
 
-static int addBlock(void* ptr, size_t size, char* location);
-static int updateBlock(void* old_ptr, void* new_ptr, size_t size, char* location);
+static int addBlock(void* ptr, size_t size, const char* location);
+static int takeBlock(void* ptr, size_t* size, int* tag);
 static int freeBlock(void* ptr);
-static int findBlock(void* ptr);
 static void printHeapInfo(FILE* file);
 #ifdef WITH_PIO
 static void printHeapInfo_pio(PFILE* file);
@@ -32,35 +33,84 @@ typedef struct memBlock_st
 {
    size_t size;
    void*  ptr;
+   int    tag;
    char   location[40];
 } MEMBLOCK;
 
-#define MAX_BLOCK 32000
-static MEMBLOCK _block[MAX_BLOCK];
-static int      _freeBlock[MAX_BLOCK];
-static int      _nextBlock = MAX_BLOCK +1;
+/** The block table is a hash table keyed on the pointer.  To let
+ *  threads allocate concurrently it is split into stripes, each with
+ *  its own lock and its own open addressed (linear probing) table.
+ *  Each stripe grows independently so there is no fixed limit on the
+ *  number of blocks. */
+#define N_STRIPE 64
+#define INITIAL_STRIPE_CAPACITY 256
+
+typedef struct memStripe_st
+{
+   pthread_mutex_t lock;
+   MEMBLOCK* block;
+   unsigned capacity;    /* always a power of two */
+   unsigned nUsed;
+   char pad[64];
+} MEMSTRIPE;
+
+static MEMSTRIPE _stripe[N_STRIPE];
+static pthread_once_t _initOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t _peakLock = PTHREAD_MUTEX_INITIALIZER;
+
 static size_t   _memUsed = 0;
 static size_t   _peakUsed = 0;
 static int      _blocksUsed = 0;
+static size_t   _tagUsed[DDCMEM_NTAGS];
+static size_t   _tagPeak[DDCMEM_NTAGS];
+static size_t   _tagAtPeak[DDCMEM_NTAGS];
+static int      _peakTag = DDCMEM_OTHER;
+static __thread int _currentTag = DDCMEM_OTHER;
 const double    b2mb=1024*1024;
 
+static const char* _tagName[DDCMEM_NTAGS] =
+   {"other", "anatomy", "diffusion", "reaction", "halo", "io"};
+
 
 void ddcMemSetVerbose(int task)
 {
    _verboseTask = task;
 }
 
-void ddcMemInit(void)
+static void initStripes(void)
 {
-   for (unsigned ii=0; ii<MAX_BLOCK; ++ii)
+   for (unsigned ii=0; ii<N_STRIPE; ++ii)
    {
-      _freeBlock[ii] = ii;
-      _block[ii].size = 0;
-      _block[ii].ptr = NULL;
-      _block[ii].location[0] = '\0';
+      pthread_mutex_init(&_stripe[ii].lock, NULL);
+      _stripe[ii].capacity = INITIAL_STRIPE_CAPACITY;
+      _stripe[ii].nUsed = 0;
+      _stripe[ii].block = (MEMBLOCK*) calloc(INITIAL_STRIPE_CAPACITY, sizeof(MEMBLOCK));
    }
-   
-   _nextBlock = 0;
+}
+
+void ddcMemInit(void)
+{
+   pthread_once(&_initOnce, initStripes);
+}
+
+const char* ddcMemTagName(int tag)
+{
+   if (tag < 0 || tag >= DDCMEM_NTAGS)
+      return "unknown";
+   return _tagName[tag];
+}
+
+int ddcMemSetTag(int tag)
+{
+   int old = _currentTag;
+   if (tag >= 0 && tag < DDCMEM_NTAGS)
+      _currentTag = tag;
+   return old;
+}
+
+int ddcMemGetTag(void)
+{
+   return _currentTag;
 }
 
 void ddcMemSummary(FILE* file)
@@ -79,21 +129,109 @@ void ddcMemSummary_pio(PFILE* file)
 }
 #endif
 
+void ddcMemTagSummary(FILE* file)
+{
+   fprintf(file, "ddcMem task %d: peak=%7.2fMB set by %s\n",
+           getRank(0), _peakUsed/b2mb, ddcMemTagName(_peakTag));
+   fprintf(file, "   tag          current(MB)   peak(MB)   at task peak(MB)\n");
+   for (unsigned ii=0; ii<DDCMEM_NTAGS; ++ii)
+      fprintf(file, "   %-10s %12.2f %10.2f %18.2f\n", _tagName[ii],
+              _tagUsed[ii]/b2mb, _tagPeak[ii]/b2mb, _tagAtPeak[ii]/b2mb);
+}
+
+#ifdef WITH_MPI
+/** The peaks of the tasks on a node are summed to estimate the node
+ *  high-water mark.  This is an upper bound since the tasks need not
+ *  peak at the same time.  Task 0 of comm prints the worst node, its
+ *  breakdown by tag, and for each tag the number of nodes in which
+ *  that tag holds the most memory at the peak.
+ *
+ *  This is a collective on comm. */
+void ddcMemTagReport(MPI_Comm comm, FILE* file)
+{
+   int myRank;
+   MPI_Comm_rank(comm, &myRank);
+   MPI_Comm nodeComm;
+   MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, myRank, MPI_INFO_NULL, &nodeComm);
+   int nodeRank;
+   MPI_Comm_rank(nodeComm, &nodeRank);
+   MPI_Comm leaderComm;
+   MPI_Comm_split(comm, nodeRank == 0 ? 0 : MPI_UNDEFINED, myRank, &leaderComm);
+
+   const int nData = DDCMEM_NTAGS+1;
+   double local[DDCMEM_NTAGS+1];
+   double node[DDCMEM_NTAGS+1];
+   local[0] = _peakUsed;
+   for (unsigned ii=0; ii<DDCMEM_NTAGS; ++ii)
+      local[ii+1] = _tagAtPeak[ii];
+   MPI_Reduce(local, node, nData, MPI_DOUBLE, MPI_SUM, 0, nodeComm);
+   MPI_Comm_free(&nodeComm);
+
+   if (leaderComm == MPI_COMM_NULL)
+      return;
+
+   int nNodes, leaderRank;
+   MPI_Comm_size(leaderComm, &nNodes);
+   MPI_Comm_rank(leaderComm, &leaderRank);
+   double* all = NULL;
+   if (leaderRank == 0)
+      all = (double*) malloc(nNodes*nData*sizeof(double));
+   MPI_Gather(node, nData, MPI_DOUBLE, all, nData, MPI_DOUBLE, 0, leaderComm);
+   MPI_Comm_free(&leaderComm);
+   if (leaderRank != 0)
+      return;
+
+   int nDominant[DDCMEM_NTAGS] = {0};
+   int worst = 0;
+   double sum = 0;
+   for (int jj=0; jj<nNodes; ++jj)
+   {
+      double* nn = all + jj*nData;
+      sum += nn[0];
+      if (nn[0] > all[worst*nData])
+         worst = jj;
+      int maxTag = 0;
+      for (unsigned ii=1; ii<DDCMEM_NTAGS; ++ii)
+         if (nn[ii+1] > nn[maxTag+1])
+            maxTag = ii;
+      ++nDominant[maxTag];
+   }
+
+   double* ww = all + worst*nData;
+   fprintf(file, "ddcMem node high-water marks over %d nodes: max=%9.2fMB (node %d) avg=%9.2fMB\n",
+           nNodes, ww[0]/b2mb, worst, sum/nNodes/b2mb);
+   fprintf(file, "   tag          max node(MB)   nodes dominated\n");
+   for (unsigned ii=0; ii<DDCMEM_NTAGS; ++ii)
+      fprintf(file, "   %-10s %14.2f %17d\n", _tagName[ii], ww[ii+1]/b2mb, nDominant[ii]);
+   fflush(file);
+   free(all);
+}
+#endif
+
 void ddcMemReport(FILE* file)
 {
    size_t totalSize = 0;
+   ddcMemInit();
    
    fprintf(file, "ddcMem report for task %d\n\n", getRank(0));
-   fprintf(file, "Block  ptr         size          location\n");
+   fprintf(file, "Block  ptr         size          tag        location\n");
    fprintf(file, "=======================================================================\n");
    
-   for (unsigned ii=0; ii<MAX_BLOCK; ++ii)
+   unsigned nn = 0;
+   for (unsigned jj=0; jj<N_STRIPE; ++jj)
    {
-      if (_block[ii].ptr == NULL)
-	 continue;
-      fprintf(file, "%5d: %10p %12zuk %s\n", ii, _block[ii].ptr,
-	      _block[ii].size/1024, _block[ii].location);
-      totalSize += _block[ii].size;
+      MEMSTRIPE* stripe = _stripe+jj;
+      pthread_mutex_lock(&stripe->lock);
+      for (unsigned ii=0; ii<stripe->capacity; ++ii)
+      {
+	 MEMBLOCK* block = stripe->block+ii;
+	 if (block->ptr == NULL)
+	    continue;
+	 fprintf(file, "%5d: %10p %12zuk %-10s %s\n", nn++, block->ptr,
+		 block->size/1024, _tagName[block->tag], block->location);
+	 totalSize += block->size;
+      }
+      pthread_mutex_unlock(&stripe->lock);
    }
    fprintf(file, "\nTotal size = %f MB\n", totalSize/b2mb);
    fprintf(file, "Peak size = %f MB\n\n", _peakUsed/b2mb);
@@ -104,18 +242,27 @@ void ddcMemReport(FILE* file)
 void ddcMemReport_pio(PFILE* file)
 {
    size_t totalSize = 0;
+   ddcMemInit();
    
    Pprintf(file, "ddcMem report for task %d\n\n", getRank(0));
-   Pprintf(file, "Block  ptr         size          location\n");
+   Pprintf(file, "Block  ptr         size          tag        location\n");
    Pprintf(file, "=======================================================================\n");
    
-   for (unsigned ii=0; ii<MAX_BLOCK; ++ii)
+   unsigned nn = 0;
+   for (unsigned jj=0; jj<N_STRIPE; ++jj)
    {
-      if (_block[ii].ptr == NULL)
-	 continue;
-      Pprintf(file, "%5d: 0x%08x %12ik %s\n", ii, _block[ii].ptr,
-	      _block[ii].size/1024, _block[ii].location);
-      totalSize += _block[ii].size;
+      MEMSTRIPE* stripe = _stripe+jj;
+      pthread_mutex_lock(&stripe->lock);
+      for (unsigned ii=0; ii<stripe->capacity; ++ii)
+      {
+	 MEMBLOCK* block = stripe->block+ii;
+	 if (block->ptr == NULL)
+	    continue;
+	 Pprintf(file, "%5d: %10p %12zuk %-10s %s\n", nn++, block->ptr,
+		 block->size/1024, _tagName[block->tag], block->location);
+	 totalSize += block->size;
+      }
+      pthread_mutex_unlock(&stripe->lock);
    }
    Pprintf(file, "\nTotal size = %f MB\n", totalSize/b2mb);
    Pprintf(file, "Peak size = %f MB\n\n", _peakUsed/b2mb);
@@ -211,10 +358,18 @@ void* _ddcRealloc(void* ptr, size_t size, char* location)
       return NULL;
    }
 
-   void* old_ptr = ptr;
+   // As in _ddcFree the old block leaves the table before realloc can
+   // free it.  The block realloc returns, or the old one if realloc
+   // fails, goes back in with the tag of the original allocation.
+   size_t oldSize = 0;
+   int tag = _currentTag;
+   int found = (takeBlock(ptr, &oldSize, &tag) >= 0);
    void* new_ptr = realloc(ptr, size);
+   int oldTag = ddcMemSetTag(tag);
    if (!new_ptr)
    {
+      if (found)
+	 addBlock(ptr, oldSize, location);
       printf("mem: ddcRealloc failed on task %d (%zu bytes at %s)\n"
 	     "                                  ptr=%10p\n"
 	     "                                  memUsed=%8.2f\n",
@@ -223,11 +378,12 @@ void* _ddcRealloc(void* ptr, size_t size, char* location)
    }
    else
    {
-      int b = updateBlock(old_ptr, new_ptr, size, location);
+      int b = addBlock(new_ptr, size, location);
       if (_verboseTask == getRank(0))
 	 printf("mem: task %d block %d  realloc %10p  (%zu bytes at %s) total %8.2f\n",
 		getRank(0), b, ptr, size, location, _memUsed/b2mb);
    }
+   ddcMemSetTag(oldTag);
    
    return new_ptr;
 }
@@ -249,11 +405,11 @@ int _ddcMallocAligned(void** ptr, size_t alignment, size_t size, char* location)
    }
    else
    {
-      int b = addBlock(ptr, size, location);   
+      int b = addBlock(*ptr, size, location);   
       if (_verboseTask == getRank(0))
       {
 	 printf("mem: task %d block %d  mallocAligned %10p  (%zu bytes at %s) total %8.2f\n",
-		getRank(0), b, ptr, size, location, _memUsed/b2mb);
+		getRank(0), b, *ptr, size, location, _memUsed/b2mb);
 	 printHeapInfo(stdout);
       }
    }
@@ -264,117 +420,210 @@ int _ddcMallocAligned(void** ptr, size_t alignment, size_t size, char* location)
 
 void  _ddcFree(void* ptr, const char* location)
 {
-   free(ptr);
-   
+   // Remove the block before free so another thread can't get the
+   // same address from malloc while it is still in the table.
    int b = freeBlock(ptr);
+   free(ptr);
    
    if (_verboseTask == getRank(0))
       printf("mem:  task %d block %d  free %10p at %s total %8.2f\n",
 	     getRank(0), b, ptr, location, _memUsed/b2mb);
 }
 
+/** The location string is built in a per-thread buffer so that
+ *  threads can allocate concurrently. */
 char* _ddcLine(const char* file, int lineNum)
 {
-   static char buffer[256];
+   static __thread char buffer[256];
    sprintf(buffer, "%s:%d", file, lineNum);
    return buffer;
 }
 
-int addBlock(void* ptr, size_t size, char* location)
+void ddcMemTrack(void* ptr, size_t size, const char* location)
 {
-   assert(ptr != NULL);
-   int here;
-   #pragma omp critical (ddcMalloc_addBlock)
-   {
-      if (_nextBlock == MAX_BLOCK+1)
-	 ddcMemInit();
-      
-      here = _freeBlock[_nextBlock];
-      _block[here].ptr = ptr;
-      _block[here].size = size;
-      _block[here].location[0] = '\0';
-      strncat(_block[here].location, basename(location),39);
-      
-      ++_blocksUsed;
-      _memUsed += size;
-      if (_memUsed > _peakUsed) _peakUsed = _memUsed;
-      ++_nextBlock;
-      if (_nextBlock == MAX_BLOCK)
-      {
-	 printf("Block storage exhausted on task %d in addBlock.\n" 
-		"%s\n"
-		"Try increasing MAX_BLOCK\n", getRank(0),location);
-	 exit(3);
-      }
-   } 
-   return here;
+   if (ptr != NULL)
+      addBlock(ptr, size, location);
 }
 
+void ddcMemUntrack(void* ptr)
+{
+   freeBlock(ptr);
+}
 
-int updateBlock(void* old_ptr, void* new_ptr, size_t size, char* location)
+static uint64_t hashPtr(const void* ptr)
 {
-   if (old_ptr == NULL)
-      return addBlock(new_ptr, size, location);
+   uint64_t key = (uint64_t)(uintptr_t)ptr;
+   key ^= key >> 33;
+   key *= 0xff51afd7ed558ccdULL;
+   key ^= key >> 33;
+   return key;
+}
 
-   int here = findBlock(old_ptr);
-   
-   if (here < 0)
+/** The stripe is picked from the high bits of the hash and the slot
+ *  from the low bits so the two are independent. */
+static MEMSTRIPE* stripeOf(uint64_t hash)
+{
+   return _stripe + (hash >> 58) % N_STRIPE;
+}
+
+/** Caller must hold the stripe lock.  Returns the slot holding ptr, or
+ *  the empty slot where it would go. */
+static unsigned probe(const MEMSTRIPE* stripe, uint64_t hash, const void* ptr)
+{
+   unsigned mask = stripe->capacity-1;
+   unsigned here = hash & mask;
+   while (stripe->block[here].ptr != NULL && stripe->block[here].ptr != ptr)
+      here = (here+1) & mask;
+   return here;
+}
+
+static void growStripe(MEMSTRIPE* stripe)
+{
+   MEMBLOCK* old = stripe->block;
+   unsigned oldCapacity = stripe->capacity;
+   MEMBLOCK* block = (MEMBLOCK*) calloc(2*oldCapacity, sizeof(MEMBLOCK));
+   if (block == NULL)
    {
-      /*       printf("Error in updateBlock on task %d\n" */
-      /* 	     "   old_ptr=%08x not found in block table.\n" */
-      /* 	     "   new_ptr=%08x\n" */
-      /* 	     "   %d bytes at %s\n", */
-      /* 	     getRank(0), old_ptr, new_ptr, size, location); */
-      return addBlock(new_ptr, size, location);
+      printf("Block storage exhausted on task %d in addBlock.\n", getRank(0));
+      exit(3);
    }
-   
-   #pragma omp critical (ddcMalloc_updateBlock)
+   stripe->block = block;
+   stripe->capacity = 2*oldCapacity;
+   for (unsigned ii=0; ii<oldCapacity; ++ii)
+      if (old[ii].ptr != NULL)
+	 block[probe(stripe, hashPtr(old[ii].ptr), old[ii].ptr)] = old[ii];
+   free(old);
+}
+
+/** Removes slot here by shifting later members of the probe run back
+ *  so no tombstones are needed.  Caller must hold the stripe lock. */
+static void eraseSlot(MEMSTRIPE* stripe, unsigned here)
+{
+   unsigned mask = stripe->capacity-1;
+   unsigned next = (here+1) & mask;
+   while (stripe->block[next].ptr != NULL)
+   {
+      unsigned home = hashPtr(stripe->block[next].ptr) & mask;
+      // next may fill the hole unless its home lies in (here, next]
+      if (((next - home) & mask) >= ((next - here) & mask))
+      {
+	 stripe->block[here] = stripe->block[next];
+	 here = next;
+      }
+      next = (next+1) & mask;
+   }
+   stripe->block[here].ptr = NULL;
+   stripe->block[here].size = 0;
+   stripe->block[here].location[0] = '\0';
+   --stripe->nUsed;
+}
+
+static void tagAdd(int tag, size_t size)
+{
+   size_t used = __sync_add_and_fetch(&_memUsed, size);
+   size_t tagUsed = __sync_add_and_fetch(&_tagUsed[tag], size);
+   size_t peak = _tagPeak[tag];
+   while (tagUsed > peak && !__sync_bool_compare_and_swap(&_tagPeak[tag], peak, tagUsed))
+      peak = _tagPeak[tag];
+
+   // The breakdown at the peak is a snapshot of counters other threads
+   // may be changing, so it is only approximately consistent.  That is
+   // good enough to see who owns the memory.
+   if (used > _peakUsed && pthread_mutex_trylock(&_peakLock) == 0)
    {
-      _memUsed += (size - _block[here].size);
-      if (_memUsed > _peakUsed) _peakUsed = _memUsed;
-      _block[here].ptr = new_ptr;
-      _block[here].size = size;
-      _block[here].location[0] = '\0';
-      strncat(_block[here].location, basename(location),39);
+      if (used > _peakUsed)
+      {
+	 _peakUsed = used;
+	 _peakTag = tag;
+	 for (unsigned ii=0; ii<DDCMEM_NTAGS; ++ii)
+	    _tagAtPeak[ii] = _tagUsed[ii];
+      }
+      pthread_mutex_unlock(&_peakLock);
    }
+}
+
+static void tagSub(int tag, size_t size)
+{
+   __sync_sub_and_fetch(&_memUsed, size);
+   __sync_sub_and_fetch(&_tagUsed[tag], size);
+}
+
+int addBlock(void* ptr, size_t size, const char* location)
+{
+   assert(ptr != NULL);
+   ddcMemInit();
+   uint64_t hash = hashPtr(ptr);
+   MEMSTRIPE* stripe = stripeOf(hash);
+   int tag = _currentTag;
+   const char* base = strrchr(location, '/');
+   
+   pthread_mutex_lock(&stripe->lock);
+   if (2*(stripe->nUsed+1) > stripe->capacity)
+      growStripe(stripe);
+   unsigned here = probe(stripe, hash, ptr);
+   MEMBLOCK* block = stripe->block+here;
+   int isNew = (block->ptr == NULL);
+   size_t staleSize = block->size;
+   int staleTag = block->tag;
+   if (isNew)
+      ++stripe->nUsed;
+   block->ptr = ptr;
+   block->size = size;
+   block->tag = tag;
+   block->location[0] = '\0';
+   strncat(block->location, base ? base+1 : location, 39);
+   pthread_mutex_unlock(&stripe->lock);
+
+   // A stale entry means the pointer was freed without ddcFree.
+   if (isNew)
+      __sync_fetch_and_add(&_blocksUsed, 1);
+   else
+      tagSub(staleTag, staleSize);
+   tagAdd(tag, size);
    return here;
 }
 
 
-int freeBlock(void* ptr)
+/** Removes ptr from the block table.  Returns the slot it was in, or
+ *  -1 if it isn't in the table, in which case size and tag are left
+ *  alone. */
+int takeBlock(void* ptr, size_t* size, int* tag)
 {
    if (ptr == NULL)
-      return -2;
-   int here = findBlock(ptr);
-
-   #pragma omp critical (ddcMalloc_freeBlock)
+      return -1;
+   ddcMemInit();
+   uint64_t hash = hashPtr(ptr);
+   MEMSTRIPE* stripe = stripeOf(hash);
+
+   pthread_mutex_lock(&stripe->lock);
+   unsigned here = probe(stripe, hash, ptr);
+   MEMBLOCK* block = stripe->block+here;
+   if (block->ptr == NULL)
    {
-      if (here >= 0)
-      {
-	 --_blocksUsed;
-	 _memUsed -= _block[here].size;
-	 _block[here].ptr = NULL;
-	 _block[here].size = 0;
-	 _block[here].location[0] = '\0';
-	 --_nextBlock;
-	 assert (_nextBlock >= 0);
-	 _freeBlock[_nextBlock] = here;
-      }
-      /*    else */
-      /*       printf("mem: Error on Task %d. Request to free ptr 0x%08x.\n" */
+      pthread_mutex_unlock(&stripe->lock);
+      /*    printf("mem: Error on Task %d. Request to free ptr 0x%08x.\n" */
       /* 	     "     Pointer cannot be found in block list.\n", */
       /* 	     getRank(0), ptr); */
+      return -1;
    }
+   *size = block->size;
+   *tag = block->tag;
+   eraseSlot(stripe, here);
+   pthread_mutex_unlock(&stripe->lock);
+
+   __sync_fetch_and_sub(&_blocksUsed, 1);
+   tagSub(*tag, *size);
    return here;
 }
 
 
-int findBlock(void*ptr)
+int freeBlock(void* ptr)
 {
-   for (unsigned ii=0; ii<MAX_BLOCK; ++ii)
-      if (_block[ii].ptr == ptr)
-	 return ii;
-   return -1;
+   if (ptr == NULL)
+      return -2;
+   size_t size;
+   int tag;
+   return takeBlock(ptr, &size, &tag);
 }
 
 void printHeapInfo(FILE* file)
@@ -1,51 +1,102 @@
 /* $Id$ */
 
+#define _GNU_SOURCE
 #include "heap.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <libgen.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 #include "mpiUtils.h"
 #include "ddcMalloc.h"
 #include "object.h"
 
 #define MAX_HEAP_BLOCKS 64
-extern FILE *ddcfile; 
+extern FILE *ddcfile;
 
 // Is there any reason we shouldn't quad align all of the heap
 // allocations on every platform?  I can't think of any.
 #define QUAD_WORD_ALIGN_HEAP
 static const int alignOffset=16;
 
+// Chunks at least this large are rounded to a whole number of huge
+// pages and backed by huge pages when the OS will give them to us.
+static const size_t hugePageSize = 2*1024*1024;
+// Chunk size used by threads that touch the heap before anyone calls
+// heap_allocate.
+static const size_t minChunkSize = 1024*1024;
+
+/** A chunk is a single contiguous piece of memory obtained from the
+ *  OS.  Each arena owns a stack of chunks.  The head of the stack is
+ *  the chunk new blocks are carved from.  Chunks released by heapFree
+ *  go to a spare list so a steady state run stops calling mmap. */
+typedef struct heapChunk_st
+{
+	char* base;
+	size_t capacity;
+	size_t claimed;
+	int hugePage;
+	struct heapChunk_st* next;
+} HEAP_CHUNK;
+
 typedef struct heapBlock_st
 {
 	char* blockStart;
 	size_t blockSize;
+	HEAP_CHUNK* chunk;
+	size_t chunkOffset;
 	char location[40];
 } HEAP_BLOCK;
 
-
-static void* heapBuffer=NULL;
-static size_t _heapCapacity = 0;
-static size_t _heapClaimed = 0;
-static int _nBlocks=0;
-static HEAP_BLOCK _blocks[MAX_HEAP_BLOCKS];
-static int _openBlock = -1;
-static size_t _heapHighWaterMark = 0;
-
-static void blockOpenError(const char* file, int line);
-static void tooManyBlocksError(const char* file, int line);
-static void heapTooSmallError(size_t request, const char* file, int line);
+/** Each thread gets its own arena, so the LIFO rules documented in
+ *  heap.h apply per thread and no locking is needed on the block
+ *  operations. */
+typedef struct heapArena_st
+{
+	HEAP_CHUNK* chunks;
+	HEAP_CHUNK* spare;
+	size_t capacity;
+	size_t claimed;
+	size_t highWaterMark;
+	int nChunks;
+	int nHugeChunks;
+	int nBlocks;
+	int openBlock;
+	HEAP_BLOCK blocks[MAX_HEAP_BLOCKS];
+} HEAP_ARENA;
+
+static pthread_once_t _arenaKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t _arenaKey;
+static size_t _defaultChunkSize = 0;
+
+// Process wide totals: capacity summed over all thread arenas and the
+// largest high water mark of any one arena.
+static size_t _totalCapacity = 0;
+static size_t _maxHighWaterMark = 0;
+static int _nArenas = 0;
+
+static HEAP_ARENA* arenaGet(void);
+static void arenaDestroy(void* ptr);
+static void arenaRelease(HEAP_ARENA* arena);
+static HEAP_CHUNK* chunkPush(HEAP_ARENA* arena, size_t minSize);
+static void chunkFree(HEAP_CHUNK* chunk);
+static void blockOpenError(HEAP_ARENA* arena, const char* file, int line);
+static void tooManyBlocksError(HEAP_ARENA* arena, const char* file, int line);
+static void heapTooSmallError(HEAP_ARENA* arena, size_t request, const char* file, int line);
 static void heapFreeOpenBlockError(const char* file, int line);
 static void heapFreeOrderError(const char* file, int line);
 static void heapAlreadyAllocatedWarning(void);
 static void heapAlreadyClosedError(const char* file, int line);
+static void heapGrowClosedError(const char* file, int line);
 
 
 HEAP* heap_init(void* parent, char* name)
 {
 	HEAP* heapObj = (HEAP*)object_initialize(name, "HEAP", sizeof(HEAP));
-	heapObj->parent=parent; 
+	heapObj->parent=parent;
 	int size;
 	object_get((OBJECT *) heapObj, "size", &size, INT, 1, "1");
 
@@ -54,16 +105,7 @@ HEAP* heap_init(void* parent, char* name)
 	  l_size *= (size_t) (1024*1024);
 	  heap_allocate(l_size);
 	}
-	_nBlocks = 0;
-	_openBlock = -1;
-	for (unsigned ii=0; ii<MAX_HEAP_BLOCKS; ++ii)
-	{
-		_blocks[ii].blockStart = NULL;
-		_blocks[ii].blockSize = 0;
-		_blocks[ii].location[0] = '\0';
-	}
-	
-	return heapObj; 
+	return heapObj;
 }
 void heap_start(int size)
 {
@@ -73,157 +115,369 @@ void heap_start(int size)
 	  l_size *= (size_t) (1024*1024);
 	  heap_allocate(l_size);
 	}
-	_nBlocks = 0;
-	_openBlock = -1;
-	for (unsigned ii=0; ii<MAX_HEAP_BLOCKS; ++ii)
-	{
-		_blocks[ii].blockStart = NULL;
-		_blocks[ii].blockSize = 0;
-		_blocks[ii].location[0] = '\0';
-	}
 }
 
 void* _heapGet(unsigned* blockNumber, char* file, int line)
 {
-	if (_openBlock != -1)
-		blockOpenError(file, line);
-
-	_openBlock = _nBlocks;
-	*blockNumber= _nBlocks;
-	//fprintf(ddcfile,"ddt %d:  Opening block %d (%s:%d)\n", getRank(-1), _nBlocks, file, line); fflush(ddcfile);
-	
-	void* blockStart = ((char*)heapBuffer)+_heapClaimed;
-	_blocks[_nBlocks].blockStart = blockStart;
-	_blocks[_nBlocks].blockSize  = _heapCapacity-_heapClaimed;
-	snprintf(_blocks[_nBlocks].location, 39, "%s:%d", basename(file), line);
-	++_nBlocks;
-	if (_nBlocks >= MAX_HEAP_BLOCKS)
-		tooManyBlocksError(file, line);
-
-
-	
-	return blockStart;
+	HEAP_ARENA* arena = arenaGet();
+	if (arena->openBlock != -1)
+		blockOpenError(arena, file, line);
+	if (arena->nBlocks >= MAX_HEAP_BLOCKS-1)
+		tooManyBlocksError(arena, file, line);
+
+	HEAP_CHUNK* chunk = arena->chunks;
+	if (chunk == NULL || chunk->claimed == chunk->capacity)
+		chunk = chunkPush(arena, 0);
+
+	int nn = arena->nBlocks;
+	arena->openBlock = nn;
+	*blockNumber= nn;
+	//fprintf(ddcfile,"ddt %d:  Opening block %d (%s:%d)\n", getRank(-1), nn, file, line); fflush(ddcfile);
+
+	HEAP_BLOCK* block = arena->blocks + nn;
+	block->blockStart = chunk->base + chunk->claimed;
+	block->blockSize  = chunk->capacity - chunk->claimed;
+	block->chunk = chunk;
+	block->chunkOffset = chunk->claimed;
+	// basename isn't re-entrant
+	const char* base = strrchr(file, '/');
+	snprintf(block->location, 39, "%s:%d", base ? base+1 : file, line);
+	++arena->nBlocks;
+
+	return block->blockStart;
 }
 void slave_heap_init(char *data) { heap_init(NULL,data); }
 void _heapTestAvailable(unsigned blockNumber,  size_t size, const char* file, int line)
 {
-	size_t heapNeeded = _heapClaimed + size; 
-	if (heapNeeded > _heapCapacity) heapTooSmallError(size, file, line);
+	HEAP_ARENA* arena = arenaGet();
+	if ((int)blockNumber >= arena->nBlocks || size > arena->blocks[blockNumber].blockSize)
+		heapTooSmallError(arena, size, file, line);
+}
+
+/** An open block lives at the end of its chunk, so it can always be
+ *  extended by moving it to a fresh chunk.  The first used bytes are
+ *  carried along.  The tail of the old chunk stays unused until the
+ *  block is freed. */
+void* _heapGrow(unsigned blockNumber, size_t used, size_t size, const char* file, int line)
+{
+	HEAP_ARENA* arena = arenaGet();
+	if (arena->openBlock != (int)blockNumber)
+		heapGrowClosedError(file, line);
+
+	HEAP_BLOCK* block = arena->blocks + blockNumber;
+	if (size <= block->blockSize)
+		return block->blockStart;
+	assert(used <= block->blockSize);
+
+	HEAP_CHUNK* chunk = chunkPush(arena, size);
+	memcpy(chunk->base, block->blockStart, used);
+	block->blockStart = chunk->base;
+	block->blockSize = chunk->capacity;
+	block->chunk = chunk;
+	block->chunkOffset = 0;
+	return block->blockStart;
 }
+
 size_t heapAvailable(void) {
-  return _heapCapacity - _heapClaimed - 64 /* In case 32 bytes are lost on either side for alignment reasons */;
+	HEAP_ARENA* arena = arenaGet();
+	HEAP_CHUNK* chunk = arena->chunks;
+	size_t avail = 0;
+	if (chunk != NULL)
+		avail = chunk->capacity - chunk->claimed;
+	/* In case 32 bytes are lost on either side for alignment reasons */
+	return avail > 64 ? avail - 64 : 0;
 }
 void _heapEndBlock(unsigned blockNumber, size_t size, const char* file, int line)
 {
-	//fprintf(ddcfile,"ddt %d:  Ending block %d (%s:%d), size=%d\n", getRank(-1), blockNumber, file, line, size); fflush(ddcfile); 
-	if (_openBlock != (int)blockNumber) heapAlreadyClosedError(file, line);
-	
-	_openBlock = -1;
+	HEAP_ARENA* arena = arenaGet();
+	//fprintf(ddcfile,"ddt %d:  Ending block %d (%s:%d), size=%d\n", getRank(-1), blockNumber, file, line, size); fflush(ddcfile);
+	if (arena->openBlock != (int)blockNumber) heapAlreadyClosedError(file, line);
+
+	arena->openBlock = -1;
+
+	HEAP_BLOCK* block = arena->blocks + blockNumber;
+	if (size > block->blockSize) heapTooSmallError(arena, size, file, line);
 
 #ifdef QUAD_WORD_ALIGN_HEAP
 	size += (alignOffset - (size%alignOffset) ) % alignOffset;
+	if (size > block->blockSize) size = block->blockSize;
 #endif
 
 
-	assert((int)blockNumber == _nBlocks-1);
-	
-	_heapClaimed += size; 
-	_blocks[_nBlocks-1].blockSize = size; 
-	if (_heapHighWaterMark < _heapClaimed) _heapHighWaterMark = _heapClaimed; 
-	if (_heapHighWaterMark > _heapCapacity) heapTooSmallError(size, file, line);
+	assert((int)blockNumber == arena->nBlocks-1);
+
+	block->chunk->claimed = block->chunkOffset + size;
+	block->blockSize = size;
+	arena->claimed += size;
+	if (arena->highWaterMark < arena->claimed)
+	{
+		arena->highWaterMark = arena->claimed;
+		size_t hwm = _maxHighWaterMark;
+		while (hwm < arena->highWaterMark &&
+				 !__sync_bool_compare_and_swap(&_maxHighWaterMark, hwm, arena->highWaterMark))
+			hwm = _maxHighWaterMark;
+	}
 }
 void _heapFree(unsigned blockNumber, const char* file, int line)
 {
- 	//fprintf(ddcfile,"ddt %d:  Free block %d (%s:%d) size=%d, claimed=%d\n", getRank(-1), blockNumber, file, line, _blocks[_nBlocks-1].blockSize, _heapClaimed); fflush(ddcfile); 
-	if (_openBlock != -1)
+	HEAP_ARENA* arena = arenaGet();
+ 	//fprintf(ddcfile,"ddt %d:  Free block %d (%s:%d) size=%d, claimed=%d\n", getRank(-1), blockNumber, file, line, arena->blocks[arena->nBlocks-1].blockSize, arena->claimed); fflush(ddcfile);
+	if (arena->openBlock != -1)
 		heapFreeOpenBlockError(file, line);
-	if ((int)blockNumber != _nBlocks-1)
+	if ((int)blockNumber != arena->nBlocks-1)
 		heapFreeOrderError(file, line);
 
-	if (heapBuffer == NULL || _nBlocks == 0)
+	if (arena->nBlocks == 0)
 		return ;
 
-	--_nBlocks;
-	assert(_nBlocks == (int)blockNumber);
-	_heapClaimed -= _blocks[_nBlocks].blockSize;
+	--arena->nBlocks;
+	assert(arena->nBlocks == (int)blockNumber);
+	HEAP_BLOCK* block = arena->blocks + arena->nBlocks;
+	arena->claimed -= block->blockSize;
+
+	// Any chunks pushed after this block was opened belong to this
+	// block (or to blocks already freed) so they are idle now.
+	while (arena->chunks != block->chunk)
+	{
+		HEAP_CHUNK* chunk = arena->chunks;
+		arena->chunks = chunk->next;
+		chunk->claimed = 0;
+		chunk->next = arena->spare;
+		arena->spare = chunk;
+	}
+	block->chunk->claimed = block->chunkOffset;
 
-	_blocks[_nBlocks].blockStart = NULL;
-	_blocks[_nBlocks].blockSize = 0;
-	_blocks[_nBlocks].location[0] = '\0';
+	block->blockStart = NULL;
+	block->blockSize = 0;
+	block->chunk = NULL;
+	block->chunkOffset = 0;
+	block->location[0] = '\0';
 }
 
+/** Sets the size of the first chunk for the calling thread.  The first
+ *  call also sets the chunk size every other thread starts with.  A
+ *  chunk is only the starting size.  Blocks that need more space move
+ *  to a larger chunk (see heapGrow), so n need not be the largest
+ *  buffer the application will ever write. */
 void heap_allocate(size_t n)
 {
-	if (heapBuffer != NULL)
+	HEAP_ARENA* arena = arenaGet();
+	if (arena->chunks != NULL || arena->spare != NULL)
 	{
 		heapAlreadyAllocatedWarning();
-		return; 
+		return;
 	}
-	
-	_heapHighWaterMark = 0; 
-	_heapClaimed = 0;
-	_heapCapacity = n; 
+
 #ifdef  QUAD_WORD_ALIGN_HEAP
-	_heapCapacity +=  (alignOffset - (_heapCapacity % alignOffset) ) % alignOffset;
-	ddcMallocAligned((void **)&heapBuffer, alignOffset, _heapCapacity);
-#else 
-	heapBuffer = ddcMalloc(n); 
-#endif 
-	_nBlocks=0; 
-	
+	n +=  (alignOffset - (n % alignOffset) ) % alignOffset;
+#endif
+	__sync_bool_compare_and_swap(&_defaultChunkSize, 0, n);
+	chunkPush(arena, n);
 }
 size_t heapSize(void)
 {
-	return _heapCapacity;
+	return arenaGet()->capacity;
 }
 
 size_t heapBlockSize(unsigned block)
 {
-   if ((int)block >= _nBlocks)
-      return 0;
-	return _blocks[block].blockSize;
+	HEAP_ARENA* arena = arenaGet();
+	if ((int)block >= arena->nBlocks)
+		return 0;
+	return arena->blocks[block].blockSize;
 }
 
 void heapSummary(FILE *file)
 {
+	HEAP_ARENA* arena = arenaGet();
 	fprintf(file, "Scratch heap capacity: %f Mbytes,  high water mark: %f Mbytes \n",
-			  _heapCapacity/(1024*1024.0), _heapHighWaterMark/(1024*1024.0));
+			  arena->capacity/(1024*1024.0), arena->highWaterMark/(1024*1024.0));
+	fprintf(file, "   %d chunks (%d huge page backed), %d threads total: %f Mbytes,  max thread high water mark: %f Mbytes\n",
+			  arena->nChunks, arena->nHugeChunks, _nArenas,
+			  _totalCapacity/(1024*1024.0), _maxHighWaterMark/(1024*1024.0));
 }
 
 #ifdef WITH_PIO
 void heapSummary_pio(PFILE *file)
 {
+	HEAP_ARENA* arena = arenaGet();
 	Pprintf(file, "Scratch heap capacity: %f Mbytes,  high water mark: %f Mbytes \n",
-			  _heapCapacity/(1024*1024.0), _heapHighWaterMark/(1024*1024.0));
+			  arena->capacity/(1024*1024.0), arena->highWaterMark/(1024*1024.0));
+	Pprintf(file, "   %d chunks (%d huge page backed), %d threads total: %f Mbytes,  max thread high water mark: %f Mbytes\n",
+			  arena->nChunks, arena->nHugeChunks, _nArenas,
+			  _totalCapacity/(1024*1024.0), _maxHighWaterMark/(1024*1024.0));
 }
 #endif
 
+/** Releases all memory held by the calling thread's arena.  Other
+ *  threads release theirs when they exit. */
 void heap_deallocate(void)
 {
-	ddcFree(heapBuffer); 
+	HEAP_ARENA* arena = arenaGet();
+	assert(arena->nBlocks == 0);
+	arenaRelease(arena);
 }
 
 
-void blockOpenError(const char* file, int line)
+static void makeArenaKey(void)
+{
+	pthread_key_create(&_arenaKey, arenaDestroy);
+}
+
+HEAP_ARENA* arenaGet(void)
+{
+	pthread_once(&_arenaKeyOnce, makeArenaKey);
+	HEAP_ARENA* arena = (HEAP_ARENA*) pthread_getspecific(_arenaKey);
+	if (arena != NULL)
+		return arena;
+
+	arena = (HEAP_ARENA*) calloc(1, sizeof(HEAP_ARENA));
+	arena->openBlock = -1;
+	pthread_setspecific(_arenaKey, arena);
+	__sync_fetch_and_add(&_nArenas, 1);
+	return arena;
+}
+
+void arenaDestroy(void* ptr)
+{
+	HEAP_ARENA* arena = (HEAP_ARENA*) ptr;
+	arenaRelease(arena);
+	__sync_fetch_and_sub(&_nArenas, 1);
+	free(arena);
+}
+
+void arenaRelease(HEAP_ARENA* arena)
+{
+	HEAP_CHUNK* lists[2] = {arena->chunks, arena->spare};
+	for (unsigned ii=0; ii<2; ++ii)
+	{
+		HEAP_CHUNK* chunk = lists[ii];
+		while (chunk != NULL)
+		{
+			HEAP_CHUNK* next = chunk->next;
+			__sync_fetch_and_sub(&_totalCapacity, chunk->capacity);
+			chunkFree(chunk);
+			chunk = next;
+		}
+	}
+	arena->chunks = NULL;
+	arena->spare = NULL;
+	arena->capacity = 0;
+	arena->claimed = 0;
+	arena->highWaterMark = 0;
+	arena->nChunks = 0;
+	arena->nHugeChunks = 0;
+	arena->nBlocks = 0;
+	arena->openBlock = -1;
+}
+
+/** Makes a chunk with at least minSize bytes the current chunk of
+ *  arena.  A spare chunk is reused if one is big enough.  Otherwise a
+ *  new chunk at least twice minSize is mapped so that a block that
+ *  keeps growing moves only O(log(size)) times. */
+HEAP_CHUNK* chunkPush(HEAP_ARENA* arena, size_t minSize)
+{
+	HEAP_CHUNK** prev = &arena->spare;
+	for (HEAP_CHUNK* chunk = arena->spare; chunk != NULL; chunk = chunk->next)
+	{
+		if (chunk->capacity >= minSize)
+		{
+			*prev = chunk->next;
+			chunk->claimed = 0;
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+			return chunk;
+		}
+		prev = &chunk->next;
+	}
+
+	size_t size = _defaultChunkSize;
+	if (size < minChunkSize) size = minChunkSize;
+	if (minSize > 0 && size < 2*minSize) size = 2*minSize;
+	if (size >= hugePageSize)
+		size += (hugePageSize - (size % hugePageSize)) % hugePageSize;
+	else
+		size += (alignOffset - (size % alignOffset)) % alignOffset;
+
+	HEAP_CHUNK* chunk = (HEAP_CHUNK*) calloc(1, sizeof(HEAP_CHUNK));
+	void* base = NULL;
+#ifdef __linux__
+	if (size >= hugePageSize)
+	{
+#ifdef MAP_HUGETLB
+		base = mmap(NULL, size, PROT_READ|PROT_WRITE,
+						MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+		if (base == MAP_FAILED)
+			base = NULL;
+		else
+			chunk->hugePage = 1;
+#endif
+		if (base == NULL)
+		{
+			base = mmap(NULL, size, PROT_READ|PROT_WRITE,
+							MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+			if (base == MAP_FAILED)
+				base = NULL;
+#ifdef MADV_HUGEPAGE
+			else if (madvise(base, size, MADV_HUGEPAGE) == 0)
+				chunk->hugePage = 1;
+#endif
+		}
+	}
+#endif
+	if (base == NULL)
+	{
+		if (_mallocAligned(&base, alignOffset, size) != 0)
+			base = NULL;
+		chunk->hugePage = -1;
+	}
+	if (base == NULL)
+		heapTooSmallError(arena, size, __FILE__, __LINE__);
+
+	chunk->base = (char*) base;
+	chunk->capacity = size;
+	chunk->claimed = 0;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	arena->capacity += size;
+	++arena->nChunks;
+	if (chunk->hugePage == 1) ++arena->nHugeChunks;
+	__sync_fetch_and_add(&_totalCapacity, size);
+	return chunk;
+}
+
+void chunkFree(HEAP_CHUNK* chunk)
+{
+#ifdef __linux__
+	if (chunk->hugePage >= 0)
+		munmap(chunk->base, chunk->capacity);
+	else
+#endif
+		free(chunk->base);
+	free(chunk);
+}
+
+
+void blockOpenError(HEAP_ARENA* arena, const char* file, int line)
 {
 	printf("Scratch Heap ERROR:\n"
 			 "   heapGet called with block already open.\n"
 			 "   current call from %s:%d\n"
 			 "   open block created from %s\n",
-			 file, line, _blocks[_nBlocks-1].location);
+			 file, line, arena->blocks[arena->nBlocks-1].location);
 	abortAll(-1);
 }
 
-void tooManyBlocksError(const char* file, int line)
+void tooManyBlocksError(HEAP_ARENA* arena, const char* file, int line)
 {
 	printf("Scratch Heap ERROR:\n"
 			 "   Too many blocks.  _nBlocks = %d\n"
 			 "   current call from %s:%d\n",
-			 _nBlocks, file, line);
+			 arena->nBlocks, file, line);
 	abortAll(-1);
 }
 
-void heapTooSmallError(size_t request, const char* file, int line)
+void heapTooSmallError(HEAP_ARENA* arena, size_t request, const char* file, int line)
 {
 	printf("Scratch Heap ERROR:\n"
 			 "   heap too small\n"
@@ -231,8 +485,8 @@ void heapTooSmallError(size_t request, const char* file, int line)
 			 "   _heapCapacity = %f Mbytes\n"
 			 "   _heapClaimed = %f Mbytes\n"
 			 "   request = %f Mbytes\n",
-			 file, line, _heapCapacity/(1024*1024.0),
-			 _heapClaimed/(1024*1024.0),
+			 file, line, arena->capacity/(1024*1024.0),
+			 arena->claimed/(1024*1024.0),
 			 request/(1024*1024.0));
 	abortAll(-1);
 }
@@ -266,6 +520,15 @@ void heapAlreadyClosedError(const char* file, int line)
 	abortAll(-1);
 }
 
+void heapGrowClosedError(const char* file, int line)
+{
+	printf("Scratch Heap ERROR:\n"
+			 "   Attempt to call heapGrow on a block that is not open\n"
+			 "   %s:%d\n",
+			 file, line);
+	abortAll(-1);
+}
+
 
 
 
@@ -55,8 +55,6 @@ static void   bufferAppend(PFILE* file, const void* data, size_t n);
 static void   internalSelfTest(const PFILE* file);
 
 
-static char string[1024];
-static int error_global; 
 static int _nWriteFiles = 0;
 
 PFILE *Popen(const char *filename, const char *mode, MPI_Comm comm)
@@ -191,10 +189,21 @@ int Pprintf(PFILE* file, const char* fmt, ...)
    char buffer[size]; 
 	va_list ap;
 	va_start(ap, fmt);
+	va_list ap2;
+	va_copy(ap2, ap);
 	int n = vsnprintf(buffer, size, fmt, ap);
-   assert(n<size-1); 
 	va_end(ap);
-	bufferAppend(file, buffer, n);
+	if (n < size)
+		bufferAppend(file, buffer, n);
+	else
+	{
+		// long header lines, e.g. the field names of a wide file
+		char* longBuffer = ddcMalloc(n+1);
+		vsnprintf(longBuffer, n+1, fmt, ap2);
+		bufferAppend(file, longBuffer, n);
+		ddcFree(longBuffer);
+	}
+	va_end(ap2);
 	return n;
 }
 
@@ -283,15 +292,18 @@ int Pclose_forWrite(PFILE*file)
 {
 	unsigned pio_msg_blk;
 	heapEndBlock(file->pio_buf_blk, file->bufsize);
+	// The message block stays open until all messages are received so
+	// that it can grow to fit the largest one.
 	char* buffer = (char*) heapGet(&pio_msg_blk);
 	size_t bufMax = heapBlockSize(pio_msg_blk);
-	heapEndBlock(pio_msg_blk, bufMax);
 	
 	int flag = 1;
 	int error = 0;
+	int error_global = 0;
 	int dataWritten = 0;
 	if (file->groupToHandle >= 0)
 	{
+		char string[1024];
 		sprintf(string, "%s#%6.6d", file->name, file->groupToHandle);
 		file->file = fopen(string, file->mode);
 
@@ -321,10 +333,8 @@ int Pclose_forWrite(PFILE*file)
 				MPI_Recv(&bufsize, sizeof(size_t), MPI_BYTE, id, file->msgTag, file->comm, MPI_STATUS_IGNORE);
 				if (bufsize > bufMax)
 				{
-					printf("ERROR:  Buffer size exceeded.  Size = %zu\n"
-							 "Task %d attempting to send %zu bytes to I/O task %d\n",
-							 bufMax, id, bufsize, file->id);
-					MPI_Abort(file->comm, 11);
+					buffer = (char*) heapGrow(pio_msg_blk, 0, bufsize);
+					bufMax = heapBlockSize(pio_msg_blk);
 				}
 				assert(bufsize < _maxMpiCount);
 				MPI_Recv(buffer, (int)bufsize, MPI_BYTE, id, file->msgTag, file->comm, MPI_STATUS_IGNORE);
@@ -347,6 +357,7 @@ int Pclose_forWrite(PFILE*file)
 		MPI_Send(file->buf, (int)file->bufsize, MPI_BYTE, file->io_id, file->msgTag, file->comm);
 	}
  	MPI_Reduce(&error,&error_global,1,MPI_INT,MPI_BAND,0,file->comm);
+	heapEndBlock(pio_msg_blk, bufMax);
 	heapFree(pio_msg_blk);
 	heapFree(file->pio_buf_blk);
 	// Since write gets file->buf from the scratch heap instead of malloc
@@ -382,17 +393,8 @@ void PioReserve(PFILE* file, size_t capacity)
 
 	if (capacity > file->bufcapacity)
 	{
-		float b2mb = 1.0/(1024.0*1024.0);
-		printf("ERROR:  Heap too small for requested buffer capacity in PioReserve.\n"
-				 "  Task %d:\n"
-				 "  Requested buffer capacity = %10.2f MB\n"
-				 "  Total Heap Size = %10.2f MB\n"
-				 "  Size of Available block = %10.2f MB\n"
-				 "  Block number = %d\n",
-				 file->id, capacity*b2mb, heapSize()*b2mb, file->bufcapacity*b2mb,
-				 file->pio_buf_blk);
-		
-		MPI_Abort(file->comm, 11);
+		file->buf = heapGrow(file->pio_buf_blk, file->bufsize, capacity);
+		file->bufcapacity = heapBlockSize(file->pio_buf_blk);
 	}
 }
 
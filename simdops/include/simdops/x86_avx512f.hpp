@@ -10,27 +10,31 @@ typedef __m512d native_vector_type;
 
 #define SIMDOPS_FLOAT64V_WIDTH 8
 
-inline native_vector_type load(const double* x) { return _mm512_load_pd(x); }
-inline void store(double* x, const native_vector_type y) { _mm512_store_pd(x,y); }
-inline native_vector_type make_float(const double x) { return _mm512_set_pd(x,x,x,x,x,x,x,x); }
-inline native_vector_type splat(const double* x) { return _mm512_broadcast_f64x4(_mm256_broadcast_sd(x)); }
+inline native_vector_type load(const double* x) { return _mm512_loadu_pd(x); }
+inline void store(double* x, const native_vector_type y) { _mm512_storeu_pd(x,y); }
+inline native_vector_type make_float(const double x) { return _mm512_set1_pd(x); }
+inline native_vector_type splat(const double* x) { return _mm512_set1_pd(*x); }
 inline native_vector_type add(const native_vector_type a, const native_vector_type b) { return _mm512_add_pd(a,b); }
 inline native_vector_type sub(const native_vector_type a, const native_vector_type b) { return _mm512_sub_pd(a,b); }
 inline native_vector_type mul(const native_vector_type a, const native_vector_type b) { return _mm512_mul_pd(a,b); }
 inline native_vector_type div(const native_vector_type a, const native_vector_type b) { return _mm512_div_pd(a,b); }
 inline native_vector_type neg(const native_vector_type a) { return _mm512_sub_pd(make_float(0),a); }
 
-inline native_vector_type lt(const native_vector_type a, const native_vector_type b) { return _mm512_cmp_pd(a,b,_CMP_LT_OQ); }
-inline native_vector_type gt(const native_vector_type a, const native_vector_type b) { return _mm512_cmp_pd(a,b,_CMP_GT_OQ); }
-inline native_vector_type le(const native_vector_type a, const native_vector_type b) { return _mm512_cmp_pd(a,b,_CMP_LE_OQ); }
-inline native_vector_type ge(const native_vector_type a, const native_vector_type b) { return _mm512_cmp_pd(a,b,_CMP_GE_OQ); }
-inline native_vector_type eq(const native_vector_type a, const native_vector_type b) { return _mm512_cmp_pd(a,b,_CMP_EQ_OQ); }
-inline native_vector_type neq(const native_vector_type a, const native_vector_type b) { return _mm512_cmp_pd(a,b,_CMP_NEQ_OQ); }
-inline native_vector_type b_and(const native_vector_type a, const native_vector_type b) { return _mm512_and_pd(a,b); }
-inline native_vector_type b_or(const native_vector_type a, const native_vector_type b) { return _mm512_or_pd(a,b); }
-inline native_vector_type b_not(const native_vector_type a) { return _mm512_xor_pd(a,eq(a,a)); }
-
-inline bool any(const native_vector_type a) { return _mm512_movemask_pd(a); }
+// Comparisons produce a mask register.  Expand it to all ones/all zeros
+// lanes so that masks combine with b_and/b_or like on the other arches.
+// The bitwise ops go through the integer unit: the _pd forms need AVX512DQ.
+inline native_vector_type from_mask(const __mmask8 m) { return _mm512_castsi512_pd(_mm512_maskz_set1_epi64(m,-1)); }
+inline native_vector_type lt(const native_vector_type a, const native_vector_type b) { return from_mask(_mm512_cmp_pd_mask(a,b,_CMP_LT_OQ)); }
+inline native_vector_type gt(const native_vector_type a, const native_vector_type b) { return from_mask(_mm512_cmp_pd_mask(a,b,_CMP_GT_OQ)); }
+inline native_vector_type le(const native_vector_type a, const native_vector_type b) { return from_mask(_mm512_cmp_pd_mask(a,b,_CMP_LE_OQ)); }
+inline native_vector_type ge(const native_vector_type a, const native_vector_type b) { return from_mask(_mm512_cmp_pd_mask(a,b,_CMP_GE_OQ)); }
+inline native_vector_type eq(const native_vector_type a, const native_vector_type b) { return from_mask(_mm512_cmp_pd_mask(a,b,_CMP_EQ_OQ)); }
+inline native_vector_type neq(const native_vector_type a, const native_vector_type b) { return from_mask(_mm512_cmp_pd_mask(a,b,_CMP_NEQ_OQ)); }
+inline native_vector_type b_and(const native_vector_type a, const native_vector_type b) { return _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(a),_mm512_castpd_si512(b))); }
+inline native_vector_type b_or(const native_vector_type a, const native_vector_type b) { return _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(a),_mm512_castpd_si512(b))); }
+inline native_vector_type b_not(const native_vector_type a) { return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a),_mm512_castpd_si512(eq(a,a)))); }
+
+inline bool any(const native_vector_type a) { return _mm512_test_epi64_mask(_mm512_castpd_si512(a),_mm512_castpd_si512(a)) != 0; }
 
 #if defined(SIMDOPS_INTEL_VECTOR_LIBM)
 inline native_vector_type expm1(native_vector_type x) {